@@ -417,6 +417,9 @@ static int demoOpen(
     demoUnlock,                   /* xUnlock */
     demoCheckReservedLock,        /* xCheckReservedLock */
     demoSectorSize,               /* xSectorSize */
+    0,                            /* xWritev */
+    0,                            /* xPrefetch */
+    0,                            /* xDiscard */
   };
 
   DemoFile *p = (DemoFile*)pFile; /* Populate this structure */
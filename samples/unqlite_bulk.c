@@ -0,0 +1,183 @@
+/*
+ * Compile this file together with the UnQLite database engine source code
+ * to generate the executable. For example:
+ *  gcc -W -Wall -O6 unqlite_bulk.c unqlite.c -o unqlite_bulk
+*/
+/*
+ * This program populates a fresh database in a single shot using the
+ * [unqlite_bulk_load()] interface. Records are pulled from a callback,
+ * buffered and partitioned by bucket in memory, then written out with the
+ * storage pre-sized for the whole input so that no bucket split occurs.
+ *
+ * The input is a text file with one record per line, the key and the data
+ * being separated by a tabulation:
+ *
+ *  ./unqlite_bulk test.db records.tsv
+ *
+ * When no input file is given, 100000 generated records are loaded:
+ *
+ *  ./unqlite_bulk test.db
+ *
+ * To start an in-memory database, invoke the program without arguments as follows:
+ *
+ *  ./unqlite_bulk
+ *
+ * For an introduction to the UnQLite C/C++ interface, please refer to:
+ *        https://unqlite.symisc.net/api_intro.html
+ * For the full C/C++ API reference guide, please refer to:
+ *        https://unqlite.symisc.net/c_api.html
+ */
+#include <stdio.h>  /* puts() */
+#include <stdlib.h> /* exit() */
+#include <string.h> /* strchr() */
+  /* Make sure this header file is available.*/
+#include "unqlite.h"
+/*
+ * Banner.
+ */
+static const char zBanner[] = {
+	"============================================================\n"
+	"UnQLite Bulk Loader                                         \n"
+	"                                         https://unqlite.symisc.net/\n"
+	"============================================================\n"
+};
+/*
+ * Extract the database error log and exit.
+ */
+static void Fatal(unqlite *pDb, const char *zMsg)
+{
+	if (pDb) {
+		const char *zErr;
+		int iLen = 0; /* Stupid cc warning */
+
+		/* Extract the database error log */
+		unqlite_config(pDb, UNQLITE_CONFIG_ERR_LOG, &zErr, &iLen);
+		if (iLen > 0) {
+			/* Output the DB error log */
+			puts(zErr); /* Always null terminated */
+		}
+	}
+	else {
+		if (zMsg) {
+			puts(zMsg);
+		}
+	}
+	/* Manually shutdown the library */
+	unqlite_lib_shutdown();
+	/* Exit immediately */
+	exit(0);
+}
+/*
+ * Records generated when no input file is given.
+ */
+#define MAX_RECORDS 100000
+/*
+ * State of the record stream.
+ */
+typedef struct BulkInput BulkInput;
+struct BulkInput
+{
+	FILE *pIn;         /* Input file or NULL for generated records */
+	int nRec;          /* Records produced so far */
+	char zLine[8192];  /* Current input line */
+	char zKey[32];     /* Generated key */
+	char zData[64];    /* Generated data */
+};
+/*
+ * Record stream callback [unqlite_bulk_load()].
+ * Point to the next record and return UNQLITE_OK, or UNQLITE_DONE at the end of the input.
+ */
+static int NextRecord(void *pUserData, const void **ppKey, int *pKeyLen, const void **ppData, unqlite_int64 *pDataLen)
+{
+	BulkInput *pInput = (BulkInput *)pUserData;
+	char *zSep;
+	size_t n;
+	if (pInput->pIn == 0) {
+		if (pInput->nRec >= MAX_RECORDS) {
+			return UNQLITE_DONE;
+		}
+		*pKeyLen = sprintf(pInput->zKey, "key-%d", pInput->nRec);
+		*pDataLen = sprintf(pInput->zData, "Dummy data for record number %d", pInput->nRec);
+		*ppKey = pInput->zKey;
+		*ppData = pInput->zData;
+		pInput->nRec++;
+		return UNQLITE_OK;
+	}
+	for (;;) {
+		if (fgets(pInput->zLine, (int)sizeof(pInput->zLine), pInput->pIn) == 0) {
+			return UNQLITE_DONE;
+		}
+		n = strlen(pInput->zLine);
+		while (n > 0 && (pInput->zLine[n - 1] == '\n' || pInput->zLine[n - 1] == '\r')) {
+			n--;
+		}
+		zSep = strchr(pInput->zLine, '\t');
+		if (zSep == 0 || zSep == pInput->zLine || (size_t)(zSep - pInput->zLine) >= n) {
+			/* Malformed line, skip */
+			continue;
+		}
+		*ppKey = pInput->zLine;
+		*pKeyLen = (int)(zSep - pInput->zLine);
+		*ppData = &zSep[1];
+		*pDataLen = (unqlite_int64)(n - (size_t)(zSep - pInput->zLine) - 1);
+		pInput->nRec++;
+		return UNQLITE_OK;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *zPath = ":mem:"; /* Assume an in-memory database */
+	unqlite_int64 nHint = 0;     /* Expected amount of input */
+	static BulkInput sInput;     /* Record stream */
+	unqlite *pDb;                /* Database handle */
+	char zBuf[64];
+	unqlite_int64 nLen;
+	int rc;
+
+	puts(zBanner);
+	if (argc > 1) {
+		zPath = argv[1];
+	}
+	if (argc > 2) {
+		/* Load the given file, its size is used to pre-size the storage */
+		sInput.pIn = fopen(argv[2], "rb");
+		if (sInput.pIn == 0) {
+			Fatal(0, "Cannot open the input file");
+		}
+		fseek(sInput.pIn, 0, SEEK_END);
+		nHint = (unqlite_int64)ftell(sInput.pIn);
+		fseek(sInput.pIn, 0, SEEK_SET);
+	}
+
+	/* Open our database */
+	rc = unqlite_open(&pDb, zPath, UNQLITE_OPEN_CREATE);
+	if (rc != UNQLITE_OK) {
+		Fatal(0, "Out of memory");
+	}
+
+	/* Load the records, the new image is committed on success */
+	rc = unqlite_bulk_load(pDb, nHint, NextRecord, &sInput);
+	if (sInput.pIn) {
+		fclose(sInput.pIn);
+	}
+	if (rc != UNQLITE_OK) {
+		/* Something goes wrong, extract the database error log and exit */
+		Fatal(pDb, 0);
+	}
+	printf("%d records loaded\n", sInput.nRec);
+
+	if (sInput.pIn == 0) {
+		/* Check one of the generated records */
+		nLen = (unqlite_int64)sizeof(zBuf);
+		rc = unqlite_kv_fetch(pDb, "key-79125", -1, zBuf, &nLen);
+		if (rc != UNQLITE_OK) {
+			Fatal(0, "Record not found");
+		}
+		printf("key-79125 ==> %.*s\n", (int)nLen, zBuf);
+	}
+
+	/* All done, close our database */
+	unqlite_close(pDb);
+	return 0;
+}
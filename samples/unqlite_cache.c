@@ -0,0 +1,170 @@
+/*
+ * Compile this file together with the UnQLite database engine source code
+ * to generate the executable. For example:
+ *  gcc -W -Wall -O6 unqlite_cache.c unqlite.c -o unqlite_cache
+*/
+/*
+ * This program exercises the bounded page cache configured via [unqlite_config()]
+ * with a configuration verb set to UNQLITE_CONFIG_MAX_PAGE_CACHE.
+ *
+ * Transactions much larger than the cache are written so that dirty pages are
+ * spilled to the database file and evicted. Every record is then read back
+ * before the commit, after a rollback and after the database is reopened.
+ * The program exits with a non-zero status on failure.
+ *
+ *  ./unqlite_cache [test.db]
+ *
+ * For an introduction to the UnQLite C/C++ interface, please refer to:
+ *        https://unqlite.symisc.net/api_intro.html
+ * For the full C/C++ API reference guide, please refer to:
+ *        https://unqlite.symisc.net/c_api.html
+ */
+#include <stdio.h>  /* puts() */
+#include <stdlib.h> /* exit() */
+#include <string.h> /* memcmp() */
+  /* Make sure this header file is available.*/
+#include "unqlite.h"
+/*
+ * Banner.
+ */
+static const char zBanner[] = {
+	"============================================================\n"
+	"UnQLite Page Cache Test                                     \n"
+	"                                         https://unqlite.symisc.net/\n"
+	"============================================================\n"
+};
+/*
+ * Extract the database error log and exit with a failure status.
+ */
+static void Fatal(unqlite *pDb, const char *zMsg)
+{
+	if (zMsg) {
+		puts(zMsg);
+	}
+	if (pDb) {
+		const char *zErr;
+		int iLen = 0; /* Stupid cc warning */
+
+		/* Extract the database error log */
+		unqlite_config(pDb, UNQLITE_CONFIG_ERR_LOG, &zErr, &iLen);
+		if (iLen > 0) {
+			/* Output the DB error log */
+			puts(zErr); /* Always null terminated */
+		}
+	}
+	/* Manually shutdown the library */
+	unqlite_lib_shutdown();
+	/* Exit immediately */
+	exit(1);
+}
+/*
+ * Maximum number of cached pages (The smallest accepted limit).
+ */
+#define CACHE_PAGES 256
+/*
+ * Records per transaction.
+ */
+#define TXN_RECORDS 20000
+/*
+ * Generate the data of a record. Odd generations hold the data
+ * written by the rolled back transaction.
+ */
+static void RecordData(int iRec, int iGen, char *zData, int nData)
+{
+	memset(zData, 'a' + (iRec + iGen) % 26, (size_t)nData);
+	sprintf(zData, "Record %d generation %d", iRec, iGen);
+}
+/*
+ * Check records [0,nRec) against the given generation.
+ */
+static void CheckRecords(unqlite *pDb, int nRec, int iGen, const char *zWhen)
+{
+	char zKey[32], zData[120], zBuf[120];
+	unqlite_int64 nLen;
+	int i, rc;
+	for (i = 0; i < nRec; i++) {
+		sprintf(zKey, "key-%d", i);
+		RecordData(i, iGen, zData, (int)sizeof(zData));
+		nLen = (unqlite_int64)sizeof(zBuf);
+		rc = unqlite_kv_fetch(pDb, zKey, -1, zBuf, &nLen);
+		if (rc != UNQLITE_OK || nLen != (unqlite_int64)sizeof(zData) || memcmp(zBuf, zData, sizeof(zData)) != 0) {
+			puts(zWhen);
+			Fatal(pDb, "Record mismatch");
+		}
+	}
+}
+/*
+ * Store records [iFirst,iFirst+nRec) with the given generation.
+ */
+static void StoreRecords(unqlite *pDb, int iFirst, int nRec, int iGen)
+{
+	char zKey[32], zData[120];
+	int i, rc;
+	for (i = iFirst; i < iFirst + nRec; i++) {
+		sprintf(zKey, "key-%d", i);
+		RecordData(i, iGen, zData, (int)sizeof(zData));
+		rc = unqlite_kv_store(pDb, zKey, -1, zData, (unqlite_int64)sizeof(zData));
+		if (rc != UNQLITE_OK) {
+			Fatal(pDb, "Store failed");
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *zPath = "unqlite_cache_test.db";
+	unqlite_int64 nHit, nMiss, nEvict;
+	unqlite *pDb;
+	int rc;
+
+	puts(zBanner);
+	if (argc > 1) {
+		zPath = argv[1];
+	}
+	remove(zPath);
+	rc = unqlite_open(&pDb, zPath, UNQLITE_OPEN_CREATE);
+	if (rc != UNQLITE_OK) {
+		Fatal(0, "Out of memory");
+	}
+	rc = unqlite_config(pDb, UNQLITE_CONFIG_MAX_PAGE_CACHE, CACHE_PAGES);
+	if (rc != UNQLITE_OK) {
+		Fatal(pDb, "Cannot set the cache limit");
+	}
+
+	/* First transaction, read back before and after the commit */
+	StoreRecords(pDb, 0, TXN_RECORDS, 0);
+	CheckRecords(pDb, TXN_RECORDS, 0, "Before the first commit");
+	rc = unqlite_commit(pDb);
+	if (rc != UNQLITE_OK) {
+		Fatal(pDb, "Commit failed");
+	}
+	CheckRecords(pDb, TXN_RECORDS, 0, "After the first commit");
+
+	/* Second transaction overwrite the records and grow the file, then roll back */
+	StoreRecords(pDb, 0, 2 * TXN_RECORDS, 1);
+	CheckRecords(pDb, 2 * TXN_RECORDS, 1, "Before the rollback");
+	rc = unqlite_rollback(pDb);
+	if (rc != UNQLITE_OK) {
+		Fatal(pDb, "Rollback failed");
+	}
+	CheckRecords(pDb, TXN_RECORDS, 0, "After the rollback");
+
+	/* The cache must have been bounded */
+	unqlite_config(pDb, UNQLITE_CONFIG_CACHE_STATS, &nHit, &nMiss, &nEvict);
+	if (nEvict < 1) {
+		Fatal(pDb, "No page was evicted");
+	}
+	unqlite_close(pDb);
+
+	/* Reopen and check the committed image */
+	rc = unqlite_open(&pDb, zPath, UNQLITE_OPEN_READONLY);
+	if (rc != UNQLITE_OK) {
+		Fatal(0, "Cannot reopen the database");
+	}
+	unqlite_config(pDb, UNQLITE_CONFIG_MAX_PAGE_CACHE, CACHE_PAGES);
+	CheckRecords(pDb, TXN_RECORDS, 0, "After reopen");
+	unqlite_close(pDb);
+	remove(zPath);
+	puts("Spill, eviction and rollback: OK");
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Compile this file together with the UnQLite database engine source code
+ * to generate the executable. For example:
+ *  gcc -W -Wall -O6 unqlite_codec.c unqlite.c -o unqlite_codec
+*/
+/*
+ * This program exercises the page compression layer selected via
+ * [unqlite_config()] with a configuration verb set to UNQLITE_CONFIG_PAGE_CODEC.
+ *
+ * The first pass stores compressible records under a small page cache so that
+ * dirty pages are spilled, evicted and read back before the transaction grows
+ * the file. The second pass stores random (incompressible) values holding the
+ * codec magic number at the start of their pages so that they must be stored raw.
+ * Every record is read back and checked. The program exits with a non-zero
+ * status on failure.
+ *
+ *  ./unqlite_codec [test.db]
+ *
+ * For an introduction to the UnQLite C/C++ interface, please refer to:
+ *        https://unqlite.symisc.net/api_intro.html
+ * For the full C/C++ API reference guide, please refer to:
+ *        https://unqlite.symisc.net/c_api.html
+ */
+#include <stdio.h>  /* puts() */
+#include <stdlib.h> /* exit() */
+#include <string.h> /* memcmp() */
+  /* Make sure this header file is available.*/
+#include "unqlite.h"
+/*
+ * Banner.
+ */
+static const char zBanner[] = {
+	"============================================================\n"
+	"UnQLite Page Codec Test                                     \n"
+	"                                         https://unqlite.symisc.net/\n"
+	"============================================================\n"
+};
+/*
+ * Extract the database error log and exit with a failure status.
+ */
+static void Fatal(unqlite *pDb, const char *zMsg)
+{
+	if (zMsg) {
+		puts(zMsg);
+	}
+	if (pDb) {
+		const char *zErr;
+		int iLen = 0; /* Stupid cc warning */
+
+		/* Extract the database error log */
+		unqlite_config(pDb, UNQLITE_CONFIG_ERR_LOG, &zErr, &iLen);
+		if (iLen > 0) {
+			/* Output the DB error log */
+			puts(zErr); /* Always null terminated */
+		}
+	}
+	/* Manually shutdown the library */
+	unqlite_lib_shutdown();
+	/* Exit immediately */
+	exit(1);
+}
+/*
+ * Open a fresh database compressed with the built-in "lz" codec.
+ */
+static unqlite * OpenCompressed(const char *zPath, const char *zEngine)
+{
+	unqlite *pDb;
+	int rc;
+	remove(zPath);
+	rc = unqlite_open(&pDb, zPath, UNQLITE_OPEN_CREATE);
+	if (rc != UNQLITE_OK) {
+		Fatal(0, "Out of memory");
+	}
+	if (zEngine) {
+		rc = unqlite_config(pDb, UNQLITE_CONFIG_KV_ENGINE, zEngine);
+		if (rc != UNQLITE_OK) {
+			Fatal(pDb, "Cannot select the storage engine");
+		}
+	}
+	rc = unqlite_config(pDb, UNQLITE_CONFIG_PAGE_CODEC, "lz");
+	if (rc != UNQLITE_OK) {
+		Fatal(pDb, "Cannot select the page codec");
+	}
+	return pDb;
+}
+/*
+ * Records per transaction of the first pass.
+ */
+#define SPILL_RECORDS 10000
+/*
+ * Compressible records under a small page cache.
+ */
+static void SpillTest(const char *zPath)
+{
+	char zKey[32], zData[200], zBuf[200];
+	unqlite_int64 nLen;
+	unqlite *pDb;
+	int i, j, rc;
+
+	pDb = OpenCompressed(zPath, 0);
+	unqlite_config(pDb, UNQLITE_CONFIG_MAX_PAGE_CACHE, 256);
+	for (i = 0; i < 4; i++) {
+		for (j = i * SPILL_RECORDS; j < (i + 1) * SPILL_RECORDS; j++) {
+			sprintf(zKey, "key-%d", j);
+			memset(zData, 'a' + j % 26, sizeof(zData));
+			sprintf(zData, "Data of record %d", j);
+			rc = unqlite_kv_store(pDb, zKey, -1, zData, (unqlite_int64)sizeof(zData));
+			if (rc != UNQLITE_OK) {
+				Fatal(pDb, "Store failed");
+			}
+		}
+		/* Read back before the commit, evicted pages come from the database file */
+		for (j = 0; j < (i + 1) * SPILL_RECORDS; j += 7) {
+			sprintf(zKey, "key-%d", j);
+			memset(zData, 'a' + j % 26, sizeof(zData));
+			sprintf(zData, "Data of record %d", j);
+			nLen = (unqlite_int64)sizeof(zBuf);
+			rc = unqlite_kv_fetch(pDb, zKey, -1, zBuf, &nLen);
+			if (rc != UNQLITE_OK || nLen != (unqlite_int64)sizeof(zData) || memcmp(zBuf, zData, sizeof(zData)) != 0) {
+				Fatal(pDb, "Fetch mismatch after page spill");
+			}
+		}
+		rc = unqlite_commit(pDb);
+		if (rc != UNQLITE_OK) {
+			Fatal(pDb, "Commit failed");
+		}
+	}
+	unqlite_close(pDb);
+	puts("Spill and eviction: OK");
+}
+/*
+ * Size of the random values of the second pass.
+ */
+#define MAGIC_VALUE_SIZE 20000
+/*
+ * Incompressible values holding the codec magic number. The log-structured
+ * engine lay the value out on consecutive pages, the first page boundary is
+ * near byte 4077 of the value with 4 KB pages. Each value is stored in a fresh
+ * database and shift the magic numbers so that some of them land at the start
+ * of a page.
+ */
+static void MagicTest(const char *zPath)
+{
+	static unsigned char zValue[MAGIC_VALUE_SIZE], zBuf[MAGIC_VALUE_SIZE];
+	static const unsigned char aMagic[4] = { 0x5A, 0x1C, 0x0D, 0xEC };
+	unqlite_int64 nLen;
+	unsigned int iSeed = 7;
+	char zKey[32];
+	unqlite *pDb;
+	int i, j, rc;
+
+	for (i = 0; i < 16; i++) {
+		pDb = OpenCompressed(zPath, "lsm");
+		for (j = 0; j < MAGIC_VALUE_SIZE; j++) {
+			iSeed = iSeed * 1103515245 + 12345;
+			zValue[j] = (unsigned char)(iSeed >> 16);
+		}
+		for (j = 4061 + 4 * i; j + 4 <= MAGIC_VALUE_SIZE; j += 4092) {
+			memcpy(&zValue[j], aMagic, sizeof(aMagic));
+		}
+		sprintf(zKey, "value-%d", i);
+		rc = unqlite_kv_store(pDb, zKey, -1, zValue, MAGIC_VALUE_SIZE);
+		if (rc != UNQLITE_OK) {
+			Fatal(pDb, "Store failed");
+		}
+		rc = unqlite_commit(pDb);
+		if (rc != UNQLITE_OK) {
+			Fatal(pDb, "Commit failed");
+		}
+		/* Read back from disk */
+		unqlite_close(pDb);
+		rc = unqlite_open(&pDb, zPath, UNQLITE_OPEN_CREATE);
+		if (rc != UNQLITE_OK) {
+			Fatal(0, "Cannot reopen the database");
+		}
+		nLen = MAGIC_VALUE_SIZE;
+		rc = unqlite_kv_fetch(pDb, zKey, -1, zBuf, &nLen);
+		if (rc != UNQLITE_OK || nLen != MAGIC_VALUE_SIZE || memcmp(zBuf, zValue, MAGIC_VALUE_SIZE) != 0) {
+			Fatal(pDb, "Fetch mismatch on a raw page");
+		}
+		unqlite_close(pDb);
+	}
+	puts("Raw pages starting with the codec magic: OK");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *zPath = "unqlite_codec_test.db";
+
+	puts(zBanner);
+	if (argc > 1) {
+		zPath = argv[1];
+	}
+	SpillTest(zPath);
+	MagicTest(zPath);
+	remove(zPath);
+	return 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * Compile this file together with the UnQLite database engine source code
+ * to generate the executable. For example:
+ *  gcc -W -Wall -O6 unqlite_index.c unqlite.c -o unqlite_index
+*/
+/*
+ * This program exercises the maintenance of the secondary indexes created
+ * via the db_create_index() Jx9 function while the records are served from
+ * the collection record cache.
+ *
+ * A record fetched by db_fetch_by_id() is changed by the script then either
+ * written back with db_update_record() or dropped with db_drop_record(). In
+ * both cases the index entries of the stored value must be replaced or removed.
+ * The program exits with a non-zero status on failure.
+ *
+ * For an introduction to the UnQLite C/C++ interface, please refer to:
+ *        https://unqlite.symisc.net/api_intro.html
+ * For an introduction to Jx9, please refer to:
+ *        https://unqlite.symisc.net/jx9.html
+ * For the full C/C++ API reference guide, please refer to:
+ *        https://unqlite.symisc.net/c_api.html
+ */
+#include <stdio.h>  /* puts() */
+#include <stdlib.h> /* exit() */
+#include <string.h> /* strcmp() */
+  /* Make sure this header file is available.*/
+#include "unqlite.h"
+/*
+ * Banner.
+ */
+static const char zBanner[] = {
+	"============================================================\n"
+	"UnQLite Collection Index Test                               \n"
+	"                                         https://unqlite.symisc.net/\n"
+	"============================================================\n"
+};
+/*
+ * Extract the database error log and exit with a failure status.
+ */
+static void Fatal(unqlite *pDb, const char *zMsg)
+{
+	if (zMsg) {
+		puts(zMsg);
+	}
+	if (pDb) {
+		const char *zErr;
+		int iLen = 0; /* Stupid cc warning */
+
+		/* Extract the database error log */
+		unqlite_config(pDb, UNQLITE_CONFIG_ERR_LOG, &zErr, &iLen);
+		if (iLen > 0) {
+			/* Output the DB error log */
+			puts(zErr); /* Always null terminated */
+		}
+	}
+	/* Manually shutdown the library */
+	unqlite_lib_shutdown();
+	/* Exit immediately */
+	exit(1);
+}
+/*
+ * Populate the 'users' collection with an index on the 'email' field.
+ */
+#define JX9_CREATE \
+ "db_create('users');"\
+ "db_create_index('users','email');"\
+ "for($i = 0 ; $i < 10 ; $i++){"\
+ "  db_store('users',{ name : 'u'..$i, email : 'u'..$i..'@example.com' });"\
+ "}"
+/*
+ * Fetch, change and update a record. The new value must be found by
+ * the index lookup and the old one must not.
+ */
+#define JX9_UPDATE \
+ "$rec = db_fetch_by_id('users',6);"\
+ "$rec.email = 'six@example.com';"\
+ "$status = 'update failed';"\
+ "if( db_update_record('users',6,$rec) ){"\
+ "  $new = db_fetch_by_field('users','email','six@example.com');"\
+ "  $old = db_fetch_by_field('users','email','u6@example.com');"\
+ "  if( count($new) == 1 && $new[0].name == 'u6' && count($old) == 0 ){"\
+ "    $status = 'ok';"\
+ "  }else{"\
+ "    $status = 'stale index after update';"\
+ "  }"\
+ "}"
+/*
+ * Fetch, change and drop a record.
+ */
+#define JX9_DROP \
+ "$rec = db_fetch_by_id('users',7);"\
+ "$rec.email = 'seven@example.com';"\
+ "$status = db_drop_record('users',7) ? 'ok' : 'drop failed';"
+/*
+ * Compile and execute a Jx9 program, then check its $status variable
+ * when bCheck is true.
+ */
+static void RunScript(unqlite *pDb, const char *zScript, int bCheck)
+{
+	unqlite_value *pStatus;
+	const char *zStatus;
+	unqlite_vm *pVm;
+	int rc;
+	rc = unqlite_compile(pDb, zScript, -1, &pVm);
+	if (rc != UNQLITE_OK) {
+		Fatal(pDb, "Jx9 compile error");
+	}
+	rc = unqlite_vm_exec(pVm);
+	if (rc != UNQLITE_OK) {
+		Fatal(pDb, "Jx9 execution error");
+	}
+	if (bCheck) {
+		pStatus = unqlite_vm_extract_variable(pVm, "status");
+		zStatus = pStatus ? unqlite_value_to_string(pStatus, 0) : "no status";
+		if (strcmp(zStatus, "ok") != 0) {
+			Fatal(pDb, zStatus);
+		}
+	}
+	unqlite_vm_release(pVm);
+}
+/*
+ * Number of entries in the underlying Key/Value store.
+ */
+static int CountEntries(unqlite *pDb)
+{
+	unqlite_kv_cursor *pCur;
+	int nEntry = 0;
+	if (unqlite_kv_cursor_init(pDb, &pCur) != UNQLITE_OK) {
+		Fatal(pDb, "Out of memory");
+	}
+	for (unqlite_kv_cursor_first_entry(pCur); unqlite_kv_cursor_valid_entry(pCur); unqlite_kv_cursor_next_entry(pCur)) {
+		nEntry++;
+	}
+	unqlite_kv_cursor_release(pDb, pCur);
+	return nEntry;
+}
+
+int main(void)
+{
+	unqlite *pDb;
+	int nEntry;
+	int rc;
+
+	puts(zBanner);
+	rc = unqlite_open(&pDb, ":mem:", UNQLITE_OPEN_CREATE);
+	if (rc != UNQLITE_OK) {
+		Fatal(0, "Out of memory");
+	}
+	RunScript(pDb, JX9_CREATE, 0);
+	RunScript(pDb, JX9_UPDATE, 1);
+	puts("Fetch, change and update: OK");
+	nEntry = CountEntries(pDb);
+	RunScript(pDb, JX9_DROP, 1);
+	/* The record and the index entry of its stored email must be gone */
+	if (CountEntries(pDb) != nEntry - 2) {
+		Fatal(pDb, "Orphan index entry after drop");
+	}
+	puts("Fetch, change and drop: OK");
+	unqlite_close(pDb);
+	return 0;
+}
@@ -46,18 +46,20 @@ static struct unqlGlobal_Data
 											*/
 #endif
 	SySet kv_storage;                      /* Installed KV storage engines */
+	SySet page_codec;                      /* Installed page compression codecs */
 	int iPageSize;                         /* Default Page size */
 	unqlite_vfs *pVfs;                     /* Underlying virtual file system (Vfs) */
 	sxi32 nDB;                             /* Total number of active DB handles */
 	unqlite *pDB;                          /* List of active DB handles */
 	sxu32 nMagic;                          /* Sanity check against library misuse */
 }sUnqlMPGlobal = {
-	{0, 0, 0, 0, 0, 0, 0, 0}, 
+	{0, 0, 0, 0, 0, 0, 0, 0, {0}, 0, 0}, 
 #if defined(UNQLITE_ENABLE_THREADS)
 	0, 
 	0, 
 	0, 
 #endif
+	{0, 0, 0, 0, 0, 0, 0 },
 	{0, 0, 0, 0, 0, 0, 0 },
 	UNQLITE_DEFAULT_PAGE_SIZE,
 	0, 
@@ -105,6 +107,30 @@ UNQLITE_PRIVATE unqlite_kv_methods * unqliteFindKVStore(
 	/* No such entry, return NULL */
 	return 0;
 }
+/*
+ * Find a page compression codec from the set of installed codecs.
+ * Return a pointer to the codec methods on success. NULL on failure.
+ */
+UNQLITE_PRIVATE const unqlite_page_codec * unqliteFindPageCodec(
+	const char *zName, /* Codec name [i.e. lz] */
+	sxu32 nByte        /* zName length */
+	)
+{
+	const unqlite_page_codec **apCodec,*pEntry;
+	sxu32 n,nMax;
+	/* Point to the set of installed codecs */
+	apCodec = (const unqlite_page_codec **)SySetBasePtr(&sUnqlMPGlobal.page_codec);
+	nMax = SySetUsed(&sUnqlMPGlobal.page_codec);
+	for( n = 0 ; n < nMax; ++n ){
+		pEntry = apCodec[n];
+		if( nByte == SyStrlen(pEntry->zName) && SyStrnicmp(pEntry->zName,zName,nByte) == 0 ){
+			/* Codec found */
+			return pEntry;
+		}
+	}
+	/* No such entry, return NULL */
+	return 0;
+}
 /*
  * Configure the UnQLite library.
  * Return UNQLITE_OK on success. Any other return value indicates failure.
@@ -144,6 +170,19 @@ static sxi32 unqliteCoreConfigure(sxi32 nOp, va_list ap)
 			rc = SySetPut(&sUnqlMPGlobal.kv_storage,(const void *)&pMethods);
 			break;
 												}
+	    case UNQLITE_LIB_CONFIG_PAGE_CODEC: {
+			/* Install a page compression codec */
+			const unqlite_page_codec *pCodec = va_arg(ap,const unqlite_page_codec *);
+			/* Make sure we are dealing with a valid codec */
+			if( pCodec == 0 || SX_EMPTY_STR(pCodec->zName) || SyStrlen(pCodec->zName) > 255 
+				|| pCodec->xCompress == 0 || pCodec->xDecompress == 0 ){
+					rc = UNQLITE_INVALID;
+					break;
+			}
+			/* Install it */
+			rc = SySetPut(&sUnqlMPGlobal.page_codec,(const void *)&pCodec);
+			break;
+											}
 	    case UNQLITE_LIB_CONFIG_VFS:{
 			/* Install a virtual file system */
 			unqlite_vfs *pVfs = va_arg(ap,unqlite_vfs *);
@@ -347,6 +386,15 @@ static sxi32 unqliteCoreInitialize(void)
 		/* Default disk key/value storage engine */
 		pMethods = unqliteExportDiskKvStorage(); /* Disk storage */
 		unqlite_lib_config(UNQLITE_LIB_CONFIG_STORAGE_ENGINE,pMethods);
+		/* Ordered disk storage */
+		pMethods = unqliteExportBtreeKvStorage();
+		unqlite_lib_config(UNQLITE_LIB_CONFIG_STORAGE_ENGINE,pMethods);
+		/* Write optimized disk storage */
+		pMethods = unqliteExportLsmKvStorage();
+		unqlite_lib_config(UNQLITE_LIB_CONFIG_STORAGE_ENGINE,pMethods);
+		SySetInit(&sUnqlMPGlobal.page_codec,&sUnqlMPGlobal.sAllocator,sizeof(unqlite_page_codec *));
+		/* Install the built-in page codec */
+		unqlite_lib_config(UNQLITE_LIB_CONFIG_PAGE_CODEC,unqliteExportLzCodec());
 		/* Default page size */
 		if( sUnqlMPGlobal.iPageSize < UNQLITE_MIN_PAGE_SIZE ){
 			unqlite_lib_config(UNQLITE_LIB_CONFIG_PAGE_SIZE,UNQLITE_DEFAULT_PAGE_SIZE);
@@ -428,6 +476,8 @@ static void unqliteCoreShutdown(void)
 	}
 	/* Release the storage methods container */
 	SySetRelease(&sUnqlMPGlobal.kv_storage);
+	/* Release the page codecs container */
+	SySetRelease(&sUnqlMPGlobal.page_codec);
 #if defined(UNQLITE_ENABLE_THREADS)
 	/* Release the mutex subsystem */
 	if( sUnqlMPGlobal.pMutexMethods ){
@@ -545,14 +595,12 @@ static unsigned int unqliteSanityzeFlag(unsigned int iFlags)
 		iFlags |= UNQLITE_OPEN_READWRITE;
 	}
 	if( iFlags & UNQLITE_OPEN_CREATE ){
-		iFlags &= ~(UNQLITE_OPEN_MMAP|UNQLITE_OPEN_READONLY);
+		iFlags &= ~UNQLITE_OPEN_READONLY;
 		/* Auto-append the R+W flag */
 		iFlags |= UNQLITE_OPEN_READWRITE;
 	}else{
 		if( iFlags & UNQLITE_OPEN_READONLY ){
 			iFlags &= ~UNQLITE_OPEN_READWRITE;
-		}else if( iFlags & UNQLITE_OPEN_READWRITE ){
-			iFlags &= ~UNQLITE_OPEN_MMAP;
 		}
 	}
 	return iFlags;
@@ -577,6 +625,7 @@ static int unqliteInitDatabase(
 //	SyMemBackendDisbaleMutexing(&pDB->sMem);
 //#endif
 	SyBlobInit(&pDB->sErr,&pDB->sMem);
+	SySetInit(&pStorage->aReader,&pDB->sMem,sizeof(unqlite_kv_cursor *));
 	/* Sanityze flags */
 	iFlags = unqliteSanityzeFlag(iFlags);
 	/* Init the pager and the transaction manager */
@@ -617,6 +666,7 @@ static int unqliteInitVm(unqlite *pDb,jx9_vm *pJx9Vm,unqlite_vm **ppOut)
 	pVm->iColSize = 32; /* Must be a power of two */
 	/* Zero the table */
 	SyZero((void *)pVm->apCol,pVm->iColSize * sizeof(unqlite_col *));
+	pVm->nMaxRecord = UNQLITE_DEFAULT_RECORD_CACHE;
 #if defined(UNQLITE_ENABLE_THREADS)
 	if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE ){
 		 /* Associate a recursive mutex with this instance */
@@ -674,10 +724,12 @@ UNQLITE_PRIVATE int unqliteGetPageSize(void)
 UNQLITE_PRIVATE int unqliteGenError(unqlite *pDb,const char *zErr)
 {
 	int rc;
+	unqliteLatchEnter(pDb);
 	/* Append the error message */
 	rc = SyBlobAppend(&pDb->sErr,(const void *)zErr,SyStrlen(zErr));
 	/* Append a new line */
 	SyBlobAppend(&pDb->sErr,(const void *)"\n",sizeof(char));
+	unqliteLatchLeave(pDb);
 	return rc;
 }
 /*
@@ -687,11 +739,13 @@ UNQLITE_PRIVATE int unqliteGenErrorFormat(unqlite *pDb,const char *zFmt,...)
 {
 	va_list ap;
 	int rc;
+	unqliteLatchEnter(pDb);
 	va_start(ap,zFmt);
 	rc = SyBlobFormatAp(&pDb->sErr,zFmt,ap);
 	va_end(ap);
 	/* Append a new line */
 	SyBlobAppend(&pDb->sErr,(const void *)"\n",sizeof(char));
+	unqliteLatchLeave(pDb);
 	return rc;
 }
 /*
@@ -716,7 +770,7 @@ static int unqliteConfigure(unqlite *pDb,int nOp,va_list ap)
 		break;
 	case UNQLITE_CONFIG_MAX_PAGE_CACHE: {
 		int max_page = va_arg(ap,int);
-		/* Maximum number of page to cache (Simple hint). */
+		/* Maximum number of page to cache (Unused pages are evicted past this limit). */
 		rc = unqlitePagerSetCachesize(pDb->sDB.pPager,max_page);
 		break;
 										}
@@ -741,6 +795,40 @@ static int unqliteConfigure(unqlite *pDb,int nOp,va_list ap)
 		}
 		break;
 								 }
+	case UNQLITE_CONFIG_KV_ENGINE: {
+		/* Key/Value storage engine of a new database */
+		const char *zName = va_arg(ap,const char *);
+		unqlite_kv_methods *pMethods;
+		if( zName == 0 ){
+			rc = UNQLITE_INVALID;
+			break;
+		}
+		pMethods = unqliteFindKVStore(zName,SyStrlen(zName));
+		if( pMethods == 0 ){
+			unqliteGenErrorFormat(pDb,"No such Key/Value storage engine '%s'",zName);
+			rc = UNQLITE_NOTIMPLEMENTED;
+			break;
+		}
+		rc = unqlitePagerSwitchKvEngine(pDb->sDB.pPager,pMethods);
+		break;
+								   }
+	case UNQLITE_CONFIG_PAGE_CODEC: {
+		/* Page compression codec of a new database */
+		const char *zName = va_arg(ap,const char *);
+		const unqlite_page_codec *pCodec;
+		if( zName == 0 ){
+			rc = UNQLITE_INVALID;
+			break;
+		}
+		pCodec = unqliteFindPageCodec(zName,SyStrlen(zName));
+		if( pCodec == 0 ){
+			unqliteGenErrorFormat(pDb,"No such page codec '%s'",zName);
+			rc = UNQLITE_NOTIMPLEMENTED;
+			break;
+		}
+		rc = unqlitePagerSetCodec(pDb->sDB.pPager,pCodec);
+		break;
+									}
 	case UNQLITE_CONFIG_DISABLE_AUTO_COMMIT:{
 		/* Disable auto-commit */
 		pDb->iFlags |= UNQLITE_FL_DISABLE_AUTO_COMMIT;
@@ -757,6 +845,49 @@ static int unqliteConfigure(unqlite *pDb,int nOp,va_list ap)
 		}
 		break;
 									 }
+	case UNQLITE_CONFIG_DISABLE_CACHE_RETAIN:{
+		/* Drop the page cache after each commit */
+		unqlitePagerRetainCache(pDb->sDB.pPager,FALSE);
+		break;
+											  }
+	case UNQLITE_CONFIG_CACHE_STATS: {
+		/* Page cache hits, misses and evicted pages */
+		unqlite_int64 *pHit = va_arg(ap,unqlite_int64 *);
+		unqlite_int64 *pMiss = va_arg(ap,unqlite_int64 *);
+		unqlite_int64 *pEvict = va_arg(ap,unqlite_int64 *);
+		sxu64 nHit,nMiss,nEvict;
+		unqlitePagerCacheStats(pDb->sDB.pPager,&nHit,&nMiss,&nEvict);
+		if( pHit ){
+			*pHit = (unqlite_int64)nHit;
+		}
+		if( pMiss ){
+			*pMiss = (unqlite_int64)nMiss;
+		}
+		if( pEvict ){
+			*pEvict = (unqlite_int64)nEvict;
+		}
+		break;
+									 }
+	case UNQLITE_CONFIG_GROUP_COMMIT: {
+		/* Group commit window and maximum batch size */
+		int iWindow = va_arg(ap,int);
+		int nMax = va_arg(ap,int);
+#if defined(UNQLITE_ENABLE_THREADS)
+		pDb->nCommitWindow = iWindow > 0 ? (sxu32)iWindow : 0;
+		pDb->nCommitMax = nMax > 0 ? (sxu32)nMax : SXU32_HIGH;
+#else
+		/* No concurrent committers without threading support */
+		SXUNUSED(iWindow);
+		SXUNUSED(nMax);
+#endif
+		break;
+									  }
+	case UNQLITE_CONFIG_READ_AHEAD: {
+		/* Read-ahead window of cursor scans */
+		int nPage = va_arg(ap,int);
+		unqlitePagerSetReadAhead(pDb->sDB.pPager,nPage);
+		break;
+									}
 	default:
 		/* Unknown configuration option */
 		rc = UNQLITE_UNKNOWN;
@@ -771,6 +902,130 @@ UNQLITE_PRIVATE const SyMemBackend * unqliteExportMemBackend(void)
 {
 	return &sUnqlMPGlobal.sAllocator;
 }
+#if defined(UNQLITE_ENABLE_THREADS)
+/*
+ * Concurrent readers.
+ * A read-only fetch takes the DB mutex only long enough to grab an idle cursor,
+ * then seek and read without it so that any number of threads may fetch at once.
+ * The page cache and the parsed pages they share are guarded by the handle latch
+ * which is held for a few instructions at a time. Everything else keeps running
+ * under the DB mutex and waits for the readers to leave before touching the storage.
+ * Writers are announced before they queue on the DB mutex: no new concurrent reader
+ * starts meanwhile so that the writer is not starved by a steady flow of fetches.
+ */
+/*
+ * Turn the calling thread into a concurrent reader and release the DB mutex.
+ * Return TRUE with a private cursor in *ppCur, FALSE when the read must be
+ * done under the DB mutex (No latch or the storage engine does not support it).
+ * The DB mutex must be held by the caller.
+ */
+static int unqliteBeginRead(unqlite *pDb,unqlite_kv_cursor **ppCur)
+{
+	unqlite_kv_cursor *pCur = 0;
+	if( pDb->pLatch == 0 || !unqlitePagerSharedRead(pDb->sDB.pPager) ){
+		return FALSE;
+	}
+	unqliteLatchEnter(pDb);
+	if( pDb->nWriter > 0 ){
+		/* A writer is waiting for the DB mutex, read under it instead */
+		unqliteLatchLeave(pDb);
+		return FALSE;
+	}
+	if( SySetUsed(&pDb->sDB.aReader) > 0 ){
+		/* Recycle an idle cursor */
+		pCur = *(unqlite_kv_cursor **)SySetPop(&pDb->sDB.aReader);
+	}
+	pDb->nReader++;
+	unqliteLatchLeave(pDb);
+	if( pCur == 0 && unqliteInitCursor(pDb,&pCur) != UNQLITE_OK ){
+		unqliteLatchEnter(pDb);
+		pDb->nReader--;
+		unqliteLatchLeave(pDb);
+		return FALSE;
+	}
+	/* Let the other readers in */
+	SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex);
+	*ppCur = pCur;
+	return TRUE;
+}
+/*
+ * Drop the pages pinned by the cursor of a concurrent reader and make it available
+ * to the next one.
+ */
+static void unqliteEndRead(unqlite *pDb,unqlite_kv_cursor *pCur)
+{
+	unqlite_kv_methods *pMethods = pCur->pStore->pIo->pMethods;
+	if( pMethods->xCursorRelease ){
+		pMethods->xCursorRelease(pCur);
+	}
+	if( pMethods->xCursorInit ){
+		pMethods->xCursorInit(pCur);
+	}
+	unqliteLatchEnter(pDb);
+	if( SySetPut(&pDb->sDB.aReader,(const void *)&pCur) != SXRET_OK ){
+		unqliteReleaseCursor(pDb,pCur);
+	}
+	pDb->nReader--;
+	if( pDb->nReader < 1 ){
+		/* Wake up the thread draining the readers if any */
+		SyEventNotify(pDb->pReadEvent);
+	}
+	unqliteLatchLeave(pDb);
+}
+/*
+ * Wait for the concurrent readers to leave. The DB mutex must be held by the
+ * caller so that no new reader can start meanwhile.
+ */
+static void unqliteDrainReaders(unqlite *pDb)
+{
+	sxu32 iSeq;
+	if( pDb->pLatch == 0 ){
+		return;
+	}
+	unqliteLatchEnter(pDb);
+	while( pDb->nReader > 0 ){
+		iSeq = SyEventSeq(pDb->pReadEvent);
+		unqliteLatchLeave(pDb);
+		SyEventWait(pDb->pReadEvent,iSeq,0);
+		unqliteLatchEnter(pDb);
+	}
+	unqliteLatchLeave(pDb);
+}
+/*
+ * Acquire the DB mutex on behalf of a writer. The pending writer is visible to
+ * unqliteBeginRead() while it waits for the mutex.
+ */
+static void unqliteWriterEnter(unqlite *pDb)
+{
+	if( pDb->pLatch == 0 ){
+		SyMutexEnter(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+		return;
+	}
+	unqliteLatchEnter(pDb);
+	pDb->nWriter++;
+	unqliteLatchLeave(pDb);
+	SyMutexEnter(sUnqlMPGlobal.pMutexMethods,pDb->pMutex);
+	unqliteLatchEnter(pDb);
+	pDb->nWriter--;
+	unqliteLatchLeave(pDb);
+}
+#endif
+/*
+ * Make the transactions committed by the other handles visible to the upcoming
+ * read (WAL mode only). The DB mutex must be held by the caller.
+ */
+static int unqliteRefreshRead(unqlite *pDb)
+{
+	Pager *pPager = pDb->sDB.pPager;
+	if( !unqlitePagerLogChanged(pPager) ){
+		return UNQLITE_OK;
+	}
+#if defined(UNQLITE_ENABLE_THREADS)
+	/* The page cache is about to be reloaded */
+	unqliteDrainReaders(pDb);
+#endif
+	return unqlitePagerRefresh(pPager);
+}
 /*
  * [CAPIREF: unqlite_open()]
  * Please refer to the official documentation for function purpose and expected parameters.
@@ -814,6 +1069,29 @@ int unqlite_open(unqlite **ppDB,const char *zFilename,unsigned int iMode)
 			 rc = UNQLITE_NOMEM;
 			 goto Release;
 		 }
+		 /* Latch shared by the concurrent readers */
+		 pHandle->pMethods = sUnqlMPGlobal.pMutexMethods;
+		 pHandle->pLatch = SyMutexNew(sUnqlMPGlobal.pMutexMethods, SXMUTEX_TYPE_RECURSIVE);
+		 if( pHandle->pLatch == 0 ){
+			 SyMutexRelease(sUnqlMPGlobal.pMutexMethods, pHandle->pMutex)
+			 rc = UNQLITE_NOMEM;
+			 goto Release;
+		 }
+		 /* Group commit and reader drain waits */
+		 pHandle->pCommitEvent = SyEventNew();
+		 pHandle->pReadEvent = SyEventNew();
+		 if( pHandle->pCommitEvent == 0 || pHandle->pReadEvent == 0 ){
+			 if( pHandle->pCommitEvent ){
+				 SyEventRelease(pHandle->pCommitEvent);
+			 }
+			 if( pHandle->pReadEvent ){
+				 SyEventRelease(pHandle->pReadEvent);
+			 }
+			 SyMutexRelease(sUnqlMPGlobal.pMutexMethods, pHandle->pLatch)
+			 SyMutexRelease(sUnqlMPGlobal.pMutexMethods, pHandle->pMutex)
+			 rc = UNQLITE_NOMEM;
+			 goto Release;
+		 }
 	 }
 #endif
 	/* Link to the list of active DB handles */
@@ -849,12 +1127,14 @@ int unqlite_config(unqlite *pDb,int nConfigOp,...)
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	 va_start(ap, nConfigOp);
 	 rc = unqliteConfigure(&(*pDb),nConfigOp, ap);
@@ -876,12 +1156,14 @@ int unqlite_close(unqlite *pDb)
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	/* Release the database handle */
 	rc = unqliteDbRelease(pDb);
@@ -890,6 +1172,13 @@ int unqlite_close(unqlite *pDb)
 	 SyMutexLeave(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
 	 /* Release DB mutex */
 	 SyMutexRelease(sUnqlMPGlobal.pMutexMethods, pDb->pMutex) /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 SyMutexRelease(sUnqlMPGlobal.pMutexMethods, pDb->pLatch)
+	 if( pDb->pCommitEvent ){
+		 SyEventRelease(pDb->pCommitEvent);
+	 }
+	 if( pDb->pReadEvent ){
+		 SyEventRelease(pDb->pReadEvent);
+	 }
 #endif
 #if defined(UNQLITE_ENABLE_THREADS)
 	/* Enter the global mutex */
@@ -918,12 +1207,14 @@ int unqlite_compile(unqlite *pDb,const char *zJx9,int nByte,unqlite_vm **ppOut)
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT;
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	 /* Compile the Jx9 script first */
 	 rc = jx9_compile(pDb->sDB.pJx9,zJx9,nByte,&pVm);
@@ -953,12 +1244,14 @@ int unqlite_compile_file(unqlite *pDb,const char *zPath,unqlite_vm **ppOut)
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT;
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	 /* Compile the Jx9 script first */
 	rc = jx9_compile_file(pDb->sDB.pJx9,zPath,&pVm);
@@ -981,8 +1274,40 @@ int unqlite_compile_file(unqlite *pDb,const char *zPath,unqlite_vm **ppOut)
  */
 static int unqliteVmConfig(unqlite_vm *pVm,sxi32 iOp,va_list ap)
 {
-	int rc;
-	rc = jx9VmConfigure(pVm->pJx9Vm,iOp,ap);
+	int rc = UNQLITE_OK;
+	switch(iOp){
+	case UNQLITE_VM_CONFIG_RECORD_CACHE: {
+		/* Maximum number of decoded records each collection keep in memory (Zero disable the cache) */
+		int nMax = va_arg(ap,int);
+		if( nMax < 0 ){
+			rc = UNQLITE_INVALID;
+			break;
+		}
+		pVm->nMaxRecord = (sxu32)nMax;
+		/* Shrink the loaded collections right now */
+		unqliteVmTrimRecordCache(pVm);
+		break;
+										 }
+	case UNQLITE_VM_CONFIG_RECORD_CACHE_STATS: {
+		/* Record cache hits, misses and evicted records */
+		unqlite_int64 *pHit = va_arg(ap,unqlite_int64 *);
+		unqlite_int64 *pMiss = va_arg(ap,unqlite_int64 *);
+		unqlite_int64 *pEvict = va_arg(ap,unqlite_int64 *);
+		if( pHit ){
+			*pHit = (unqlite_int64)pVm->nRecHit;
+		}
+		if( pMiss ){
+			*pMiss = (unqlite_int64)pVm->nRecMiss;
+		}
+		if( pEvict ){
+			*pEvict = (unqlite_int64)pVm->nRecEvict;
+		}
+		break;
+											   }
+	default:
+		rc = jx9VmConfigure(pVm->pJx9Vm,iOp,ap);
+		break;
+	}
 	return rc;
 }
 /*
@@ -1902,12 +2227,14 @@ int unqlite_kv_store(unqlite *pDb,const void *pKey,int nKeyLen,const void *pData
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	 /* Point to the underlying storage engine */
 	 pEngine = unqlitePagerGetKvEngine(pDb);
@@ -1946,12 +2273,14 @@ int unqlite_kv_store_fmt(unqlite *pDb,const void *pKey,int nKeyLen,const char *z
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	 /* Point to the underlying storage engine */
 	 pEngine = unqlitePagerGetKvEngine(pDb);
@@ -1999,12 +2328,14 @@ int unqlite_kv_append(unqlite *pDb,const void *pKey,int nKeyLen,const void *pDat
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	 /* Point to the underlying storage engine */
 	 pEngine = unqlitePagerGetKvEngine(pDb);
@@ -2043,12 +2374,14 @@ int unqlite_kv_append_fmt(unqlite *pDb,const void *pKey,int nKeyLen,const char *
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	 /* Point to the underlying storage engine */
 	 pEngine = unqlitePagerGetKvEngine(pDb);
@@ -2093,6 +2426,9 @@ int unqlite_kv_fetch(unqlite *pDb,const void *pKey,int nKeyLen,void *pBuf,unqlit
 	unqlite_kv_methods *pMethods;
 	unqlite_kv_engine *pEngine;
 	unqlite_kv_cursor *pCur;
+#if defined(UNQLITE_ENABLE_THREADS)
+	int bShared = FALSE;
+#endif
 	int rc;
 	if( UNQLITE_DB_MISUSE(pDb) ){
 		return UNQLITE_CORRUPT;
@@ -2105,6 +2441,14 @@ int unqlite_kv_fetch(unqlite *pDb,const void *pKey,int nKeyLen,void *pBuf,unqlit
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
 #endif
+	 /* Pick up the transactions committed by the other handles */
+	 rc = unqliteRefreshRead(pDb);
+	 if( rc != UNQLITE_OK ){
+#if defined(UNQLITE_ENABLE_THREADS)
+		 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+#endif
+		 return rc;
+	 }
 	 /* Point to the underlying storage engine */
 	 pEngine = unqlitePagerGetKvEngine(pDb);
 	 pMethods = pEngine->pIo->pMethods;
@@ -2117,6 +2461,10 @@ int unqlite_kv_fetch(unqlite *pDb,const void *pKey,int nKeyLen,void *pBuf,unqlit
 		  unqliteGenError(pDb,"Empty key");
 		  rc = UNQLITE_EMPTY;
 	 }else{
+#if defined(UNQLITE_ENABLE_THREADS)
+		  /* Seek and read without the DB mutex if possible */
+		  bShared = unqliteBeginRead(pDb,&pCur);
+#endif
 		  /* Seek to the record position */
 		  rc = pMethods->xSeek(pCur,pKey,nKeyLen,UNQLITE_CURSOR_MATCH_EXACT);
 	 }
@@ -2137,8 +2485,12 @@ int unqlite_kv_fetch(unqlite *pDb,const void *pKey,int nKeyLen,void *pBuf,unqlit
 		 }
 	 }
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Leave DB mutex */
-	 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 if( bShared ){
+		 unqliteEndRead(pDb,pCur);
+	 }else{
+		 /* Leave DB mutex */
+		 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 }
 #endif
 	return rc;
 }
@@ -2163,6 +2515,14 @@ int unqlite_kv_fetch_callback(unqlite *pDb,const void *pKey,int nKeyLen,int (*xC
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
 #endif
+	 /* Pick up the transactions committed by the other handles */
+	 rc = unqliteRefreshRead(pDb);
+	 if( rc != UNQLITE_OK ){
+#if defined(UNQLITE_ENABLE_THREADS)
+		 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+#endif
+		 return rc;
+	 }
 	 /* Point to the underlying storage engine */
 	 pEngine = unqlitePagerGetKvEngine(pDb);
 	 pMethods = pEngine->pIo->pMethods;
@@ -2189,18 +2549,92 @@ int unqlite_kv_fetch_callback(unqlite *pDb,const void *pKey,int nKeyLen,int (*xC
 	return rc;
 }
 /*
- * [CAPIREF: unqlite_kv_delete()]
+ * [CAPIREF: unqlite_kv_fetch_ref()]
  * Please refer to the official documentation for function purpose and expected parameters.
  */
-int unqlite_kv_delete(unqlite *pDb,const void *pKey,int nKeyLen)
+int unqlite_kv_fetch_ref(unqlite *pDb,const void *pKey,int nKeyLen,const void **ppData,unqlite_int64 *pDataLen,unqlite_page **ppRef)
 {
 	unqlite_kv_methods *pMethods;
 	unqlite_kv_engine *pEngine;
 	unqlite_kv_cursor *pCur;
+#if defined(UNQLITE_ENABLE_THREADS)
+	int bShared = FALSE;
+#endif
+	int rc;
+	if( UNQLITE_DB_MISUSE(pDb) || ppData == 0 || pDataLen == 0 || ppRef == 0 ){
+		return UNQLITE_CORRUPT;
+	}
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Acquire DB mutex */
+	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
+		 UNQLITE_THRD_DB_RELEASE(pDb) ){
+			 return UNQLITE_ABORT; /* Another thread have released this instance */
+	 }
+#endif
+	 *ppRef = 0;
+	 /* Pick up the transactions committed by the other handles */
+	 rc = unqliteRefreshRead(pDb);
+	 if( rc != UNQLITE_OK ){
+#if defined(UNQLITE_ENABLE_THREADS)
+		 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+#endif
+		 return rc;
+	 }
+	 /* Point to the underlying storage engine */
+	 pEngine = unqlitePagerGetKvEngine(pDb);
+	 pMethods = pEngine->pIo->pMethods;
+	 pCur = pDb->sDB.pCursor;
+	 if( pMethods->iVersion < 4 || pMethods->xDataRef == 0 ){
+		 /* Storage engine does not implement such method */
+		 unqliteGenError(pDb,"xDataRef() method not implemented in the underlying storage engine");
+		 rc = UNQLITE_NOTIMPLEMENTED;
+	 }else{
+		 if( nKeyLen < 0 ){
+			 /* Assume a null terminated string and compute it's length */
+			 nKeyLen = SyStrlen((const char *)pKey);
+		 }
+		 if( !nKeyLen ){
+			 unqliteGenError(pDb,"Empty key");
+			 rc = UNQLITE_EMPTY;
+		 }else{
+#if defined(UNQLITE_ENABLE_THREADS)
+			 /* Seek without the DB mutex if possible */
+			 bShared = unqliteBeginRead(pDb,&pCur);
+#endif
+			 /* Seek to the record position */
+			 rc = pMethods->xSeek(pCur,pKey,nKeyLen,UNQLITE_CURSOR_MATCH_EXACT);
+		 }
+		 if( rc == UNQLITE_OK ){
+			 /* Point to the data in place, UNQLITE_NOTIMPLEMENTED if it is not stored locally */
+			 rc = pMethods->xDataRef(pCur,ppData,pDataLen,ppRef);
+		 }
+	 }
+#if defined(UNQLITE_ENABLE_THREADS)
+	 if( bShared ){
+		 unqliteEndRead(pDb,pCur);
+	 }else{
+		 /* Leave DB mutex */
+		 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 }
+#endif
+	return rc;
+}
+/*
+ * [CAPIREF: unqlite_kv_release_ref()]
+ * Please refer to the official documentation for function purpose and expected parameters.
+ */
+int unqlite_kv_release_ref(unqlite *pDb,unqlite_page *pRef)
+{
+	unqlite_kv_engine *pEngine;
 	int rc;
 	if( UNQLITE_DB_MISUSE(pDb) ){
 		return UNQLITE_CORRUPT;
 	}
+	if( pRef == 0 ){
+		/* Nothing to release */
+		return UNQLITE_OK;
+	}
 #if defined(UNQLITE_ENABLE_THREADS)
 	 /* Acquire DB mutex */
 	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
@@ -2208,6 +2642,38 @@ int unqlite_kv_delete(unqlite *pDb,const void *pKey,int nKeyLen)
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+#endif
+	 /* Drop the reference taken by unqlite_kv_fetch_ref() */
+	 pEngine = unqlitePagerGetKvEngine(pDb);
+	 rc = pEngine->pIo->xPageUnref(pRef);
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Leave DB mutex */
+	 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+#endif
+	return rc;
+}
+/*
+ * [CAPIREF: unqlite_kv_delete()]
+ * Please refer to the official documentation for function purpose and expected parameters.
+ */
+int unqlite_kv_delete(unqlite *pDb,const void *pKey,int nKeyLen)
+{
+	unqlite_kv_methods *pMethods;
+	unqlite_kv_engine *pEngine;
+	unqlite_kv_cursor *pCur;
+	int rc;
+	if( UNQLITE_DB_MISUSE(pDb) ){
+		return UNQLITE_CORRUPT;
+	}
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
+	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
+		 UNQLITE_THRD_DB_RELEASE(pDb) ){
+			 return UNQLITE_ABORT; /* Another thread have released this instance */
+	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	 /* Point to the underlying storage engine */
 	 pEngine = unqlitePagerGetKvEngine(pDb);
@@ -2240,6 +2706,452 @@ int unqlite_kv_delete(unqlite *pDb,const void *pKey,int nKeyLen)
 #endif
 	return rc;
 }
+/*
+ * Entry of a batched KV operation.
+ */
+typedef struct unqlite_kv_batch unqlite_kv_batch;
+struct unqlite_kv_batch
+{
+	pgno iBucket;      /* Bucket reported by the storage engine */
+	const void *pKey;  /* Key */
+	int nKey;          /* Key length */
+	int iEntry;        /* Position in the caller arrays */
+};
+static int unqliteBatchCmp(const unqlite_kv_batch *pA,const unqlite_kv_batch *pB,int bKey)
+{
+	int rc;
+	if( pA->iBucket != pB->iBucket ){
+		return pA->iBucket < pB->iBucket ? -1 : 1;
+	}
+	if( bKey ){
+		rc = SyMemcmp(pA->pKey,pB->pKey,(sxu32)(pA->nKey < pB->nKey ? pA->nKey : pB->nKey));
+		if( rc != 0 ){
+			return rc;
+		}
+		if( pA->nKey != pB->nKey ){
+			return pA->nKey < pB->nKey ? -1 : 1;
+		}
+	}
+	/* Keep the caller order so that the last store of a key wins */
+	return pA->iEntry - pB->iEntry;
+}
+static void unqliteBatchSort(unqlite_kv_batch *aEntry,unqlite_kv_batch *aTmp,int n,int bKey)
+{
+	int i,j,k,m;
+	if( n < 2 ){
+		return;
+	}
+	m = n >> 1;
+	unqliteBatchSort(aEntry,aTmp,m,bKey);
+	unqliteBatchSort(&aEntry[m],aTmp,n - m,bKey);
+	for( i = 0 , j = m , k = 0 ; i < m && j < n ; ){
+		aTmp[k++] = unqliteBatchCmp(&aEntry[j],&aEntry[i],bKey) < 0 ? aEntry[j++] : aEntry[i++];
+	}
+	while( i < m ){
+		aTmp[k++] = aEntry[i++];
+	}
+	/* The tail of the right half is already in place */
+	SyMemcpy((const void *)aTmp,(void *)aEntry,(sxu32)(k * sizeof(unqlite_kv_batch)));
+}
+/*
+ * Compute the order in which the entries of a batched operation are processed.
+ * Entries are grouped by the bucket the engine maps their key to so that each
+ * bucket page is visited once. Engines that do not report buckets get the
+ * entries sorted by key which gives the same locality for ordered stores.
+ */
+static int unqliteBatchPrepare(
+	unqlite *pDb,
+	unqlite_kv_engine *pEngine,
+	int nEntry,
+	const void **apKey,const int *anKeyLen,
+	unqlite_kv_batch **paOut
+	)
+{
+	unqlite_kv_methods *pMethods = pEngine->pIo->pMethods;
+	unqlite_kv_batch *aEntry;
+	int bBucket,i,rc;
+	bBucket = pMethods->iVersion > 2 && pMethods->xBucket;
+	aEntry = (unqlite_kv_batch *)SyMemBackendAlloc(&pDb->sMem,(sxu32)(2 * nEntry * sizeof(unqlite_kv_batch)));
+	if( aEntry == 0 ){
+		unqliteGenOutofMem(pDb);
+		return UNQLITE_NOMEM;
+	}
+	for( i = 0 ; i < nEntry ; ++i ){
+		unqlite_kv_batch *pEntry = &aEntry[i];
+		pEntry->pKey = apKey[i];
+		pEntry->nKey = anKeyLen ? anKeyLen[i] : -1;
+		if( pEntry->nKey < 0 ){
+			/* Assume a null terminated string and compute it's length */
+			pEntry->nKey = SyStrlen((const char *)pEntry->pKey);
+		}
+		pEntry->iEntry = i;
+		pEntry->iBucket = 0;
+		if( bBucket && pEntry->nKey > 0 ){
+			rc = pMethods->xBucket(pEngine,pEntry->pKey,pEntry->nKey,&pEntry->iBucket);
+			if( rc != UNQLITE_OK ){
+				SyMemBackendFree(&pDb->sMem,aEntry);
+				return rc;
+			}
+		}
+	}
+	unqliteBatchSort(aEntry,&aEntry[nEntry],nEntry,!bBucket);
+	*paOut = aEntry;
+	return UNQLITE_OK;
+}
+/*
+ * Store a batch of records in bucket order, stop on the first error.
+ */
+static int unqliteBatchStore(
+	unqlite *pDb,
+	unqlite_kv_engine *pEngine,
+	int nEntry,
+	const void **apKey,const int *anKeyLen,
+	const void **apData,const unqlite_int64 *anDataLen
+	)
+{
+	unqlite_kv_batch *aEntry;
+	int i,rc;
+	rc = unqliteBatchPrepare(pDb,pEngine,nEntry,apKey,anKeyLen,&aEntry);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	for( i = 0 ; i < nEntry ; ++i ){
+		if( aEntry[i].nKey < 1 ){
+			unqliteGenError(pDb,"Empty key");
+			rc = UNQLITE_EMPTY;
+			break;
+		}
+	}
+	/* Perform the requested operations */
+	for( i = 0 ; rc == UNQLITE_OK && i < nEntry ; ++i ){
+		unqlite_kv_batch *pEntry = &aEntry[i];
+		rc = pEngine->pIo->pMethods->xReplace(pEngine,pEntry->pKey,pEntry->nKey,
+			apData[pEntry->iEntry],anDataLen[pEntry->iEntry]);
+	}
+	SyMemBackendFree(&pDb->sMem,aEntry);
+	return rc;
+}
+/*
+ * [CAPIREF: unqlite_kv_store_batch()]
+ * Please refer to the official documentation for function purpose and expected parameters.
+ */
+int unqlite_kv_store_batch(unqlite *pDb,int nEntry,const void **apKey,const int *anKeyLen,
+	const void **apData,const unqlite_int64 *anDataLen)
+{
+	unqlite_kv_engine *pEngine;
+	int rc;
+	if( UNQLITE_DB_MISUSE(pDb) || apKey == 0 || apData == 0 || anDataLen == 0 ){
+		return UNQLITE_CORRUPT;
+	}
+	if( nEntry < 1 ){
+		return UNQLITE_OK;
+	}
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
+	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
+		 UNQLITE_THRD_DB_RELEASE(pDb) ){
+			 return UNQLITE_ABORT; /* Another thread have released this instance */
+	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
+#endif
+	 /* Point to the underlying storage engine */
+	 pEngine = unqlitePagerGetKvEngine(pDb);
+	 if( pEngine->pIo->pMethods->xReplace == 0 ){
+		 /* Storage engine does not implement such method */
+		 unqliteGenError(pDb,"xReplace() method not implemented in the underlying storage engine");
+		 rc = UNQLITE_NOTIMPLEMENTED;
+	 }else{
+		 rc = unqliteBatchStore(pDb,pEngine,nEntry,apKey,anKeyLen,apData,anDataLen);
+	 }
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Leave DB mutex */
+	 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+#endif
+	return rc;
+}
+/*
+ * [CAPIREF: unqlite_kv_fetch_batch()]
+ * Please refer to the official documentation for function purpose and expected parameters.
+ */
+int unqlite_kv_fetch_batch(unqlite *pDb,int nEntry,const void **apKey,const int *anKeyLen,
+	void **apBuf,unqlite_int64 *anBufLen,int *aRc)
+{
+	unqlite_kv_methods *pMethods;
+	unqlite_kv_engine *pEngine;
+	unqlite_kv_batch *aEntry;
+	unqlite_kv_cursor *pCur;
+#if defined(UNQLITE_ENABLE_THREADS)
+	int bShared = FALSE;
+#endif
+	int i,rc,rcEntry;
+	if( UNQLITE_DB_MISUSE(pDb) || apKey == 0 || anBufLen == 0 ){
+		return UNQLITE_CORRUPT;
+	}
+	if( nEntry < 1 ){
+		return UNQLITE_OK;
+	}
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Acquire DB mutex */
+	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
+		 UNQLITE_THRD_DB_RELEASE(pDb) ){
+			 return UNQLITE_ABORT; /* Another thread have released this instance */
+	 }
+#endif
+	 /* Pick up the transactions committed by the other handles */
+	 rc = unqliteRefreshRead(pDb);
+	 if( rc != UNQLITE_OK ){
+#if defined(UNQLITE_ENABLE_THREADS)
+		 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+#endif
+		 return rc;
+	 }
+	 /* Point to the underlying storage engine */
+	 pEngine = unqlitePagerGetKvEngine(pDb);
+	 pMethods = pEngine->pIo->pMethods;
+	 pCur = pDb->sDB.pCursor;
+	 rc = unqliteBatchPrepare(pDb,pEngine,nEntry,apKey,anKeyLen,&aEntry);
+	 if( rc == UNQLITE_OK ){
+#if defined(UNQLITE_ENABLE_THREADS)
+		 /* Seek and read without the DB mutex if possible */
+		 bShared = unqliteBeginRead(pDb,&pCur);
+#endif
+		 for( i = 0 ; i < nEntry ; ++i ){
+			 unqlite_kv_batch *pEntry = &aEntry[i];
+			 int iEntry = pEntry->iEntry;
+			 if( pEntry->nKey < 1 ){
+				 rcEntry = UNQLITE_EMPTY;
+			 }else{
+				 /* Seek to the record position */
+				 rcEntry = pMethods->xSeek(pCur,pEntry->pKey,pEntry->nKey,UNQLITE_CURSOR_MATCH_EXACT);
+			 }
+			 if( rcEntry == UNQLITE_OK ){
+				 if( apBuf == 0 || apBuf[iEntry] == 0 ){
+					 /* Data length only */
+					 rcEntry = pMethods->xDataLength(pCur,&anBufLen[iEntry]);
+				 }else{
+					 SyBlob sBlob;
+					 /* Initialize the data consumer */
+					 SyBlobInitFromBuf(&sBlob,apBuf[iEntry],(sxu32)anBufLen[iEntry]);
+					 /* Consume the data */
+					 rcEntry = pMethods->xData(pCur,unqliteDataConsumer,&sBlob);
+					 /* Data length */
+					 anBufLen[iEntry] = (unqlite_int64)SyBlobLength(&sBlob);
+					 /* Cleanup */
+					 SyBlobRelease(&sBlob);
+				 }
+			 }
+			 if( aRc ){
+				 aRc[iEntry] = rcEntry;
+			 }
+			 if( rcEntry != UNQLITE_OK && rcEntry != UNQLITE_NOTFOUND && rc == UNQLITE_OK ){
+				 /* Report the first failure, missing records are not errors */
+				 rc = rcEntry;
+			 }
+		 }
+		 SyMemBackendFree(&pDb->sMem,aEntry);
+	 }
+#if defined(UNQLITE_ENABLE_THREADS)
+	 if( bShared ){
+		 unqliteEndRead(pDb,pCur);
+	 }else{
+		 /* Leave DB mutex */
+		 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 }
+#endif
+	return rc;
+}
+/*
+ * Amount of input buffered and hash-partitioned in memory by [unqlite_bulk_load()]
+ * before it is written out.
+ */
+#ifndef UNQLITE_BULK_CHUNK
+#define UNQLITE_BULK_CHUNK (32 << 20) /* 32 MB */
+#endif
+/*
+ * Record buffered by [unqlite_bulk_load()].
+ */
+typedef struct unqlite_bulk_rec unqlite_bulk_rec;
+struct unqlite_bulk_rec
+{
+	sxu32 iOff;           /* Offset of the key in the chunk, the data follows */
+	int nKey;             /* Key length */
+	unqlite_int64 nData;  /* Data length */
+};
+/*
+ * Write out a chunk of buffered records in bucket order.
+ */
+static int unqliteBulkFlush(unqlite *pDb,unqlite_kv_engine *pEngine,SyBlob *pChunk,SySet *pRec)
+{
+	unqlite_bulk_rec *aRec = (unqlite_bulk_rec *)SySetBasePtr(pRec);
+	int i,n = (int)SySetUsed(pRec);
+	const char *zBase = (const char *)SyBlobData(pChunk);
+	unqlite_int64 *anData;
+	const void **apKey,**apData;
+	int *anKey;
+	int rc;
+	if( n < 1 ){
+		return UNQLITE_OK;
+	}
+	apKey = (const void **)SyMemBackendAlloc(&pDb->sMem,
+		(sxu32)(n * (2 * sizeof(void *) + sizeof(unqlite_int64) + sizeof(int))));
+	if( apKey == 0 ){
+		unqliteGenOutofMem(pDb);
+		return UNQLITE_NOMEM;
+	}
+	apData = &apKey[n];
+	anData = (unqlite_int64 *)&apData[n];
+	anKey = (int *)&anData[n];
+	for( i = 0 ; i < n ; ++i ){
+		apKey[i] = (const void *)&zBase[aRec[i].iOff];
+		anKey[i] = aRec[i].nKey;
+		apData[i] = (const void *)&zBase[aRec[i].iOff + aRec[i].nKey];
+		anData[i] = aRec[i].nData;
+	}
+	rc = unqliteBatchStore(pDb,pEngine,n,apKey,anKey,apData,anData);
+	SyMemBackendFree(&pDb->sMem,(void *)apKey);
+	SyBlobReset(pChunk);
+	SySetReset(pRec);
+	return rc;
+}
+/*
+ * [CAPIREF: unqlite_bulk_load()]
+ * Please refer to the official documentation for function purpose and expected parameters.
+ */
+int unqlite_bulk_load(unqlite *pDb,unqlite_int64 nByteHint,
+	int (*xNext)(void *,const void **ppKey,int *pKeyLen,const void **ppData,unqlite_int64 *pDataLen),void *pUserData)
+{
+	unqlite_kv_methods *pMethods;
+	unqlite_kv_engine *pEngine;
+	unqlite_kv_cursor *pCur;
+	unqlite_bulk_rec sRec;
+	const void *pKey,*pData;
+	unqlite_int64 nData;
+	int bReserved = 0;
+	SyBlob sChunk;
+	SySet aRec;
+	int nKey;
+	int rc;
+	if( UNQLITE_DB_MISUSE(pDb) || xNext == 0 ){
+		return UNQLITE_CORRUPT;
+	}
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
+	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
+		 UNQLITE_THRD_DB_RELEASE(pDb) ){
+			 return UNQLITE_ABORT; /* Another thread have released this instance */
+	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
+#endif
+	 /* Point to the underlying storage engine */
+	 pEngine = unqlitePagerGetKvEngine(pDb);
+	 pMethods = pEngine->pIo->pMethods;
+	 pCur = pDb->sDB.pCursor;
+	 if( pMethods->xReplace == 0 ){
+		 /* Storage engine does not implement such method */
+		 unqliteGenError(pDb,"xReplace() method not implemented in the underlying storage engine");
+		 rc = UNQLITE_NOTIMPLEMENTED;
+		 goto leave;
+	 }
+	 /* Bulk loading is for empty databases only */
+	 rc = pMethods->xFirst(pCur);
+	 if( rc == UNQLITE_OK && pMethods->xValid(pCur) ){
+		 unqliteGenError(pDb,"Bulk loading requires an empty database");
+		 rc = UNQLITE_INVALID;
+		 goto leave;
+	 }
+	 SyBlobInit(&sChunk,&pDb->sMem);
+	 SySetInit(&aRec,&pDb->sMem,sizeof(unqlite_bulk_rec));
+	 for(;;){
+		 int bEof;
+		 rc = xNext(pUserData,&pKey,&nKey,&pData,&nData);
+		 bEof = (rc == UNQLITE_DONE);
+		 if( !bEof ){
+			 if( rc != UNQLITE_OK ){
+				 /* Aborted by the caller */
+				 break;
+			 }
+			 if( nKey < 0 ){
+				 /* Assume a null terminated string and compute it's length */
+				 nKey = (int)SyStrlen((const char *)pKey);
+			 }
+			 if( nData < 0 ){
+				 unqliteGenError(pDb,"Negative data length");
+				 rc = UNQLITE_INVALID;
+				 break;
+			 }
+			 if( (unqlite_int64)nKey + nData >= UNQLITE_BULK_CHUNK ){
+				 /* Too large for the chunk (32-bit offsets), flush the pending records and store it directly */
+				 rc = unqliteBulkFlush(pDb,pEngine,&sChunk,&aRec);
+				 if( rc != UNQLITE_OK ){
+					 break;
+				 }
+				 /* The storage is no longer empty, skip the pre-sizing */
+				 bReserved = 1;
+				 rc = pMethods->xReplace(pEngine,pKey,nKey,pData,nData);
+				 if( rc != UNQLITE_OK ){
+					 break;
+				 }
+				 continue;
+			 }
+			 /* Buffer the record */
+			 sRec.iOff = SyBlobLength(&sChunk);
+			 sRec.nKey = nKey;
+			 sRec.nData = nData;
+			 rc = SyBlobAppend(&sChunk,pKey,(sxu32)nKey);
+			 if( rc == UNQLITE_OK ){
+				 rc = SyBlobAppend(&sChunk,pData,(sxu32)nData);
+			 }
+			 if( rc == UNQLITE_OK ){
+				 rc = SySetPut(&aRec,(const void *)&sRec);
+			 }
+			 if( rc != UNQLITE_OK ){
+				 unqliteGenOutofMem(pDb);
+				 rc = UNQLITE_NOMEM;
+				 break;
+			 }
+			 if( SyBlobLength(&sChunk) < UNQLITE_BULK_CHUNK ){
+				 continue;
+			 }
+		 }
+		 if( !bReserved && SySetUsed(&aRec) > 0 && pMethods->iVersion > 4 && pMethods->xReserve ){
+			 /* Pre-size the storage from the first chunk, extrapolated to the hint */
+			 unqlite_int64 nByte = (unqlite_int64)SyBlobLength(&sChunk);
+			 unqlite_int64 nRecord = (unqlite_int64)SySetUsed(&aRec);
+			 if( !bEof && nByteHint > nByte ){
+				 nRecord = (unqlite_int64)((double)nRecord * ((double)nByteHint / (double)nByte));
+				 nByte = nByteHint;
+			 }
+			 rc = pMethods->xReserve(pEngine,nRecord,nByte);
+			 if( rc != UNQLITE_OK ){
+				 break;
+			 }
+		 }
+		 bReserved = 1;
+		 rc = unqliteBulkFlush(pDb,pEngine,&sChunk,&aRec);
+		 if( rc != UNQLITE_OK || bEof ){
+			 break;
+		 }
+	 }
+	 SyBlobRelease(&sChunk);
+	 SySetRelease(&aRec);
+	 if( rc == UNQLITE_OK ){
+		 /* Commit the new image */
+		 rc = unqlitePagerCommit(pDb->sDB.pPager);
+	 }else{
+		 unqlitePagerRollback(pDb->sDB.pPager,TRUE);
+	 }
+leave:
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Leave DB mutex */
+	 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+#endif
+	return rc;
+}
 /*
  * [CAPIREF: unqlite_kv_config()]
  * Please refer to the official documentation for function purpose and expected parameters.
@@ -2252,12 +3164,14 @@ int unqlite_kv_config(unqlite *pDb,int iOp,...)
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	 /* Point to the underlying storage engine */
 	 pEngine = unqlitePagerGetKvEngine(pDb);
@@ -2289,13 +3203,25 @@ int unqlite_kv_cursor_init(unqlite *pDb,unqlite_kv_cursor **ppOut)
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
+	 /* Pick up the transactions committed by the other handles */
+	 rc = unqliteRefreshRead(pDb);
+	 if( rc != UNQLITE_OK ){
+#if defined(UNQLITE_ENABLE_THREADS)
+		 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+#endif
+		 return rc;
+	 }
+	 /* Make sure the engine recorded in the database header is installed */
+	 unqlitePagerGetKvEngine(pDb);
 	 /* Allocate a new cursor */
 	 rc = unqliteInitCursor(pDb,ppOut);
 #if defined(UNQLITE_ENABLE_THREADS)
@@ -2304,6 +3230,36 @@ int unqlite_kv_cursor_init(unqlite *pDb,unqlite_kv_cursor **ppOut)
 #endif
 	 return rc;
 }
+/*
+ * [CAPIREF: unqlite_kv_cursor_snapshot()]
+ * Please refer to the official documentation for function purpose and expected parameters.
+ */
+int unqlite_kv_cursor_snapshot(unqlite *pDb,unqlite_kv_cursor **ppOut)
+{
+	int rc;
+	if( UNQLITE_DB_MISUSE(pDb) || ppOut == 0 /* Noop */){
+		return UNQLITE_CORRUPT;
+	}
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
+	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
+		 UNQLITE_THRD_DB_RELEASE(pDb) ){
+			 return UNQLITE_ABORT; /* Another thread have released this instance */
+	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
+#endif
+	 /* Make sure the engine recorded in the database header is installed */
+	 unqlitePagerGetKvEngine(pDb);
+	 /* Pin the last committed image and open a read-only cursor on it */
+	 rc = unqlitePagerSnapshotCursor(pDb->sDB.pPager,ppOut);
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Leave DB mutex */
+	 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+#endif
+	 return rc;
+}
 /*
  * [CAPIREF: unqlite_kv_cursor_release()]
  * Please refer to the official documentation for function purpose and expected parameters.
@@ -2315,12 +3271,14 @@ int unqlite_kv_cursor_release(unqlite *pDb,unqlite_kv_cursor *pCur)
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	 /* Release the cursor */
 	 rc = unqliteReleaseCursor(pDb,pCur);
@@ -2620,12 +3578,14 @@ int unqlite_begin(unqlite *pDb)
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	 /* Begin the write transaction */
 	 rc = unqlitePagerBegin(pDb->sDB.pPager);
@@ -2635,6 +3595,69 @@ int unqlite_begin(unqlite *pDb)
 #endif
 	 return rc;
 }
+#if defined(UNQLITE_ENABLE_THREADS)
+/*
+ * Group commit.
+ * The first thread to commit becomes the leader of a new batch and waits
+ * for the configured window (or until the batch is full) before committing.
+ * Threads committing meanwhile join the batch and wait for the leader, so
+ * the whole batch costs a single journal sync and a single database sync.
+ * Each caller returns only once the batch holding its changes is durable,
+ * with the result of that commit. While the batch is collected, the shared
+ * transaction cannot be rolled back (See unqlite_rollback()).
+ * The DB mutex must be held by the caller and is released on return.
+ */
+static int unqliteGroupCommit(unqlite *pDb)
+{
+	sxu32 iBatch = pDb->iCommitBatch;
+	sxu32 iSeq;
+	int rc;
+	pDb->nCommitWait++;
+	if( pDb->bCommitLeader ){
+		if( pDb->nCommitWait >= pDb->nCommitMax ){
+			/* Batch full, wake up the leader */
+			SyEventNotify(pDb->pCommitEvent);
+		}
+		/* Wait for the leader to commit the current batch */
+		while( pDb->iCommitBatch == iBatch ){
+			iSeq = SyEventSeq(pDb->pCommitEvent);
+			SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex);
+			SyEventWait(pDb->pCommitEvent,iSeq,0);
+			SyMutexEnter(sUnqlMPGlobal.pMutexMethods,pDb->pMutex);
+			if( UNQLITE_THRD_DB_RELEASE(pDb) ){
+				return UNQLITE_ABORT; /* Another thread have released this instance */
+			}
+		}
+		rc = pDb->iCommitRc;
+		SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex);
+		return rc;
+	}
+	/* Collect the commit requests of the other threads */
+	pDb->bCommitLeader = 1;
+	if( pDb->nCommitWait < pDb->nCommitMax ){
+		iSeq = SyEventSeq(pDb->pCommitEvent);
+		SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex);
+		/* Until the window is over or the batch is full */
+		SyEventWait(pDb->pCommitEvent,iSeq,pDb->nCommitWindow);
+		unqliteWriterEnter(pDb);
+		if( UNQLITE_THRD_DB_RELEASE(pDb) ){
+			return UNQLITE_ABORT; /* Another thread have released this instance */
+		}
+	}
+	/* Readers may have started while the batch was collected */
+	unqliteDrainReaders(pDb);
+	/* One commit for the whole batch */
+	rc = unqlitePagerCommit(pDb->sDB.pPager);
+	pDb->iCommitRc = rc;
+	pDb->iCommitBatch++;
+	pDb->nCommitWait = 0;
+	pDb->bCommitLeader = 0;
+	/* Release the waiting members */
+	SyEventNotify(pDb->pCommitEvent);
+	SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex);
+	return rc;
+}
+#endif
 /*
  * [CAPIREF: unqlite_commit()]
  * Please refer to the official documentation for function purpose and expected parameters.
@@ -2646,12 +3669,18 @@ int unqlite_commit(unqlite *pDb)
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
+	 if( pDb->pMutex && pDb->nCommitWindow > 0 ){
+		 /* Share the commit with the other threads committing within the window */
+		 return unqliteGroupCommit(pDb);
+	 }
 #endif
 	 /* Commit the transaction */
 	 rc = unqlitePagerCommit(pDb->sDB.pPager);
@@ -2672,12 +3701,20 @@ int unqlite_rollback(unqlite *pDb)
 		return UNQLITE_CORRUPT;
 	}
 #if defined(UNQLITE_ENABLE_THREADS)
-	 /* Acquire DB mutex */
-	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
 	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
 		 UNQLITE_THRD_DB_RELEASE(pDb) ){
 			 return UNQLITE_ABORT; /* Another thread have released this instance */
 	 }
+	 if( pDb->bCommitLeader ){
+		 /* The transaction is shared by a pending group commit batch */
+		 unqliteGenError(pDb,"A group commit is pending on this transaction, it cannot be rolled back");
+		 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex);
+		 return UNQLITE_BUSY;
+	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
 #endif
 	 /* Rollback the transaction */
 	 rc = unqlitePagerRollback(pDb->sDB.pPager,TRUE);
@@ -2687,6 +3724,68 @@ int unqlite_rollback(unqlite *pDb)
 #endif
 	 return rc;
 }
+/*
+ * [CAPIREF: unqlite_vacuum()]
+ * Please refer to the official documentation for function purpose and expected parameters.
+ * Reclaim the free pages of the database and shrink the file. When nPage is greater than
+ * zero, at most nPage pages are processed per call (incremental vacuum) and the amount of
+ * work left is stored in *pRemain so that the caller can loop until it reach zero.
+ * The changes are committed before returning. No cursor must be open on the database.
+ */
+int unqlite_vacuum(unqlite *pDb,int nPage,unqlite_int64 *pRemain)
+{
+	unqlite_kv_methods *pMethods;
+	unqlite_kv_engine *pEngine;
+	unqlite_kv_cursor *pCur;
+	unqlite_int64 nRemain = 0;
+	int rc;
+	if( UNQLITE_DB_MISUSE(pDb) ){
+		return UNQLITE_CORRUPT;
+	}
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Acquire DB mutex, ahead of the new concurrent readers */
+	 unqliteWriterEnter(pDb);
+	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
+		 UNQLITE_THRD_DB_RELEASE(pDb) ){
+			 return UNQLITE_ABORT; /* Another thread have released this instance */
+	 }
+	 /* Wait for the concurrent readers to leave */
+	 unqliteDrainReaders(pDb);
+#endif
+	 /* Point to the underlying storage engine */
+	 pEngine = unqlitePagerGetKvEngine(pDb);
+	 pMethods = pEngine->pIo->pMethods;
+	 if( pMethods->iVersion < 6 || pMethods->xVacuum == 0 ){
+		 /* Storage engine does not implement such method */
+		 unqliteGenError(pDb,"xVacuum() method not implemented in the underlying storage engine");
+		 rc = UNQLITE_NOTIMPLEMENTED;
+		 goto leave;
+	 }
+	 /* The common cursor must not pin any page while the pages are moved around */
+	 pCur = pDb->sDB.pCursor;
+	 if( pMethods->xCursorRelease ){
+		 pMethods->xCursorRelease(pCur);
+	 }
+	 if( pMethods->xCursorInit ){
+		 pMethods->xCursorInit(pCur);
+	 }
+	 rc = pMethods->xVacuum(pEngine,nPage,&nRemain);
+	 if( rc == UNQLITE_OK ){
+		 /* Commit, this is where the file is truncated */
+		 rc = unqlitePagerCommit(pDb->sDB.pPager);
+	 }else{
+		 unqlitePagerRollback(pDb->sDB.pPager,TRUE);
+	 }
+	 if( pRemain ){
+		 *pRemain = rc == UNQLITE_OK ? nRemain : 0;
+	 }
+leave:
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Leave DB mutex */
+	 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pDb->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+#endif
+	 return rc;
+}
 /*
  * [CAPIREF: unqlite_util_load_mmaped_file()]
  * Please refer to the official documentation for function purpose and expected parameters.
@@ -2789,3 +3888,17 @@ UNQLITE_APIEXPORT unsigned int unqlite_util_random_num(unqlite *pDb)
 #endif
 	 return iNum;
 }
+/*
+ * [CAPIREF: unqlite_util_io_uring_vfs()]
+ * Please refer to the official documentation for function purpose and expected parameters.
+ */
+UNQLITE_APIEXPORT const unqlite_vfs * unqlite_util_io_uring_vfs(void)
+{
+#if defined(UNQLITE_ENABLE_IO_URING) && defined(__linux__)
+	/* Register it via unqlite_lib_config(UNQLITE_LIB_CONFIG_VFS,...) */
+	return unqliteExportUringVfs();
+#else
+	/* Not compiled in */
+	return 0;
+#endif
+}
@@ -0,0 +1,1454 @@
+/*
+ * Symisc unQLite: An Embeddable NoSQL (Post Modern) Database Engine.
+ * Copyright (C) 2012-2018, Symisc Systems https://unqlite.symisc.net/
+ * Version 1.2.1
+ * For information on licensing, redistribution of this file, and for a DISCLAIMER OF ALL WARRANTIES
+ * please contact Symisc Systems via:
+ *       legal@symisc.net
+ *       licensing@symisc.net
+ *       contact@symisc.net
+ * or visit:
+ *      https://unqlite.symisc.net/licensing.html
+ */
+ /* $SymiscID: btree_kv.c v1.0 Linux 2026-10-17 10:12 stable <chm@symisc.net> $ */
+#ifndef UNQLITE_AMALGAMATION
+#include "unqliteInt.h"
+#endif
+/*
+ * This file implements a disk based B+tree Key/Value storage engine.
+ * Records are kept in key order in the leaf pages, which are chained in both
+ * directions so that cursors can walk the whole tree, or any range of it,
+ * without going back to the interior pages.
+ * Interior pages only hold separator keys and child page numbers: the child
+ * of the i-th cell holds the keys that are smaller than the cell key while the
+ * right-most child holds the keys that are greater or equal to the last key.
+ * Payloads that do not fit in a cell spill over a chain of overflow pages.
+ */
+/* Magic number identifying a valid storage image */
+#define BT_MAGIC 0xB7EE5A1D
+/*
+ * Storage header (page one) layout.
+ */
+#define BT_HDR_MAGIC 0  /* Magic number (4 bytes) */
+#define BT_HDR_ROOT  4  /* Root page (8 bytes) */
+#define BT_HDR_FREE  12 /* Head of the free page list (8 bytes) */
+/*
+ * Page types.
+ */
+#define BT_PAGE_LEAF     1
+#define BT_PAGE_INTERIOR 2
+/*
+ * Page header layout:
+ *   Page type (1 byte) + Unused (1 byte) + Total cells (2 bytes) + Start of the cell content area (2 bytes)
+ *   + Fragmented free bytes (2 bytes) + Right page (8 bytes) + Left page (8 bytes).
+ * The right page is the next leaf for leaf pages or the right-most child for interior pages,
+ * the left page is the previous leaf. An array of 2 bytes cell offsets follows the header.
+ */
+#define BT_PAGE_HDR_SZ 24
+#define BT_NODE_NCELL   2
+#define BT_NODE_CONTENT 4
+#define BT_NODE_FRAG    6
+#define BT_NODE_RIGHT   8
+#define BT_NODE_LEFT    16
+/*
+ * Cell header size on disk: Key length (4 bytes) + Data length for leaf cells
+ * or left child for interior cells (8 bytes).
+ */
+#define BT_CELL_HDR_SZ (4+8)
+/*
+ * The maximum amount of payload (in bytes) that can be stored locally for
+ * a cell. This guarantees that at least four cells fit in a page.
+ * Larger payloads keep (BT_MAX_LOCAL - 8) bytes locally followed by the
+ * number of the first overflow page.
+ */
+#define BT_MAX_LOCAL(PAGE_SZ) ((((PAGE_SZ) - BT_PAGE_HDR_SZ) / 4) - (BT_CELL_HDR_SZ + 2))
+/*
+ * Maximum depth of the tree.
+ */
+#define BT_MAX_DEPTH 32
+/* Forward declaration */
+typedef struct btree_kv_engine btree_kv_engine;
+/*
+ * A decoded cell.
+ */
+typedef struct btcell btcell;
+struct btcell
+{
+	sxu32 nKey;                  /* Key length */
+	sxu64 nData;                 /* Data length (leaf cells only) */
+	pgno iChild;                 /* Left child (interior cells only) */
+	const unsigned char *zLocal; /* Local payload */
+	sxu32 nLocal;                /* Local payload size */
+	pgno iOvfl;                  /* First overflow page, 0 if none */
+	sxu32 nSize;                 /* Cell size on disk */
+};
+/*
+ * Page visited while descending the tree, and the index of the followed child.
+ */
+typedef struct btpath btpath;
+struct btpath
+{
+	pgno iPage;
+	int iIdx;
+};
+/*
+ * Each active B+tree engine is represented by an instance of the following structure.
+ */
+struct btree_kv_engine
+{
+	const unqlite_kv_io *pIo;    /* IO methods: Must be first */
+	/* Private fields */
+	SyMemBackend sAllocator;     /* Private memory backend */
+	ProcCmp xCmp;                /* Key comparison function */
+	unqlite_page *pHeader;       /* Page one of the storage */
+	int iPageSize;               /* Page size */
+	sxu32 nMaxLocal;             /* Maximum payload stored locally */
+	unsigned char *zScratch;     /* Defragmentation buffer (one page) */
+	unsigned char *zCell;        /* Cell being inserted (one page) */
+	unsigned char *zSep;         /* Separator promoted to the parent page (one page) */
+	unsigned char *zSplit;       /* Cells of a page being split (two pages) */
+	sxu32 *aOfft;                /* Offset of each cell in zSplit */
+	sxu32 *aSize;                /* Size of each cell in zSplit */
+	SyBlob sKey;                 /* Large keys */
+	SyBlob sWorker;              /* Data of appended records */
+};
+/*
+ * Big-endian accessors.
+ */
+static sxu32 btGet16(const unsigned char *z)
+{
+	sxu16 n;
+	SyBigEndianUnpack16(z,&n);
+	return (sxu32)n;
+}
+static sxu64 btGet64(const unsigned char *z)
+{
+	sxu64 n;
+	SyBigEndianUnpack64(z,&n);
+	return n;
+}
+/*
+ * Page header accessors.
+ */
+#define btNodeCount(Z)    btGet16(&(Z)[BT_NODE_NCELL])
+#define btNodeFrag(Z)     btGet16(&(Z)[BT_NODE_FRAG])
+#define btNodeRight(Z)    ((pgno)btGet64(&(Z)[BT_NODE_RIGHT]))
+#define btNodeLeft(Z)     ((pgno)btGet64(&(Z)[BT_NODE_LEFT]))
+#define btCellOfft(Z,I)   btGet16(&(Z)[BT_PAGE_HDR_SZ + 2*(I)])
+static sxu32 btNodeContent(btree_kv_engine *pEngine,const unsigned char *zPage)
+{
+	sxu32 iContent = btGet16(&zPage[BT_NODE_CONTENT]);
+	/* Zero stands for 65536 */
+	return iContent == 0 ? (sxu32)pEngine->iPageSize : iContent;
+}
+/*
+ * Initialize an empty page.
+ */
+static void btInitNode(btree_kv_engine *pEngine,unsigned char *zPage,int iType)
+{
+	SyZero(zPage,BT_PAGE_HDR_SZ);
+	zPage[0] = (unsigned char)iType;
+	SyBigEndianPack16(&zPage[BT_NODE_CONTENT],(sxu16)(pEngine->iPageSize & 0xFFFF));
+}
+/*
+ * Decode the cell starting at zCell.
+ */
+static void btParseCellAt(btree_kv_engine *pEngine,const unsigned char *zCell,int bLeaf,btcell *pCell)
+{
+	sxu64 nPayload;
+	SyBigEndianUnpack32(zCell,&pCell->nKey);
+	if( bLeaf ){
+		SyBigEndianUnpack64(&zCell[4],&pCell->nData);
+		pCell->iChild = 0;
+		nPayload = pCell->nKey + pCell->nData;
+	}else{
+		pCell->iChild = (pgno)btGet64(&zCell[4]);
+		pCell->nData = 0;
+		nPayload = pCell->nKey;
+	}
+	pCell->zLocal = &zCell[BT_CELL_HDR_SZ];
+	if( nPayload <= pEngine->nMaxLocal ){
+		pCell->nLocal = (sxu32)nPayload;
+		pCell->iOvfl = 0;
+		pCell->nSize = BT_CELL_HDR_SZ + pCell->nLocal;
+	}else{
+		pCell->nLocal = pEngine->nMaxLocal - 8;
+		pCell->iOvfl = (pgno)btGet64(&pCell->zLocal[pCell->nLocal]);
+		pCell->nSize = BT_CELL_HDR_SZ + pEngine->nMaxLocal;
+	}
+}
+/*
+ * Decode the i-th cell of a page.
+ */
+static void btParseCell(btree_kv_engine *pEngine,const unsigned char *zPage,int iCell,btcell *pCell)
+{
+	btParseCellAt(pEngine,&zPage[btCellOfft(zPage,iCell)],zPage[0] == BT_PAGE_LEAF,pCell);
+}
+/*
+ * Return the child page to follow at the given index of an interior page.
+ */
+static pgno btChild(const unsigned char *zPage,int iIdx)
+{
+	if( iIdx < (int)btNodeCount(zPage) ){
+		return (pgno)btGet64(&zPage[btCellOfft(zPage,iIdx) + 4]);
+	}
+	return btNodeRight(zPage);
+}
+/*
+ * Read a field of the storage header.
+ */
+static pgno btHeaderGet(btree_kv_engine *pEngine,int iOfft)
+{
+	return (pgno)btGet64(&pEngine->pHeader->zData[iOfft]);
+}
+/*
+ * Update a field of the storage header.
+ */
+static int btHeaderSet(btree_kv_engine *pEngine,int iOfft,pgno iValue)
+{
+	int rc;
+	rc = pEngine->pIo->xWrite(pEngine->pHeader);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	SyBigEndianPack64(&pEngine->pHeader->zData[iOfft],(sxu64)iValue);
+	return UNQLITE_OK;
+}
+/*
+ * Allocate a writable page, either from the free list or by growing the file.
+ */
+static int btAllocPage(btree_kv_engine *pEngine,unqlite_page **ppPage)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	unqlite_page *pPage;
+	pgno iFree;
+	int rc;
+	iFree = btHeaderGet(pEngine,BT_HDR_FREE);
+	if( iFree > 0 ){
+		rc = pIo->xGet(pIo->pHandle,iFree,&pPage);
+	}else{
+		rc = pIo->xNew(pIo->pHandle,&pPage);
+	}
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	rc = pIo->xWrite(pPage);
+	if( rc == UNQLITE_OK && iFree > 0 ){
+		/* Unlink from the free list */
+		rc = btHeaderSet(pEngine,BT_HDR_FREE,(pgno)btGet64(pPage->zData));
+	}
+	if( rc != UNQLITE_OK ){
+		pIo->xPageUnref(pPage);
+		return rc;
+	}
+	*ppPage = pPage;
+	return UNQLITE_OK;
+}
+/*
+ * Release a chain of overflow pages to the free list.
+ */
+static int btFreeOverflow(btree_kv_engine *pEngine,pgno iOvfl)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	unqlite_page *pPage;
+	pgno iNext;
+	int rc;
+	while( iOvfl > 0 ){
+		rc = pIo->xGet(pIo->pHandle,iOvfl,&pPage);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		rc = pIo->xWrite(pPage);
+		if( rc != UNQLITE_OK ){
+			pIo->xPageUnref(pPage);
+			return rc;
+		}
+		iNext = (pgno)btGet64(pPage->zData);
+		/* Push on the free list */
+		SyBigEndianPack64(pPage->zData,(sxu64)btHeaderGet(pEngine,BT_HDR_FREE));
+		rc = btHeaderSet(pEngine,BT_HDR_FREE,iOvfl);
+		pIo->xPageUnref(pPage);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		iOvfl = iNext;
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Copy a range of the virtual concatenation of a key and its data.
+ */
+static void btPayloadCopy(
+	const void *pKey,sxu32 nKey,
+	const void *pData,
+	sxu64 iOfft,unsigned char *zDest,sxu32 nAmt
+	)
+{
+	sxu32 n;
+	if( iOfft < nKey ){
+		n = nKey - (sxu32)iOfft;
+		if( n > nAmt ){
+			n = nAmt;
+		}
+		SyMemcpy(&((const unsigned char *)pKey)[iOfft],zDest,n);
+		zDest += n;
+		nAmt -= n;
+		iOfft = nKey;
+	}
+	if( nAmt > 0 ){
+		SyMemcpy(&((const unsigned char *)pData)[iOfft - nKey],zDest,nAmt);
+	}
+}
+/*
+ * Write the payload past iOfft to a new chain of overflow pages.
+ */
+static int btWriteOverflow(
+	btree_kv_engine *pEngine,
+	const void *pKey,sxu32 nKey,
+	const void *pData,sxu64 nData,
+	sxu64 iOfft,pgno *piFirst
+	)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	sxu32 nChunk = (sxu32)pEngine->iPageSize - 8;
+	sxu64 nRem = nKey + nData - iOfft;
+	unqlite_page *pPrev = 0;
+	unqlite_page *pNew;
+	sxu32 n;
+	int rc;
+	*piFirst = 0;
+	while( nRem > 0 ){
+		rc = btAllocPage(pEngine,&pNew);
+		if( rc != UNQLITE_OK ){
+			if( pPrev ){
+				pIo->xPageUnref(pPrev);
+			}
+			return rc;
+		}
+		n = nRem > nChunk ? nChunk : (sxu32)nRem;
+		SyBigEndianPack64(pNew->zData,0);
+		btPayloadCopy(pKey,nKey,pData,iOfft,&pNew->zData[8],n);
+		if( pPrev ){
+			/* Link to the previous page of the chain */
+			SyBigEndianPack64(pPrev->zData,(sxu64)pNew->iPage);
+			pIo->xPageUnref(pPrev);
+		}else{
+			*piFirst = pNew->iPage;
+		}
+		pPrev = pNew;
+		iOfft += n;
+		nRem -= n;
+	}
+	if( pPrev ){
+		pIo->xPageUnref(pPrev);
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Stream a range of a cell payload to the given consumer callback.
+ */
+static int btReadPayload(
+	btree_kv_engine *pEngine,
+	btcell *pCell,
+	sxu64 iOfft,sxu64 nAmt,
+	int (*xConsumer)(const void *,unsigned int,void *),
+	void *pUserData
+	)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	sxu32 nChunk = (sxu32)pEngine->iPageSize - 8;
+	unqlite_page *pPage;
+	pgno iPage;
+	sxu64 n;
+	int rc;
+	if( iOfft < pCell->nLocal ){
+		/* Local part */
+		n = pCell->nLocal - iOfft;
+		if( n > nAmt ){
+			n = nAmt;
+		}
+		if( n > 0 ){
+			rc = xConsumer((const void *)&pCell->zLocal[iOfft],(unsigned int)n,pUserData);
+			if( rc != UNQLITE_OK ){
+				/* Consumer routine request an operation abort */
+				return UNQLITE_ABORT;
+			}
+		}
+		iOfft += n;
+		nAmt -= n;
+	}
+	/* Offset in the overflow chain */
+	iOfft -= pCell->nLocal;
+	iPage = pCell->iOvfl;
+	while( nAmt > 0 && iPage > 0 ){
+		rc = pIo->xGet(pIo->pHandle,iPage,&pPage);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		if( iOfft >= nChunk ){
+			/* Skip this page */
+			iOfft -= nChunk;
+		}else{
+			n = nChunk - iOfft;
+			if( n > nAmt ){
+				n = nAmt;
+			}
+			rc = xConsumer((const void *)&pPage->zData[8 + iOfft],(unsigned int)n,pUserData);
+			if( rc != UNQLITE_OK ){
+				pIo->xPageUnref(pPage);
+				return UNQLITE_ABORT;
+			}
+			iOfft = 0;
+			nAmt -= n;
+		}
+		iPage = (pgno)btGet64(pPage->zData);
+		pIo->xPageUnref(pPage);
+	}
+	if( nAmt > 0 ){
+		/* Truncated overflow chain */
+		return UNQLITE_CORRUPT;
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Append a payload chunk to a blob.
+ */
+static int btBlobConsumer(const void *pData,unsigned int nLen,void *pUserData)
+{
+	return SyBlobAppend((SyBlob *)pUserData,pData,nLen);
+}
+/*
+ * Compare a cell key with the given key. The sign of *pRes is the sign of (cell key - key).
+ */
+static int btCompareKey(btree_kv_engine *pEngine,btcell *pCell,const void *pKey,sxu32 nKey,int *pRes)
+{
+	const unsigned char *zCellKey = pCell->zLocal;
+	sxu32 n;
+	int rc,r;
+	if( pCell->nLocal < pCell->nKey ){
+		/* Compare the local prefix first */
+		n = pCell->nLocal < nKey ? pCell->nLocal : nKey;
+		r = n > 0 ? pEngine->xCmp((const void *)zCellKey,pKey,n) : 0;
+		if( r != 0 || n == nKey ){
+			/* Decided by the prefix (a key that is a prefix of the cell key sorts first) */
+			*pRes = r != 0 ? r : 1;
+			return UNQLITE_OK;
+		}
+		/* Load the whole key */
+		SyBlobReset(&pEngine->sKey);
+		rc = btReadPayload(pEngine,pCell,0,pCell->nKey,btBlobConsumer,&pEngine->sKey);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		zCellKey = (const unsigned char *)SyBlobData(&pEngine->sKey);
+	}
+	n = pCell->nKey < nKey ? pCell->nKey : nKey;
+	r = n > 0 ? pEngine->xCmp((const void *)zCellKey,pKey,n) : 0;
+	if( r == 0 && pCell->nKey != nKey ){
+		r = pCell->nKey < nKey ? -1 : 1;
+	}
+	*pRes = r;
+	return UNQLITE_OK;
+}
+/*
+ * Binary search a page. On a leaf page, *pIdx is the index of the first key
+ * greater or equal to the target key. On an interior page, *pIdx is the index of
+ * the child to follow.
+ */
+static int btSearchPage(btree_kv_engine *pEngine,const unsigned char *zPage,const void *pKey,sxu32 nKey,int *pIdx,int *pExact)
+{
+	int bLeaf = zPage[0] == BT_PAGE_LEAF;
+	int lo = 0,hi = (int)btNodeCount(zPage);
+	btcell sCell;
+	int mid,r;
+	int rc;
+	*pExact = 0;
+	while( lo < hi ){
+		mid = (lo + hi) >> 1;
+		btParseCell(pEngine,zPage,mid,&sCell);
+		rc = btCompareKey(pEngine,&sCell,pKey,nKey,&r);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		if( r == 0 && bLeaf ){
+			*pIdx = mid;
+			*pExact = 1;
+			return UNQLITE_OK;
+		}
+		if( r > 0 ){
+			hi = mid;
+		}else{
+			/* Interior: keys equal to the separator live in the next child */
+			lo = mid + 1;
+		}
+	}
+	*pIdx = lo;
+	return UNQLITE_OK;
+}
+/*
+ * Descend from the root to the leaf page that holds (or would hold) the given key.
+ * The visited pages and followed children are recorded in aPath[].
+ */
+static int btSeekLeaf(
+	btree_kv_engine *pEngine,
+	const void *pKey,sxu32 nKey,
+	btpath *aPath,int *pnPath,
+	unqlite_page **ppLeaf,int *pIdx,int *pExact
+	)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	unqlite_page *pPage;
+	pgno iPage;
+	int nPath = 0;
+	int iIdx;
+	int rc;
+	/* Acquire the first page so that the storage gets loaded automatically */
+	rc = pIo->xGet(pIo->pHandle,1,0);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	iPage = btHeaderGet(pEngine,BT_HDR_ROOT);
+	for(;;){
+		if( nPath >= BT_MAX_DEPTH ){
+			return UNQLITE_CORRUPT;
+		}
+		rc = pIo->xGet(pIo->pHandle,iPage,&pPage);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		if( pPage->zData[0] != BT_PAGE_LEAF && pPage->zData[0] != BT_PAGE_INTERIOR ){
+			pIo->xPageUnref(pPage);
+			return UNQLITE_CORRUPT;
+		}
+		rc = btSearchPage(pEngine,pPage->zData,pKey,nKey,&iIdx,pExact);
+		if( rc != UNQLITE_OK ){
+			pIo->xPageUnref(pPage);
+			return rc;
+		}
+		aPath[nPath].iPage = iPage;
+		aPath[nPath].iIdx = iIdx;
+		nPath++;
+		if( pPage->zData[0] == BT_PAGE_LEAF ){
+			break;
+		}
+		iPage = btChild(pPage->zData,iIdx);
+		pIo->xPageUnref(pPage);
+	}
+	*pnPath = nPath;
+	*ppLeaf = pPage;
+	*pIdx = iIdx;
+	return UNQLITE_OK;
+}
+/*
+ * Descend to the first or the last leaf page of the tree.
+ */
+static int btSeekEdge(btree_kv_engine *pEngine,int bLast,unqlite_page **ppLeaf)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	unqlite_page *pPage;
+	pgno iPage;
+	int nDepth;
+	int rc;
+	rc = pIo->xGet(pIo->pHandle,1,0);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	iPage = btHeaderGet(pEngine,BT_HDR_ROOT);
+	for( nDepth = 0 ; nDepth < BT_MAX_DEPTH ; nDepth++ ){
+		rc = pIo->xGet(pIo->pHandle,iPage,&pPage);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		if( pPage->zData[0] == BT_PAGE_LEAF ){
+			*ppLeaf = pPage;
+			return UNQLITE_OK;
+		}
+		if( pPage->zData[0] != BT_PAGE_INTERIOR ){
+			break;
+		}
+		iPage = btChild(pPage->zData,bLast ? (int)btNodeCount(pPage->zData) : 0);
+		pIo->xPageUnref(pPage);
+	}
+	pIo->xPageUnref(pPage);
+	return UNQLITE_CORRUPT;
+}
+/*
+ * Encode a cell. Large payloads spill over a chain of overflow pages.
+ */
+static int btBuildCell(
+	btree_kv_engine *pEngine,
+	const void *pKey,sxu32 nKey,
+	const void *pData,sxu64 nData,
+	int bLeaf,pgno iChild,
+	unsigned char *zOut,sxu32 *pnSize
+	)
+{
+	sxu64 nPayload;
+	sxu32 nLocal;
+	pgno iOvfl;
+	int rc;
+	if( !bLeaf ){
+		/* Interior cells hold keys only */
+		nData = 0;
+	}
+	nPayload = nKey + nData;
+	SyBigEndianPack32(zOut,nKey);
+	SyBigEndianPack64(&zOut[4],bLeaf ? nData : (sxu64)iChild);
+	if( nPayload <= pEngine->nMaxLocal ){
+		btPayloadCopy(pKey,nKey,pData,0,&zOut[BT_CELL_HDR_SZ],(sxu32)nPayload);
+		*pnSize = BT_CELL_HDR_SZ + (sxu32)nPayload;
+		return UNQLITE_OK;
+	}
+	nLocal = pEngine->nMaxLocal - 8;
+	btPayloadCopy(pKey,nKey,pData,0,&zOut[BT_CELL_HDR_SZ],nLocal);
+	rc = btWriteOverflow(pEngine,pKey,nKey,pData,nData,nLocal,&iOvfl);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	SyBigEndianPack64(&zOut[BT_CELL_HDR_SZ + nLocal],(sxu64)iOvfl);
+	*pnSize = BT_CELL_HDR_SZ + pEngine->nMaxLocal;
+	return UNQLITE_OK;
+}
+/*
+ * Move all the cells of a page to the end of the page so that the
+ * fragmented free space become contiguous.
+ */
+static void btDefragPage(btree_kv_engine *pEngine,unsigned char *zPage)
+{
+	unsigned char *zCopy = pEngine->zScratch;
+	int bLeaf = zPage[0] == BT_PAGE_LEAF;
+	sxu32 nCell = btNodeCount(zPage);
+	sxu32 iContent = (sxu32)pEngine->iPageSize;
+	sxu32 i,iOfft;
+	btcell sCell;
+	SyMemcpy(zPage,zCopy,(sxu32)pEngine->iPageSize);
+	for( i = 0 ; i < nCell ; i++ ){
+		iOfft = btCellOfft(zCopy,i);
+		btParseCellAt(pEngine,&zCopy[iOfft],bLeaf,&sCell);
+		iContent -= sCell.nSize;
+		SyMemcpy(&zCopy[iOfft],&zPage[iContent],sCell.nSize);
+		SyBigEndianPack16(&zPage[BT_PAGE_HDR_SZ + 2*i],(sxu16)iContent);
+	}
+	SyBigEndianPack16(&zPage[BT_NODE_CONTENT],(sxu16)(iContent & 0xFFFF));
+	SyBigEndianPack16(&zPage[BT_NODE_FRAG],0);
+}
+/*
+ * Insert a cell at the given index of a page.
+ * Return FALSE if there is no room for it.
+ */
+static int btInsertCell(btree_kv_engine *pEngine,unsigned char *zPage,int iIdx,const unsigned char *zCell,sxu32 nSize)
+{
+	sxu32 nCell = btNodeCount(zPage);
+	sxu32 iContent = btNodeContent(pEngine,zPage);
+	sxu32 iEnd = BT_PAGE_HDR_SZ + 2*nCell;
+	sxu32 i;
+	if( iContent < iEnd + nSize + 2 ){
+		if( iContent - iEnd + btNodeFrag(zPage) < nSize + 2 ){
+			/* Split needed */
+			return FALSE;
+		}
+		btDefragPage(pEngine,zPage);
+		iContent = btNodeContent(pEngine,zPage);
+	}
+	iContent -= nSize;
+	SyMemcpy(zCell,&zPage[iContent],nSize);
+	/* Make room in the cell offset array */
+	for( i = nCell ; i > (sxu32)iIdx ; i-- ){
+		zPage[BT_PAGE_HDR_SZ + 2*i]     = zPage[BT_PAGE_HDR_SZ + 2*(i - 1)];
+		zPage[BT_PAGE_HDR_SZ + 2*i + 1] = zPage[BT_PAGE_HDR_SZ + 2*(i - 1) + 1];
+	}
+	SyBigEndianPack16(&zPage[BT_PAGE_HDR_SZ + 2*iIdx],(sxu16)iContent);
+	SyBigEndianPack16(&zPage[BT_NODE_NCELL],(sxu16)(nCell + 1));
+	SyBigEndianPack16(&zPage[BT_NODE_CONTENT],(sxu16)iContent);
+	return TRUE;
+}
+/*
+ * Remove the cell at the given index of a page.
+ */
+static void btDropCell(btree_kv_engine *pEngine,unsigned char *zPage,int iIdx)
+{
+	sxu32 nCell = btNodeCount(zPage);
+	sxu32 iOfft = btCellOfft(zPage,iIdx);
+	sxu32 iContent = btNodeContent(pEngine,zPage);
+	sxu32 i;
+	btcell sCell;
+	btParseCellAt(pEngine,&zPage[iOfft],zPage[0] == BT_PAGE_LEAF,&sCell);
+	for( i = (sxu32)iIdx ; i + 1 < nCell ; i++ ){
+		zPage[BT_PAGE_HDR_SZ + 2*i]     = zPage[BT_PAGE_HDR_SZ + 2*(i + 1)];
+		zPage[BT_PAGE_HDR_SZ + 2*i + 1] = zPage[BT_PAGE_HDR_SZ + 2*(i + 1) + 1];
+	}
+	nCell--;
+	SyBigEndianPack16(&zPage[BT_NODE_NCELL],(sxu16)nCell);
+	if( nCell < 1 ){
+		SyBigEndianPack16(&zPage[BT_NODE_CONTENT],(sxu16)(pEngine->iPageSize & 0xFFFF));
+		SyBigEndianPack16(&zPage[BT_NODE_FRAG],0);
+	}else if( iOfft == iContent ){
+		SyBigEndianPack16(&zPage[BT_NODE_CONTENT],(sxu16)(iContent + sCell.nSize));
+	}else{
+		SyBigEndianPack16(&zPage[BT_NODE_FRAG],(sxu16)(btNodeFrag(zPage) + sCell.nSize));
+	}
+}
+/*
+ * Rebuild a page from a range of the cells gathered in zSplit.
+ * The right and left page numbers are set by the caller.
+ */
+static void btFillNode(btree_kv_engine *pEngine,unsigned char *zPage,int iType,int iFrom,int iTo)
+{
+	sxu32 iContent = (sxu32)pEngine->iPageSize;
+	int i;
+	btInitNode(pEngine,zPage,iType);
+	for( i = iFrom ; i < iTo ; i++ ){
+		iContent -= pEngine->aSize[i];
+		SyMemcpy(&pEngine->zSplit[pEngine->aOfft[i]],&zPage[iContent],pEngine->aSize[i]);
+		SyBigEndianPack16(&zPage[BT_PAGE_HDR_SZ + 2*(i - iFrom)],(sxu16)iContent);
+	}
+	SyBigEndianPack16(&zPage[BT_NODE_NCELL],(sxu16)(iTo - iFrom));
+	SyBigEndianPack16(&zPage[BT_NODE_CONTENT],(sxu16)(iContent & 0xFFFF));
+}
+/*
+ * Insert a cell in a full page: split the page in two and hook the new right
+ * sibling in the parent page, splitting the parents in turn when needed.
+ * pPage must be writable and is released by this function.
+ */
+static int btBalance(
+	btree_kv_engine *pEngine,
+	btpath *aPath,int iDepth,
+	unqlite_page *pPage,int iIdx,
+	const unsigned char *zCell,sxu32 nSize
+	)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	unsigned char *zSplit = pEngine->zSplit;
+	unqlite_page *pRight,*pParent;
+	sxu32 nTotal,nAcc,nSep,iOfft,nSz;
+	const unsigned char *zSrc;
+	pgno iRight,iNext,iPrev;
+	unsigned char *zPage;
+	int bLeaf,nCell,n,k;
+	btcell sCell;
+	int rc;
+	for(;;){
+		zPage = pPage->zData;
+		bLeaf = zPage[0] == BT_PAGE_LEAF;
+		nCell = (int)btNodeCount(zPage);
+		/* Gather the cells of the page and the new one in key order */
+		iOfft = nTotal = 0;
+		for( n = 0 ; n <= nCell ; n++ ){
+			if( n == iIdx ){
+				zSrc = zCell;
+				nSz = nSize;
+			}else{
+				zSrc = &zPage[btCellOfft(zPage,n < iIdx ? n : n - 1)];
+				btParseCellAt(pEngine,zSrc,bLeaf,&sCell);
+				nSz = sCell.nSize;
+			}
+			SyMemcpy(zSrc,&zSplit[iOfft],nSz);
+			pEngine->aOfft[n] = iOfft;
+			pEngine->aSize[n] = nSz;
+			iOfft += nSz;
+			nTotal += nSz + 2;
+		}
+		/* Split point: half of the bytes on each side */
+		nAcc = 0;
+		for( k = 0 ; k < n ; k++ ){
+			nAcc += pEngine->aSize[k] + 2;
+			if( nAcc >= nTotal / 2 ){
+				break;
+			}
+		}
+		k++;
+		if( k > n - (bLeaf ? 1 : 2) ){
+			k = n - (bLeaf ? 1 : 2);
+		}
+		if( k < 1 ){
+			k = 1;
+		}
+		rc = btAllocPage(pEngine,&pRight);
+		if( rc != UNQLITE_OK ){
+			pIo->xPageUnref(pPage);
+			return rc;
+		}
+		iRight = pRight->iPage;
+		iNext = btNodeRight(zPage);
+		if( bLeaf ){
+			iPrev = btNodeLeft(zPage);
+			btFillNode(pEngine,zPage,BT_PAGE_LEAF,0,k);
+			SyBigEndianPack64(&zPage[BT_NODE_LEFT],(sxu64)iPrev);
+			SyBigEndianPack64(&zPage[BT_NODE_RIGHT],(sxu64)iRight);
+			btFillNode(pEngine,pRight->zData,BT_PAGE_LEAF,k,n);
+			SyBigEndianPack64(&pRight->zData[BT_NODE_LEFT],(sxu64)pPage->iPage);
+			SyBigEndianPack64(&pRight->zData[BT_NODE_RIGHT],(sxu64)iNext);
+			pIo->xPageUnref(pRight);
+			if( iNext > 0 ){
+				unqlite_page *pNext;
+				/* Fix the back link of the next leaf */
+				rc = pIo->xGet(pIo->pHandle,iNext,&pNext);
+				if( rc == UNQLITE_OK ){
+					rc = pIo->xWrite(pNext);
+					if( rc == UNQLITE_OK ){
+						SyBigEndianPack64(&pNext->zData[BT_NODE_LEFT],(sxu64)iRight);
+					}
+					pIo->xPageUnref(pNext);
+				}
+				if( rc != UNQLITE_OK ){
+					pIo->xPageUnref(pPage);
+					return rc;
+				}
+			}
+			/* The first key of the right page is the separator */
+			btParseCellAt(pEngine,&zSplit[pEngine->aOfft[k]],TRUE,&sCell);
+			if( sCell.nLocal >= sCell.nKey ){
+				rc = btBuildCell(pEngine,sCell.zLocal,sCell.nKey,0,0,FALSE,pPage->iPage,pEngine->zSep,&nSep);
+			}else{
+				SyBlobReset(&pEngine->sKey);
+				rc = btReadPayload(pEngine,&sCell,0,sCell.nKey,btBlobConsumer,&pEngine->sKey);
+				if( rc == UNQLITE_OK ){
+					rc = btBuildCell(pEngine,SyBlobData(&pEngine->sKey),SyBlobLength(&pEngine->sKey),0,0,FALSE,pPage->iPage,
+						pEngine->zSep,&nSep);
+				}
+			}
+			if( rc != UNQLITE_OK ){
+				pIo->xPageUnref(pPage);
+				return rc;
+			}
+		}else{
+			/* The middle cell moves up, its child becomes the right-most child of the left page */
+			nSep = pEngine->aSize[k];
+			SyMemcpy(&zSplit[pEngine->aOfft[k]],pEngine->zSep,nSep);
+			btFillNode(pEngine,zPage,BT_PAGE_INTERIOR,0,k);
+			SyBigEndianPack64(&zPage[BT_NODE_RIGHT],btGet64(&pEngine->zSep[4]));
+			btFillNode(pEngine,pRight->zData,BT_PAGE_INTERIOR,k + 1,n);
+			SyBigEndianPack64(&pRight->zData[BT_NODE_RIGHT],(sxu64)iNext);
+			pIo->xPageUnref(pRight);
+			SyBigEndianPack64(&pEngine->zSep[4],(sxu64)pPage->iPage);
+		}
+		if( iDepth < 1 ){
+			/* Root split, grow the tree */
+			rc = btAllocPage(pEngine,&pParent);
+			if( rc == UNQLITE_OK ){
+				btInitNode(pEngine,pParent->zData,BT_PAGE_INTERIOR);
+				SyBigEndianPack64(&pParent->zData[BT_NODE_RIGHT],(sxu64)iRight);
+				btInsertCell(pEngine,pParent->zData,0,pEngine->zSep,nSep);
+				rc = btHeaderSet(pEngine,BT_HDR_ROOT,pParent->iPage);
+				pIo->xPageUnref(pParent);
+			}
+			pIo->xPageUnref(pPage);
+			return rc;
+		}
+		pIo->xPageUnref(pPage);
+		iDepth--;
+		rc = pIo->xGet(pIo->pHandle,aPath[iDepth].iPage,&pParent);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		rc = pIo->xWrite(pParent);
+		if( rc != UNQLITE_OK ){
+			pIo->xPageUnref(pParent);
+			return rc;
+		}
+		zPage = pParent->zData;
+		iIdx = aPath[iDepth].iIdx;
+		/* The slot that pointed to the split page now points to its right sibling,
+		 * the separator is inserted before it and points to the left page.
+		 */
+		if( iIdx < (int)btNodeCount(zPage) ){
+			SyBigEndianPack64(&zPage[btCellOfft(zPage,iIdx) + 4],(sxu64)iRight);
+		}else{
+			SyBigEndianPack64(&zPage[BT_NODE_RIGHT],(sxu64)iRight);
+		}
+		if( btInsertCell(pEngine,zPage,iIdx,pEngine->zSep,nSep) ){
+			pIo->xPageUnref(pParent);
+			return UNQLITE_OK;
+		}
+		/* Split the parent in turn */
+		pPage = pParent;
+		zCell = pEngine->zSep;
+		nSize = nSep;
+	}
+}
+/*
+ * Insert or replace a record. If bAppend is set, the data is appended to
+ * the data of an existing record.
+ */
+static int btInsert(btree_kv_engine *pEngine,const void *pKey,sxu32 nKey,const void *pData,sxu64 nData,int bAppend)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	btpath aPath[BT_MAX_DEPTH];
+	unqlite_page *pLeaf;
+	int nPath,iIdx,bExact;
+	btcell sCell;
+	sxu32 nSize;
+	int rc;
+	rc = btSeekLeaf(pEngine,pKey,nKey,aPath,&nPath,&pLeaf,&iIdx,&bExact);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	rc = pIo->xWrite(pLeaf);
+	if( rc != UNQLITE_OK ){
+		goto fail;
+	}
+	if( bExact ){
+		btParseCell(pEngine,pLeaf->zData,iIdx,&sCell);
+		if( bAppend ){
+			/* Old data followed by the new chunk */
+			SyBlobReset(&pEngine->sWorker);
+			rc = btReadPayload(pEngine,&sCell,sCell.nKey,sCell.nData,btBlobConsumer,&pEngine->sWorker);
+			if( rc == UNQLITE_OK ){
+				rc = SyBlobAppend(&pEngine->sWorker,pData,(sxu32)nData);
+			}
+			if( rc != UNQLITE_OK ){
+				goto fail;
+			}
+			pData = SyBlobData(&pEngine->sWorker);
+			nData = SyBlobLength(&pEngine->sWorker);
+		}
+		/* Release the old overflow pages first so that the new record can reuse them */
+		rc = btFreeOverflow(pEngine,sCell.iOvfl);
+		if( rc != UNQLITE_OK ){
+			goto fail;
+		}
+		btDropCell(pEngine,pLeaf->zData,iIdx);
+	}
+	rc = btBuildCell(pEngine,pKey,nKey,pData,nData,TRUE,0,pEngine->zCell,&nSize);
+	if( rc != UNQLITE_OK ){
+		goto fail;
+	}
+	if( !btInsertCell(pEngine,pLeaf->zData,iIdx,pEngine->zCell,nSize) ){
+		return btBalance(pEngine,aPath,nPath - 1,pLeaf,iIdx,pEngine->zCell,nSize);
+	}
+fail:
+	pIo->xPageUnref(pLeaf);
+	return rc;
+}
+/*
+ * Exported: xReplace() method.
+ */
+static int btree_kv_replace(unqlite_kv_engine *pKv,const void *pKey,int nKeyLen,const void *pData,unqlite_int64 nDataLen)
+{
+	return btInsert((btree_kv_engine *)pKv,pKey,(sxu32)nKeyLen,pData,(sxu64)nDataLen,FALSE);
+}
+/*
+ * Exported: xAppend() method.
+ */
+static int btree_kv_append(unqlite_kv_engine *pKv,const void *pKey,int nKeyLen,const void *pData,unqlite_int64 nDataLen)
+{
+	return btInsert((btree_kv_engine *)pKv,pKey,(sxu32)nKeyLen,pData,(sxu64)nDataLen,TRUE);
+}
+/*
+ * Allocate the working buffers for the given page size.
+ */
+static int btAllocBuffers(btree_kv_engine *pEngine,int iPageSize)
+{
+	sxu32 nSlot;
+	if( pEngine->zScratch ){
+		if( pEngine->iPageSize == iPageSize ){
+			return UNQLITE_OK;
+		}
+		SyMemBackendFree(&pEngine->sAllocator,pEngine->zScratch);
+	}
+	/* Upper bound on the number of cells of a page plus the one being inserted */
+	nSlot = (sxu32)iPageSize / (BT_CELL_HDR_SZ + 2) + 2;
+	pEngine->zScratch = (unsigned char *)SyMemBackendAlloc(&pEngine->sAllocator,
+		5 * (sxu32)iPageSize + 2 * nSlot * sizeof(sxu32));
+	if( pEngine->zScratch == 0 ){
+		return UNQLITE_NOMEM;
+	}
+	pEngine->zCell  = &pEngine->zScratch[iPageSize];
+	pEngine->zSep   = &pEngine->zScratch[2 * iPageSize];
+	pEngine->zSplit = &pEngine->zScratch[3 * iPageSize];
+	pEngine->aOfft  = (sxu32 *)&pEngine->zScratch[5 * iPageSize];
+	pEngine->aSize  = &pEngine->aOfft[nSlot];
+	pEngine->iPageSize = iPageSize;
+	pEngine->nMaxLocal = (sxu32)BT_MAX_LOCAL(iPageSize);
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xOpen() method.
+ */
+static int btree_kv_open(unqlite_kv_engine *pKv,pgno dbSize)
+{
+	btree_kv_engine *pEngine = (btree_kv_engine *)pKv;
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	unqlite_page *pHeader,*pRoot;
+	sxu32 nMagic;
+	int rc;
+	/* The page size of an existing database may differ from the default one */
+	rc = btAllocBuffers(pEngine,pIo->xPageSize(pIo->pHandle));
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	if( dbSize < 1 ){
+		/* A new database, create the header */
+		rc = pIo->xNew(pIo->pHandle,&pHeader);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		rc = pIo->xWrite(pHeader);
+		if( rc != UNQLITE_OK ){
+			pIo->xPageUnref(pHeader);
+			return rc;
+		}
+		SyZero(pHeader->zData,BT_HDR_FREE + 8);
+		SyBigEndianPack32(&pHeader->zData[BT_HDR_MAGIC],BT_MAGIC);
+		pEngine->pHeader = pHeader;
+		/* Empty root leaf */
+		rc = btAllocPage(pEngine,&pRoot);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		btInitNode(pEngine,pRoot->zData,BT_PAGE_LEAF);
+		rc = btHeaderSet(pEngine,BT_HDR_ROOT,pRoot->iPage);
+		pIo->xPageUnref(pRoot);
+		return rc;
+	}
+	/* Acquire the page one of the database */
+	rc = pIo->xGet(pIo->pHandle,1,&pHeader);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	SyBigEndianUnpack32(&pHeader->zData[BT_HDR_MAGIC],&nMagic);
+	if( nMagic != BT_MAGIC || btGet64(&pHeader->zData[BT_HDR_ROOT]) < 1 ){
+		/* Not a B+tree storage image */
+		pIo->xPageUnref(pHeader);
+		return UNQLITE_CORRUPT;
+	}
+	pEngine->pHeader = pHeader;
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xInit() method.
+ */
+static int btree_kv_init(unqlite_kv_engine *pKv,int iPageSize)
+{
+	btree_kv_engine *pEngine = (btree_kv_engine *)pKv;
+	/* This structure is always zeroed, go to the initialization directly */
+	SyMemBackendInitFromParent(&pEngine->sAllocator,unqliteExportMemBackend());
+	pEngine->iPageSize = iPageSize;
+	pEngine->nMaxLocal = (sxu32)BT_MAX_LOCAL(iPageSize);
+	/* Default comparison function */
+	pEngine->xCmp = SyMemcmp;
+	SyBlobInit(&pEngine->sKey,&pEngine->sAllocator);
+	SyBlobInit(&pEngine->sWorker,&pEngine->sAllocator);
+	/* Pages carry no private data */
+	pEngine->pIo->xSetUnpin(pEngine->pIo->pHandle,0);
+	pEngine->pIo->xSetReload(pEngine->pIo->pHandle,0);
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xRelease() method.
+ */
+static void btree_kv_release(unqlite_kv_engine *pKv)
+{
+	btree_kv_engine *pEngine = (btree_kv_engine *)pKv;
+	/* Release the private memory backend */
+	SyMemBackendRelease(&pEngine->sAllocator);
+}
+/*
+ * Exported: xConfig() method.
+ */
+static int btree_kv_config(unqlite_kv_engine *pKv,int op,va_list ap)
+{
+	btree_kv_engine *pEngine = (btree_kv_engine *)pKv;
+	int rc = UNQLITE_OK;
+	switch(op){
+	case UNQLITE_KV_CONFIG_CMP_FUNC: {
+		/* Key comparison function, must be set before any record is stored */
+		ProcCmp xCmp = va_arg(ap,ProcCmp);
+		if( xCmp ){
+			pEngine->xCmp = xCmp;
+		}
+		break;
+									 }
+	default:
+		/* Unknown OP */
+		rc = UNQLITE_UNKNOWN;
+		break;
+	}
+	return rc;
+}
+/*
+ * B+tree cursor.
+ * Cursors remember the key of the current record and not only its location
+ * so that they survive page splits and deletions: the position is re-established
+ * by a key lookup whenever the leaf page no longer holds that key.
+ */
+typedef struct btree_kv_cursor btree_kv_cursor;
+struct btree_kv_cursor
+{
+	unqlite_kv_engine *pStore; /* Must be first */
+	/* Private fields */
+	pgno iLeaf;                /* Leaf page of the current record */
+	int iCell;                 /* Cell index of the current record */
+	int bValid;                /* True if the cursor points to a record */
+	SyBlob sKey;               /* Key of the current record */
+};
+/*
+ * Point the cursor to the record at the given index of a leaf page. The index may
+ * be out of range, in which case the neighbour leaves are walked in the given direction.
+ * pLeaf is released by this function.
+ */
+static int btCursorSettle(btree_kv_cursor *pCur,unqlite_page *pLeaf,int iCell,int bForward)
+{
+	btree_kv_engine *pEngine = (btree_kv_engine *)pCur->pStore;
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	btcell sCell;
+	pgno iNext;
+	int rc;
+	for(;;){
+		if( iCell >= 0 && iCell < (int)btNodeCount(pLeaf->zData) ){
+			break;
+		}
+		/* Empty leaves are skipped */
+		iNext = bForward ? btNodeRight(pLeaf->zData) : btNodeLeft(pLeaf->zData);
+		pIo->xPageUnref(pLeaf);
+		pCur->bValid = FALSE;
+		if( iNext < 1 ){
+			return UNQLITE_DONE;
+		}
+		rc = pIo->xGet(pIo->pHandle,iNext,&pLeaf);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		if( pLeaf->zData[0] != BT_PAGE_LEAF ){
+			pIo->xPageUnref(pLeaf);
+			return UNQLITE_CORRUPT;
+		}
+		iCell = bForward ? 0 : (int)btNodeCount(pLeaf->zData) - 1;
+	}
+	/* Remember the key */
+	btParseCell(pEngine,pLeaf->zData,iCell,&sCell);
+	SyBlobReset(&pCur->sKey);
+	rc = btReadPayload(pEngine,&sCell,0,sCell.nKey,btBlobConsumer,&pCur->sKey);
+	pCur->iLeaf = pLeaf->iPage;
+	pCur->iCell = iCell;
+	pCur->bValid = rc == UNQLITE_OK;
+	pIo->xPageUnref(pLeaf);
+	return rc;
+}
+/*
+ * Locate the record the cursor points to. On return, *piCell is the index of
+ * the record in the leaf page, or the index of its successor if the record
+ * was deleted in which case *pExact is set to FALSE.
+ */
+static int btCursorRestore(btree_kv_cursor *pCur,unqlite_page **ppLeaf,int *piCell,int *pExact)
+{
+	btree_kv_engine *pEngine = (btree_kv_engine *)pCur->pStore;
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	const void *pKey = SyBlobData(&pCur->sKey);
+	sxu32 nKey = SyBlobLength(&pCur->sKey);
+	btpath aPath[BT_MAX_DEPTH];
+	unqlite_page *pLeaf;
+	const unsigned char *zPage;
+	btcell sCell;
+	int nPath,r;
+	sxu32 iOfft;
+	int rc;
+	rc = pIo->xGet(pIo->pHandle,pCur->iLeaf,&pLeaf);
+	if( rc == UNQLITE_OK ){
+		zPage = pLeaf->zData;
+		if( zPage[0] == BT_PAGE_LEAF && pCur->iCell < (int)btNodeCount(zPage) ){
+			iOfft = btCellOfft(zPage,pCur->iCell);
+			if( iOfft >= BT_PAGE_HDR_SZ && iOfft + BT_CELL_HDR_SZ <= (sxu32)pEngine->iPageSize ){
+				btParseCellAt(pEngine,&zPage[iOfft],TRUE,&sCell);
+				if( iOfft + sCell.nSize <= (sxu32)pEngine->iPageSize &&
+					btCompareKey(pEngine,&sCell,pKey,nKey,&r) == UNQLITE_OK && r == 0 ){
+					/* Fast path, the record did not move */
+					*ppLeaf = pLeaf;
+					*piCell = pCur->iCell;
+					*pExact = TRUE;
+					return UNQLITE_OK;
+				}
+			}
+		}
+		pIo->xPageUnref(pLeaf);
+	}
+	/* The tree was modified, seek to the saved key */
+	rc = btSeekLeaf(pEngine,pKey,nKey,aPath,&nPath,ppLeaf,piCell,pExact);
+	return rc;
+}
+/*
+ * Exported: xCursorInit() method.
+ */
+static void btCursorInit(unqlite_kv_cursor *pCursor)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	/* Survives engine resets */
+	SyBlobInit(&pCur->sKey,(SyMemBackend *)unqliteExportMemBackend());
+	pCur->bValid = FALSE;
+}
+/*
+ * Exported: xFirst() method.
+ */
+static int btCursorFirst(unqlite_kv_cursor *pCursor)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	unqlite_page *pLeaf;
+	int rc;
+	pCur->bValid = FALSE;
+	rc = btSeekEdge((btree_kv_engine *)pCur->pStore,FALSE,&pLeaf);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	return btCursorSettle(pCur,pLeaf,0,TRUE);
+}
+/*
+ * Exported: xLast() method.
+ */
+static int btCursorLast(unqlite_kv_cursor *pCursor)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	unqlite_page *pLeaf;
+	int rc;
+	pCur->bValid = FALSE;
+	rc = btSeekEdge((btree_kv_engine *)pCur->pStore,TRUE,&pLeaf);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	return btCursorSettle(pCur,pLeaf,(int)btNodeCount(pLeaf->zData) - 1,FALSE);
+}
+/*
+ * Exported: xSeek() method.
+ */
+static int btCursorSeek(unqlite_kv_cursor *pCursor,const void *pKey,int nByte,int iPos)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	btpath aPath[BT_MAX_DEPTH];
+	unqlite_page *pLeaf;
+	int nPath,iIdx,bExact;
+	int rc;
+	pCur->bValid = FALSE;
+	rc = btSeekLeaf((btree_kv_engine *)pCur->pStore,pKey,(sxu32)nByte,aPath,&nPath,&pLeaf,&iIdx,&bExact);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	switch(iPos){
+	case UNQLITE_CURSOR_MATCH_LE:
+		/* Largest key less than or equal to the target */
+		rc = btCursorSettle(pCur,pLeaf,bExact ? iIdx : iIdx - 1,FALSE);
+		break;
+	case UNQLITE_CURSOR_MATCH_GE:
+		/* Smallest key greater than or equal to the target */
+		rc = btCursorSettle(pCur,pLeaf,iIdx,TRUE);
+		break;
+	default:
+		if( !bExact ){
+			pCur->pStore->pIo->xPageUnref(pLeaf);
+			return UNQLITE_NOTFOUND;
+		}
+		rc = btCursorSettle(pCur,pLeaf,iIdx,TRUE);
+		break;
+	}
+	return rc == UNQLITE_DONE ? UNQLITE_NOTFOUND : rc;
+}
+/*
+ * Exported: xValid() method.
+ */
+static int btCursorValid(unqlite_kv_cursor *pCursor)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	return pCur->bValid;
+}
+/*
+ * Exported: xNext() method.
+ */
+static int btCursorNext(unqlite_kv_cursor *pCursor)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	unqlite_page *pLeaf;
+	int iCell,bExact;
+	int rc;
+	if( !pCur->bValid ){
+		return UNQLITE_DONE;
+	}
+	rc = btCursorRestore(pCur,&pLeaf,&iCell,&bExact);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	/* If the record was deleted, its successor is already the next one */
+	return btCursorSettle(pCur,pLeaf,bExact ? iCell + 1 : iCell,TRUE);
+}
+/*
+ * Exported: xPrev() method.
+ */
+static int btCursorPrev(unqlite_kv_cursor *pCursor)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	unqlite_page *pLeaf;
+	int iCell,bExact;
+	int rc;
+	if( !pCur->bValid ){
+		return UNQLITE_DONE;
+	}
+	rc = btCursorRestore(pCur,&pLeaf,&iCell,&bExact);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	return btCursorSettle(pCur,pLeaf,iCell - 1,FALSE);
+}
+/*
+ * Exported: xKeyLength() method.
+ */
+static int btCursorKeyLength(unqlite_kv_cursor *pCursor,int *pLen)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	if( !pCur->bValid ){
+		return UNQLITE_INVALID;
+	}
+	*pLen = (int)SyBlobLength(&pCur->sKey);
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xKey() method.
+ */
+static int btCursorKey(unqlite_kv_cursor *pCursor,int (*xConsumer)(const void *,unsigned int,void *),void *pUserData)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	int rc;
+	if( !pCur->bValid ){
+		return UNQLITE_INVALID;
+	}
+	/* The key is cached in the cursor */
+	rc = xConsumer(SyBlobData(&pCur->sKey),SyBlobLength(&pCur->sKey),pUserData);
+	return rc != UNQLITE_OK ? UNQLITE_ABORT : UNQLITE_OK;
+}
+/*
+ * Locate the cell of the current record.
+ */
+static int btCursorCell(btree_kv_cursor *pCur,unqlite_page **ppLeaf,btcell *pCell)
+{
+	int iCell,bExact;
+	int rc;
+	if( !pCur->bValid ){
+		return UNQLITE_INVALID;
+	}
+	rc = btCursorRestore(pCur,ppLeaf,&iCell,&bExact);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	if( !bExact ){
+		/* Deleted under the cursor */
+		pCur->pStore->pIo->xPageUnref(*ppLeaf);
+		return UNQLITE_NOTFOUND;
+	}
+	pCur->iLeaf = (*ppLeaf)->iPage;
+	pCur->iCell = iCell;
+	btParseCell((btree_kv_engine *)pCur->pStore,(*ppLeaf)->zData,iCell,pCell);
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xDataLength() method.
+ */
+static int btCursorDataLength(unqlite_kv_cursor *pCursor,unqlite_int64 *pLen)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	unqlite_page *pLeaf;
+	btcell sCell;
+	int rc;
+	rc = btCursorCell(pCur,&pLeaf,&sCell);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	*pLen = (unqlite_int64)sCell.nData;
+	pCur->pStore->pIo->xPageUnref(pLeaf);
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xData() method.
+ */
+static int btCursorData(unqlite_kv_cursor *pCursor,int (*xConsumer)(const void *,unsigned int,void *),void *pUserData)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	unqlite_page *pLeaf;
+	btcell sCell;
+	int rc;
+	rc = btCursorCell(pCur,&pLeaf,&sCell);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	rc = btReadPayload((btree_kv_engine *)pCur->pStore,&sCell,sCell.nKey,sCell.nData,xConsumer,pUserData);
+	pCur->pStore->pIo->xPageUnref(pLeaf);
+	return rc;
+}
+/*
+ * Exported: xDelete() method.
+ * The cursor is left pointing to the next record.
+ */
+static int btCursorDelete(unqlite_kv_cursor *pCursor)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	btree_kv_engine *pEngine = (btree_kv_engine *)pCur->pStore;
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	unqlite_page *pLeaf;
+	btcell sCell;
+	int rc;
+	rc = btCursorCell(pCur,&pLeaf,&sCell);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	rc = pIo->xWrite(pLeaf);
+	if( rc == UNQLITE_OK ){
+		rc = btFreeOverflow(pEngine,sCell.iOvfl);
+	}
+	if( rc != UNQLITE_OK ){
+		pIo->xPageUnref(pLeaf);
+		return rc;
+	}
+	/* Empty leaves are kept and skipped by the cursors */
+	btDropCell(pEngine,pLeaf->zData,pCur->iCell);
+	rc = btCursorSettle(pCur,pLeaf,pCur->iCell,TRUE);
+	return rc == UNQLITE_DONE ? UNQLITE_OK : rc;
+}
+/*
+ * Exported: xReset() method.
+ */
+static void btCursorReset(unqlite_kv_cursor *pCursor)
+{
+	btCursorFirst(pCursor);
+}
+/*
+ * Exported: xCursorRelease() method.
+ */
+static void btCursorRelease(unqlite_kv_cursor *pCursor)
+{
+	btree_kv_cursor *pCur = (btree_kv_cursor *)pCursor;
+	SyBlobRelease(&pCur->sKey);
+}
+/*
+ * Export the B+tree KV storage engine.
+ */
+UNQLITE_PRIVATE const unqlite_kv_methods * unqliteExportBtreeKvStorage(void)
+{
+	static const unqlite_kv_methods sBtreeStore = {
+		"btree",                    /* zName */
+		sizeof(btree_kv_engine),    /* szKv */
+		sizeof(btree_kv_cursor),    /* szCursor */
+		1,                          /* iVersion */
+		btree_kv_init,              /* xInit */
+		btree_kv_release,           /* xRelease */
+		btree_kv_config,            /* xConfig */
+		btree_kv_open,              /* xOpen */
+		btree_kv_replace,           /* xReplace */
+		btree_kv_append,            /* xAppend */
+		btCursorInit,               /* xCursorInit */
+		btCursorSeek,               /* xSeek */
+		btCursorFirst,              /* xFirst */
+		btCursorLast,               /* xLast */
+		btCursorValid,              /* xValid */
+		btCursorNext,               /* xNext */
+		btCursorPrev,               /* xPrev */
+		btCursorDelete,             /* xDelete */
+		btCursorKeyLength,          /* xKeyLength */
+		btCursorKey,                /* xKey */
+		btCursorDataLength,         /* xDataLength */
+		btCursorData,               /* xData */
+		btCursorReset,              /* xReset */
+		btCursorRelease,            /* xRelease */
+		0,                          /* xSync */
+		0,                          /* xBucket */
+		0,                          /* xDataRef */
+		0,                          /* xReserve */
+		0,                          /* xVacuum */
+		0                           /* bSharedRead */
+	};
+	return &sBtreeStore;
+}
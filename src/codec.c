@@ -0,0 +1,307 @@
+/*
+ * Symisc unQLite: An Embeddable NoSQL (Post Modern) Database Engine.
+ * Copyright (C) 2012-2026, Symisc Systems https://unqlite.symisc.net/
+ * Version 1.2.1
+ * For information on licensing, redistribution of this file, and for a DISCLAIMER OF ALL WARRANTIES
+ * please contact Symisc Systems via:
+ *       legal@symisc.net
+ *       licensing@symisc.net
+ *       contact@symisc.net
+ * or visit:
+ *      https://unqlite.symisc.net/licensing.html
+ */
+ /* $SymiscID: codec.c v1.0 Linux 2026-10-17 09:12 stable <chm@symisc.net> $ */
+#ifndef UNQLITE_AMALGAMATION
+#include "unqliteInt.h"
+#endif
+
+/*
+** This file implements the page compression layer used by the pager when
+** a page codec was selected at database creation (UNQLITE_CONFIG_PAGE_CODEC).
+**
+** Each page keeps its slot at (page number * page size) in the database file
+** so that the journal, the write-ahead log and the page cache are left
+** untouched. A page that compress well is stored at the start of its slot
+** behind a small header and the rest of the slot is handed back to the
+** file system (hole punching) so that it occupy fewer disk blocks and that
+** fewer bytes are read per lookup. A page that does not compress well is
+** stored raw and is recognized by the absence of the magic number:
+**
+**   4 byte magic number (UNQLITE_CODEC_MAGIC)
+**   4 byte compressed length
+**   4 byte checksum of the decompressed page
+**   compressed data
+**
+** The last UNQLITE_CODEC_RESERVE bytes of each page are reserved to the codec
+** (the storage engine is handed a shorter page). A raw page that start with
+** either magic number would be mistaken for a compressed or escaped image, so
+** its first 4 bytes are moved to the reserved tail and replaced by the escape
+** magic (UNQLITE_CODEC_ESCAPE). Any page can therefore be stored while a
+** damaged header is still reported as a corruption rather than served as data.
+**
+** The built-in "lz" codec is a byte oriented LZ77 compressor in the spirit
+** of LZ4: Fast, no entropy coding and a decoder that check every access.
+*/
+#define UNQLITE_CODEC_MAGIC  0x5A1C0DEC
+#define UNQLITE_CODEC_ESCAPE 0x5A1C0DED
+#define UNQLITE_CODEC_HDR_SZ (4/*Magic*/+4/*Compressed length*/+4/*Checksum*/)
+/*
+ * Adler-32 checksum of a decompressed page.
+ */
+static sxu32 CodecChecksum(const unsigned char *zIn,sxu32 nByte)
+{
+	sxu32 s1 = 1,s2 = 0;
+	sxu32 n;
+	while( nByte > 0 ){
+		/* Largest block that cannot overflow s2 */
+		n = nByte > 5552 ? 5552 : nByte;
+		nByte -= n;
+		while( n-- > 0 ){
+			s1 += *zIn++;
+			s2 += s1;
+		}
+		s1 %= 65521;
+		s2 %= 65521;
+	}
+	return (s2 << 16) | s1;
+}
+/*
+ * Compress a page image into zOut which must be at least nPage bytes long.
+ * Return the number of bytes of zOut to write at the start of the page slot
+ * (nPage for an escaped raw image) or zero when the page should be stored
+ * raw as is.
+ */
+UNQLITE_PRIVATE int unqliteCodecEncode(const unqlite_page_codec *pCodec,const unsigned char *zPage,int nPage,unsigned char *zOut)
+{
+	/* Not worth it unless an eighth of the page is saved */
+	int nMax = nPage - (nPage >> 3) - UNQLITE_CODEC_HDR_SZ;
+	int nUsable = nPage - UNQLITE_CODEC_RESERVE;
+	sxu32 iMagic;
+	int nByte;
+	nByte = pCodec->xCompress((const void *)zPage,nUsable,(void *)&zOut[UNQLITE_CODEC_HDR_SZ],nMax);
+	if( nByte > 0 && nByte <= nMax ){
+		SyBigEndianPack32(zOut,UNQLITE_CODEC_MAGIC);
+		SyBigEndianPack32(&zOut[4],(sxu32)nByte);
+		SyBigEndianPack32(&zOut[8],CodecChecksum(zPage,(sxu32)nUsable));
+		return nByte + UNQLITE_CODEC_HDR_SZ;
+	}
+	SyBigEndianUnpack32(zPage,&iMagic);
+	if( iMagic != UNQLITE_CODEC_MAGIC && iMagic != UNQLITE_CODEC_ESCAPE ){
+		/* Raw page */
+		return 0;
+	}
+	/* Would be taken for a compressed or escaped image, escape it */
+	SyMemcpy((const void *)zPage,zOut,(sxu32)nUsable);
+	SyMemcpy((const void *)zPage,&zOut[nUsable],4);
+	SyBigEndianPack32(zOut,UNQLITE_CODEC_ESCAPE);
+	return nPage;
+}
+/*
+ * Restore in place the page image read from its slot. zTmp is a work buffer
+ * of nPage bytes. Raw pages are left untouched.
+ * Return UNQLITE_CORRUPT if the compressed image cannot be restored.
+ */
+UNQLITE_PRIVATE int unqliteCodecDecode(const unqlite_page_codec *pCodec,unsigned char *zPage,int nPage,unsigned char *zTmp)
+{
+	int nUsable = nPage - UNQLITE_CODEC_RESERVE;
+	sxu32 iMagic,nByte,iCksum;
+	SyBigEndianUnpack32(zPage,&iMagic);
+	if( iMagic == UNQLITE_CODEC_ESCAPE ){
+		/* Escaped raw page, restore the leading bytes */
+		SyMemcpy((const void *)&zPage[nUsable],zPage,4);
+		SyZero(&zPage[nUsable],UNQLITE_CODEC_RESERVE);
+		return UNQLITE_OK;
+	}
+	if( iMagic != UNQLITE_CODEC_MAGIC ){
+		/* Raw page */
+		return UNQLITE_OK;
+	}
+	SyBigEndianUnpack32(&zPage[4],&nByte);
+	SyBigEndianUnpack32(&zPage[8],&iCksum);
+	if( nByte < 1 || nByte > (sxu32)(nPage - UNQLITE_CODEC_HDR_SZ) ){
+		return UNQLITE_CORRUPT;
+	}
+	if( pCodec->xDecompress((const void *)&zPage[UNQLITE_CODEC_HDR_SZ],(int)nByte,(void *)zTmp,nUsable) != nUsable ){
+		return UNQLITE_CORRUPT;
+	}
+	if( CodecChecksum(zTmp,(sxu32)nUsable) != iCksum ){
+		return UNQLITE_CORRUPT;
+	}
+	SyMemcpy((const void *)zTmp,zPage,(sxu32)nUsable);
+	SyZero(&zPage[nUsable],UNQLITE_CODEC_RESERVE);
+	return UNQLITE_OK;
+}
+/*
+ * Built-in "lz" codec.
+ * The compressed stream is a sequence of records:
+ *   1 byte token: Literal length (high nibble), match length minus LZ_MIN_MATCH (low nibble).
+ *   Literal length continuation bytes if the high nibble is 15 (255 means more to follow).
+ *   The literals.
+ *   2 byte little-endian match offset (absent in the last record).
+ *   Match length continuation bytes if the low nibble is 15.
+ */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_LOG  12
+#define LZ_MAX_OFFT  0xFFFF
+#define LZ_READ32(P) ((sxu32)(P)[0] | ((sxu32)(P)[1] << 8) | ((sxu32)(P)[2] << 16) | ((sxu32)(P)[3] << 24))
+/*
+ * Append a record to the compressed stream.
+ * Return the new end of the stream or NULL when the output buffer is full.
+ */
+static unsigned char * LzEmit(unsigned char *zOut,unsigned char *zEnd,const unsigned char *zLit,sxu32 nLit,sxu32 iOfft,sxu32 nMatch)
+{
+	sxu32 n;
+	if( (sxu32)(zEnd - zOut) < 1 + nLit + nLit / 255 + 1 + 2 + nMatch / 255 + 1 ){
+		return 0;
+	}
+	*zOut = (unsigned char)((nLit >= 15 ? 15 : nLit) << 4);
+	if( nMatch > 0 ){
+		n = nMatch - LZ_MIN_MATCH;
+		*zOut |= (unsigned char)(n >= 15 ? 15 : n);
+	}
+	zOut++;
+	if( nLit >= 15 ){
+		for( n = nLit - 15 ; n >= 255 ; n -= 255 ){
+			*zOut++ = 255;
+		}
+		*zOut++ = (unsigned char)n;
+	}
+	SyMemcpy((const void *)zLit,zOut,nLit);
+	zOut += nLit;
+	if( nMatch > 0 ){
+		zOut[0] = (unsigned char)(iOfft & 0xFF);
+		zOut[1] = (unsigned char)(iOfft >> 8);
+		zOut += 2;
+		if( nMatch - LZ_MIN_MATCH >= 15 ){
+			for( n = nMatch - LZ_MIN_MATCH - 15 ; n >= 255 ; n -= 255 ){
+				*zOut++ = 255;
+			}
+			*zOut++ = (unsigned char)n;
+		}
+	}
+	return zOut;
+}
+/*
+ * Compress nIn bytes into pOut. Return the compressed length or zero
+ * when the result does not fit in nOut bytes.
+ */
+static int LzCompress(const void *pIn,int nIn,void *pOut,int nOut)
+{
+	const unsigned char *zIn = (const unsigned char *)pIn;
+	const unsigned char *zEnd = &zIn[nIn];
+	const unsigned char *zAnchor = zIn;
+	const unsigned char *zPtr = zIn;
+	const unsigned char *zRef;
+	unsigned char *zOut = (unsigned char *)pOut;
+	unsigned char *zOutEnd = &zOut[nOut];
+	sxu32 aHash[1 << LZ_HASH_LOG];
+	sxu32 iHash,nMatch;
+	if( nIn < 1 || nOut < 1 ){
+		return 0;
+	}
+	/* Positions are recorded plus one so that zero means an empty slot */
+	SyZero(aHash,sizeof(aHash));
+	while( zEnd - zPtr > LZ_MIN_MATCH ){
+		iHash = (LZ_READ32(zPtr) * 2654435761U) >> (32 - LZ_HASH_LOG);
+		zRef = aHash[iHash] ? &zIn[aHash[iHash] - 1] : 0;
+		aHash[iHash] = (sxu32)(zPtr - zIn) + 1;
+		if( zRef == 0 || zPtr - zRef > LZ_MAX_OFFT || LZ_READ32(zRef) != LZ_READ32(zPtr) ){
+			zPtr++;
+			continue;
+		}
+		/* Extend the match */
+		nMatch = LZ_MIN_MATCH;
+		while( &zPtr[nMatch] < zEnd && zRef[nMatch] == zPtr[nMatch] ){
+			nMatch++;
+		}
+		zOut = LzEmit(zOut,zOutEnd,zAnchor,(sxu32)(zPtr - zAnchor),(sxu32)(zPtr - zRef),nMatch);
+		if( zOut == 0 ){
+			return 0;
+		}
+		zPtr += nMatch;
+		zAnchor = zPtr;
+	}
+	/* Trailing literals */
+	zOut = LzEmit(zOut,zOutEnd,zAnchor,(sxu32)(zEnd - zAnchor),0,0);
+	if( zOut == 0 ){
+		return 0;
+	}
+	return (int)(zOut - (unsigned char *)pOut);
+}
+/*
+ * Decompress nIn bytes into pOut. Return the decompressed length
+ * or -1 on malformed input.
+ */
+static int LzDecompress(const void *pIn,int nIn,void *pOut,int nOut)
+{
+	const unsigned char *zIn = (const unsigned char *)pIn;
+	const unsigned char *zEnd = &zIn[nIn];
+	unsigned char *zStart = (unsigned char *)pOut;
+	unsigned char *zOutEnd = &zStart[nOut];
+	unsigned char *zOut = zStart;
+	sxu32 nLit,nMatch,iOfft,c;
+	int iToken;
+	while( zIn < zEnd ){
+		iToken = *zIn++;
+		/* Literals */
+		nLit = (sxu32)(iToken >> 4);
+		if( nLit == 15 ){
+			do{
+				if( zIn >= zEnd ){
+					return -1;
+				}
+				c = *zIn++;
+				nLit += c;
+			}while( c == 255 );
+		}
+		if( nLit > (sxu32)(zEnd - zIn) || nLit > (sxu32)(zOutEnd - zOut) ){
+			return -1;
+		}
+		SyMemcpy((const void *)zIn,zOut,nLit);
+		zIn += nLit;
+		zOut += nLit;
+		if( zIn >= zEnd ){
+			/* Last record */
+			break;
+		}
+		/* Match */
+		if( zEnd - zIn < 2 ){
+			return -1;
+		}
+		iOfft = (sxu32)zIn[0] | ((sxu32)zIn[1] << 8);
+		zIn += 2;
+		nMatch = (sxu32)(iToken & 15);
+		if( nMatch == 15 ){
+			do{
+				if( zIn >= zEnd ){
+					return -1;
+				}
+				c = *zIn++;
+				nMatch += c;
+			}while( c == 255 );
+		}
+		nMatch += LZ_MIN_MATCH;
+		if( iOfft < 1 || iOfft > (sxu32)(zOut - zStart) || nMatch > (sxu32)(zOutEnd - zOut) ){
+			return -1;
+		}
+		/* Byte by byte, the source may overlap the destination */
+		while( nMatch-- > 0 ){
+			*zOut = zOut[-(sxi32)iOfft];
+			zOut++;
+		}
+	}
+	return (int)(zOut - zStart);
+}
+/*
+ * Export the built-in page codec.
+ */
+UNQLITE_PRIVATE const unqlite_page_codec * unqliteExportLzCodec(void)
+{
+	static const unqlite_page_codec sLzCodec = {
+		"lz",          /* zName */
+		1,             /* iVersion */
+		LzCompress,    /* xCompress */
+		LzDecompress   /* xDecompress */
+	};
+	return &sLzCodec;
+}
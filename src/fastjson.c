@@ -24,6 +24,21 @@
 #endif /* UNQLITE_FAST_JSON_NEST_LIMIT */
 /* 
  * JSON to Binary using the FastJSON implementation (BigEndian).
+ *
+ * Two encodings are understood. Version 1 records are a raw token stream where
+ * objects and arrays are delimited by start/end tokens, strings carry a 4 bytes
+ * length and reals are stored as text. Version 2 records (the one produced by
+ * FastJsonEncode()) start with the FJSON_VERSION_2 marker and a flags byte,
+ * followed by an optional sorted key dictionary and the root value:
+ *
+ *   record     := FJSON_VERSION_2 flags [dictionary] value
+ *   dictionary := Big32(length) (varint(len) key-bytes)*  (sorted, distinct)
+ *   object     := FJSON_DOC2 Big32(length) (key value)*
+ *   array      := FJSON_ARRAY2 Big32(length) value*
+ *   key        := FJSON_KEY2 varint(dictionary offset) | string | integer
+ *
+ * Container lengths let readers jump over a subtree in O(1), integers are
+ * zigzag varints and reals raw IEEE-754 doubles.
  */
 /*
  * FastJSON implemented binary token.
@@ -38,17 +53,172 @@
 #define FJSON_STRING       8 /* String + 4 bytes length */
 #define FJSON_BYTE         9 /* Byte */
 #define FJSON_INT64       10 /* Integer 64 + 8 bytes */
+#define FJSON_DOC2        11 /* Object + 4 bytes length [version 2] */
+#define FJSON_ARRAY2      12 /* Array + 4 bytes length [version 2] */
+#define FJSON_INT2        13 /* Zigzag varint integer [version 2] */
+#define FJSON_REAL2       14 /* IEEE-754 double + 8 bytes [version 2] */
+#define FJSON_STRING2     15 /* String + varint length [version 2] */
+#define FJSON_KEY2        16 /* Dictionary key + varint offset [version 2] */
 #define FJSON_REAL        18 /* Floating point value + 2 bytes */
 #define FJSON_NULL        23 /* NULL */
 #define FJSON_TRUE        24 /* TRUE */
 #define FJSON_FALSE       25 /* FALSE */
 /*
- * Encode a Jx9 value to binary JSON.
+ * Version 2 record marker and header flags.
  */
-UNQLITE_PRIVATE sxi32 FastJsonEncode(
-	jx9_value *pValue, /* Value to encode */
-	SyBlob *pOut,      /* Store encoded value here */
-	int iNest          /* Nesting limit */ 
+#define FJSON_VERSION_2   0x82
+#define FJSON_FLAG_DICT   0x01 /* A key dictionary follows the header */
+/*
+ * Append a variable length (LEB128) integer.
+ */
+static sxi32 FastJsonPutVarint(SyBlob *pOut,sxu64 iVal)
+{
+	unsigned char zBuf[10];
+	sxu32 n = 0;
+	for(;;){
+		zBuf[n] = (unsigned char)(iVal & 0x7F);
+		iVal >>= 7;
+		if( iVal == 0 ){
+			break;
+		}
+		zBuf[n++] |= 0x80;
+	}
+	return SyBlobAppend(pOut,(const void *)zBuf,n+1);
+}
+/*
+ * Read a variable length integer. Return a pointer past it or NULL on corrupt input.
+ */
+static const unsigned char * FastJsonGetVarint(const unsigned char *zIn,const unsigned char *zEnd,sxu64 *pVal)
+{
+	sxu64 iVal = 0;
+	int iShift = 0;
+	while( zIn < zEnd && iShift < 64 ){
+		iVal |= ((sxu64)(zIn[0] & 0x7F)) << iShift;
+		if( (zIn[0] & 0x80) == 0 ){
+			*pVal = iVal;
+			return &zIn[1];
+		}
+		zIn++;
+		iShift += 7;
+	}
+	return 0;
+}
+/*
+ * Zigzag mapping of signed integers so that small magnitudes get short varints.
+ */
+#define FJSON_ZIGZAG(I)   ( (((sxu64)(I)) << 1) ^ ((I) < 0 ? ~(sxu64)0 : 0) )
+#define FJSON_UNZIGZAG(U) ( (jx9_int64)(((U) >> 1) ^ ((sxu64)0 - ((U) & 1))) )
+/*
+ * Encoder state: the key dictionary under construction.
+ */
+typedef struct fjson_key fjson_key;
+struct fjson_key
+{
+	sxu32 iOfft;  /* Key offset in sArena */
+	sxu32 nByte;  /* Key length */
+	sxu32 iDict;  /* Key offset in the encoded dictionary */
+};
+typedef struct fjson_encoder fjson_encoder;
+struct fjson_encoder
+{
+	SyBlob sArena;  /* Distinct key names */
+	SySet aKey;     /* Distinct keys sorted by name (fjson_key instances) */
+	jx9_value sKey; /* Key extraction buffer */
+	int bDict;      /* True when keys are encoded as dictionary references */
+	sxu32 nDup;     /* Number of repeated key occurrences */
+};
+/*
+ * Binary search a key in the sorted dictionary. Return SXRET_OK and its index
+ * in *pIdx if found, SXERR_NOTFOUND and the insertion point otherwise.
+ */
+static sxi32 FastJsonKeyFind(fjson_encoder *pEnc,const char *zKey,sxu32 nByte,sxu32 *pIdx)
+{
+	fjson_key *aKey = (fjson_key *)SySetBasePtr(&pEnc->aKey);
+	const char *zArena = (const char *)SyBlobData(&pEnc->sArena);
+	sxu32 iLo = 0,iHi = SySetUsed(&pEnc->aKey),iMid,n;
+	sxi32 rc;
+	while( iLo < iHi ){
+		iMid = (iLo + iHi) >> 1;
+		n = aKey[iMid].nByte < nByte ? aKey[iMid].nByte : nByte;
+		rc = n > 0 ? SyMemcmp(&zArena[aKey[iMid].iOfft],zKey,n) : 0;
+		if( rc == 0 ){
+			rc = aKey[iMid].nByte < nByte ? -1 : (aKey[iMid].nByte > nByte ? 1 : 0);
+		}
+		if( rc == 0 ){
+			*pIdx = iMid;
+			return SXRET_OK;
+		}
+		if( rc < 0 ){
+			iLo = iMid + 1;
+		}else{
+			iHi = iMid;
+		}
+	}
+	*pIdx = iLo;
+	return SXERR_NOTFOUND;
+}
+/*
+ * Collect the distinct object keys of a value in the sorted dictionary.
+ */
+static sxi32 FastJsonGatherKeys(fjson_encoder *pEnc,jx9_value *pValue,int iNest)
+{
+	jx9_hashmap_node *pNode;
+	jx9_hashmap *pMap;
+	fjson_key *aKey,sNew;
+	sxu32 nIdx,n;
+	sxi32 rc;
+	if( (pValue->iFlags & MEMOBJ_HASHMAP) == 0 ){
+		return SXRET_OK;
+	}
+	if( iNest >= UNQLITE_FAST_JSON_NEST_LIMIT ){
+		/* Nesting limit reached */
+		return SXERR_LIMIT;
+	}
+	pMap = (jx9_hashmap *)pValue->x.pOther;
+	jx9HashmapResetLoopCursor(pMap);
+	while((pNode = jx9HashmapGetNextEntry(pMap)) != 0 ){
+		if( pMap->iFlags & HASHMAP_JSON_OBJECT ){
+			jx9HashmapExtractNodeKey(pNode,&pEnc->sKey);
+			if( pEnc->sKey.iFlags & MEMOBJ_STRING ){
+				const char *zKey = (const char *)SyBlobData(&pEnc->sKey.sBlob);
+				sxu32 nByte = SyBlobLength(&pEnc->sKey.sBlob);
+				if( FastJsonKeyFind(pEnc,zKey,nByte,&nIdx) == SXRET_OK ){
+					pEnc->nDup++;
+				}else{
+					/* New key, insert it at its sorted position */
+					sNew.iOfft = SyBlobLength(&pEnc->sArena);
+					sNew.nByte = nByte;
+					sNew.iDict = 0;
+					rc = SyBlobAppend(&pEnc->sArena,(const void *)zKey,nByte);
+					if( rc == SXRET_OK ){
+						rc = SySetPut(&pEnc->aKey,(const void *)&sNew);
+					}
+					if( rc != SXRET_OK ){
+						return rc;
+					}
+					aKey = (fjson_key *)SySetBasePtr(&pEnc->aKey);
+					for( n = SySetUsed(&pEnc->aKey) - 1 ; n > nIdx ; --n ){
+						aKey[n] = aKey[n-1];
+					}
+					aKey[nIdx] = sNew;
+				}
+			}
+		}
+		rc = FastJsonGatherKeys(pEnc,jx9HashmapGetNodeValue(pNode),iNest+1);
+		if( rc != SXRET_OK ){
+			return rc;
+		}
+	}
+	return SXRET_OK;
+}
+/*
+ * Encode a Jx9 value to version 2 binary JSON.
+ */
+static sxi32 FastJsonEncodeValue(
+	fjson_encoder *pEnc, /* Encoder state */
+	jx9_value *pValue,   /* Value to encode */
+	SyBlob *pOut,        /* Store encoded value here */
+	int iNest            /* Nesting limit */ 
 	)
 {
 	sxi32 iType = pValue ? pValue->iFlags : MEMOBJ_NULL;
@@ -68,121 +238,248 @@ UNQLITE_PRIVATE sxi32 FastJsonEncode(
 		c = pValue->x.iVal ? FJSON_TRUE : FJSON_FALSE;
 		rc = SyBlobAppend(pOut,(const void *)&c,sizeof(char));
 	}else if( iType & MEMOBJ_STRING ){
-		unsigned char zBuf[sizeof(sxu32)]; /* String length */
-		c = FJSON_STRING;
-		SyBigEndianPack32(zBuf,SyBlobLength(&pValue->sBlob));
+		c = FJSON_STRING2;
 		rc = SyBlobAppend(pOut,(const void *)&c,sizeof(char));
 		if( rc == SXRET_OK ){
-			rc = SyBlobAppend(pOut,(const void *)zBuf,sizeof(zBuf));
+			rc = FastJsonPutVarint(pOut,(sxu64)SyBlobLength(&pValue->sBlob));
 			if( rc == SXRET_OK ){
 				rc = SyBlobAppend(pOut,SyBlobData(&pValue->sBlob),SyBlobLength(&pValue->sBlob));
 			}
 		}
 	}else if( iType & MEMOBJ_INT ){
-		unsigned char zBuf[8];
-		/* 64bit big endian integer */
-		c = FJSON_INT64;
+		/* Zigzag varint */
+		c = FJSON_INT2;
 		rc = SyBlobAppend(pOut,(const void *)&c,sizeof(char));
 		if( rc == SXRET_OK ){
-			SyBigEndianPack64(zBuf,(sxu64)pValue->x.iVal);
-			rc = SyBlobAppend(pOut,(const void *)zBuf,sizeof(zBuf));
+			rc = FastJsonPutVarint(pOut,FJSON_ZIGZAG(pValue->x.iVal));
 		}
 	}else if( iType & MEMOBJ_REAL ){
-		/* Real number */
-		c = FJSON_REAL;
+		/* Raw 64-bit IEEE-754 double */
+		unsigned char zBuf[8];
+		sxu64 iBits;
+		c = FJSON_REAL2;
 		rc = SyBlobAppend(pOut,(const void *)&c,sizeof(char));
 		if( rc == SXRET_OK ){
-			sxu32 iOfft = SyBlobLength(pOut);
-			rc = SyBlobAppendBig16(pOut,0);
-			if( rc == SXRET_OK ){
-				unsigned char *zBlob;
-				SyBlobFormat(pOut,"%.15g",pValue->x.rVal);
-				zBlob = (unsigned char *)SyBlobDataAt(pOut,iOfft);
-				SyBigEndianPack16(zBlob,(sxu16)(SyBlobLength(pOut) - ( 2 + iOfft)));
-			}
+			SyMemcpy((const void *)&pValue->x.rVal,(void *)&iBits,sizeof(iBits));
+			SyBigEndianPack64(zBuf,iBits);
+			rc = SyBlobAppend(pOut,(const void *)zBuf,sizeof(zBuf));
 		}
 	}else if( iType & MEMOBJ_HASHMAP ){
 		/* A JSON object or array */
 		jx9_hashmap *pMap = (jx9_hashmap *)pValue->x.pOther;
 		jx9_hashmap_node *pNode;
-		jx9_value *pEntry;
+		sxu32 iOfft;
+		int bObject = (pMap->iFlags & HASHMAP_JSON_OBJECT) ? 1 : 0;
+		c = bObject ? FJSON_DOC2 : FJSON_ARRAY2;
+		rc = SyBlobAppend(pOut,(const void *)&c,sizeof(char));
+		if( rc == SXRET_OK ){
+			/* Reserve room for the container length */
+			iOfft = SyBlobLength(pOut);
+			rc = SyBlobAppendBig32(pOut,0);
+		}
+		if( rc != SXRET_OK ){
+			return rc;
+		}
 		/* Reset the hashmap loop cursor */
 		jx9HashmapResetLoopCursor(pMap);
-		if( pMap->iFlags & HASHMAP_JSON_OBJECT ){
-			jx9_value sKey;
-			/* A JSON object */
-			c = FJSON_DOC_START; /* { */
-			rc = SyBlobAppend(pOut,(const void *)&c,sizeof(char));
-			if( rc == SXRET_OK ){
-				jx9MemObjInit(pMap->pVm,&sKey);
-				/* Encode object entries */
-				while((pNode = jx9HashmapGetNextEntry(pMap)) != 0 ){
-					/* Extract the key */
-					jx9HashmapExtractNodeKey(pNode,&sKey);
-					/* Encode it */
-					rc = FastJsonEncode(&sKey,pOut,iNest+1);
-					if( rc != SXRET_OK ){
-						break;
-					}
-					c = FJSON_COLON;
-					rc = SyBlobAppend(pOut,(const void *)&c,sizeof(char));
-					if( rc != SXRET_OK ){
-						break;
-					}
-					/* Extract the value */
-					pEntry = jx9HashmapGetNodeValue(pNode);
-					/* Encode it */
-					rc = FastJsonEncode(pEntry,pOut,iNest+1);
-					if( rc != SXRET_OK ){
+		while( (pNode = jx9HashmapGetNextEntry(pMap)) != 0 ){
+			if( bObject ){
+				/* Encode the key */
+				jx9HashmapExtractNodeKey(pNode,&pEnc->sKey);
+				if( (pEnc->sKey.iFlags & MEMOBJ_STRING) && pEnc->bDict ){
+					fjson_key *pKey;
+					sxu32 nIdx;
+					if( FastJsonKeyFind(pEnc,(const char *)SyBlobData(&pEnc->sKey.sBlob),SyBlobLength(&pEnc->sKey.sBlob),&nIdx) != SXRET_OK ){
+						/* Cannot happen, all keys were gathered */
+						rc = SXERR_CORRUPT;
 						break;
 					}
-					/* Delimit the entry */
-					c = FJSON_COMMA;
+					pKey = (fjson_key *)SySetAt(&pEnc->aKey,nIdx);
+					c = FJSON_KEY2;
 					rc = SyBlobAppend(pOut,(const void *)&c,sizeof(char));
-					if( rc != SXRET_OK ){
-						break;
+					if( rc == SXRET_OK ){
+						rc = FastJsonPutVarint(pOut,(sxu64)pKey->iDict);
 					}
+				}else{
+					rc = FastJsonEncodeValue(pEnc,&pEnc->sKey,pOut,iNest+1);
 				}
-				jx9MemObjRelease(&sKey);
-				if( rc == SXRET_OK ){
-					c = FJSON_DOC_END; /* } */
-					rc = SyBlobAppend(pOut,(const void *)&c,sizeof(char));
+				if( rc != SXRET_OK ){
+					break;
 				}
 			}
-		}else{
-			/* A JSON array */
-			c = FJSON_ARRAY_START; /* [ */
-			rc = SyBlobAppend(pOut,(const void *)&c,sizeof(char));
+			/* Encode the value */
+			rc = FastJsonEncodeValue(pEnc,jx9HashmapGetNodeValue(pNode),pOut,iNest+1);
+			if( rc != SXRET_OK ){
+				break;
+			}
+		}
+		if( rc == SXRET_OK ){
+			SyBigEndianPack32((unsigned char *)SyBlobDataAt(pOut,iOfft),SyBlobLength(pOut) - (iOfft + 4));
+		}
+	}
+	return rc;
+}
+/*
+ * Encode a Jx9 value to binary JSON (version 2).
+ * A sorted dictionary of the object keys is emitted when nested
+ * objects repeat the same keys.
+ */
+UNQLITE_PRIVATE sxi32 FastJsonEncode(
+	jx9_value *pValue, /* Value to encode */
+	SyBlob *pOut,      /* Store encoded value here */
+	int iNest          /* Nesting limit */ 
+	)
+{
+	fjson_encoder sEnc;
+	unsigned char zHdr[2];
+	jx9_vm *pVm;
+	sxi32 rc;
+	if( pValue == 0 || (pValue->iFlags & MEMOBJ_HASHMAP) == 0 ){
+		/* Scalar, no dictionary */
+		zHdr[0] = FJSON_VERSION_2;
+		zHdr[1] = 0;
+		rc = SyBlobAppend(pOut,(const void *)zHdr,sizeof(zHdr));
+		if( rc == SXRET_OK ){
+			rc = FastJsonEncodeValue(0,pValue,pOut,iNest);
+		}
+		return rc;
+	}
+	pVm = pValue->pVm;
+	SyBlobInit(&sEnc.sArena,&pVm->sAllocator);
+	SySetInit(&sEnc.aKey,&pVm->sAllocator,sizeof(fjson_key));
+	jx9MemObjInit(pVm,&sEnc.sKey);
+	sEnc.bDict = 0;
+	sEnc.nDup = 0;
+	rc = SXRET_OK;
+	{
+		/* Only documents holding nested containers may repeat keys */
+		jx9_hashmap *pMap = (jx9_hashmap *)pValue->x.pOther;
+		jx9_hashmap_node *pNode;
+		jx9HashmapResetLoopCursor(pMap);
+		while( (pNode = jx9HashmapGetNextEntry(pMap)) != 0 ){
+			if( jx9HashmapGetNodeValue(pNode)->iFlags & MEMOBJ_HASHMAP ){
+				rc = FastJsonGatherKeys(&sEnc,pValue,iNest);
+				break;
+			}
+		}
+	}
+	zHdr[0] = FJSON_VERSION_2;
+	zHdr[1] = (rc == SXRET_OK && sEnc.nDup > 0) ? FJSON_FLAG_DICT : 0;
+	rc = SyBlobAppend(pOut,(const void *)zHdr,sizeof(zHdr));
+	if( rc == SXRET_OK && zHdr[1] & FJSON_FLAG_DICT ){
+		fjson_key *aKey = (fjson_key *)SySetBasePtr(&sEnc.aKey);
+		sxu32 iOfft,iStart,n;
+		/* Emit the sorted dictionary */
+		iOfft = SyBlobLength(pOut);
+		rc = SyBlobAppendBig32(pOut,0);
+		iStart = iOfft + 4;
+		for( n = 0 ; rc == SXRET_OK && n < SySetUsed(&sEnc.aKey) ; ++n ){
+			aKey[n].iDict = SyBlobLength(pOut) - iStart;
+			rc = FastJsonPutVarint(pOut,(sxu64)aKey[n].nByte);
 			if( rc == SXRET_OK ){
-				/* Encode array entries */
-				while( (pNode = jx9HashmapGetNextEntry(pMap)) != 0 ){
-					/* Extract the value */
-					pEntry = jx9HashmapGetNodeValue(pNode);
-					/* Encode it */
-					rc = FastJsonEncode(pEntry,pOut,iNest+1);
-					if( rc != SXRET_OK ){
-						break;
-					}
-					/* Delimit the entry */
-					c = FJSON_COMMA;
-					rc = SyBlobAppend(pOut,(const void *)&c,sizeof(char));
-					if( rc != SXRET_OK ){
-						break;
-					}
-				}
-				if( rc == SXRET_OK ){
-					c = FJSON_ARRAY_END; /* ] */
-					rc = SyBlobAppend(pOut,(const void *)&c,sizeof(char));
-				}
+				rc = SyBlobAppend(pOut,SyBlobDataAt(&sEnc.sArena,aKey[n].iOfft),aKey[n].nByte);
 			}
 		}
+		if( rc == SXRET_OK ){
+			SyBigEndianPack32((unsigned char *)SyBlobDataAt(pOut,iOfft),SyBlobLength(pOut) - iStart);
+			sEnc.bDict = 1;
+		}
+	}
+	if( rc == SXRET_OK ){
+		rc = FastJsonEncodeValue(&sEnc,pValue,pOut,iNest);
 	}
+	jx9MemObjRelease(&sEnc.sKey);
+	SySetRelease(&sEnc.aKey);
+	SyBlobRelease(&sEnc.sArena);
 	return rc;
 }
 /*
- * Decode a FastJSON binary blob.
+ * Decoder state: the key dictionary of a version 2 record.
  */
-UNQLITE_PRIVATE sxi32 FastJsonDecode(
+typedef struct fjson_doc fjson_doc;
+struct fjson_doc
+{
+	const unsigned char *zDict;    /* First dictionary entry or NULL */
+	const unsigned char *zDictEnd; /* End of the dictionary */
+};
+/*
+ * Parse the header of a binary JSON record. On success, *pzRoot points
+ * to the root value. Records without header are version 1 records.
+ */
+static sxi32 FastJsonOpen(const unsigned char *zIn,const unsigned char *zEnd,fjson_doc *pDoc,const unsigned char **pzRoot)
+{
+	sxu32 nLen;
+	pDoc->zDict = pDoc->zDictEnd = 0;
+	if( zIn >= zEnd || zIn[0] != FJSON_VERSION_2 ){
+		/* Version 1 record */
+		*pzRoot = zIn;
+		return SXRET_OK;
+	}
+	if( &zIn[2] > zEnd ){
+		return SXERR_CORRUPT;
+	}
+	if( zIn[1] & FJSON_FLAG_DICT ){
+		if( &zIn[6] > zEnd ){
+			return SXERR_CORRUPT;
+		}
+		SyBigEndianUnpack32(&zIn[2],&nLen);
+		if( nLen > (sxu32)(zEnd - &zIn[6]) ){
+			return SXERR_CORRUPT;
+		}
+		pDoc->zDict = &zIn[6];
+		pDoc->zDictEnd = &zIn[6+nLen];
+		*pzRoot = pDoc->zDictEnd;
+	}else{
+		*pzRoot = &zIn[2];
+	}
+	return SXRET_OK;
+}
+/*
+ * Extract a version 2 string (FJSON_STRING2 or FJSON_KEY2). On success,
+ * *pzPtr points past the token.
+ */
+static sxi32 FastJsonGetString(
+	const fjson_doc *pDoc,     /* Record dictionary */
+	const unsigned char *zIn,  /* FJSON_STRING2 or FJSON_KEY2 token */
+	const unsigned char *zEnd, /* End of input */
+	const char **pzStr,        /* OUT: String bytes */
+	sxu32 *pnLen,              /* OUT: String length */
+	const unsigned char **pzPtr
+	)
+{
+	const unsigned char *zStr;
+	sxu64 iVal;
+	int c = zIn[0];
+	zIn = FastJsonGetVarint(&zIn[1],zEnd,&iVal);
+	if( zIn == 0 ){
+		return SXERR_CORRUPT;
+	}
+	if( c == FJSON_KEY2 ){
+		/* Dictionary reference */
+		if( pDoc == 0 || pDoc->zDict == 0 || iVal >= (sxu64)(pDoc->zDictEnd - pDoc->zDict) ){
+			return SXERR_CORRUPT;
+		}
+		zStr = FastJsonGetVarint(&pDoc->zDict[iVal],pDoc->zDictEnd,&iVal);
+		if( zStr == 0 || iVal > (sxu64)(pDoc->zDictEnd - zStr) ){
+			return SXERR_CORRUPT;
+		}
+		*pzPtr = zIn;
+	}else{
+		if( iVal > (sxu64)(zEnd - zIn) ){
+			return SXERR_CORRUPT;
+		}
+		zStr = zIn;
+		*pzPtr = &zIn[iVal];
+	}
+	*pzStr = (const char *)zStr;
+	*pnLen = (sxu32)iVal;
+	return SXRET_OK;
+}
+/*
+ * Decode a binary JSON value (Version 1 or 2 token).
+ */
+static sxi32 FastJsonDecodeValue(
+	const fjson_doc *pDoc, /* Record dictionary */
 	const void *pIn,  /* Binary JSON  */
 	sxu32 nByte,      /* Chunk delimiter */
 	jx9_value *pOut,  /* Decoded value */
@@ -198,6 +495,9 @@ UNQLITE_PRIVATE sxi32 FastJsonDecode(
 		/* Nesting limit reached */
 		return SXERR_LIMIT;
 	}
+	if( nByte < 1 ){
+		return SXERR_CORRUPT;
+	}
 	c = zIn[0];
 	/* Advance the stream cursor */
 	zIn++;
@@ -230,6 +530,18 @@ UNQLITE_PRIVATE sxi32 FastJsonDecode(
 		jx9_value_int64(pOut,(jx9_int64)iVal);
 		break;
 					  }
+	case FJSON_INT2: {
+		/* Zigzag varint */
+		sxu64 iVal;
+		zIn = FastJsonGetVarint(zIn,zEnd,&iVal);
+		if( zIn == 0 ){
+			rc = SXERR_CORRUPT;
+			zIn = zEnd;
+			break;
+		}
+		jx9_value_int64(pOut,FJSON_UNZIGZAG(iVal));
+		break;
+					 }
 	case FJSON_REAL: {
 		/* Real number */
 		double iVal = 0; /* cc warning */
@@ -253,6 +565,20 @@ UNQLITE_PRIVATE sxi32 FastJsonDecode(
 		jx9_value_double(pOut,iVal);
 		break;
 					 }
+	case FJSON_REAL2: {
+		/* IEEE-754 double */
+		double rVal;
+		sxu64 iBits;
+		if( &zIn[8] > zEnd ){
+			rc = SXERR_CORRUPT;
+			break;
+		}
+		SyBigEndianUnpack64(zIn,&iBits);
+		SyMemcpy((const void *)&iBits,(void *)&rVal,sizeof(rVal));
+		zIn += 8;
+		jx9_value_double(pOut,rVal);
+		break;
+					  }
 	case FJSON_STRING: {
 		/* UTF-8/Binary chunk */
 		sxu32 iLength;
@@ -279,6 +605,23 @@ UNQLITE_PRIVATE sxi32 FastJsonDecode(
 		zIn += iLength;
 		break;
 					   }
+	case FJSON_STRING2:
+	case FJSON_KEY2: {
+		/* Inline string or dictionary key */
+		const char *zStr;
+		sxu32 iLength;
+		rc = FastJsonGetString(pDoc,&zIn[-1],zEnd,&zStr,&iLength,&zIn);
+		if( rc != SXRET_OK ){
+			break;
+		}
+		/* Invalidate any prior representation */
+		if( pOut->iFlags & MEMOBJ_STRING ){
+			/* Reset the string cursor */
+			SyBlobReset(&pOut->sBlob);
+		}
+		rc = jx9MemObjStringAppend(pOut,zStr,iLength);
+		break;
+					 }
 	case FJSON_ARRAY_START: {
 		/* Binary JSON array */
 		jx9_hashmap *pMap;
@@ -306,7 +649,7 @@ UNQLITE_PRIVATE sxi32 FastJsonDecode(
 				break;
 			}
 			/* Decode the value */
-			rc = FastJsonDecode((const void *)zIn,(sxu32)(zEnd-zIn),&sVal,&zIn,iNest+1);
+			rc = FastJsonDecodeValue(pDoc,(const void *)zIn,(sxu32)(zEnd-zIn),&sVal,&zIn,iNest+1);
 			if( rc != SXRET_OK ){
 				break;
 			}
@@ -350,7 +693,7 @@ UNQLITE_PRIVATE sxi32 FastJsonDecode(
 				break;
 			}
 			/* Extract the key */
-			rc = FastJsonDecode((const void *)zIn,(sxu32)(zEnd-zIn),&sKey,&zIn,iNest+1);
+			rc = FastJsonDecodeValue(pDoc,(const void *)zIn,(sxu32)(zEnd-zIn),&sKey,&zIn,iNest+1);
 			if( rc != UNQLITE_OK ){
 				break;
 			}
@@ -364,7 +707,7 @@ UNQLITE_PRIVATE sxi32 FastJsonDecode(
 				break;
 			}
 			/* Decode the value */
-			rc = FastJsonDecode((const void *)zIn,(sxu32)(zEnd-zIn),&sVal,&zIn,iNest+1);
+			rc = FastJsonDecodeValue(pDoc,(const void *)zIn,(sxu32)(zEnd-zIn),&sVal,&zIn,iNest+1);
 			if( rc != SXRET_OK ){
 				break;
 			}
@@ -381,6 +724,66 @@ UNQLITE_PRIVATE sxi32 FastJsonDecode(
 		jx9MemObjRelease(&sKey);
 		break;
 						  }
+	case FJSON_ARRAY2:
+	case FJSON_DOC2: {
+		/* Length prefixed array or object */
+		const unsigned char *zBodyEnd;
+		jx9_value sVal,sKey;
+		jx9_hashmap *pMap;
+		sxu32 nLen;
+		if( &zIn[4] > zEnd ){
+			rc = SXERR_CORRUPT;
+			break;
+		}
+		SyBigEndianUnpack32(zIn,&nLen);
+		zIn += 4;
+		if( nLen > (sxu32)(zEnd - zIn) ){
+			rc = SXERR_CORRUPT;
+			break;
+		}
+		zBodyEnd = &zIn[nLen];
+		/* Allocate a new hashmap */
+		pMap = (jx9_hashmap *)jx9NewHashmap(pOut->pVm,0,0);
+		if( pMap == 0 ){
+			rc = SXERR_MEM;
+			break;
+		}
+		jx9MemObjInit(pOut->pVm,&sVal);
+		jx9MemObjInit(pOut->pVm,&sKey);
+		jx9MemObjRelease(pOut);
+		MemObjSetType(pOut,MEMOBJ_HASHMAP);
+		pOut->x.pOther = pMap;
+		if( c == FJSON_DOC2 ){
+			pMap->iFlags |= HASHMAP_JSON_OBJECT;
+		}
+		rc = SXRET_OK;
+		while( zIn < zBodyEnd ){
+			if( c == FJSON_DOC2 ){
+				/* Extract the key */
+				rc = FastJsonDecodeValue(pDoc,(const void *)zIn,(sxu32)(zBodyEnd-zIn),&sKey,&zIn,iNest+1);
+				if( rc != SXRET_OK ){
+					break;
+				}
+			}
+			/* Decode the value */
+			rc = FastJsonDecodeValue(pDoc,(const void *)zIn,(sxu32)(zBodyEnd-zIn),&sVal,&zIn,iNest+1);
+			if( rc != SXRET_OK ){
+				break;
+			}
+			/* Insert the entry */
+			rc = jx9HashmapInsert(pMap,c == FJSON_DOC2 ? &sKey : 0,&sVal);
+			if( rc != UNQLITE_OK ){
+				break;
+			}
+		}
+		if( rc != SXRET_OK ){
+			jx9MemObjRelease(pOut);
+		}
+		jx9MemObjRelease(&sVal);
+		jx9MemObjRelease(&sKey);
+		zIn = zBodyEnd;
+		break;
+					 }
 	default:
 		/* Corrupt data */
 		rc = SXERR_CORRUPT;
@@ -391,3 +794,488 @@ UNQLITE_PRIVATE sxi32 FastJsonDecode(
 	}
 	return rc;
 }
+/*
+ * Decode a FastJSON binary blob (Version 1 or 2 record).
+ */
+UNQLITE_PRIVATE sxi32 FastJsonDecode(
+	const void *pIn,  /* Binary JSON  */
+	sxu32 nByte,      /* Chunk delimiter */
+	jx9_value *pOut,  /* Decoded value */
+	const unsigned char **pzPtr,
+	int iNest /* Nesting limit */
+	)
+{
+	const unsigned char *zIn = (const unsigned char *)pIn;
+	const unsigned char *zEnd = &zIn[nByte];
+	const unsigned char *zRoot;
+	fjson_doc sDoc;
+	sxi32 rc;
+	rc = FastJsonOpen(zIn,zEnd,&sDoc,&zRoot);
+	if( rc != SXRET_OK ){
+		return rc;
+	}
+	return FastJsonDecodeValue(&sDoc,(const void *)zRoot,(sxu32)(zEnd-zRoot),pOut,pzPtr,iNest);
+}
+/*
+ * Jump over the binary JSON value starting at zIn without decoding it.
+ * Return a pointer past the value or NULL on corrupt input.
+ */
+static const unsigned char * FastJsonSkip(
+	const unsigned char *zIn,  /* Binary JSON value */
+	const unsigned char *zEnd, /* End of input */
+	int iNest                  /* Nesting limit */
+	)
+{
+	sxu64 iVal;
+	int cEnd;
+	if( zIn >= zEnd || iNest >= UNQLITE_FAST_JSON_NEST_LIMIT ){
+		return 0;
+	}
+	switch(zIn[0]){
+	case FJSON_NULL:
+	case FJSON_TRUE:
+	case FJSON_FALSE:
+		return &zIn[1];
+	case FJSON_INT64:
+	case FJSON_REAL2:
+		return &zIn[9] <= zEnd ? &zIn[9] : 0;
+	case FJSON_INT2:
+	case FJSON_KEY2:
+		return FastJsonGetVarint(&zIn[1],zEnd,&iVal);
+	case FJSON_STRING2:
+		zIn = FastJsonGetVarint(&zIn[1],zEnd,&iVal);
+		if( zIn == 0 || iVal > (sxu64)(zEnd - zIn) ){
+			return 0;
+		}
+		return &zIn[iVal];
+	case FJSON_ARRAY2:
+	case FJSON_DOC2: {
+		/* Length prefixed, O(1) */
+		sxu32 nLen;
+		if( &zIn[5] > zEnd ){
+			return 0;
+		}
+		SyBigEndianUnpack32(&zIn[1],&nLen);
+		if( nLen > (sxu32)(zEnd - &zIn[5]) ){
+			return 0;
+		}
+		return &zIn[5+nLen];
+					 }
+	case FJSON_REAL: {
+		sxu16 iLen;
+		if( &zIn[3] > zEnd ){
+			return 0;
+		}
+		SyBigEndianUnpack16(&zIn[1],&iLen);
+		if( (sxu32)iLen > (sxu32)(zEnd - &zIn[3]) ){
+			return 0;
+		}
+		return &zIn[3+iLen];
+					 }
+	case FJSON_STRING: {
+		sxu32 iLength;
+		if( &zIn[5] > zEnd ){
+			return 0;
+		}
+		SyBigEndianUnpack32(&zIn[1],&iLength);
+		if( iLength > (sxu32)(zEnd - &zIn[5]) ){
+			return 0;
+		}
+		return &zIn[5+iLength];
+					   }
+	case FJSON_ARRAY_START:
+	case FJSON_DOC_START:
+		cEnd = zIn[0] == FJSON_DOC_START ? FJSON_DOC_END : FJSON_ARRAY_END;
+		zIn++;
+		for(;;){
+			/* Jump binary commas and colons */
+			while( zIn < zEnd && (zIn[0] == FJSON_COMMA || zIn[0] == FJSON_COLON) ){
+				zIn++;
+			}
+			if( zIn >= zEnd ){
+				return 0;
+			}
+			if( zIn[0] == cEnd ){
+				return &zIn[1];
+			}
+			zIn = FastJsonSkip(zIn,zEnd,iNest+1);
+			if( zIn == 0 ){
+				return 0;
+			}
+		}
+	default:
+		break;
+	}
+	/* Corrupt data */
+	return 0;
+}
+/*
+ * Point to the first entry of the root object of a binary JSON record.
+ * *pzEnd is set to the end of the object entries.
+ * Return SXERR_NOTFOUND if the root value is not a JSON object.
+ */
+static sxi32 FastJsonOpenObject(
+	const void *pIn,      /* Binary JSON  */
+	sxu32 nByte,          /* Chunk delimiter */
+	fjson_doc *pDoc,      /* OUT: Record dictionary */
+	const unsigned char **pzIn, /* OUT: First entry */
+	const unsigned char **pzEnd /* OUT: End of entries */
+	)
+{
+	const unsigned char *zIn = (const unsigned char *)pIn;
+	const unsigned char *zEnd = &zIn[nByte];
+	sxu32 nLen;
+	sxi32 rc;
+	rc = FastJsonOpen(zIn,zEnd,pDoc,&zIn);
+	if( rc != SXRET_OK ){
+		return rc;
+	}
+	if( zIn >= zEnd ){
+		return SXERR_NOTFOUND;
+	}
+	if( zIn[0] == FJSON_DOC_START ){
+		*pzIn = &zIn[1];
+		*pzEnd = zEnd;
+		return SXRET_OK;
+	}
+	if( zIn[0] != FJSON_DOC2 ){
+		return SXERR_NOTFOUND;
+	}
+	if( &zIn[5] > zEnd ){
+		return SXERR_CORRUPT;
+	}
+	SyBigEndianUnpack32(&zIn[1],&nLen);
+	if( nLen > (sxu32)(zEnd - &zIn[5]) ){
+		return SXERR_CORRUPT;
+	}
+	*pzIn = &zIn[5];
+	*pzEnd = &zIn[5+nLen];
+	return SXRET_OK;
+}
+/*
+ * Consume the encoded key of a binary JSON object entry and compare it
+ * with the given field names. *piMatch is set to the index of the
+ * matching name or -1 if the key matches none of them.
+ */
+static sxi32 FastJsonMatchKey(
+	const fjson_doc *pDoc,      /* Record dictionary */
+	const unsigned char **pzIn, /* IN/OUT: Encoded key */
+	const unsigned char *zEnd,  /* End of input */
+	SyString *aField,           /* Field names */
+	sxu32 nField,               /* aField[] length */
+	sxi32 *piMatch              /* OUT: Matching field index */
+	)
+{
+	const unsigned char *zIn = *pzIn;
+	const char *zKey = 0;
+	char zNum[32];
+	sxu32 nKey = 0;
+	int bColon = 1;
+	sxu64 iVal;
+	sxu32 n;
+	*piMatch = -1;
+	if( zIn[0] == FJSON_STRING ){
+		sxu32 iLength;
+		if( &zIn[5] > zEnd ){
+			return SXERR_CORRUPT;
+		}
+		SyBigEndianUnpack32(&zIn[1],&iLength);
+		if( iLength > (sxu32)(zEnd - &zIn[5]) ){
+			return SXERR_CORRUPT;
+		}
+		zKey = (const char *)&zIn[5];
+		nKey = iLength;
+		zIn += 5 + iLength;
+	}else if( zIn[0] == FJSON_INT64 ){
+		/* Numeric key */
+		if( &zIn[9] > zEnd ){
+			return SXERR_CORRUPT;
+		}
+		SyBigEndianUnpack64(&zIn[1],&iVal);
+		nKey = SyBufferFormat(zNum,sizeof(zNum),"%qd",(jx9_int64)iVal);
+		zKey = zNum;
+		zIn += 9;
+	}else if( zIn[0] == FJSON_STRING2 || zIn[0] == FJSON_KEY2 ){
+		/* Version 2 keys are not followed by a colon */
+		if( FastJsonGetString(pDoc,zIn,zEnd,&zKey,&nKey,&zIn) != SXRET_OK ){
+			return SXERR_CORRUPT;
+		}
+		bColon = 0;
+	}else if( zIn[0] == FJSON_INT2 ){
+		zIn = FastJsonGetVarint(&zIn[1],zEnd,&iVal);
+		if( zIn == 0 ){
+			return SXERR_CORRUPT;
+		}
+		nKey = SyBufferFormat(zNum,sizeof(zNum),"%qd",FJSON_UNZIGZAG(iVal));
+		zKey = zNum;
+		bColon = 0;
+	}else{
+		zIn = FastJsonSkip(zIn,zEnd,1);
+		if( zIn == 0 ){
+			return SXERR_CORRUPT;
+		}
+	}
+	if( zKey ){
+		for( n = 0 ; n < nField ; ++n ){
+			if( aField[n].nByte == nKey && SyMemcmp(aField[n].zString,zKey,nKey) == 0 ){
+				*piMatch = (sxi32)n;
+				break;
+			}
+		}
+	}
+	if( bColon ){
+		if( zIn >= zEnd || zIn[0] != FJSON_COLON ){
+			return SXERR_CORRUPT;
+		}
+		/* Jump the binary colon ':' */
+		zIn++;
+	}
+	*pzIn = zIn;
+	return SXRET_OK;
+}
+/*
+ * Locate the value of a top level field of a binary JSON object without
+ * decoding the object. On success, *pzValue points to the encoded value.
+ * Return SXERR_NOTFOUND if the field does not exists or the input is not
+ * a JSON object.
+ */
+UNQLITE_PRIVATE sxi32 FastJsonFetchField(
+	const void *pIn,      /* Binary JSON  */
+	sxu32 nByte,          /* Chunk delimiter */
+	SyString *pField,     /* Field name */
+	const unsigned char **pzValue /* OUT: Encoded value */
+	)
+{
+	const unsigned char *zIn,*zEnd;
+	fjson_doc sDoc;
+	sxi32 iMatch;
+	sxi32 rc;
+	rc = FastJsonOpenObject(pIn,nByte,&sDoc,&zIn,&zEnd);
+	if( rc != SXRET_OK ){
+		return rc;
+	}
+	for(;;){
+		/* Jump leading binary commas */
+		while( zIn < zEnd && zIn[0] == FJSON_COMMA ){
+			zIn++;
+		}
+		if( zIn >= zEnd || zIn[0] == FJSON_DOC_END ){
+			break;
+		}
+		rc = FastJsonMatchKey(&sDoc,&zIn,zEnd,pField,1,&iMatch);
+		if( rc != SXRET_OK ){
+			return rc;
+		}
+		if( iMatch >= 0 ){
+			*pzValue = zIn;
+			return SXRET_OK;
+		}
+		/* Jump the value */
+		zIn = FastJsonSkip(zIn,zEnd,1);
+		if( zIn == 0 ){
+			return SXERR_CORRUPT;
+		}
+	}
+	return SXERR_NOTFOUND;
+}
+/*
+ * Decode the given top level fields of a binary JSON object only.
+ * The values of the other fields, including nested objects and
+ * arrays, are skipped without being materialized.
+ * Input which is not a JSON object is decoded as a whole.
+ */
+UNQLITE_PRIVATE sxi32 FastJsonDecodeFields(
+	const void *pIn,  /* Binary JSON  */
+	sxu32 nByte,      /* Chunk delimiter */
+	SyString *aField, /* Fields to decode */
+	sxu32 nField,     /* aField[] length */
+	jx9_value *pOut   /* Decoded value */
+	)
+{
+	const unsigned char *zIn,*zEnd;
+	const unsigned char *zKey;
+	jx9_value sVal,sKey;
+	jx9_hashmap *pMap;
+	fjson_doc sDoc;
+	sxi32 iMatch;
+	sxi32 rc;
+	rc = FastJsonOpenObject(pIn,nByte,&sDoc,&zIn,&zEnd);
+	if( rc == SXERR_NOTFOUND ){
+		return FastJsonDecode(pIn,nByte,pOut,0,0);
+	}else if( rc != SXRET_OK ){
+		return rc;
+	}
+	/* Allocate a new hashmap */
+	pMap = (jx9_hashmap *)jx9NewHashmap(pOut->pVm,0,0);
+	if( pMap == 0 ){
+		return SXERR_MEM;
+	}
+	jx9MemObjInit(pOut->pVm,&sVal);
+	jx9MemObjInit(pOut->pVm,&sKey);
+	jx9MemObjRelease(pOut);
+	MemObjSetType(pOut,MEMOBJ_HASHMAP);
+	pOut->x.pOther = pMap;
+	/* The projection of an object is an object, whatever its keys */
+	pMap->iFlags |= HASHMAP_JSON_OBJECT;
+	rc = SXRET_OK;
+	for(;;){
+		/* Jump leading binary commas */
+		while( zIn < zEnd && zIn[0] == FJSON_COMMA ){
+			zIn++;
+		}
+		if( zIn >= zEnd || zIn[0] == FJSON_DOC_END ){
+			break;
+		}
+		zKey = zIn;
+		rc = FastJsonMatchKey(&sDoc,&zIn,zEnd,aField,nField,&iMatch);
+		if( rc != SXRET_OK ){
+			break;
+		}
+		if( iMatch < 0 ){
+			/* Unwanted field, jump the value */
+			zIn = FastJsonSkip(zIn,zEnd,1);
+			if( zIn == 0 ){
+				rc = SXERR_CORRUPT;
+				break;
+			}
+			continue;
+		}
+		/* Decode the key and its value */
+		rc = FastJsonDecodeValue(&sDoc,(const void *)zKey,(sxu32)(zEnd-zKey),&sKey,0,1);
+		if( rc != SXRET_OK ){
+			break;
+		}
+		rc = FastJsonDecodeValue(&sDoc,(const void *)zIn,(sxu32)(zEnd-zIn),&sVal,&zIn,1);
+		if( rc != SXRET_OK ){
+			break;
+		}
+		rc = jx9HashmapInsert(pMap,&sKey,&sVal);
+		if( rc != UNQLITE_OK ){
+			break;
+		}
+	}
+	if( rc != SXRET_OK ){
+		jx9MemObjRelease(pOut);
+	}
+	jx9MemObjRelease(&sVal);
+	jx9MemObjRelease(&sKey);
+	return rc;
+}
+/*
+ * Compare an encoded scalar with a Jx9 value without decoding it.
+ * Numbers compare numerically, strings byte-wise, booleans and null
+ * only against values of the same type.
+ * Return SXRET_OK and the result (<0, 0, >0) in *pRes, or SXERR_INVALID
+ * when the two values are not comparable.
+ */
+UNQLITE_PRIVATE sxi32 FastJsonCompare(
+	const unsigned char *zIn,  /* Encoded value (Refer to FastJsonFetchField()) */
+	const unsigned char *zEnd, /* End of input */
+	jx9_value *pValue,         /* Value to compare with */
+	sxi32 *pRes                /* OUT: Comparison result */
+	)
+{
+	sxi32 iType = pValue ? pValue->iFlags : MEMOBJ_NULL;
+	if( zIn >= zEnd ){
+		return SXERR_CORRUPT;
+	}
+	switch(zIn[0]){
+	case FJSON_NULL:
+		if( iType & MEMOBJ_NULL ){
+			*pRes = 0;
+			return SXRET_OK;
+		}
+		break;
+	case FJSON_TRUE:
+	case FJSON_FALSE:
+		if( iType & MEMOBJ_BOOL ){
+			*pRes = (zIn[0] == FJSON_TRUE ? 1 : 0) - (pValue->x.iVal ? 1 : 0);
+			return SXRET_OK;
+		}
+		break;
+	case FJSON_INT64:
+	case FJSON_INT2:
+	case FJSON_REAL:
+	case FJSON_REAL2: {
+		double rA,rB;
+		if( (iType & (MEMOBJ_INT|MEMOBJ_REAL)) == 0 ){
+			break;
+		}
+		if( zIn[0] == FJSON_INT64 || zIn[0] == FJSON_INT2 ){
+			jx9_int64 iA;
+			sxu64 iVal;
+			if( zIn[0] == FJSON_INT64 ){
+				if( &zIn[9] > zEnd ){
+					return SXERR_CORRUPT;
+				}
+				SyBigEndianUnpack64(&zIn[1],&iVal);
+				iA = (jx9_int64)iVal;
+			}else{
+				if( FastJsonGetVarint(&zIn[1],zEnd,&iVal) == 0 ){
+					return SXERR_CORRUPT;
+				}
+				iA = FJSON_UNZIGZAG(iVal);
+			}
+			if( iType & MEMOBJ_INT ){
+				/* Exact integer comparison */
+				*pRes = iA < pValue->x.iVal ? -1 : (iA > pValue->x.iVal ? 1 : 0);
+				return SXRET_OK;
+			}
+			rA = (double)iA;
+		}else if( zIn[0] == FJSON_REAL2 ){
+			sxu64 iBits;
+			if( &zIn[9] > zEnd ){
+				return SXERR_CORRUPT;
+			}
+			SyBigEndianUnpack64(&zIn[1],&iBits);
+			SyMemcpy((const void *)&iBits,(void *)&rA,sizeof(rA));
+		}else{
+			sxu16 iLen;
+			rA = 0; /* cc warning */
+			if( &zIn[3] > zEnd ){
+				return SXERR_CORRUPT;
+			}
+			SyBigEndianUnpack16(&zIn[1],&iLen);
+			if( (sxu32)iLen > (sxu32)(zEnd - &zIn[3]) ){
+				return SXERR_CORRUPT;
+			}
+			SyStrToReal((const char *)&zIn[3],(sxu32)iLen,&rA,0);
+		}
+		rB = (iType & MEMOBJ_INT) ? (double)pValue->x.iVal : pValue->x.rVal;
+		*pRes = rA < rB ? -1 : (rA > rB ? 1 : 0);
+		return SXRET_OK;
+					 }
+	case FJSON_STRING:
+	case FJSON_STRING2:
+		if( iType & MEMOBJ_STRING ){
+			const char *zStr;
+			sxu32 iLength,nLen,n;
+			sxi32 rc;
+			if( zIn[0] == FJSON_STRING ){
+				if( &zIn[5] > zEnd ){
+					return SXERR_CORRUPT;
+				}
+				SyBigEndianUnpack32(&zIn[1],&iLength);
+				if( iLength > (sxu32)(zEnd - &zIn[5]) ){
+					return SXERR_CORRUPT;
+				}
+				zStr = (const char *)&zIn[5];
+			}else if( FastJsonGetString(0,zIn,zEnd,&zStr,&iLength,&zIn) != SXRET_OK ){
+				return SXERR_CORRUPT;
+			}
+			nLen = SyBlobLength(&pValue->sBlob);
+			n = iLength < nLen ? iLength : nLen;
+			rc = n > 0 ? SyMemcmp(zStr,SyBlobData(&pValue->sBlob),n) : 0;
+			if( rc == 0 ){
+				rc = iLength < nLen ? -1 : (iLength > nLen ? 1 : 0);
+			}
+			*pRes = rc;
+			return SXRET_OK;
+		}
+		break;
+	default:
+		break;
+	}
+	/* Not comparable */
+	return SXERR_INVALID;
+}
@@ -222,6 +222,14 @@ struct SyBlob
 #define SXMEM_BACKEND_CORRUPT(BACKEND)	(BACKEND == 0 || BACKEND->nMagic != SXMEM_BACKEND_MAGIC)
 
 #define SXMEM_BACKEND_RETRY	3
+/* Pool allocator geometry */
+#define SXMEM_POOL_INCR		4     /* Smallest size class: 1 << 4 = 16 bytes (Header included) */
+#define SXMEM_POOL_NBUCKETS	7     /* Size classes: 16, 32, 64, ..., 1024 bytes */
+#define SXMEM_POOL_MAXALLOC	(1 << (SXMEM_POOL_NBUCKETS + SXMEM_POOL_INCR - 1))
+#define SXMEM_POOL_SLAB		8192  /* Slab size, carved into chunks of a single size class */
+#define SXMEM_POOL_NLARGE	16    /* Released large chunks kept for reuse */
+#define SXMEM_POOL_LARGE	0xFFFF /* Size class of chunks allocated outside the slabs */
+#define SXMEM_POOL_HDR		(2 * sizeof(sxu32))
 /* A memory backend subsystem is defined by an instance of the following structures */
 typedef struct SyMemBlock SyMemBlock;
 struct SyMemBlock
@@ -233,6 +241,14 @@ struct SyMemBlock
 							   */
 #endif
 };
+/* Each chunk served by the pool allocator is preceded by the following header */
+typedef struct SyMemHeader SyMemHeader;
+struct SyMemHeader
+{
+	sxu32 nBucket;             /* Size class this chunk belongs to or SXMEM_POOL_LARGE */
+	sxu32 nByte;               /* Chunk size (Large chunks only) */
+	SyMemHeader *pNext;        /* Next free chunk. Overlaps the chunk body while in use */
+};
 struct SyMemBackend
 {
 	const SyMutexMethods *pMutexMethods; /* Mutex methods */
@@ -243,6 +259,9 @@ struct SyMemBackend
 	void *pUserData;               /* First arg to xMemError() */
 	SyMutex *pMutex;               /* Per instance mutex */
 	sxu32 nMagic;                  /* Sanity check against misuse */
+	SyMemHeader *apPool[SXMEM_POOL_NBUCKETS]; /* Free chunks of each size class */
+	SyMemHeader *pLarge;           /* Released large chunks */
+	sxu32 nLarge;                  /* Total number of entries in pLarge */
 };
 /* Mutex types */
 #define SXMUTEX_TYPE_FAST	1
@@ -1610,6 +1629,7 @@ JX9_PRIVATE sxi32 SyBase64Decode(const char *zB64, sxu32 nLen, ProcConsumer xCon
 JX9_PRIVATE sxi32 SyBase64Encode(const char *zSrc, sxu32 nLen, ProcConsumer xConsumer, void *pUserData);
 #endif /* JX9_DISABLE_BUILTIN_FUNC */
 JX9_PRIVATE sxu32 SyBinHash(const void *pSrc, sxu32 nLen);
+JX9_PRIVATE sxu64 SyBinHash64(const void *pSrc, sxu32 nLen);
 JX9_PRIVATE sxi32 SyStrToReal(const char *zSrc, sxu32 nLen, void *pOutVal, const char **zRest);
 JX9_PRIVATE sxi32 SyBinaryStrToInt64(const char *zSrc, sxu32 nLen, void *pOutVal, const char **zRest);
 JX9_PRIVATE sxi32 SyOctalStrToInt64(const char *zSrc, sxu32 nLen, void *pOutVal, const char **zRest);
@@ -1675,6 +1695,12 @@ JX9_PRIVATE sxu32 SyStrlen(const char *zSrc);
 JX9_PRIVATE const SyMutexMethods *SyMutexExportMethods(void);
 JX9_PRIVATE sxi32 SyMemBackendMakeThreadSafe(SyMemBackend *pBackend, const SyMutexMethods *pMethods);
 JX9_PRIVATE sxi32 SyMemBackendDisbaleMutexing(SyMemBackend *pBackend);
+typedef struct SyEvent SyEvent;
+JX9_PRIVATE SyEvent * SyEventNew(void);
+JX9_PRIVATE void SyEventRelease(SyEvent *pEvent);
+JX9_PRIVATE sxu32 SyEventSeq(SyEvent *pEvent);
+JX9_PRIVATE sxi32 SyEventWait(SyEvent *pEvent, sxu32 iSeq, sxu32 nMicroSec);
+JX9_PRIVATE void SyEventNotify(SyEvent *pEvent);
 #endif
 JX9_PRIVATE void SyBigEndianPack32(unsigned char *buf,sxu32 nb);
 JX9_PRIVATE void SyBigEndianUnpack32(const unsigned char *buf,sxu32 *uNB);
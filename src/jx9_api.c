@@ -52,7 +52,7 @@ static struct Jx9Global_Data
 	jx9 *pEngines;                          /* List of active engine */
 	sxu32 nMagic;                           /* Sanity check against library misuse */
 }sJx9MPGlobal = {
-	{0, 0, 0, 0, 0, 0, 0, 0}, 
+	{0, 0, 0, 0, 0, 0, 0, 0, {0}, 0, 0}, 
 #if defined(JX9_ENABLE_THREADS)
 	0, 
 	0, 
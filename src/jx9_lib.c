@@ -259,6 +259,172 @@ JX9_PRIVATE const SyMutexMethods * SyMutexExportMethods(void)
 	return &sDummyMutexMethods;
 }
 #endif /* __WINNT__ */
+/* SyRunTimeApi: sxevent.c */
+/*
+ * Events let a thread block until another thread changes some state guarded by a
+ * mutex (i.e. a group commit batch is done) instead of polling. An event carries
+ * its own native lock and a sequence number bumped on each notification so that
+ * it works with any registered mutex subsystem: the waiter reads the sequence
+ * number before leaving the mutex guarding the state and then blocks until the
+ * number change. A notification issued in between is therefore never lost.
+ */
+#if defined(__WINNT__)
+struct SyEvent
+{
+	CRITICAL_SECTION sLock;
+	CONDITION_VARIABLE sCond;
+	sxu32 iSeq; /* Notification sequence number */
+};
+JX9_PRIVATE SyEvent * SyEventNew(void)
+{
+	SyEvent *pEvent;
+	pEvent = (SyEvent *)HeapAlloc(GetProcessHeap(), 0, sizeof(SyEvent));
+	if( pEvent == 0 ){
+		return 0;
+	}
+	InitializeCriticalSection(&pEvent->sLock);
+	InitializeConditionVariable(&pEvent->sCond);
+	pEvent->iSeq = 0;
+	return pEvent;
+}
+JX9_PRIVATE void SyEventRelease(SyEvent *pEvent)
+{
+	DeleteCriticalSection(&pEvent->sLock);
+	HeapFree(GetProcessHeap(), 0, pEvent);
+}
+JX9_PRIVATE sxu32 SyEventSeq(SyEvent *pEvent)
+{
+	sxu32 iSeq;
+	EnterCriticalSection(&pEvent->sLock);
+	iSeq = pEvent->iSeq;
+	LeaveCriticalSection(&pEvent->sLock);
+	return iSeq;
+}
+JX9_PRIVATE sxi32 SyEventWait(SyEvent *pEvent, sxu32 iSeq, sxu32 nMicroSec)
+{
+	DWORD nStart = GetTickCount();
+	DWORD nMs = (DWORD)((nMicroSec + 999) / 1000);
+	DWORD nElapsed;
+	sxi32 rc = SXRET_OK;
+	EnterCriticalSection(&pEvent->sLock);
+	while( pEvent->iSeq == iSeq ){
+		if( nMicroSec < 1 ){
+			SleepConditionVariableCS(&pEvent->sCond, &pEvent->sLock, INFINITE);
+			continue;
+		}
+		nElapsed = GetTickCount() - nStart;
+		if( nElapsed >= nMs ){
+			rc = SXERR_TIMEOUT;
+			break;
+		}
+		SleepConditionVariableCS(&pEvent->sCond, &pEvent->sLock, nMs - nElapsed);
+	}
+	LeaveCriticalSection(&pEvent->sLock);
+	return rc;
+}
+JX9_PRIVATE void SyEventNotify(SyEvent *pEvent)
+{
+	EnterCriticalSection(&pEvent->sLock);
+	pEvent->iSeq++;
+	LeaveCriticalSection(&pEvent->sLock);
+	WakeAllConditionVariable(&pEvent->sCond);
+}
+#elif defined(__UNIXES__)
+#include <time.h>
+struct SyEvent
+{
+	pthread_mutex_t sLock;
+	pthread_cond_t sCond;
+	sxu32 iSeq; /* Notification sequence number */
+};
+JX9_PRIVATE SyEvent * SyEventNew(void)
+{
+	SyEvent *pEvent;
+	pEvent = (SyEvent *)malloc(sizeof(SyEvent));
+	if( pEvent == 0 ){
+		return 0;
+	}
+	pthread_mutex_init(&pEvent->sLock, 0);
+	pthread_cond_init(&pEvent->sCond, 0);
+	pEvent->iSeq = 0;
+	return pEvent;
+}
+JX9_PRIVATE void SyEventRelease(SyEvent *pEvent)
+{
+	pthread_cond_destroy(&pEvent->sCond);
+	pthread_mutex_destroy(&pEvent->sLock);
+	free(pEvent);
+}
+JX9_PRIVATE sxu32 SyEventSeq(SyEvent *pEvent)
+{
+	sxu32 iSeq;
+	pthread_mutex_lock(&pEvent->sLock);
+	iSeq = pEvent->iSeq;
+	pthread_mutex_unlock(&pEvent->sLock);
+	return iSeq;
+}
+JX9_PRIVATE sxi32 SyEventWait(SyEvent *pEvent, sxu32 iSeq, sxu32 nMicroSec)
+{
+	struct timespec sDeadline;
+	sxi32 rc = SXRET_OK;
+	if( nMicroSec > 0 ){
+		/* Absolute deadline so that spurious wakeups do not extend the wait */
+		clock_gettime(CLOCK_REALTIME, &sDeadline);
+		sDeadline.tv_sec += nMicroSec / 1000000;
+		sDeadline.tv_nsec += (long)(nMicroSec % 1000000) * 1000;
+		if( sDeadline.tv_nsec >= 1000000000 ){
+			sDeadline.tv_sec++;
+			sDeadline.tv_nsec -= 1000000000;
+		}
+	}
+	pthread_mutex_lock(&pEvent->sLock);
+	while( pEvent->iSeq == iSeq ){
+		if( nMicroSec < 1 ){
+			pthread_cond_wait(&pEvent->sCond, &pEvent->sLock);
+		}else if( pthread_cond_timedwait(&pEvent->sCond, &pEvent->sLock, &sDeadline) != 0 && pEvent->iSeq == iSeq ){
+			rc = SXERR_TIMEOUT;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pEvent->sLock);
+	return rc;
+}
+JX9_PRIVATE void SyEventNotify(SyEvent *pEvent)
+{
+	pthread_mutex_lock(&pEvent->sLock);
+	pEvent->iSeq++;
+	pthread_cond_broadcast(&pEvent->sCond);
+	pthread_mutex_unlock(&pEvent->sLock);
+}
+#else
+/* No native threads, waiting return immediately */
+struct SyEvent
+{
+	sxu32 iSeq;
+};
+JX9_PRIVATE SyEvent * SyEventNew(void)
+{
+	static SyEvent sEvent;
+	return &sEvent;
+}
+JX9_PRIVATE void SyEventRelease(SyEvent *pEvent)
+{
+	SXUNUSED(pEvent);
+}
+JX9_PRIVATE sxu32 SyEventSeq(SyEvent *pEvent)
+{
+	return pEvent->iSeq;
+}
+JX9_PRIVATE sxi32 SyEventWait(SyEvent *pEvent, sxu32 iSeq, sxu32 nMicroSec)
+{
+	SXUNUSED(nMicroSec);
+	return pEvent->iSeq == iSeq ? SXERR_TIMEOUT : SXRET_OK;
+}
+JX9_PRIVATE void SyEventNotify(SyEvent *pEvent)
+{
+	pEvent->iSeq++;
+}
+#endif /* __WINNT__ */
 #endif /* JX9_ENABLE_THREADS */
 static void * SyOSHeapAlloc(sxu32 nByte)
 {
@@ -682,13 +848,142 @@ JX9_PRIVATE sxi32 SyMemBackendDisbaleMutexing(SyMemBackend *pBackend)
 	return SXRET_OK;
 }
 #endif
+/*
+ * Pool allocator.
+ * Small chunks are carved out of slabs holding chunks of a single size class
+ * and released chunks are kept on a per class free list. This save a trip to
+ * the underlying allocator and the per block bookkeeping on hot paths (pages,
+ * cells, records, values, ...). Slabs are ordinary blocks of the backend so
+ * they are freed in bulk when the backend is released.
+ * Larger chunks are allocated directly. A few of them are kept on release and
+ * handed back on an exact size match (i.e. database pages).
+ */
+static sxi32 MemPoolSlabAlloc(SyMemBackend *pBackend, sxu32 nBucket)
+{
+	SyMemHeader *pHeader, *pFree;
+	sxu32 nSize, n;
+	char *zSlab;
+	/* Allocate one big block first */
+	zSlab = (char *)MemBackendAlloc(&(*pBackend), SXMEM_POOL_SLAB);
+	if( zSlab == 0 ){
+		return SXERR_MEM;
+	}
+	nSize = (sxu32)1 << (nBucket + SXMEM_POOL_INCR);
+	/* Divide it into chunks of the requested size class */
+	pFree = 0;
+	n = SXMEM_POOL_SLAB - nSize;
+	for(;;){
+		pHeader = (SyMemHeader *)&zSlab[n];
+		pHeader->nBucket = nBucket;
+		pHeader->pNext = pFree;
+		pFree = pHeader;
+		if( n < nSize ){
+			break;
+		}
+		n -= nSize;
+	}
+	pBackend->apPool[nBucket] = pFree;
+	return SXRET_OK;
+}
+static void * MemBackendPoolAlloc(SyMemBackend *pBackend, sxu32 nByte)
+{
+	SyMemHeader *pHeader, *pPrev;
+	sxu32 nBucket;
+	if( nByte + SXMEM_POOL_HDR > SXMEM_POOL_MAXALLOC ){
+		/* Large chunk, reuse a released one of the same size if available */
+		pPrev = 0;
+		for( pHeader = pBackend->pLarge ; pHeader ; pHeader = pHeader->pNext ){
+			if( pHeader->nByte == nByte ){
+				if( pPrev ){
+					pPrev->pNext = pHeader->pNext;
+				}else{
+					pBackend->pLarge = pHeader->pNext;
+				}
+				pBackend->nLarge--;
+				return (void *)&((char *)pHeader)[SXMEM_POOL_HDR];
+			}
+			pPrev = pHeader;
+		}
+		pHeader = (SyMemHeader *)MemBackendAlloc(&(*pBackend), nByte + SXMEM_POOL_HDR);
+		if( pHeader == 0 ){
+			return 0;
+		}
+		pHeader->nBucket = SXMEM_POOL_LARGE;
+		pHeader->nByte = nByte;
+		return (void *)&((char *)pHeader)[SXMEM_POOL_HDR];
+	}
+	/* Locate the appropriate size class */
+	nBucket = 0;
+	while( nByte + SXMEM_POOL_HDR > ((sxu32)1 << (nBucket + SXMEM_POOL_INCR)) ){
+		nBucket++;
+	}
+	if( pBackend->apPool[nBucket] == 0 && SXRET_OK != MemPoolSlabAlloc(&(*pBackend), nBucket) ){
+		return 0;
+	}
+	pHeader = pBackend->apPool[nBucket];
+	pBackend->apPool[nBucket] = pHeader->pNext;
+	return (void *)&((char *)pHeader)[SXMEM_POOL_HDR];
+}
 JX9_PRIVATE void * SyMemBackendPoolAlloc(SyMemBackend *pBackend, sxu32 nByte)
 {
-	return SyMemBackendAlloc(pBackend, nByte);
+	void *pChunk;
+#if defined(UNTRUST)
+	if( SXMEM_BACKEND_CORRUPT(pBackend) ){
+		return 0;
+	}
+#endif
+	if( pBackend->pMutexMethods ){
+		SyMutexEnter(pBackend->pMutexMethods, pBackend->pMutex);
+	}
+	pChunk = MemBackendPoolAlloc(&(*pBackend), nByte);
+	if( pBackend->pMutexMethods ){
+		SyMutexLeave(pBackend->pMutexMethods, pBackend->pMutex);
+	}
+	return pChunk;
+}
+static sxi32 MemBackendPoolFree(SyMemBackend *pBackend, void * pChunk)
+{
+	SyMemHeader *pHeader;
+	pHeader = (SyMemHeader *)(((char *)pChunk) - SXMEM_POOL_HDR);
+	if( pHeader->nBucket == SXMEM_POOL_LARGE ){
+		if( pBackend->nLarge >= SXMEM_POOL_NLARGE ){
+			/* Give it back to the underlying allocator */
+			return MemBackendFree(&(*pBackend), (void *)pHeader);
+		}
+		pHeader->pNext = pBackend->pLarge;
+		pBackend->pLarge = pHeader;
+		pBackend->nLarge++;
+		return SXRET_OK;
+	}
+#if defined(UNTRUST)
+	if( pHeader->nBucket >= SXMEM_POOL_NBUCKETS ){
+		return SXERR_CORRUPT;
+	}
+#endif
+	/* Back to the free list of its size class */
+	pHeader->pNext = pBackend->apPool[pHeader->nBucket];
+	pBackend->apPool[pHeader->nBucket] = pHeader;
+	return SXRET_OK;
 }
 JX9_PRIVATE sxi32 SyMemBackendPoolFree(SyMemBackend *pBackend, void * pChunk)
 {
-	return SyMemBackendFree(pBackend, pChunk);
+	sxi32 rc;
+#if defined(UNTRUST)
+	if( SXMEM_BACKEND_CORRUPT(pBackend) ){
+		return SXERR_CORRUPT;
+	}
+#endif
+	if( pChunk == 0 ){
+		return SXRET_OK;
+	}
+	if( pBackend->pMutexMethods ){
+		SyMutexEnter(pBackend->pMutexMethods, pBackend->pMutex);
+	}
+	rc = MemBackendPoolFree(&(*pBackend), pChunk);
+	if( pBackend->pMutexMethods ){
+		SyMutexLeave(pBackend->pMutexMethods, pBackend->pMutex);
+	}
+	return rc;
 }
 JX9_PRIVATE sxi32 SyMemBackendInit(SyMemBackend *pBackend, ProcMemError xMemErr, void * pUserData)
 {
@@ -813,6 +1108,10 @@ static sxi32 MemBackendRelease(SyMemBackend *pBackend)
 	}
 	pBackend->pMethods = 0;
 	pBackend->pBlocks  = 0;
+	/* Slabs and large chunks were released with the blocks */
+	SyZero(pBackend->apPool, sizeof(pBackend->apPool));
+	pBackend->pLarge = 0;
+	pBackend->nLarge = 0;
 #if defined(UNTRUST)
 	pBackend->nMagic = 0x2626;
 #endif
@@ -1861,6 +2160,84 @@ JX9_PRIVATE sxu32 SyBinHash(const void *pSrc, sxu32 nLen)
 	}	
 	return nH;
 }
+/*
+ * 64-bit hash of a binary buffer (xxHash64 with a zero seed).
+ * The whole buffer is consumed 32 bytes at a time using four independent
+ * lanes so that the loop is friendly to wide loads and instruction level parallelism.
+ */
+#define SX_HASH64_P1 0x9E3779B185EBCA87
+#define SX_HASH64_P2 0xC2B2AE3D27D4EB4F
+#define SX_HASH64_P3 0x165667B19E3779F9
+#define SX_HASH64_P4 0x85EBCA77C2B2AE63
+#define SX_HASH64_P5 0x27D4EB2F165667C5
+#define SX_ROTL64(X, R) (((X) << (R)) | ((X) >> (64 - (R))))
+static sxu64 SyLittleEndianRead64(const unsigned char *z)
+{
+	return (sxu64)z[0] | ((sxu64)z[1] << 8) | ((sxu64)z[2] << 16) | ((sxu64)z[3] << 24) |
+		((sxu64)z[4] << 32) | ((sxu64)z[5] << 40) | ((sxu64)z[6] << 48) | ((sxu64)z[7] << 56);
+}
+static sxu64 SyHash64Round(sxu64 nAcc, sxu64 nInput)
+{
+	nAcc += nInput * SX_HASH64_P2;
+	nAcc = SX_ROTL64(nAcc, 31);
+	return nAcc * SX_HASH64_P1;
+}
+static sxu64 SyHash64Merge(sxu64 nAcc, sxu64 nVal)
+{
+	nAcc ^= SyHash64Round(0, nVal);
+	return nAcc * SX_HASH64_P1 + SX_HASH64_P4;
+}
+JX9_PRIVATE sxu64 SyBinHash64(const void *pSrc, sxu32 nLen)
+{
+	const unsigned char *zIn = (const unsigned char *)pSrc;
+	const unsigned char *zEnd = &zIn[nLen];
+	sxu64 nH;
+	if( nLen >= 32 ){
+		const unsigned char *zLimit = zEnd - 32;
+		sxu64 v1 = SX_HASH64_P1 + SX_HASH64_P2;
+		sxu64 v2 = SX_HASH64_P2;
+		sxu64 v3 = 0;
+		sxu64 v4 = 0 - SX_HASH64_P1;
+		do{
+			v1 = SyHash64Round(v1, SyLittleEndianRead64(zIn));
+			v2 = SyHash64Round(v2, SyLittleEndianRead64(&zIn[8]));
+			v3 = SyHash64Round(v3, SyLittleEndianRead64(&zIn[16]));
+			v4 = SyHash64Round(v4, SyLittleEndianRead64(&zIn[24]));
+			zIn += 32;
+		}while( zIn <= zLimit );
+		nH = SX_ROTL64(v1, 1) + SX_ROTL64(v2, 7) + SX_ROTL64(v3, 12) + SX_ROTL64(v4, 18);
+		nH = SyHash64Merge(nH, v1);
+		nH = SyHash64Merge(nH, v2);
+		nH = SyHash64Merge(nH, v3);
+		nH = SyHash64Merge(nH, v4);
+	}else{
+		nH = SX_HASH64_P5;
+	}
+	nH += (sxu64)nLen;
+	while( zIn + 8 <= zEnd ){
+		nH ^= SyHash64Round(0, SyLittleEndianRead64(zIn));
+		nH = SX_ROTL64(nH, 27) * SX_HASH64_P1 + SX_HASH64_P4;
+		zIn += 8;
+	}
+	if( zIn + 4 <= zEnd ){
+		sxu64 n32 = (sxu64)zIn[0] | ((sxu64)zIn[1] << 8) | ((sxu64)zIn[2] << 16) | ((sxu64)zIn[3] << 24);
+		nH ^= n32 * SX_HASH64_P1;
+		nH = SX_ROTL64(nH, 23) * SX_HASH64_P2 + SX_HASH64_P3;
+		zIn += 4;
+	}
+	while( zIn < zEnd ){
+		nH ^= (sxu64)zIn[0] * SX_HASH64_P5;
+		nH = SX_ROTL64(nH, 11) * SX_HASH64_P1;
+		zIn++;
+	}
+	/* Final avalanche */
+	nH ^= nH >> 33;
+	nH *= SX_HASH64_P2;
+	nH ^= nH >> 29;
+	nH *= SX_HASH64_P3;
+	nH ^= nH >> 32;
+	return nH;
+}
 #ifndef JX9_DISABLE_BUILTIN_FUNC
 JX9_PRIVATE sxi32 SyBase64Encode(const char *zSrc, sxu32 nLen, ProcConsumer xConsumer, void *pUserData)
 {
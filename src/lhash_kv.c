@@ -25,12 +25,21 @@
 #define L_HASH_MAGIC 0xFA782DCB
 /*
  * Magic word to hash to identify a valid hash function.
+ * Its hash is recorded in the header and tells which hash function built the database:
+ * the full key 64-bit hash for new databases, the legacy DJB hash for older ones.
  */
 #define L_HASH_WORD "chm@symisc"
 /*
  * Cell size on disk. 
  */
 #define L_HASH_CELL_SZ (4/*Hash*/+4/*Key*/+8/*Data*/+2/* Offset of the next cell */+8/*Overflow*/)
+/*
+ * Most significant bit of the 8 byte data length of a cell whose data is stored
+ * compressed on its overflow pages. The compressed payload starts with the
+ * 8 byte original data length.
+ */
+#define L_HASH_DATA_ZIP (((sxu64)1) << 63)
+#define L_HASH_CELL_DATA_LEN(CELL) ((CELL)->bZip ? ((CELL)->nData | L_HASH_DATA_ZIP) : (CELL)->nData)
 /*
  * Primary page (not overflow pages) header size on disk.
  */
@@ -70,6 +79,8 @@ struct lhcell
 	sxu16 iStart;      /* Offset of this cell */
 	pgno iDataPage;    /* Data page number when overflow */
 	sxu16 iDataOfft;   /* Offset of the data in iDataPage */
+	int bZip;          /* True if the data is stored compressed */
+	sxu64 nOrig;       /* Original data length of a compressed cell (0 until read) */
 	SyBlob sKey;       /* Record key for fast lookup (Kept in-memory if < 256KB ) */
 	lhcell *pNext,*pPrev;         /* Linked list of the loaded memory cells */
 	lhcell *pNextCol,*pPrevCol;   /* Collison chain  */
@@ -147,6 +158,8 @@ struct lhash_kv_engine
 	pgno split_bucket;            /* Current split bucket: MUST BE A POWER OF TWO */
 	pgno max_split_bucket;        /* Maximum split bucket: MUST BE A POWER OF TWO */
 	pgno nmax_split_nucket;       /* Next maximum split bucket (1 << nMsb): In-memory only */
+	pgno iVacuum;                 /* Next bucket to be packed by an incremental vacuum: In-memory only */
+	sxu32 nZipThreshold;          /* Compress overflow data larger than this (0 to disable): In-memory only */
 	sxu32 nMagic;                 /* Magic number to identify a valid linear hash disk database */
 };
 /*
@@ -511,6 +524,11 @@ static int lhParseOneCell(lhpage *pPage,const unsigned char *zRaw,const unsigned
 	/* Fill in the structure */
 	pCell->iNext = iNext;
 	pCell->nKey  = nKey;
+	if( nData & L_HASH_DATA_ZIP ){
+		/* Compressed data */
+		pCell->bZip = 1;
+		nData &= ~L_HASH_DATA_ZIP;
+	}
 	pCell->nData = nData;
 	pCell->nHash = iHash;
 	/* Overflow page if any */
@@ -793,9 +811,9 @@ static int lhConsumeCellkey(
 	return rc;
 }
 /*
- * Given a cell, Consume its data by invoking the given callback for each extracted chunk.
+ * Given a cell, Consume its data as stored on disk by invoking the given callback for each extracted chunk.
  */
-static int lhConsumeCellData(
+static int lhConsumeCellPayload(
 	lhcell *pCell, /* Target cell */
 	int (*xConsumer)(const void *,unsigned int,void *), /* Data consumer callback */
 	void *pUserData /* Last argument to xConsumer() */
@@ -872,6 +890,152 @@ static int lhConsumeCellData(
 	}
 	return rc;
 }
+/*
+ * Collect the 8 byte original length that head the payload of a compressed cell.
+ */
+typedef struct lhzip_hdr lhzip_hdr;
+struct lhzip_hdr
+{
+	unsigned char zBuf[8]; /* Original data length (Big-Endian) */
+	sxu32 nByte;           /* Bytes collected so far */
+};
+static int lhZipHdrConsumer(const void *pData,unsigned int nLen,void *pUserData)
+{
+	lhzip_hdr *pHdr = (lhzip_hdr *)pUserData;
+	if( nLen > sizeof(pHdr->zBuf) - pHdr->nByte ){
+		nLen = sizeof(pHdr->zBuf) - pHdr->nByte;
+	}
+	SyMemcpy(pData,(void *)&pHdr->zBuf[pHdr->nByte],nLen);
+	pHdr->nByte += nLen;
+	/* Stop once the header is collected */
+	return pHdr->nByte < sizeof(pHdr->zBuf) ? UNQLITE_OK : UNQLITE_DONE;
+}
+/*
+ * Return the length of the cell data once decompressed.
+ */
+static int lhCellDataLength(lhcell *pCell,sxu64 *pLen)
+{
+	const unqlite_kv_io *pIo = pCell->pPage->pHash->pIo;
+	lhzip_hdr sHdr;
+	int rc = UNQLITE_OK;
+	if( !pCell->bZip ){
+		*pLen = pCell->nData;
+		return UNQLITE_OK;
+	}
+	/* The cached length is shared with the concurrent readers */
+	pIo->xLatch(pIo->pHandle,1);
+	if( pCell->nOrig < 1 ){
+		/* Read the first bytes of the payload */
+		sHdr.nByte = 0;
+		lhConsumeCellPayload(pCell,lhZipHdrConsumer,&sHdr);
+		if( sHdr.nByte < sizeof(sHdr.zBuf) ){
+			rc = UNQLITE_CORRUPT;
+		}else{
+			SyBigEndianUnpack64(sHdr.zBuf,&pCell->nOrig);
+		}
+	}
+	*pLen = pCell->nOrig;
+	pIo->xLatch(pIo->pHandle,0);
+	return rc;
+}
+/*
+ * Given a cell, Consume its data by invoking the given callback for each extracted chunk.
+ * Compressed data is decompressed and handed to the callback in a single chunk.
+ */
+static int lhConsumeCellData(
+	lhcell *pCell, /* Target cell */
+	int (*xConsumer)(const void *,unsigned int,void *), /* Data consumer callback */
+	void *pUserData /* Last argument to xConsumer() */
+	)
+{
+	lhash_kv_engine *pEngine = pCell->pPage->pHash;
+	const unqlite_page_codec *pCodec;
+	const unsigned char *zZip;
+	unsigned char *zOut;
+	sxu64 nOrig;
+	SyBlob sZip;
+	sxu32 nZip;
+	int rc;
+	if( !pCell->bZip ){
+		return lhConsumeCellPayload(pCell,xConsumer,pUserData);
+	}
+	/* Collect the compressed payload */
+	SyBlobInit(&sZip,&pEngine->sAllocator);
+	rc = lhConsumeCellPayload(pCell,unqliteDataConsumer,&sZip);
+	if( rc != UNQLITE_OK ){
+		SyBlobRelease(&sZip);
+		return rc;
+	}
+	zZip = (const unsigned char *)SyBlobData(&sZip);
+	nZip = SyBlobLength(&sZip);
+	nOrig = 0;
+	if( nZip > 8 ){
+		SyBigEndianUnpack64(zZip,&nOrig);
+	}
+	if( nOrig < 1 || nOrig > SXI32_HIGH ){
+		SyBlobRelease(&sZip);
+		pEngine->pIo->xErr(pEngine->pIo->pHandle,"Corrupt compressed record");
+		return UNQLITE_CORRUPT;
+	}
+	zOut = (unsigned char *)SyMemBackendAlloc(&pEngine->sAllocator,(sxu32)nOrig);
+	if( zOut == 0 ){
+		SyBlobRelease(&sZip);
+		pEngine->pIo->xErr(pEngine->pIo->pHandle,"KV store is running out of memory");
+		return UNQLITE_NOMEM;
+	}
+	/* Decompress */
+	pCodec = unqliteExportLzCodec();
+	if( pCodec->xDecompress((const void *)&zZip[8],(int)(nZip - 8),(void *)zOut,(int)nOrig) != (int)nOrig ){
+		pEngine->pIo->xErr(pEngine->pIo->pHandle,"Corrupt compressed record");
+		rc = UNQLITE_CORRUPT;
+	}else{
+		rc = xConsumer((const void *)zOut,(unsigned int)nOrig,pUserData);
+		if( rc != UNQLITE_OK ){
+			rc = UNQLITE_ABORT;
+		}
+	}
+	SyMemBackendFree(&pEngine->sAllocator,zOut);
+	SyBlobRelease(&sZip);
+	return rc;
+}
+/*
+ * Compress the data of a record headed for overflow pages when it is larger
+ * than the configured threshold and shrinks by at least an eighth.
+ * On success, the compressed payload (original length first) is stored in *pzOut
+ * and must be released by the caller. Any other return value means the data is
+ * to be stored as is.
+ */
+static int lhCompressData(lhash_kv_engine *pEngine,const void *pData,unqlite_int64 nData,unsigned char **pzOut,sxu32 *pnOut)
+{
+	const unqlite_page_codec *pCodec;
+	unsigned char *zOut;
+	sxu32 nMax;
+	int nByte;
+	if( pEngine->nZipThreshold < 1 || nData <= (unqlite_int64)pEngine->nZipThreshold || nData < 64 || nData > SXI32_HIGH ){
+		/* Don't bother */
+		return UNQLITE_DONE;
+	}
+	nMax = (sxu32)(nData - (nData >> 3)) - 8;
+	zOut = (unsigned char *)SyMemBackendAlloc(&pEngine->sAllocator,nMax + 8);
+	if( zOut == 0 ){
+		/* Store the data as is */
+		return UNQLITE_NOMEM;
+	}
+	pCodec = unqliteExportLzCodec();
+	nByte = pCodec->xCompress(pData,(int)nData,(void *)&zOut[8],(int)nMax);
+	if( nByte < 1 || (sxu32)nByte > nMax ){
+		/* Not worth it */
+		SyMemBackendFree(&pEngine->sAllocator,zOut);
+		return UNQLITE_DONE;
+	}
+	SyBigEndianPack64(zOut,(sxu64)nData);
+	*pzOut = zOut;
+	*pnOut = (sxu32)nByte + 8;
+	return UNQLITE_OK;
+}
+/* Forward declaration */
+static sxu32 lhash_bin_hash(const void *pSrc,sxu32 nLen);
+static sxu32 lhash_bin_hash64(const void *pSrc,sxu32 nLen);
 /*
  * Read the linear hash header (Page one of the database).
  */
@@ -894,9 +1058,14 @@ static int lhash_read_header(lhash_kv_engine *pEngine,unqlite_page *pHeader)
 	zRaw += 4;
 	/* Sanity check */
 	if( pEngine->xHash(L_HASH_WORD,sizeof(L_HASH_WORD)-1) != nHash ){
-		/* Different hash function */
-		pEngine->pIo->xErr(pEngine->pIo->pHandle,"Invalid hash function");
-		return UNQLITE_INVALID;
+		if( pEngine->xHash == lhash_bin_hash64 && lhash_bin_hash(L_HASH_WORD,sizeof(L_HASH_WORD)-1) == nHash ){
+			/* Database created with the legacy DJB hash */
+			pEngine->xHash = lhash_bin_hash;
+		}else{
+			/* Different hash function */
+			pEngine->pIo->xErr(pEngine->pIo->pHandle,"Invalid hash function");
+			return UNQLITE_INVALID;
+		}
 	}
 	/* List of free pages */
 	SyBigEndianUnpack64(zRaw,&pEngine->nFreeList);
@@ -943,6 +1112,7 @@ static int lhash_read_header(lhash_kv_engine *pEngine,unqlite_page *pHeader)
 		pMap->iPtr = 0;
 		/* Load the map in memory */
 		rc = lhMapLoadPage(pEngine,pMap,pPage->zData);
+		pEngine->pIo->xPageUnref(pPage);
 		if( rc != UNQLITE_OK ){
 			return rc;
 		}
@@ -957,7 +1127,8 @@ static int lhRecordLookup(
 	lhash_kv_engine *pEngine, /* KV storage engine */
 	const void *pKey,         /* Lookup key */
 	sxu32 nByte,              /* Key length */
-	lhcell **ppCell           /* OUT: Target cell on success */
+	lhcell **ppCell,          /* OUT: Target cell on success */
+	unqlite_page **ppRaw      /* OUT: Referenced master page on success */
 	)
 {
 	lhash_bmap_rec *pRec;
@@ -985,21 +1156,32 @@ static int lhRecordLookup(
 		/* No such entry */
 		return UNQLITE_NOTFOUND;
 	}
+	/* The parsed pages are shared with the concurrent readers */
+	pEngine->pIo->xLatch(pEngine->pIo->pHandle,1);
 	/* Load the master page and it's slave page in-memory  */
 	rc = lhLoadPage(pEngine,pRec->iReal,0,&pPage,0);
 	if( rc != UNQLITE_OK ){
+		pEngine->pIo->xLatch(pEngine->pIo->pHandle,0);
 		/* IO error, unlikely scenario */
 		return rc;
 	}
 	/* Lookup for the cell */
 	pCell = lhFindCell(pPage,pKey,nByte,nHash);
+	pEngine->pIo->xLatch(pEngine->pIo->pHandle,0);
 	if( pCell == 0 ){
 		/* No such entry */
+		pEngine->pIo->xPageUnref(pPage->pRaw);
 		return UNQLITE_NOTFOUND;
 	}
 	if( ppCell ){
 		*ppCell = pCell;
 	}
+	if( ppRaw ){
+		/* Caller is responsible of unreferencing this page */
+		*ppRaw = pPage->pRaw;
+	}else{
+		pEngine->pIo->xPageUnref(pPage->pRaw);
+	}
 	return UNQLITE_OK;
 }
 /*
@@ -1075,12 +1257,13 @@ static int lhMapWriteRecord(lhash_kv_engine *pEngine,pgno iLogic,pgno iReal)
 		}else{
 			/* Link the new page */
 			SyBigEndianPack64(pOld->zData,pPage->iPage);
-			/* Unref */
-			pEngine->pIo->xPageUnref(pOld);
 		}
+		/* Unref, the map pages are not pinned so that a vacuum can move them */
+		pEngine->pIo->xPageUnref(pOld);
 		/* Assume the last bucket map page */
 		rc = pEngine->pIo->xWrite(pPage);
 		if( rc != UNQLITE_OK ){
+			pEngine->pIo->xPageUnref(pPage);
 			return rc;
 		}
 		SyBigEndianPack64(pPage->zData,0); /* Next bucket map page on the list */
@@ -1095,6 +1278,7 @@ static int lhMapWriteRecord(lhash_kv_engine *pEngine,pgno iLogic,pgno iReal)
 	/* Make page writable */
 	rc = pEngine->pIo->xWrite(pPage);
 	if( rc != UNQLITE_OK ){
+		pEngine->pIo->xPageUnref(pPage);
 		return rc;
 	}
 	/* Write the data */
@@ -1115,12 +1299,12 @@ static int lhMapWriteRecord(lhash_kv_engine *pEngine,pgno iLogic,pgno iReal)
 		}else{
 			/* Make page writable */
 			rc = pEngine->pIo->xWrite(pPage);
-			if( rc != UNQLITE_OK ){
-				return rc;
+			if( rc == UNQLITE_OK ){
+				SyBigEndianPack32(&pPage->zData[8],pMap->nRec);
 			}
-			SyBigEndianPack32(&pPage->zData[8],pMap->nRec);
 		}
 	}
+	pEngine->pIo->xPageUnref(pPage);
 	return rc;
 }
 /*
@@ -1163,7 +1347,7 @@ static int lhPageDefragment(lhpage *pPage)
 			SyBigEndianPack32(zPtr,pCell->nKey);
 			zPtr += 4;
 			/* 8 byte data length */
-			SyBigEndianPack64(zPtr,pCell->nData);
+			SyBigEndianPack64(zPtr,L_HASH_CELL_DATA_LEN(pCell));
 			zPtr += 8;
 			/* 2 byte offset of the next cell */
 			SyBigEndianPack16(zPtr,pCell->iNext);
@@ -1229,6 +1413,11 @@ static int lhAllocateSpace(lhpage *pPage,sxu64 nAmount,sxu16 *pOfft)
 		/* Big chunk need an overflow page for its data */
 		return UNQLITE_FULL;
 	}
+	/* Acquire writer lock on this page */
+	rc = pPage->pHash->pIo->xWrite(pPage->pRaw);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
 	zPtr = &pPage->pRaw->zData[pPage->sHdr.iFree];
 	zEnd = &pPage->pRaw->zData[pPage->pHash->iPageSize];
 	nByte = (sxu16)nAmount;
@@ -1265,11 +1454,6 @@ static int lhAllocateSpace(lhpage *pPage,sxu64 nAmount,sxu16 *pOfft)
 		/* Point to the next free block */
 		zPtr = &pPage->pRaw->zData[iNext];
 	}
-	/* Acquire writer lock on this page */
-	rc = pPage->pHash->pIo->xWrite(pPage->pRaw);
-	if( rc != UNQLITE_OK ){
-		return rc;
-	}
 	/* Save block offset */
 	*pOfft = (sxu16)(zPtr - pPage->pRaw->zData);
 	/* Fix pointers */
@@ -1312,7 +1496,7 @@ static int lhCellWriteHeader(lhcell *pCell)
 	SyBigEndianPack32(zRaw,pCell->nKey);
 	zRaw += 4;
 	/* 8 byte data length */
-	SyBigEndianPack64(zRaw,pCell->nData);
+	SyBigEndianPack64(zRaw,L_HASH_CELL_DATA_LEN(pCell));
 	zRaw += 8;
 	/* 2 byte offset of the next cell */
 	pCell->iNext = pPage->sHdr.iOfft;
@@ -1658,7 +1842,8 @@ static int lhRecordOverwrite(
 	const unsigned char *zPtr,*zEnd;
 	unqlite_page *pOvfl,*pOld,*pNew;
 	lhpage *pPage = pCell->pPage;
-	sxu32 nAvail;
+	unsigned char *zZip = 0;
+	sxu32 nAvail,nZip;
 	pgno iOvfl;
 	int rc;
 	/* Acquire a writer lock on this page */
@@ -1686,17 +1871,28 @@ static int lhRecordOverwrite(
 			/* Check if another chunk is available for this cell */
 			rc = lhAllocateSpace(pPage,L_HASH_CELL_SZ + pCell->nKey + nByte,&iOfft);
 			if( rc != UNQLITE_OK ){
+				sxu64 nOld = pCell->nData;
+				if( lhCompressData(pEngine,pData,nByte,&zZip,&nZip) == UNQLITE_OK ){
+					/* Store the compressed data instead */
+					pCell->bZip = 1;
+					pCell->nOrig = (sxu64)nByte;
+					pData = (const void *)zZip;
+					nByte = (unqlite_int64)nZip;
+				}
 				/* Transfer the payload to an overflow page */
 				rc = lhCellWriteOvflPayload(pCell,&pPage->pRaw->zData[pCell->iStart + L_HASH_CELL_SZ],pCell->nKey,pData,nByte,(const void *)0);
+				if( zZip ){
+					SyMemBackendFree(&pEngine->sAllocator,zZip);
+				}
 				if( rc != UNQLITE_OK ){
 					return rc;
 				}
-				/* Update the cell header */
-				SyBigEndianPack64(&pPage->pRaw->zData[pCell->iStart + 4 /* Hash */ + 4 /* Key */],(sxu64)nByte);
-				/* Restore freespace */
-				lhRestoreSpace(pPage,(sxu16)(pCell->iStart + L_HASH_CELL_SZ),(sxu16)(pCell->nKey + pCell->nData));
 				/* New data size */
 				pCell->nData = (sxu64)nByte;
+				/* Update the cell header */
+				SyBigEndianPack64(&pPage->pRaw->zData[pCell->iStart + 4 /* Hash */ + 4 /* Key */],L_HASH_CELL_DATA_LEN(pCell));
+				/* Restore freespace */
+				lhRestoreSpace(pPage,(sxu16)(pCell->iStart + L_HASH_CELL_SZ),(sxu16)(pCell->nKey + nOld));
 			}else{
 				sxu16 iOldOfft = pCell->iStart;
 				sxu32 iOld = (sxu32)pCell->nData;
@@ -1735,18 +1931,27 @@ static int lhRecordOverwrite(
 			pEngine->pIo->xPageUnref(pOld);
 		}
 	}
+	/* Acquire a writer lock */
+	rc = pEngine->pIo->xWrite(pOvfl);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
 	/* Point to the data offset */
 	zRaw = &pOvfl->zData[pCell->iDataOfft];
 	zRawEnd = &pOvfl->zData[pEngine->iPageSize];
+	pCell->bZip = 0;
+	pCell->nOrig = 0;
+	if( lhCompressData(pEngine,pData,nByte,&zZip,&nZip) == UNQLITE_OK ){
+		/* Store the compressed data instead */
+		pCell->bZip = 1;
+		pCell->nOrig = (sxu64)nByte;
+		pData = (const void *)zZip;
+		nByte = (unqlite_int64)nZip;
+	}
 	/* The data to be stored */
 	zPtr = (const unsigned char *)pData;
 	zEnd = &zPtr[nByte];
 	/* Start the overwrite process */
-	/* Acquire a writer lock */
-	rc = pEngine->pIo->xWrite(pOvfl);
-	if( rc != UNQLITE_OK ){
-		return rc;
-	}
 	SyBigEndianPack64(pOvfl->zData,0);
 	for(;;){
 		sxu32 nLen;
@@ -1756,11 +1961,13 @@ static int lhRecordOverwrite(
 		if( zRaw >= zRawEnd ){
 			/* Acquire a new page */
 			rc = lhAcquirePage(pEngine,&pNew);
-			if( rc != UNQLITE_OK ){
-				return rc;
+			if( rc == UNQLITE_OK ){
+				rc = pEngine->pIo->xWrite(pNew);
 			}
-			rc = pEngine->pIo->xWrite(pNew);
 			if( rc != UNQLITE_OK ){
+				if( zZip ){
+					SyMemBackendFree(&pEngine->sAllocator,zZip);
+				}
 				return rc;
 			}
 			/* Link */
@@ -1783,9 +1990,12 @@ static int lhRecordOverwrite(
 	}
 	/* Unref the last overflow page */
 	pEngine->pIo->xPageUnref(pOvfl);
+	if( zZip ){
+		SyMemBackendFree(&pEngine->sAllocator,zZip);
+	}
 	/* Finally, update the cell header */
 	pCell->nData = (sxu64)nByte;
-	SyBigEndianPack64(&pPage->pRaw->zData[pCell->iStart + 4 /* Hash */ + 4 /* Key */],pCell->nData);
+	SyBigEndianPack64(&pPage->pRaw->zData[pCell->iStart + 4 /* Hash */ + 4 /* Key */],L_HASH_CELL_DATA_LEN(pCell));
 	/* All done */
 	return UNQLITE_OK;
 }
@@ -1803,7 +2013,7 @@ static int lhRecordAppend(
 	unsigned char *zRaw,*zRawEnd;
 	unqlite_page *pOvfl,*pNew;
 	sxu64 nDatalen;
-	sxu32 nAvail;
+	sxu32 nAvail,nOfft;
 	pgno iOvfl;
 	int rc;
 	if( pCell->nData + nByte < pCell->nData ){
@@ -1811,6 +2021,20 @@ static int lhRecordAppend(
 		pEngine->pIo->xErr(pEngine->pIo->pHandle,"Append operation will cause data overflow");
 		return UNQLITE_LIMIT;
 	}
+	if( pCell->bZip ){
+		SyBlob sWorker;
+		/* Compressed data, rewrite the whole record */
+		SyBlobInit(&sWorker,&pEngine->sAllocator);
+		rc = lhConsumeCellData(pCell,unqliteDataConsumer,&sWorker);
+		if( rc == UNQLITE_OK ){
+			rc = SyBlobAppend(&sWorker,pData,(sxu32)nByte);
+		}
+		if( rc == UNQLITE_OK ){
+			rc = lhRecordOverwrite(pCell,SyBlobData(&sWorker),(unqlite_int64)SyBlobLength(&sWorker));
+		}
+		SyBlobRelease(&sWorker);
+		return rc;
+	}
 	/* Acquire a writer lock on this page */
 	rc = pEngine->pIo->xWrite(pPage->pRaw);
 	if( rc != UNQLITE_OK ){
@@ -1905,10 +2129,14 @@ static int lhRecordAppend(
 	zPtr = (const unsigned char *)pData;
 	zEnd = &zPtr[nByte];
 	/* Acquire a writer lock */
+	nOfft = (sxu32)(zRaw - pOvfl->zData);
 	rc = pEngine->pIo->xWrite(pOvfl);
 	if( rc != UNQLITE_OK ){
 		return rc;
 	}
+	/* The pager may have moved the page content to a private buffer */
+	zRaw = &pOvfl->zData[nOfft];
+	zRawEnd = &pOvfl->zData[pEngine->iPageSize];
 	for(;;){
 		sxu32 nLen;
 		if( zPtr >= zEnd ){
@@ -1956,8 +2184,8 @@ static int lhRecordAppend(
  */
 static int lhSetEmptyPage(lhpage *pPage)
 {
-	unsigned char *zRaw = pPage->pRaw->zData;
 	lhphdr *pHeader = &pPage->sHdr;
+	unsigned char *zRaw;
 	sxu16 nByte;
 	int rc;
 	/* Acquire a writer lock */
@@ -1965,6 +2193,8 @@ static int lhSetEmptyPage(lhpage *pPage)
 	if( rc != UNQLITE_OK ){
 		return rc;
 	}
+	/* The pager may have moved the page content to a private buffer */
+	zRaw = pPage->pRaw->zData;
 	/* Offset of the first cell */
 	SyBigEndianPack16(zRaw,0);
 	zRaw += 2;
@@ -2052,7 +2282,20 @@ static int lhStoreCell(
 	}
 	/* Write the payload */
 	if( iNeedOvfl ){
+		unsigned char *zZip = 0;
+		sxu32 nZip;
+		if( lhCompressData(pEngine,pData,nDataLen,&zZip,&nZip) == UNQLITE_OK ){
+			/* Store the compressed data instead */
+			pCell->bZip = 1;
+			pCell->nOrig = pCell->nData;
+			pCell->nData = (sxu64)nZip;
+			pData = (const void *)zZip;
+			nDataLen = (unqlite_int64)nZip;
+		}
 		rc = lhCellWriteOvflPayload(pCell,pKey,nKeyLen,pData,nDataLen,(const void *)0);
+		if( zZip ){
+			SyMemBackendFree(&pEngine->sAllocator,zZip);
+		}
 		if( rc != UNQLITE_OK ){
 			lhCellDiscard(pCell);
 			return rc;
@@ -2192,6 +2435,8 @@ static int lhTransferCell(lhcell *pTarget,lhpage *pPage)
 	/* Fill-in the structure */
 	pCell->iStart = nOfft;
 	pCell->nData  = pTarget->nData;
+	pCell->bZip   = pTarget->bZip;
+	pCell->nOrig  = pTarget->nOrig;
 	pCell->nKey   = pTarget->nKey;
 	pCell->iOvfl  = pTarget->iOvfl;
 	pCell->iDataOfft = pTarget->iDataOfft;
@@ -2301,11 +2546,14 @@ static int lhSplit(lhpage *pTarget,int *pRetry)
 	/* Request a new page */
 	rc = lhAcquirePage(pEngine,&pRaw);
 	if( rc != UNQLITE_OK ){
+		pEngine->pIo->xPageUnref(pOld->pRaw);
 		return rc;
 	}
 	/* Initialize the page */
 	pNew = lhNewPage(pEngine,pRaw,0);
 	if( pNew == 0 ){
+		pEngine->pIo->xPageUnref(pRaw);
+		pEngine->pIo->xPageUnref(pOld->pRaw);
 		return UNQLITE_NOMEM;
 	}
 	/* Mark as an empty page */
@@ -2334,7 +2582,7 @@ static int lhSplit(lhpage *pTarget,int *pRetry)
 	/* Acquire a writer lock on the first page */
 	rc = pEngine->pIo->xWrite(pEngine->pHeader);
 	if( rc != UNQLITE_OK ){
-		return rc;
+		goto fail;
 	}
 	if( pEngine->split_bucket >= pEngine->max_split_bucket ){
 		/* Increment the generation number */
@@ -2344,7 +2592,8 @@ static int lhSplit(lhpage *pTarget,int *pRetry)
 		if( !pEngine->nmax_split_nucket ){
 			/* If this happen to your installation, please tell us <chm@symisc.net> */
 			pEngine->pIo->xErr(pEngine->pIo->pHandle,"Database page (64-bit integer) limit reached");
-			return UNQLITE_LIMIT;
+			rc = UNQLITE_LIMIT;
+			goto fail;
 		}
 		/* Reflect in the page header */
 		SyBigEndianPack64(&pEngine->pHeader->zData[4/*Magic*/+4/*Hash*/+8/*Free list*/],pEngine->split_bucket);
@@ -2353,10 +2602,14 @@ static int lhSplit(lhpage *pTarget,int *pRetry)
 		/* Modify only the split bucket */
 		SyBigEndianPack64(&pEngine->pHeader->zData[4/*Magic*/+4/*Hash*/+8/*Free list*/],pEngine->split_bucket);
 	}
+	/* Both pages are no longer in use */
+	pEngine->pIo->xPageUnref(pNew->pRaw);
+	pEngine->pIo->xPageUnref(pOld->pRaw);
 	/* All done */
 	return UNQLITE_OK;
 fail:
 	pEngine->pIo->xPageUnref(pNew->pRaw);
+	pEngine->pIo->xPageUnref(pOld->pRaw);
 	return rc;
 }
 /*
@@ -2505,6 +2758,637 @@ static int lhash_kv_append(
 	rc = lh_record_insert(pKv,pKey,(sxu32)nKeyLen,pData,nDataLen,1);
 	return rc;
 }
+/*
+ * Exported: xBucket() method.
+ * Logical bucket the given key maps to under the current split state.
+ */
+static int lhash_kv_bucket(unqlite_kv_engine *pKv,const void *pKey,int nKeyLen,pgno *piBucket)
+{
+	lhash_kv_engine *pEngine = (lhash_kv_engine *)pKv;
+	pgno iBucket;
+	sxu32 nHash;
+	int rc;
+	/* Make sure the header is loaded */
+	rc = pEngine->pIo->xGet(pEngine->pIo->pHandle,1,0);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	nHash = pEngine->xHash(pKey,(sxu32)nKeyLen);
+	iBucket = nHash & (pEngine->nmax_split_nucket - 1);
+	if( iBucket >= pEngine->split_bucket + pEngine->max_split_bucket ){
+		/* Low mask */
+		iBucket = nHash & (pEngine->max_split_bucket - 1);
+	}
+	*piBucket = iBucket;
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xReserve() method.
+ * Pre-size an empty linear hash so that the expected records fit without splits.
+ * The bucket pages are created up front so that they are laid out sequentially.
+ */
+static int lhash_kv_reserve(unqlite_kv_engine *pKv,unqlite_int64 nRecord,unqlite_int64 nByte)
+{
+	lhash_kv_engine *pEngine = (lhash_kv_engine *)pKv;
+	sxu64 nAvg,nTotal,nBucket;
+	unqlite_page *pRaw;
+	lhpage *pPage;
+	pgno iBucket,nMax;
+	int rc;
+	/* Make sure the header is loaded */
+	rc = pEngine->pIo->xGet(pEngine->pIo->pHandle,1,0);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	if( pEngine->nBuckRec > 0 ){
+		/* Not an empty storage */
+		return UNQLITE_LOCKED;
+	}
+	if( nRecord < 1 || nByte < 1 ){
+		return UNQLITE_OK;
+	}
+	/* Local bytes of an average cell, large payloads go to overflow pages */
+	nAvg = (sxu64)(nByte / nRecord) + L_HASH_CELL_SZ;
+	if( nAvg > (sxu64)L_HASH_MX_PAYLOAD(pEngine->iPageSize) ){
+		nAvg = L_HASH_CELL_SZ;
+	}
+	nTotal = nAvg * (sxu64)nRecord;
+	/* Fill the bucket pages up to three quarters */
+	nBucket = nTotal / ((L_HASH_MX_FREE_SPACE(pEngine->iPageSize) >> 2) * 3) + 1;
+	if( nBucket < 2 ){
+		return UNQLITE_OK;
+	}
+	for( nMax = 1 ; (nMax << 1) <= nBucket ; nMax <<= 1 );
+	/* As if the buckets below split_bucket were already split */
+	pEngine->split_bucket = nBucket - nMax;
+	pEngine->max_split_bucket = nMax;
+	pEngine->nmax_split_nucket = nMax << 1;
+	rc = pEngine->pIo->xWrite(pEngine->pHeader);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	SyBigEndianPack64(&pEngine->pHeader->zData[4/*Magic*/+4/*Hash*/+8/*Free list*/],pEngine->split_bucket);
+	SyBigEndianPack64(&pEngine->pHeader->zData[4/*Magic*/+4/*Hash*/+8/*Free list*/+8/*Split bucket*/],pEngine->max_split_bucket);
+	/* Create the bucket pages */
+	for( iBucket = 0 ; iBucket < nBucket ; ++iBucket ){
+		rc = lhAcquirePage(pEngine,&pRaw);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		pPage = lhNewPage(pEngine,pRaw,0);
+		if( pPage == 0 ){
+			pEngine->pIo->xPageUnref(pRaw);
+			return UNQLITE_NOMEM;
+		}
+		rc = lhSetEmptyPage(pPage);
+		if( rc == UNQLITE_OK ){
+			rc = lhMapWriteRecord(pEngine,iBucket,pRaw->iPage);
+		}
+		pEngine->pIo->xPageUnref(pRaw);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	return UNQLITE_OK;
+}
+/* Forward declaration */
+static void lhash_page_release(void *pUserData);
+/*
+ * Drop the parsed master pages (and their slave pages) from memory so that
+ * the vacuum can work on the raw pages. They are parsed again on demand.
+ */
+static void lhVacuumDiscard(lhash_kv_engine *pEngine)
+{
+	lhash_bmap_rec *pRec = pEngine->pList;
+	unqlite_page *pRaw;
+	sxu32 n;
+	for( n = 0 ; n < pEngine->nBuckRec ; ++n ){
+		if( pEngine->pIo->xLookup(pEngine->pIo->pHandle,pRec->iReal,&pRaw) == UNQLITE_OK && pRaw->pUserData ){
+			lhash_page_release(pRaw->pUserData);
+		}
+		pRec = pRec->pNext;
+	}
+}
+/*
+ * Rewrite the cells of a bucket that spilled into slave pages so that they
+ * are densely packed into as few pages as possible. The pages left empty
+ * are restored to the free list and their number is added to *pFreed.
+ */
+static int lhVacuumPackBucket(lhash_kv_engine *pEngine,pgno iMaster,sxu32 *pFreed)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	sxu32 nCap = (sxu32)L_HASH_MX_FREE_SPACE(pEngine->iPageSize);
+	unsigned char *zTmp,*zPtr,*zEnd;
+	const unsigned char *zRaw,*zCell;
+	sxu32 i,nPage,nUsed,nAvail,nCell,nSize;
+	unqlite_page **apPage,*pRaw;
+	sxu16 iOfft,iNext,iHead;
+	SySet aPage,aCell;
+	SyBlob sWork;
+	sxu64 nData;
+	sxu32 nKey;
+	pgno iOvfl;
+	int rc;
+	SySetInit(&aPage,&pEngine->sAllocator,sizeof(unqlite_page *));
+	SySetInit(&aCell,&pEngine->sAllocator,sizeof(sxu32));
+	SyBlobInit(&sWork,&pEngine->sAllocator);
+	/* Collect the master page and its slave pages */
+	rc = UNQLITE_OK;
+	while( iMaster > 0 ){
+		if( SySetUsed(&aPage) >= (sxu32)0x100000 ){
+			/* Slave pages loop */
+			rc = UNQLITE_CORRUPT;
+			goto done;
+		}
+		rc = pIo->xGet(pIo->pHandle,iMaster,&pRaw);
+		if( rc != UNQLITE_OK ){
+			goto done;
+		}
+		SySetPut(&aPage,(const void *)&pRaw);
+		SyBigEndianUnpack64(&pRaw->zData[2/*Cell offset*/+2/*Free block offset*/],&iMaster);
+	}
+	nPage = SySetUsed(&aPage);
+	apPage = (unqlite_page **)SySetBasePtr(&aPage);
+	if( nPage < 2 ){
+		/* No slave pages */
+		goto done;
+	}
+	/* Copy the cells (header and local payload) to the work buffer */
+	for( i = 0 ; i < nPage ; ++i ){
+		zRaw = apPage[i]->zData;
+		SyBigEndianUnpack16(zRaw,&iOfft);
+		nCell = 0;
+		while( iOfft > 0 ){
+			if( (sxu32)iOfft + L_HASH_CELL_SZ > (sxu32)pEngine->iPageSize || ++nCell > (sxu32)pEngine->iPageSize / L_HASH_CELL_SZ ){
+				rc = UNQLITE_CORRUPT;
+				goto done;
+			}
+			zCell = &zRaw[iOfft];
+			SyBigEndianUnpack32(&zCell[4/*Hash*/],&nKey);
+			SyBigEndianUnpack64(&zCell[4/*Hash*/+4/*Key*/],&nData);
+			SyBigEndianUnpack16(&zCell[4/*Hash*/+4/*Key*/+8/*Data*/],&iNext);
+			SyBigEndianUnpack64(&zCell[4/*Hash*/+4/*Key*/+8/*Data*/+2/*Next cell*/],&iOvfl);
+			nSize = L_HASH_CELL_SZ;
+			if( iOvfl == 0 ){
+				/* Local payload */
+				if( (sxu64)iOfft + L_HASH_CELL_SZ + nKey + nData > (sxu64)pEngine->iPageSize ){
+					rc = UNQLITE_CORRUPT;
+					goto done;
+				}
+				nSize += nKey + (sxu32)nData;
+			}
+			SySetPut(&aCell,(const void *)&nSize);
+			SyBlobAppend(&sWork,(const void *)zCell,nSize);
+			iOfft = iNext;
+		}
+	}
+	/* Pages needed once the cells are packed */
+	nUsed = 1;
+	nAvail = nCap;
+	for( i = 0 ; i < SySetUsed(&aCell) ; ++i ){
+		nSize = ((sxu32 *)SySetBasePtr(&aCell))[i];
+		if( nSize > nAvail ){
+			nUsed++;
+			nAvail = nCap;
+		}
+		nAvail -= nSize;
+	}
+	if( nUsed >= nPage ){
+		/* Nothing to gain */
+		goto done;
+	}
+	/* Rewrite the pages */
+	zTmp = pIo->xTmpPage(pIo->pHandle);
+	zEnd = &zTmp[pEngine->iPageSize];
+	zCell = (const unsigned char *)SyBlobData(&sWork);
+	nCell = 0;
+	for( i = 0 ; i < nUsed ; ++i ){
+		SyZero(zTmp,(sxu32)pEngine->iPageSize);
+		zPtr = &zTmp[L_HASH_PAGE_HDR_SZ];
+		iHead = 0;
+		while( nCell < SySetUsed(&aCell) ){
+			nSize = ((sxu32 *)SySetBasePtr(&aCell))[nCell];
+			if( nSize > (sxu32)(zEnd - zPtr) ){
+				break;
+			}
+			SyMemcpy((const void *)zCell,zPtr,nSize);
+			/* Link to the previous cell */
+			SyBigEndianPack16(&zPtr[4/*Hash*/+4/*Key*/+8/*Data*/],iHead);
+			iHead = (sxu16)(zPtr - zTmp);
+			zPtr += nSize;
+			zCell += nSize;
+			nCell++;
+		}
+		/* Page header */
+		SyBigEndianPack16(zTmp,iHead);
+		SyBigEndianPack64(&zTmp[2/*Cell offset*/+2/*Free block offset*/],i + 1 < nUsed ? apPage[i+1]->iPage : 0);
+		if( zEnd - zPtr > 3 ){
+			/* Trailing free block */
+			SyBigEndianPack16(&zTmp[2],(sxu16)(zPtr - zTmp));
+			SyBigEndianPack16(zPtr,0); /* Offset of the next free block */
+			SyBigEndianPack16(&zPtr[2],(sxu16)(zEnd - zPtr)); /* Block length */
+		}
+		rc = pIo->xWrite(apPage[i]);
+		if( rc != UNQLITE_OK ){
+			goto done;
+		}
+		SyMemcpy((const void *)zTmp,apPage[i]->zData,(sxu32)pEngine->iPageSize);
+	}
+	/* Restore the unused slave pages to the free list */
+	for( i = nUsed ; i < nPage ; ++i ){
+		rc = lhRestorePage(pEngine,apPage[i]);
+		if( rc != UNQLITE_OK ){
+			goto done;
+		}
+		(*pFreed)++;
+	}
+done:
+	apPage = (unqlite_page **)SySetBasePtr(&aPage);
+	for( i = 0 ; i < SySetUsed(&aPage) ; ++i ){
+		pIo->xPageUnref(apPage[i]);
+	}
+	SySetRelease(&aPage);
+	SySetRelease(&aCell);
+	SyBlobRelease(&sWork);
+	return rc;
+}
+/*
+ * A page past the new end of the database and the pointers referencing it.
+ * There is at most two of them: The link from the previous page on a chain
+ * and the data page of an overflow chain.
+ */
+typedef struct lhash_vacuum_ref lhash_vacuum_ref;
+struct lhash_vacuum_ref
+{
+	pgno aRef[2];   /* Pages holding a pointer to this page */
+	sxu16 aOfft[2]; /* Offset of the pointers */
+	sxu32 nRef;     /* Total number of pointers, 0 for an unused page */
+	pgno iNew;      /* New page number once relocated */
+};
+/*
+ * Record a pointer to iPage stored at offset iOfft of page iRef.
+ */
+static void lhVacuumRecordRef(lhash_vacuum_ref *aRef,pgno nNew,pgno nDb,pgno iPage,pgno iRef,sxu16 iOfft)
+{
+	lhash_vacuum_ref *pRef;
+	if( iPage < nNew || iPage >= nDb ){
+		return;
+	}
+	pRef = &aRef[iPage - nNew];
+	if( pRef->nRef < 2 ){
+		pRef->aRef[pRef->nRef] = iRef;
+		pRef->aOfft[pRef->nRef] = iOfft;
+	}
+	pRef->nRef++;
+}
+/*
+ * Walk the bucket map, the bucket pages with their slave pages and the overflow
+ * chains and record the pointers to the pages past the new end of the database.
+ */
+static int lhVacuumScan(lhash_kv_engine *pEngine,lhash_vacuum_ref *aRef,pgno nNew,pgno nDb)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	unqlite_page *pMap,*pPage,*pOvfl;
+	pgno iMap,iReal,iNum,iNext,iOvfl,iData,iChain;
+	sxu32 n,nRec,nCell,nLoop;
+	sxu16 iOfft,iPtr;
+	int rc;
+	/* The bucket map starts on the header page */
+	pMap = pEngine->pHeader;
+	pIo->xPageRef(pMap);
+	iPtr = 4/*Magic*/+4/*Hash*/+8/*Free list*/+8/*Split bucket*/+8/*Max split bucket*/;
+	nLoop = 0;
+	for(;;){
+		SyBigEndianUnpack64(&pMap->zData[iPtr],&iMap);
+		lhVacuumRecordRef(aRef,nNew,nDb,iMap,pMap->iPage,iPtr);
+		iPtr += 8;
+		SyBigEndianUnpack32(&pMap->zData[iPtr],&nRec);
+		iPtr += 4;
+		for( n = 0 ; n < nRec && (sxu32)iPtr + 16 <= (sxu32)pEngine->iPageSize ; ++n ){
+			/* Real bucket number */
+			SyBigEndianUnpack64(&pMap->zData[iPtr + 8],&iReal);
+			lhVacuumRecordRef(aRef,nNew,nDb,iReal,pMap->iPage,iPtr + 8);
+			iPtr += 16;
+			/* Walk the bucket and its slave pages */
+			for( iNum = iReal ; iNum > 0 ; iNum = iNext ){
+				if( ++nLoop > nDb ){
+					rc = UNQLITE_CORRUPT;
+					goto fail;
+				}
+				rc = pIo->xGet(pIo->pHandle,iNum,&pPage);
+				if( rc != UNQLITE_OK ){
+					goto fail;
+				}
+				SyBigEndianUnpack64(&pPage->zData[2/*Cell offset*/+2/*Free block offset*/],&iNext);
+				lhVacuumRecordRef(aRef,nNew,nDb,iNext,iNum,2+2);
+				SyBigEndianUnpack16(pPage->zData,&iOfft);
+				nCell = 0;
+				while( iOfft > 0 && (sxu32)iOfft + L_HASH_CELL_SZ <= (sxu32)pEngine->iPageSize &&
+					++nCell <= (sxu32)pEngine->iPageSize / L_HASH_CELL_SZ ){
+					SyBigEndianUnpack64(&pPage->zData[iOfft + 4/*Hash*/+4/*Key*/+8/*Data*/+2/*Next cell*/],&iOvfl);
+					if( iOvfl > 0 ){
+						/* Overflow chain */
+						lhVacuumRecordRef(aRef,nNew,nDb,iOvfl,iNum,iOfft + 4+4+8+2);
+						iData = 0;
+						while( iOvfl > 0 ){
+							if( ++nLoop > nDb ){
+								pIo->xPageUnref(pPage);
+								rc = UNQLITE_CORRUPT;
+								goto fail;
+							}
+							rc = pIo->xGet(pIo->pHandle,iOvfl,&pOvfl);
+							if( rc != UNQLITE_OK ){
+								pIo->xPageUnref(pPage);
+								goto fail;
+							}
+							if( iData == 0 ){
+								/* First overflow page, record the data page */
+								SyBigEndianUnpack64(&pOvfl->zData[8/*Next ovfl*/],&iData);
+								lhVacuumRecordRef(aRef,nNew,nDb,iData,iOvfl,8);
+							}
+							SyBigEndianUnpack64(pOvfl->zData,&iChain);
+							lhVacuumRecordRef(aRef,nNew,nDb,iChain,iOvfl,0);
+							pIo->xPageUnref(pOvfl);
+							iOvfl = iChain;
+						}
+					}
+					SyBigEndianUnpack16(&pPage->zData[iOfft + 4/*Hash*/+4/*Key*/+8/*Data*/],&iOfft);
+				}
+				pIo->xPageUnref(pPage);
+			}
+		}
+		/* Next map page */
+		pIo->xPageUnref(pMap);
+		if( iMap == 0 ){
+			break;
+		}
+		if( ++nLoop > nDb ){
+			return UNQLITE_CORRUPT;
+		}
+		rc = pIo->xGet(pIo->pHandle,iMap,&pMap);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		iPtr = 0;
+	}
+	return UNQLITE_OK;
+fail:
+	pIo->xPageUnref(pMap);
+	return rc;
+}
+/*
+ * Write a page number at the given offset of a page.
+ */
+static int lhVacuumWritePtr(lhash_kv_engine *pEngine,pgno iPage,sxu16 iOfft,pgno iValue)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	unqlite_page *pPage;
+	int rc;
+	rc = pIo->xGet(pIo->pHandle,iPage,&pPage);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	rc = pIo->xWrite(pPage);
+	if( rc == UNQLITE_OK ){
+		SyBigEndianPack64(&pPage->zData[iOfft],iValue);
+	}
+	pIo->xPageUnref(pPage);
+	return rc;
+}
+/*
+ * Move the pages past the new end of the database to free pages closer to
+ * the beginning of the file, relink the remaining free pages and shrink the
+ * database image. When nPage is greater than zero, at most nPage pages are
+ * cut from the end of the file. The number of free pages that a further call
+ * could reclaim is stored in *pnLeft.
+ */
+static int lhVacuumRelocate(lhash_kv_engine *pEngine,int nPage,pgno *pnLeft)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	lhash_vacuum_ref *aRef,*pRef;
+	unqlite_page *pSrc,*pDest;
+	pgno *aFree,*aKeep;
+	pgno nDb,nNew,nFree,nKeep,iPage,iNext;
+	lhash_bmap_rec *pRec;
+	SySet aList;
+	sxu32 n,i,j;
+	int rc;
+	*pnLeft = 0;
+	nDb = pIo->xPageCount(pIo->pHandle);
+	/* Collect the free list */
+	SySetInit(&aList,&pEngine->sAllocator,sizeof(pgno));
+	iPage = pEngine->nFreeList;
+	while( iPage > 0 ){
+		if( iPage < 2 || iPage >= nDb || (pgno)SySetUsed(&aList) >= nDb ){
+			SySetRelease(&aList);
+			return UNQLITE_CORRUPT;
+		}
+		SySetPut(&aList,(const void *)&iPage);
+		rc = pIo->xGet(pIo->pHandle,iPage,&pSrc);
+		if( rc != UNQLITE_OK ){
+			SySetRelease(&aList);
+			return rc;
+		}
+		SyBigEndianUnpack64(pSrc->zData,&iPage);
+		pIo->xPageUnref(pSrc);
+	}
+	nFree = (pgno)SySetUsed(&aList);
+	aFree = (pgno *)SySetBasePtr(&aList);
+	nNew = nDb - nFree;
+	if( nPage > 0 && nFree > (pgno)nPage ){
+		/* Incremental vacuum */
+		nNew = nDb - (pgno)nPage;
+		*pnLeft = nFree - (pgno)nPage;
+	}
+	if( nNew < 2 ){
+		nNew = 2;
+	}
+	if( nNew >= nDb ){
+		/* Nothing to cut */
+		SySetRelease(&aList);
+		return UNQLITE_OK;
+	}
+	aRef = (lhash_vacuum_ref *)SyMemBackendAlloc(&pEngine->sAllocator,(sxu32)((nDb - nNew) * sizeof(lhash_vacuum_ref)));
+	aKeep = (pgno *)SyMemBackendAlloc(&pEngine->sAllocator,(sxu32)((nFree + 1) * sizeof(pgno)));
+	if( aRef == 0 || aKeep == 0 ){
+		rc = UNQLITE_NOMEM;
+		goto done;
+	}
+	SyZero(aRef,(sxu32)((nDb - nNew) * sizeof(lhash_vacuum_ref)));
+	/* Find out who point to the pages past the new end */
+	rc = lhVacuumScan(pEngine,aRef,nNew,nDb);
+	if( rc != UNQLITE_OK ){
+		goto done;
+	}
+	for( n = 0 ; n < nFree ; ++n ){
+		if( aFree[n] >= nNew && aRef[aFree[n] - nNew].nRef > 0 ){
+			/* Free page in use */
+			rc = UNQLITE_CORRUPT;
+			goto done;
+		}
+	}
+	/* Pick a destination for each page in use */
+	nKeep = 0;
+	j = 0;
+	for( n = 0 ; n < nFree ; ++n ){
+		if( aFree[n] >= nNew ){
+			/* Dropped with the tail */
+			continue;
+		}
+		while( j < nDb - nNew && aRef[j].nRef < 1 ){
+			j++;
+		}
+		if( j < nDb - nNew ){
+			aRef[j++].iNew = aFree[n];
+		}else{
+			aKeep[nKeep++] = aFree[n];
+		}
+	}
+	/* Copy the page contents */
+	for( i = 0 ; i < nDb - nNew ; ++i ){
+		pRef = &aRef[i];
+		if( pRef->nRef < 1 ){
+			continue;
+		}
+		if( pRef->nRef > 2 || pRef->iNew == 0 ){
+			rc = UNQLITE_CORRUPT;
+			goto done;
+		}
+		rc = pIo->xGet(pIo->pHandle,nNew + i,&pSrc);
+		if( rc != UNQLITE_OK ){
+			goto done;
+		}
+		rc = pIo->xGet(pIo->pHandle,pRef->iNew,&pDest);
+		if( rc != UNQLITE_OK ){
+			pIo->xPageUnref(pSrc);
+			goto done;
+		}
+		rc = pIo->xWrite(pDest);
+		if( rc == UNQLITE_OK ){
+			SyMemcpy((const void *)pSrc->zData,pDest->zData,(sxu32)pEngine->iPageSize);
+		}
+		pIo->xPageUnref(pDest);
+		pIo->xPageUnref(pSrc);
+		if( rc != UNQLITE_OK ){
+			goto done;
+		}
+	}
+	/* Update the pointers, the referencing page may have moved as well */
+	for( i = 0 ; i < nDb - nNew ; ++i ){
+		pRef = &aRef[i];
+		for( n = 0 ; n < pRef->nRef ; ++n ){
+			iPage = pRef->aRef[n];
+			if( iPage >= nNew ){
+				iPage = aRef[iPage - nNew].iNew;
+			}
+			rc = lhVacuumWritePtr(pEngine,iPage,pRef->aOfft[n],pRef->iNew);
+			if( rc != UNQLITE_OK ){
+				goto done;
+			}
+		}
+	}
+	/* Relink the remaining free pages */
+	for( n = 0 ; n < nKeep ; ++n ){
+		iNext = n + 1 < nKeep ? aKeep[n + 1] : 0;
+		rc = pIo->xGet(pIo->pHandle,aKeep[n],&pSrc);
+		if( rc != UNQLITE_OK ){
+			goto done;
+		}
+		SyBigEndianUnpack64(pSrc->zData,&iPage);
+		if( iPage != iNext ){
+			rc = pIo->xWrite(pSrc);
+			if( rc == UNQLITE_OK ){
+				SyBigEndianPack64(pSrc->zData,iNext);
+			}
+		}
+		pIo->xPageUnref(pSrc);
+		if( rc != UNQLITE_OK ){
+			goto done;
+		}
+	}
+	rc = pIo->xWrite(pEngine->pHeader);
+	if( rc != UNQLITE_OK ){
+		goto done;
+	}
+	pEngine->nFreeList = nKeep > 0 ? aKeep[0] : 0;
+	SyBigEndianPack64(&pEngine->pHeader->zData[4/*Magic*/+4/*Hash*/],pEngine->nFreeList);
+	/* Reflect the moved buckets in the in-memory map */
+	pRec = pEngine->pList;
+	for( n = 0 ; n < pEngine->nBuckRec ; ++n ){
+		if( pRec->iReal >= nNew ){
+			pRec->iReal = aRef[pRec->iReal - nNew].iNew;
+		}
+		pRec = pRec->pNext;
+	}
+	if( pEngine->sPageMap.iNum >= nNew ){
+		/* Last bucket map page */
+		pEngine->sPageMap.iNum = aRef[pEngine->sPageMap.iNum - nNew].iNew;
+	}
+	/* Finally, cut the tail */
+	rc = pIo->xTruncate(pIo->pHandle,nNew);
+	if( rc == UNQLITE_OK && *pnLeft > 0 ){
+		*pnLeft = nKeep;
+	}
+done:
+	if( aRef ){
+		SyMemBackendFree(&pEngine->sAllocator,aRef);
+	}
+	if( aKeep ){
+		SyMemBackendFree(&pEngine->sAllocator,aKeep);
+	}
+	SySetRelease(&aList);
+	return rc;
+}
+/*
+ * Exported: xVacuum() method.
+ * Pack the buckets that spilled into slave pages, then move the pages in use
+ * toward the beginning of the file and cut the free pages left at its end.
+ */
+static int lhash_kv_vacuum(unqlite_kv_engine *pKv,int nPage,unqlite_int64 *pRemain)
+{
+	lhash_kv_engine *pEngine = (lhash_kv_engine *)pKv;
+	lhash_bmap_rec *pRec;
+	sxu32 nFreed = 0;
+	pgno nLeft = 0;
+	pgno iBucket;
+	int rc;
+	*pRemain = 0;
+	if( pEngine->pIo->xReadOnly(pEngine->pIo->pHandle) ){
+		return UNQLITE_READ_ONLY;
+	}
+	/* Acquire the first page (hash Header) so that everything gets loaded autmatically */
+	rc = pEngine->pIo->xGet(pEngine->pIo->pHandle,1,0);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	/* Work on the raw pages */
+	lhVacuumDiscard(pEngine);
+	for( iBucket = pEngine->iVacuum ; iBucket < pEngine->nBuckRec ; ){
+		pRec = lhMapFindBucket(pEngine,iBucket++);
+		if( pRec ){
+			rc = lhVacuumPackBucket(pEngine,pRec->iReal,&nFreed);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+		}
+		if( nPage > 0 && nFreed >= (sxu32)nPage ){
+			/* Resume from here on the next call */
+			break;
+		}
+	}
+	pEngine->iVacuum = iBucket;
+	/* Shrink the file */
+	rc = lhVacuumRelocate(pEngine,nPage,&nLeft);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	if( iBucket >= pEngine->nBuckRec ){
+		/* Every bucket was packed */
+		pEngine->iVacuum = 0;
+	}
+	*pRemain = (unqlite_int64)nLeft + (unqlite_int64)(pEngine->nBuckRec - iBucket);
+	return UNQLITE_OK;
+}
 /*
  * Write the hash header (Page one).
  */
@@ -2590,7 +3474,36 @@ static void lhash_page_release(void *pUserData)
 	lhash_kv_engine *pEngine = pPage->pHash;
 	lhcell *pNext,*pCell = pPage->pList;
 	unqlite_page *pRaw = pPage->pRaw;
+	lhpage *pSlave,*pNextSlave;
 	sxu32 n;
+	if( pPage->pMaster != pPage ){
+		lhpage *pMaster = pPage->pMaster;
+		lhpage **ppPtr = &pMaster->pSlave;
+		/* Slave page, detach it from its master */
+		while( *ppPtr ){
+			if( *ppPtr == pPage ){
+				*ppPtr = pPage->pNextSlave;
+				pMaster->iSlave--;
+				break;
+			}
+			ppPtr = &(*ppPtr)->pNextSlave;
+		}
+	}else{
+		/* Master page, the cells of its slave pages are dropped below
+		 * so release the slave pages as well.
+		 */
+		pSlave = pPage->pSlave;
+		while( pSlave ){
+			pNextSlave = pSlave->pNextSlave;
+			pSlave->pRaw->pUserData = 0;
+			/* Unref the slave page, reloaded with its master */
+			pEngine->pIo->xPageUnref(pSlave->pRaw);
+			SyMemBackendPoolFree(&pEngine->sAllocator,pSlave);
+			pSlave = pNextSlave;
+		}
+		pPage->pSlave = 0;
+		pPage->iSlave = 0;
+	}
 	/* Drop in-memory cells */
 	for( n = 0 ; n < pPage->nCell ; ++n ){
 		pNext = pCell->pNext;
@@ -2609,7 +3522,7 @@ static void lhash_page_release(void *pUserData)
 	pRaw->pUserData = 0;
 }
 /*
- * Default hash function (DJB).
+ * Legacy hash function (DJB) used by databases created by older releases.
  */
 static sxu32 lhash_bin_hash(const void *pSrc,sxu32 nLen)
 {
@@ -2628,6 +3541,14 @@ static sxu32 lhash_bin_hash(const void *pSrc,sxu32 nLen)
 	}	
 	return nH;
 }
+/*
+ * Default hash function: 64-bit hash of the whole key folded to 32 bits.
+ */
+static sxu32 lhash_bin_hash64(const void *pSrc,sxu32 nLen)
+{
+	sxu64 nH = SyBinHash64(pSrc,nLen);
+	return (sxu32)(nH ^ (nH >> 32));
+}
 /*
  * Exported: xInit() method.
  * Initialize the Key value storage engine.
@@ -2645,7 +3566,7 @@ static int lhash_kv_init(unqlite_kv_engine *pEngine,int iPageSize)
 //#endif
 	pHash->iPageSize = iPageSize;
 	/* Default hash function */
-	pHash->xHash = lhash_bin_hash;
+	pHash->xHash = lhash_bin_hash64;
 	/* Default comparison function */
 	pHash->xCmp = SyMemcmp;
 	/* Allocate a new record map */
@@ -2710,6 +3631,12 @@ static int lhash_kv_config(unqlite_kv_engine *pEngine,int op,va_list ap)
 		}
 		break;
 									 }
+	case UNQLITE_KV_CONFIG_ZIP_THRESHOLD: {
+		/* Compress the data of large records stored on overflow pages */
+		unsigned int nThreshold = va_arg(ap,unsigned int);
+		pHash->nZipThreshold = (sxu32)nThreshold;
+		break;
+									 }
 	default:
 		/* Unknown OP */
 		rc = UNQLITE_UNKNOWN;
@@ -2730,6 +3657,13 @@ struct lhash_kv_cursor
 	lhcell *pCell;        /* Current cell we are processing */
 	unqlite_page *pRaw;   /* Raw disk page */
 	lhash_bmap_rec *pRec; /* Logical to real bucket map */
+	/* Read-ahead state */
+	lhash_bmap_rec *pAhead; /* Next map record to read-ahead */
+	int nAhead;           /* Buckets read-ahead but not yet visited */
+	int nLast;            /* Size of the last read-ahead batch */
+	int nSeq;             /* Consecutive buckets visited in the same direction */
+	int bNext;            /* Direction of the scan */
+	int bNoAhead;         /* Read-ahead is disabled */
 };
 /* 
  * Possible state of the cursor
@@ -2737,6 +3671,71 @@ struct lhash_kv_cursor
 #define L_HASH_CURSOR_STATE_NEXT_PAGE 1 /* Next page in the list */
 #define L_HASH_CURSOR_STATE_CELL      2 /* Processing Cell */
 #define L_HASH_CURSOR_STATE_DONE      3 /* Cursor does not point to anything */
+/*
+ * Maximum number of buckets passed to the pager in a single read-ahead request.
+ */
+#define L_HASH_READ_AHEAD_MAX 64
+/*
+ * Reset the read-ahead state of the cursor.
+ */
+static void lhCursorResetReadAhead(lhash_kv_cursor *pCur)
+{
+	pCur->pAhead = 0;
+	pCur->nAhead = pCur->nLast = pCur->nSeq = 0;
+	pCur->bNoAhead = 0;
+}
+/*
+ * A bucket was visited by a cursor scan. Once the scan pattern is detected,
+ * hand the real page numbers of the upcoming buckets (taken from the bucket
+ * map) to the pager so that they are read in batches rather than one page
+ * at a time.
+ */
+static void lhCursorReadAhead(lhash_kv_cursor *pCur,int bNext)
+{
+	const unqlite_kv_io *pIo = pCur->pStore->pIo;
+	pgno aPgno[L_HASH_READ_AHEAD_MAX];
+	lhash_bmap_rec *pRec;
+	int n,nDone;
+	if( pCur->bNoAhead || pIo->xPrefetch == 0 ){
+		return;
+	}
+	if( pCur->bNext != bNext ){
+		/* Direction changed */
+		pCur->bNext = bNext;
+		pCur->nAhead = pCur->nSeq = 0;
+	}
+	if( pCur->nAhead > 0 ){
+		pCur->nAhead--;
+	}
+	if( ++pCur->nSeq < 2 || pCur->nAhead > (pCur->nLast >> 1) ){
+		/* Not a scan yet or enough buckets ahead */
+		return;
+	}
+	if( pCur->nAhead < 1 ){
+		pCur->pAhead = pCur->pRec;
+	}
+	pRec = pCur->pAhead;
+	n = 0;
+	while( pRec && n < L_HASH_READ_AHEAD_MAX ){
+		aPgno[n++] = pRec->iReal;
+		pRec = bNext ? pRec->pPrev : pRec->pNext; /* Not a bug, reverse link */
+	}
+	if( n < 1 ){
+		return;
+	}
+	nDone = pIo->xPrefetch(pIo->pHandle,aPgno,n);
+	if( nDone < 1 ){
+		/* Read-ahead disabled */
+		pCur->bNoAhead = 1;
+		return;
+	}
+	/* Advance the read-ahead cursor */
+	for( n = 0 ; n < nDone && pCur->pAhead ; n++ ){
+		pCur->pAhead = bNext ? pCur->pAhead->pPrev : pCur->pAhead->pNext;
+	}
+	pCur->nAhead += nDone;
+	pCur->nLast = nDone;
+}
 /*
  * Initialize the cursor.
  */
@@ -2750,6 +3749,8 @@ static void lhInitCursor(unqlite_kv_cursor *pPtr)
 	 pCur->pRec = pEngine->pFirst;
 	 pCur->pRaw = 0;
 	 pCur->is_first = 1;
+	 pCur->bNext = 1;
+	 lhCursorResetReadAhead(pCur);
 }
 /*
  * Point to the next page on the database.
@@ -2773,6 +3774,7 @@ static int lhCursorNextPage(lhash_kv_cursor *pPtr)
 		}
 		/* Advance the map cursor */
 		pCur->pRec = pRec->pPrev; /* Not a bug, reverse link */
+		lhCursorReadAhead(pCur,1);
 		/* Load the next page on the list */
 		rc = lhLoadPage((lhash_kv_engine *)pCur->pStore,pRec->iReal,0,&pPage,0);
 		if( rc != UNQLITE_OK ){
@@ -2812,6 +3814,7 @@ static int lhCursorPrevPage(lhash_kv_cursor *pPtr)
 		}
 		/* Advance the map cursor */
 		pCur->pRec = pRec->pNext; /* Not a bug, reverse link */
+		lhCursorReadAhead(pCur,0);
 		/* Load the previous page on the list */
 		rc = lhLoadPage((lhash_kv_engine *)pCur->pStore,pRec->iReal,0,&pPage,0);
 		if( rc != UNQLITE_OK ){
@@ -2855,6 +3858,7 @@ static int lhCursorFirst(unqlite_kv_cursor *pCursor)
 	}
 	/* Point to the first map record */
 	pCur->pRec = pEngine->pFirst;
+	lhCursorResetReadAhead(pCur);
 	/* Load the cells */
 	rc = lhCursorNextPage(pCur);
 	return rc;
@@ -2877,6 +3881,7 @@ static int lhCursorLast(unqlite_kv_cursor *pCursor)
 	}
 	/* Point to the last map record */
 	pCur->pRec = pEngine->pList;
+	lhCursorResetReadAhead(pCur);
 	/* Load the cells */
 	rc = lhCursorPrevPage(pCur);
 	return rc;
@@ -2957,6 +3962,8 @@ static int lhCursorDataLength(unqlite_kv_cursor *pCursor,unqlite_int64 *pLen)
 {
 	lhash_kv_cursor *pCur = (lhash_kv_cursor *)pCursor;
 	lhcell *pCell;
+	sxu64 nData = 0;
+	int rc;
 	
 	if( pCur->iState != L_HASH_CURSOR_STATE_CELL || pCur->pCell == 0 ){
 		/* Invalid state */
@@ -2965,8 +3972,9 @@ static int lhCursorDataLength(unqlite_kv_cursor *pCursor,unqlite_int64 *pLen)
 	/* Point to the target cell */
 	pCell = pCur->pCell;
 	/* Return data length */
-	*pLen = (unqlite_int64)pCell->nData;
-	return UNQLITE_OK;
+	rc = lhCellDataLength(pCell,&nData);
+	*pLen = (unqlite_int64)nData;
+	return rc;
 }
 /*
  * Consume the key.
@@ -3009,6 +4017,35 @@ static int lhCursorData(unqlite_kv_cursor *pCursor,int (*xConsumer)(const void *
 	rc = lhConsumeCellData(pCell,xConsumer,pUserData);
 	return rc;
 }
+/*
+ * Point to the data of a cell stored locally and pin its page.
+ * Data spilled to overflow pages is not contiguous and cannot be referenced.
+ */
+static int lhCursorDataRef(unqlite_kv_cursor *pCursor,const void **ppData,unqlite_int64 *pLen,unqlite_page **ppPage)
+{
+	lhash_kv_cursor *pCur = (lhash_kv_cursor *)pCursor;
+	unqlite_page *pRaw;
+	lhcell *pCell;
+	int rc;
+	if( pCur->iState != L_HASH_CURSOR_STATE_CELL || pCur->pCell == 0 ){
+		/* Invalid state */
+		return UNQLITE_INVALID;
+	}
+	/* Point to the target cell */
+	pCell = pCur->pCell;
+	if( pCell->iOvfl != 0 ){
+		return UNQLITE_NOTIMPLEMENTED;
+	}
+	pRaw = pCell->pPage->pRaw;
+	rc = pCur->pStore->pIo->xPageRef(pRaw);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	*ppData = (const void *)&pRaw->zData[pCell->iStart + L_HASH_CELL_SZ + pCell->nKey];
+	*pLen = (unqlite_int64)pCell->nData;
+	*ppPage = pRaw;
+	return UNQLITE_OK;
+}
 /*
  * Find a partiuclar record.
  */
@@ -3016,8 +4053,14 @@ static int lhCursorSeek(unqlite_kv_cursor *pCursor,const void *pKey,int nByte,in
 {
 	lhash_kv_cursor *pCur = (lhash_kv_cursor *)pCursor;
 	int rc;
+	if( pCur->pRaw ){
+		/* Unref the previous page */
+		pCur->pStore->pIo->xPageUnref(pCur->pRaw);
+		pCur->pRaw = 0;
+	}
+	lhCursorResetReadAhead(pCur);
 	/* Perform a lookup */
-	rc = lhRecordLookup((lhash_kv_engine *)pCur->pStore,pKey,nByte,&pCur->pCell);
+	rc = lhRecordLookup((lhash_kv_engine *)pCur->pStore,pKey,nByte,&pCur->pCell,&pCur->pRaw);
 	if( rc != UNQLITE_OK ){
 		SXUNUSED(iPos);
 		pCur->pCell = 0;
@@ -3047,6 +4090,18 @@ static int lhCursorDelete(unqlite_kv_cursor *pCursor)
 	rc = lhRecordRemove(pCell);
 	return rc;
 }
+/*
+ * Release the cursor. (xCursorRelease callback).
+ */
+static void lhCursorRelease(unqlite_kv_cursor *pCursor)
+{
+	lhash_kv_cursor *pCur = (lhash_kv_cursor *)pCursor;
+	if( pCur->pRaw ){
+		/* Unref the page the cursor is pointing to */
+		pCur->pStore->pIo->xPageUnref(pCur->pRaw);
+		pCur->pRaw = 0;
+	}
+}
 /*
  * Export the linear-hash storage engine.
  */
@@ -3056,7 +4111,7 @@ UNQLITE_PRIVATE const unqlite_kv_methods * unqliteExportDiskKvStorage(void)
 		"hash",                     /* zName */
 		sizeof(lhash_kv_engine),    /* szKv */
 		sizeof(lhash_kv_cursor),    /* szCursor */
-		1,                          /* iVersion */
+		7,                          /* iVersion */
 		lhash_kv_init,              /* xInit */
 		lhash_kv_release,           /* xRelease */
 		lhash_kv_config,            /* xConfig */
@@ -3076,7 +4131,13 @@ UNQLITE_PRIVATE const unqlite_kv_methods * unqliteExportDiskKvStorage(void)
 		lhCursorDataLength,         /* xDataLength */
 		lhCursorData,               /* xData */
 		lhCursorReset,              /* xReset */
-		0                           /* xRelease */                        
+		lhCursorRelease,            /* xRelease */
+		0,                          /* xSync */
+		lhash_kv_bucket,            /* xBucket */
+		lhCursorDataRef,            /* xDataRef */
+		lhash_kv_reserve,           /* xReserve */
+		lhash_kv_vacuum,            /* xVacuum */
+		1                           /* bSharedRead */
 	};
 	return &sDiskStore;
 }
@@ -0,0 +1,2067 @@
+/*
+ * Symisc unQLite: An Embeddable NoSQL (Post Modern) Database Engine.
+ * Copyright (C) 2012-2018, Symisc Systems https://unqlite.symisc.net/
+ * Version 1.2.1
+ * For information on licensing, redistribution of this file, and for a DISCLAIMER OF ALL WARRANTIES
+ * please contact Symisc Systems via:
+ *       legal@symisc.net
+ *       licensing@symisc.net
+ *       contact@symisc.net
+ * or visit:
+ *      https://unqlite.symisc.net/licensing.html
+ */
+ /* $SymiscID: lsm_kv.c v1.0 Linux 2026-10-17 14:40 stable <chm@symisc.net> $ */
+#ifndef UNQLITE_AMALGAMATION
+#include "unqliteInt.h"
+#endif
+/*
+ * This file implements a log-structured merge (LSM) Key/Value storage engine.
+ * Records are first inserted in an in-memory skip list (the memtable). When the memtable
+ * grows past LSM_MEMTABLE_SIZE or when the transaction is committed, it is written out
+ * sequentially as an immutable sorted run: a contiguous range of pages holding the records
+ * in key order, followed by a sparse index and a bloom filter.
+ * Runs of the same level are merged into a single run of the next level once there are
+ * LSM_MERGE_FANOUT of them, so that lookups only probe a handful of runs.
+ * Deleted records are represented by tombstones which shadow the older versions of the
+ * record until the oldest run takes part in a merge.
+ */
+/* Magic number identifying a valid storage image */
+#define LSM_MAGIC 0x15A7EE01
+/*
+ * Memtable size (in bytes) past which it is written out as a sorted run.
+ */
+#ifndef LSM_MEMTABLE_SIZE
+#define LSM_MEMTABLE_SIZE (4*1024*1024)
+#endif
+/*
+ * Size of the chunks the memtable entries are allocated from.
+ */
+#define LSM_CHUNK_SIZE (64*1024)
+/*
+ * Number of runs of the same level merged together.
+ */
+#define LSM_MERGE_FANOUT 4
+/*
+ * Maximum height of the memtable skip list.
+ */
+#define LSM_SKIP_HEIGHT 12
+/*
+ * Bloom filter: bits per key and number of probes.
+ */
+#define LSM_BLOOM_BITS  10
+#define LSM_BLOOM_PROBE 7
+/*
+ * Data length of a deleted record.
+ */
+#define LSM_TOMBSTONE SXU64_HIGH
+/*
+ * Record header: Key length (4 bytes) + Data length (8 bytes).
+ * The key and the data follow.
+ */
+#define LSM_REC_HDR_SZ (4+8)
+/*
+ * Index entry header: Record offset (8 bytes) + Key length (4 bytes).
+ * The key follows.
+ */
+#define LSM_IDX_HDR_SZ (8+4)
+/*
+ * Granularity of the sparse index: a point lookup scans at most one block
+ * plus one record.
+ */
+#define LSM_INDEX_BLOCK 512
+/*
+ * Storage header (page one) layout:
+ *   Magic (4 bytes) + Total runs (4 bytes) + Total free extents (4 bytes) + Reserved (4 bytes)
+ *   followed by the run descriptors (newest first) and the free extents.
+ */
+#define LSM_HDR_MAGIC 0
+#define LSM_HDR_NRUN  4
+#define LSM_HDR_NFREE 8
+#define LSM_HDR_SZ    16
+/*
+ * Run descriptor: First page (8 bytes) + Total pages (4 bytes) + Level (4 bytes)
+ *   + Data size (8 bytes) + Total records (8 bytes) + Index size (8 bytes)
+ *   + Total index entries (4 bytes) + Bloom filter size (4 bytes).
+ */
+#define LSM_RUN_SZ  48
+/*
+ * Free extent: First page (8 bytes) + Total pages (8 bytes).
+ */
+#define LSM_FREE_SZ 16
+/* Forward declaration */
+typedef struct lsm_kv_engine lsm_kv_engine;
+/*
+ * Memtable entry. The key and the initial data are stored right after the forward links.
+ */
+typedef struct lsm_node lsm_node;
+struct lsm_node
+{
+	void *pData;         /* Record data */
+	sxu64 nData;         /* Data length or LSM_TOMBSTONE */
+	sxu32 nKey;          /* Key length */
+	int nHeight;         /* Total forward links */
+	lsm_node *pPrev;     /* Previous entry */
+	lsm_node *apNext[1]; /* Forward links */
+};
+#define LSM_NODE_KEY(NODE) ((const unsigned char *)&(NODE)->apNext[(NODE)->nHeight])
+/*
+ * Sparse index entry: one entry per record starting in a new LSM_INDEX_BLOCK sized block.
+ */
+typedef struct lsm_index lsm_index;
+struct lsm_index
+{
+	sxu64 iOff;                /* Record offset in the data stream */
+	const unsigned char *zKey; /* Record key */
+	sxu32 nKey;                /* Key length */
+};
+/*
+ * A sorted run. The data stream starts at the first page, the index and
+ * the bloom filter follow.
+ */
+typedef struct lsm_run lsm_run;
+struct lsm_run
+{
+	pgno iFirst;         /* First page */
+	sxu32 nPage;         /* Total pages */
+	sxu32 iLevel;        /* Merge level */
+	sxu64 nData;         /* Size of the data stream */
+	sxu64 nRec;          /* Total records */
+	sxu64 nIndexByte;    /* Size of the index */
+	sxu32 nIndex;        /* Total index entries */
+	sxu32 nBloom;        /* Size of the bloom filter */
+	lsm_index *aIndex;   /* Decoded index (also owns the raw index and the filter) */
+	unsigned char *zBloom; /* Bloom filter */
+	int bNew;            /* Written by the current transaction */
+};
+/*
+ * Free page extent.
+ */
+typedef struct lsm_extent lsm_extent;
+struct lsm_extent
+{
+	pgno iFirst;
+	pgno nPage;
+};
+/*
+ * Each active LSM engine is represented by an instance of the following structure.
+ */
+struct lsm_kv_engine
+{
+	const unqlite_kv_io *pIo;    /* IO methods: Must be first */
+	/* Private fields */
+	SyMemBackend sAllocator;     /* Private memory backend */
+	SyMemBackend sMem;           /* Memtable memory, released on each flush */
+	unsigned char *zChunk;       /* Free space of the current memtable chunk */
+	sxu32 nChunkFree;            /* Bytes left in zChunk */
+	ProcCmp xCmp;                /* Key comparison function */
+	unqlite_page *pHeader;       /* Page one of the storage */
+	int iPageSize;               /* Page size */
+	/* Memtable */
+	lsm_node *apHead[LSM_SKIP_HEIGHT]; /* Skip list heads */
+	lsm_node *pLast;             /* Last entry */
+	int nHeight;                 /* Current skip list height */
+	sxu32 iRand;                 /* PRNG state */
+	sxu64 nMemByte;              /* Memory used by the memtable */
+	sxu64 nMemData;              /* Serialized size of the memtable records */
+	sxu64 nMemRec;               /* Total memtable entries */
+	/* Runs */
+	lsm_run *aRun;               /* Sorted runs, newest first */
+	int nRun;                    /* Total runs */
+	int nMaxRun;                 /* Runs that fit in the header */
+	int nMaxFree;                /* Free extents that fit in the header */
+	SySet sFree;                 /* Committed free extents (lsm_extent) */
+	SySet sPending;              /* Extents freed by the current transaction */
+	int bSynced;                 /* The transaction was committed */
+	sxu64 iGen;                  /* Bumped on each change, used to revalidate cursors */
+	SyBlob sIndex;               /* Index of the run being written */
+	SyBlob sWorker;              /* Data of appended records */
+};
+/*
+ * Iterator over the memtable or a single run.
+ */
+typedef struct lsm_iter lsm_iter;
+struct lsm_iter
+{
+	lsm_kv_engine *pEngine;
+	lsm_run *pRun;       /* Run, NULL for the memtable */
+	lsm_node *pNode;     /* Memtable entry */
+	sxu64 iOff;          /* Offset of the current record in the run */
+	sxu64 nData;         /* Data length of the current record or LSM_TOMBSTONE */
+	sxu32 nKey;          /* Key length of the current record */
+	SyBlob sKey;         /* Key of the current run record */
+	int bValid;          /* True if the iterator points to a record */
+};
+/*
+ * Merge of several iterators, the first one being the newest.
+ */
+typedef struct lsm_merge lsm_merge;
+struct lsm_merge
+{
+	SyMemBackend *pAlloc; /* Memory backend */
+	lsm_iter *aIter;      /* Source iterators, newest first */
+	int nIter;            /* Total sources */
+	int nAlloc;           /* Allocated sources */
+	int iCur;             /* Source holding the current record, -1 at EOF */
+	int iDir;             /* Direction: 1 forward, -1 backward */
+	int bKeepTomb;        /* Report tombstones */
+	SyBlob sKey;          /* Key saved across direction changes */
+};
+/*
+ * Key comparison. Shorter keys sort first on a common prefix.
+ */
+static int lsmCmp(lsm_kv_engine *pEngine,const void *pA,sxu32 nA,const void *pB,sxu32 nB)
+{
+	sxu32 n = nA < nB ? nA : nB;
+	int r;
+	r = n > 0 ? pEngine->xCmp(pA,pB,n) : 0;
+	if( r == 0 && nA != nB ){
+		r = nA < nB ? -1 : 1;
+	}
+	return r;
+}
+static int lsmBlobConsumer(const void *pData,unsigned int nLen,void *pUserData)
+{
+	return SyBlobAppend((SyBlob *)pUserData,pData,nLen);
+}
+/*
+ * Bloom filter hashes (DJB and FNV-1).
+ */
+static sxu32 lsmHash1(const unsigned char *z,sxu32 n)
+{
+	sxu32 h = 5381;
+	while( n-- > 0 ){
+		h = (h << 5) + h + *z++;
+	}
+	return h;
+}
+static sxu32 lsmHash2(const unsigned char *z,sxu32 n)
+{
+	sxu32 h = 0x811C9DC5;
+	while( n-- > 0 ){
+		h = (h * 0x01000193) ^ *z++;
+	}
+	return h | 1;
+}
+static void lsmBloomAdd(unsigned char *zBloom,sxu32 nBloom,const unsigned char *zKey,sxu32 nKey)
+{
+	sxu32 h1 = lsmHash1(zKey,nKey),h2 = lsmHash2(zKey,nKey);
+	sxu32 nBit = nBloom << 3;
+	sxu32 i,iBit;
+	for( i = 0 ; i < LSM_BLOOM_PROBE ; ++i ){
+		iBit = (h1 + i * h2) % nBit;
+		zBloom[iBit >> 3] |= (unsigned char)(1 << (iBit & 7));
+	}
+}
+static int lsmBloomTest(const unsigned char *zBloom,sxu32 nBloom,const unsigned char *zKey,sxu32 nKey)
+{
+	sxu32 h1 = lsmHash1(zKey,nKey),h2 = lsmHash2(zKey,nKey);
+	sxu32 nBit = nBloom << 3;
+	sxu32 i,iBit;
+	for( i = 0 ; i < LSM_BLOOM_PROBE ; ++i ){
+		iBit = (h1 + i * h2) % nBit;
+		if( (zBloom[iBit >> 3] & (1 << (iBit & 7))) == 0 ){
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+/*
+ * Size of the bloom filter for the given number of keys.
+ */
+static sxu32 lsmBloomSize(sxu64 nRec)
+{
+	return (sxu32)(((nRec * LSM_BLOOM_BITS) >> 3) + 8);
+}
+/*
+ * ----------------------------------------------------------
+ * Memtable.
+ * ----------------------------------------------------------
+ */
+/*
+ * Memtable allocations are carved from large chunks which are only released
+ * by a flush. Oversized requests get a chunk of their own.
+ */
+static void * lsmMemAlloc(lsm_kv_engine *pEngine,sxu32 nByte)
+{
+	sxu32 nChunk;
+	void *pPtr;
+	/* Keep the nodes aligned */
+	nByte = (nByte + 7) & ~7;
+	if( nByte > pEngine->nChunkFree ){
+		nChunk = nByte > LSM_CHUNK_SIZE / 4 ? nByte : LSM_CHUNK_SIZE;
+		pPtr = SyMemBackendAlloc(&pEngine->sMem,nChunk + 8);
+		if( pPtr == 0 ){
+			return 0;
+		}
+		pEngine->nMemByte += nChunk;
+		pPtr = (void *)&((unsigned char *)pPtr)[(8 - (SX_ADDR(pPtr) & 7)) & 7];
+		if( nChunk != LSM_CHUNK_SIZE ){
+			return pPtr;
+		}
+		pEngine->zChunk = (unsigned char *)pPtr;
+		pEngine->nChunkFree = nChunk;
+	}
+	pPtr = (void *)pEngine->zChunk;
+	pEngine->zChunk += nByte;
+	pEngine->nChunkFree -= nByte;
+	return pPtr;
+}
+/*
+ * Return the last entry whose key is less than (or equal to if bInclusive is set)
+ * the given key, NULL for the head of the list. If apUpdate is not NULL, it
+ * receives the last entry visited at each level.
+ */
+static lsm_node * lsmMemSeek(lsm_kv_engine *pEngine,const void *pKey,sxu32 nKey,int bInclusive,lsm_node **apUpdate)
+{
+	lsm_node *pNode = 0,*pNext;
+	int i,r;
+	for( i = pEngine->nHeight - 1 ; i >= 0 ; --i ){
+		for(;;){
+			pNext = pNode ? pNode->apNext[i] : pEngine->apHead[i];
+			if( pNext == 0 ){
+				break;
+			}
+			r = lsmCmp(pEngine,LSM_NODE_KEY(pNext),pNext->nKey,pKey,nKey);
+			if( r > 0 || (r == 0 && !bInclusive) ){
+				break;
+			}
+			pNode = pNext;
+		}
+		if( apUpdate ){
+			apUpdate[i] = pNode;
+		}
+	}
+	return pNode;
+}
+/*
+ * Insert or replace a memtable entry. nData is LSM_TOMBSTONE for a deletion.
+ */
+static int lsmMemPut(lsm_kv_engine *pEngine,const void *pKey,sxu32 nKey,const void *pData,sxu64 nData)
+{
+	lsm_node *apUpdate[LSM_SKIP_HEIGHT];
+	lsm_node *pNode,*pNext;
+	sxu32 nCopy = 0;
+	void *pCopy;
+	int i,nHeight;
+	if( nData != LSM_TOMBSTONE ){
+		if( nData >= SXU32_HIGH ){
+			return UNQLITE_LIMIT;
+		}
+		nCopy = (sxu32)nData;
+	}
+	pNode = lsmMemSeek(pEngine,pKey,nKey,FALSE,apUpdate);
+	pNext = pNode ? pNode->apNext[0] : pEngine->apHead[0];
+	if( pNext && lsmCmp(pEngine,LSM_NODE_KEY(pNext),pNext->nKey,pKey,nKey) == 0 ){
+		/* Replace the existing entry */
+		pCopy = 0;
+		if( nCopy > 0 ){
+			/* The old data is reclaimed by the next flush */
+			pCopy = lsmMemAlloc(pEngine,nCopy);
+			if( pCopy == 0 ){
+				return UNQLITE_NOMEM;
+			}
+			SyMemcpy(pData,pCopy,nCopy);
+		}
+		if( pNext->nData != LSM_TOMBSTONE ){
+			pEngine->nMemData -= pNext->nData;
+		}
+		pNext->pData = pCopy;
+		pNext->nData = nData;
+		pEngine->nMemData += nCopy;
+		return UNQLITE_OK;
+	}
+	/* Random height, each level is four times less likely than the previous one */
+	nHeight = 1;
+	for(;;){
+		pEngine->iRand ^= pEngine->iRand << 13;
+		pEngine->iRand ^= pEngine->iRand >> 17;
+		pEngine->iRand ^= pEngine->iRand << 5;
+		if( (pEngine->iRand & 3) != 0 || nHeight >= LSM_SKIP_HEIGHT ){
+			break;
+		}
+		nHeight++;
+	}
+	/* The key and the data are stored right after the node */
+	pNode = (lsm_node *)lsmMemAlloc(pEngine,
+		(sxu32)(sizeof(lsm_node) + (nHeight - 1) * sizeof(lsm_node *) + nKey + nCopy));
+	if( pNode == 0 ){
+		return UNQLITE_NOMEM;
+	}
+	pNode->nData = nData;
+	pNode->nKey = nKey;
+	pNode->nHeight = nHeight;
+	SyMemcpy(pKey,(void *)LSM_NODE_KEY(pNode),nKey);
+	pNode->pData = (void *)&LSM_NODE_KEY(pNode)[nKey];
+	SyMemcpy(pData,pNode->pData,nCopy);
+	for( i = pEngine->nHeight ; i < nHeight ; ++i ){
+		apUpdate[i] = 0;
+	}
+	if( nHeight > pEngine->nHeight ){
+		pEngine->nHeight = nHeight;
+	}
+	for( i = 0 ; i < nHeight ; ++i ){
+		if( apUpdate[i] ){
+			pNode->apNext[i] = apUpdate[i]->apNext[i];
+			apUpdate[i]->apNext[i] = pNode;
+		}else{
+			pNode->apNext[i] = pEngine->apHead[i];
+			pEngine->apHead[i] = pNode;
+		}
+	}
+	pNode->pPrev = apUpdate[0];
+	if( pNode->apNext[0] ){
+		pNode->apNext[0]->pPrev = pNode;
+	}else{
+		pEngine->pLast = pNode;
+	}
+	pEngine->nMemRec++;
+	pEngine->nMemData += LSM_REC_HDR_SZ + nKey + nCopy;
+	return UNQLITE_OK;
+}
+/*
+ * Discard the memtable content.
+ */
+static void lsmMemReset(lsm_kv_engine *pEngine)
+{
+	SyMemBackendRelease(&pEngine->sMem);
+	SyMemBackendInitFromParent(&pEngine->sMem,unqliteExportMemBackend());
+	SyZero(pEngine->apHead,sizeof(pEngine->apHead));
+	pEngine->pLast = 0;
+	pEngine->nHeight = 1;
+	pEngine->nMemByte = pEngine->nMemData = pEngine->nMemRec = 0;
+	pEngine->zChunk = 0;
+	pEngine->nChunkFree = 0;
+}
+/*
+ * ----------------------------------------------------------
+ * Sorted runs.
+ * ----------------------------------------------------------
+ */
+/*
+ * Stream a range of a run to the given consumer.
+ */
+static int lsmRunStream(lsm_kv_engine *pEngine,lsm_run *pRun,sxu64 iOff,sxu64 nByte,
+	int (*xConsumer)(const void *,unsigned int,void *),void *pUserData)
+{
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	sxu32 iPageSize = (sxu32)pEngine->iPageSize;
+	unqlite_page *pPage;
+	sxu32 iOfft,n;
+	int rc;
+	while( nByte > 0 ){
+		rc = pIo->xGet(pIo->pHandle,pRun->iFirst + (pgno)(iOff / iPageSize),&pPage);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		iOfft = (sxu32)(iOff % iPageSize);
+		n = iPageSize - iOfft;
+		if( (sxu64)n > nByte ){
+			n = (sxu32)nByte;
+		}
+		rc = xConsumer((const void *)&pPage->zData[iOfft],n,pUserData);
+		pIo->xPageUnref(pPage);
+		if( rc != UNQLITE_OK ){
+			return UNQLITE_ABORT;
+		}
+		iOff += n;
+		nByte -= n;
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Copy a range of a run to the given buffer.
+ */
+static int lsmBufConsumer(const void *pData,unsigned int nLen,void *pUserData)
+{
+	unsigned char **pzBuf = (unsigned char **)pUserData;
+	SyMemcpy(pData,(void *)*pzBuf,nLen);
+	(*pzBuf) += nLen;
+	return UNQLITE_OK;
+}
+static int lsmRunRead(lsm_kv_engine *pEngine,lsm_run *pRun,sxu64 iOff,void *pBuf,sxu32 nByte)
+{
+	unsigned char *zBuf = (unsigned char *)pBuf;
+	return lsmRunStream(pEngine,pRun,iOff,nByte,lsmBufConsumer,(void *)&zBuf);
+}
+/*
+ * Load the in-memory index and bloom filter of a run from their serialized form.
+ */
+static int lsmRunSetup(lsm_kv_engine *pEngine,lsm_run *pRun,const unsigned char *zIndex,const unsigned char *zBloom)
+{
+	unsigned char *zRaw;
+	sxu64 iOff = 0;
+	sxu32 i;
+	pRun->aIndex = (lsm_index *)SyMemBackendAlloc(&pEngine->sAllocator,
+		(sxu32)(pRun->nIndex * sizeof(lsm_index) + pRun->nIndexByte + pRun->nBloom));
+	if( pRun->aIndex == 0 ){
+		return UNQLITE_NOMEM;
+	}
+	zRaw = (unsigned char *)&pRun->aIndex[pRun->nIndex];
+	SyMemcpy(zIndex,zRaw,(sxu32)pRun->nIndexByte);
+	pRun->zBloom = &zRaw[pRun->nIndexByte];
+	SyMemcpy(zBloom,pRun->zBloom,pRun->nBloom);
+	for( i = 0 ; i < pRun->nIndex ; ++i ){
+		if( iOff + LSM_IDX_HDR_SZ > pRun->nIndexByte ){
+			return UNQLITE_CORRUPT;
+		}
+		SyBigEndianUnpack64(&zRaw[iOff],&pRun->aIndex[i].iOff);
+		SyBigEndianUnpack32(&zRaw[iOff + 8],&pRun->aIndex[i].nKey);
+		pRun->aIndex[i].zKey = &zRaw[iOff + LSM_IDX_HDR_SZ];
+		iOff += LSM_IDX_HDR_SZ + pRun->aIndex[i].nKey;
+		if( iOff > pRun->nIndexByte ){
+			return UNQLITE_CORRUPT;
+		}
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Release the in-memory part of a run.
+ */
+static void lsmRunRelease(lsm_kv_engine *pEngine,lsm_run *pRun)
+{
+	if( pRun->aIndex ){
+		SyMemBackendFree(&pEngine->sAllocator,pRun->aIndex);
+		pRun->aIndex = 0;
+	}
+}
+/*
+ * Return the index of the last index entry whose key is less than (or equal to
+ * if bInclusive is set) the given key, -1 if there is none.
+ */
+static int lsmRunFindBlock(lsm_kv_engine *pEngine,lsm_run *pRun,const void *pKey,sxu32 nKey,int bInclusive)
+{
+	int iLo = 0,iHi = (int)pRun->nIndex - 1,iMid,r;
+	int iFound = -1;
+	while( iLo <= iHi ){
+		iMid = (iLo + iHi) >> 1;
+		r = lsmCmp(pEngine,pRun->aIndex[iMid].zKey,pRun->aIndex[iMid].nKey,pKey,nKey);
+		if( r < 0 || (r == 0 && bInclusive) ){
+			iFound = iMid;
+			iLo = iMid + 1;
+		}else{
+			iHi = iMid - 1;
+		}
+	}
+	return iFound;
+}
+/*
+ * ----------------------------------------------------------
+ * Iterators.
+ * ----------------------------------------------------------
+ */
+static void lsmIterInit(lsm_iter *pIter,lsm_kv_engine *pEngine,lsm_run *pRun,SyMemBackend *pAlloc)
+{
+	pIter->pEngine = pEngine;
+	pIter->pRun = pRun;
+	pIter->pNode = 0;
+	pIter->bValid = FALSE;
+	SyBlobInit(&pIter->sKey,pAlloc);
+}
+static void lsmIterKey(lsm_iter *pIter,const void **ppKey,sxu32 *pnKey)
+{
+	if( pIter->pRun ){
+		*ppKey = SyBlobData(&pIter->sKey);
+		*pnKey = pIter->nKey;
+	}else{
+		*ppKey = (const void *)LSM_NODE_KEY(pIter->pNode);
+		*pnKey = pIter->pNode->nKey;
+	}
+}
+static sxu64 lsmIterDataLength(lsm_iter *pIter)
+{
+	return pIter->pRun ? pIter->nData : pIter->pNode->nData;
+}
+static int lsmIterCmp(lsm_iter *pIter,const void *pKey,sxu32 nKey)
+{
+	const void *pCur;
+	sxu32 nCur;
+	lsmIterKey(pIter,&pCur,&nCur);
+	return lsmCmp(pIter->pEngine,pCur,nCur,pKey,nKey);
+}
+/*
+ * Stream the data of the current record.
+ */
+static int lsmIterData(lsm_iter *pIter,int (*xConsumer)(const void *,unsigned int,void *),void *pUserData)
+{
+	sxu64 nData = lsmIterDataLength(pIter);
+	int rc;
+	if( nData == LSM_TOMBSTONE || nData == 0 ){
+		return UNQLITE_OK;
+	}
+	if( pIter->pRun == 0 ){
+		rc = xConsumer(pIter->pNode->pData,(unsigned int)nData,pUserData);
+		return rc != UNQLITE_OK ? UNQLITE_ABORT : UNQLITE_OK;
+	}
+	return lsmRunStream(pIter->pEngine,pIter->pRun,pIter->iOff + LSM_REC_HDR_SZ + pIter->nKey,nData,xConsumer,pUserData);
+}
+/*
+ * Point a run iterator to the record starting at the given offset.
+ */
+static int lsmIterLoad(lsm_iter *pIter,sxu64 iOff)
+{
+	lsm_run *pRun = pIter->pRun;
+	unsigned char zHdr[LSM_REC_HDR_SZ];
+	int rc;
+	pIter->bValid = FALSE;
+	if( iOff >= pRun->nData ){
+		return UNQLITE_OK;
+	}
+	rc = lsmRunRead(pIter->pEngine,pRun,iOff,zHdr,LSM_REC_HDR_SZ);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	SyBigEndianUnpack32(zHdr,&pIter->nKey);
+	SyBigEndianUnpack64(&zHdr[4],&pIter->nData);
+	SyBlobReset(&pIter->sKey);
+	rc = lsmRunStream(pIter->pEngine,pRun,iOff + LSM_REC_HDR_SZ,pIter->nKey,lsmBlobConsumer,&pIter->sKey);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	pIter->iOff = iOff;
+	pIter->bValid = TRUE;
+	return UNQLITE_OK;
+}
+/*
+ * Offset of the record following the current one.
+ */
+static sxu64 lsmIterNextOfft(lsm_iter *pIter)
+{
+	return pIter->iOff + LSM_REC_HDR_SZ + pIter->nKey + (pIter->nData != LSM_TOMBSTONE ? pIter->nData : 0);
+}
+/*
+ * Point a run iterator to the record that ends at the given offset.
+ */
+static int lsmIterLoadBefore(lsm_iter *pIter,sxu64 iEnd)
+{
+	lsm_run *pRun = pIter->pRun;
+	int iLo = 0,iHi = (int)pRun->nIndex - 1,iMid;
+	sxu64 iOff = 0;
+	int rc;
+	pIter->bValid = FALSE;
+	if( iEnd == 0 ){
+		return UNQLITE_OK;
+	}
+	/* Last indexed record starting before iEnd */
+	while( iLo <= iHi ){
+		iMid = (iLo + iHi) >> 1;
+		if( pRun->aIndex[iMid].iOff < iEnd ){
+			iOff = pRun->aIndex[iMid].iOff;
+			iLo = iMid + 1;
+		}else{
+			iHi = iMid - 1;
+		}
+	}
+	/* Scan the block */
+	for(;;){
+		rc = lsmIterLoad(pIter,iOff);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		if( !pIter->bValid ){
+			return UNQLITE_CORRUPT;
+		}
+		iOff = lsmIterNextOfft(pIter);
+		if( iOff >= iEnd ){
+			break;
+		}
+	}
+	return UNQLITE_OK;
+}
+static int lsmIterFirst(lsm_iter *pIter)
+{
+	if( pIter->pRun == 0 ){
+		pIter->pNode = pIter->pEngine->apHead[0];
+		pIter->bValid = pIter->pNode != 0;
+		return UNQLITE_OK;
+	}
+	return lsmIterLoad(pIter,0);
+}
+static int lsmIterLast(lsm_iter *pIter)
+{
+	if( pIter->pRun == 0 ){
+		pIter->pNode = pIter->pEngine->pLast;
+		pIter->bValid = pIter->pNode != 0;
+		return UNQLITE_OK;
+	}
+	return lsmIterLoadBefore(pIter,pIter->pRun->nData);
+}
+/*
+ * Move one record in the given direction.
+ */
+static int lsmIterStep(lsm_iter *pIter,int iDir)
+{
+	if( pIter->pRun == 0 ){
+		pIter->pNode = iDir > 0 ? pIter->pNode->apNext[0] : pIter->pNode->pPrev;
+		pIter->bValid = pIter->pNode != 0;
+		return UNQLITE_OK;
+	}
+	if( iDir > 0 ){
+		return lsmIterLoad(pIter,lsmIterNextOfft(pIter));
+	}
+	return lsmIterLoadBefore(pIter,pIter->iOff);
+}
+/*
+ * Point to the first record whose key is greater than or equal to (greater than if
+ * bStrict is set) the given key.
+ */
+static int lsmIterSeekGE(lsm_iter *pIter,const void *pKey,sxu32 nKey,int bStrict)
+{
+	lsm_node *pNode;
+	int iBlock,r;
+	int rc;
+	if( pIter->pRun == 0 ){
+		pNode = lsmMemSeek(pIter->pEngine,pKey,nKey,bStrict,0);
+		pIter->pNode = pNode ? pNode->apNext[0] : pIter->pEngine->apHead[0];
+		pIter->bValid = pIter->pNode != 0;
+		return UNQLITE_OK;
+	}
+	iBlock = lsmRunFindBlock(pIter->pEngine,pIter->pRun,pKey,nKey,bStrict);
+	rc = lsmIterLoad(pIter,iBlock < 0 ? 0 : pIter->pRun->aIndex[iBlock].iOff);
+	while( rc == UNQLITE_OK && pIter->bValid ){
+		r = lsmIterCmp(pIter,pKey,nKey);
+		if( r > 0 || (r == 0 && !bStrict) ){
+			break;
+		}
+		rc = lsmIterLoad(pIter,lsmIterNextOfft(pIter));
+	}
+	return rc;
+}
+/*
+ * Point to the last record whose key is less than or equal to (less than if
+ * bStrict is set) the given key.
+ */
+static int lsmIterSeekLE(lsm_iter *pIter,const void *pKey,sxu32 nKey,int bStrict)
+{
+	lsm_node *pNode;
+	int rc;
+	if( pIter->pRun == 0 ){
+		pNode = lsmMemSeek(pIter->pEngine,pKey,nKey,!bStrict,0);
+		pIter->pNode = pNode;
+		pIter->bValid = pNode != 0;
+		return UNQLITE_OK;
+	}
+	rc = lsmIterSeekGE(pIter,pKey,nKey,!bStrict);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	return pIter->bValid ? lsmIterStep(pIter,-1) : lsmIterLast(pIter);
+}
+/*
+ * Look up a single key. pIter must be initialized and is left pointing to the
+ * record on success. UNQLITE_NOTFOUND is returned for a missing or deleted record.
+ */
+static int lsmLookup(lsm_kv_engine *pEngine,const void *pKey,sxu32 nKey,lsm_iter *pIter)
+{
+	lsm_node *pNode;
+	lsm_run *pRun;
+	int iBlock,i,r;
+	int rc;
+	/* The newest version wins: memtable first */
+	pNode = lsmMemSeek(pEngine,pKey,nKey,TRUE,0);
+	if( pNode && lsmCmp(pEngine,LSM_NODE_KEY(pNode),pNode->nKey,pKey,nKey) == 0 ){
+		pIter->pRun = 0;
+		pIter->pNode = pNode;
+		pIter->bValid = TRUE;
+		return pNode->nData == LSM_TOMBSTONE ? UNQLITE_NOTFOUND : UNQLITE_OK;
+	}
+	for( i = 0 ; i < pEngine->nRun ; ++i ){
+		pRun = &pEngine->aRun[i];
+		if( pEngine->xCmp == SyMemcmp && !lsmBloomTest(pRun->zBloom,pRun->nBloom,(const unsigned char *)pKey,nKey) ){
+			continue;
+		}
+		iBlock = lsmRunFindBlock(pEngine,pRun,pKey,nKey,TRUE);
+		if( iBlock < 0 ){
+			continue;
+		}
+		pIter->pRun = pRun;
+		rc = lsmIterLoad(pIter,pRun->aIndex[iBlock].iOff);
+		while( rc == UNQLITE_OK && pIter->bValid ){
+			r = lsmIterCmp(pIter,pKey,nKey);
+			if( r == 0 ){
+				return pIter->nData == LSM_TOMBSTONE ? UNQLITE_NOTFOUND : UNQLITE_OK;
+			}
+			if( r > 0 ){
+				break;
+			}
+			rc = lsmIterLoad(pIter,lsmIterNextOfft(pIter));
+		}
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	pIter->bValid = FALSE;
+	return UNQLITE_NOTFOUND;
+}
+/*
+ * ----------------------------------------------------------
+ * Merge iterator.
+ * ----------------------------------------------------------
+ */
+static void lsmMergeInit(lsm_merge *pMerge,SyMemBackend *pAlloc,int bKeepTomb)
+{
+	SyZero(pMerge,sizeof(lsm_merge));
+	pMerge->pAlloc = pAlloc;
+	pMerge->bKeepTomb = bKeepTomb;
+	pMerge->iCur = -1;
+	SyBlobInit(&pMerge->sKey,pAlloc);
+}
+static void lsmMergeRelease(lsm_merge *pMerge)
+{
+	int i;
+	for( i = 0 ; i < pMerge->nAlloc ; ++i ){
+		SyBlobRelease(&pMerge->aIter[i].sKey);
+	}
+	if( pMerge->aIter ){
+		SyMemBackendFree(pMerge->pAlloc,pMerge->aIter);
+	}
+	SyBlobRelease(&pMerge->sKey);
+	pMerge->aIter = 0;
+	pMerge->nIter = pMerge->nAlloc = 0;
+	pMerge->iCur = -1;
+}
+/*
+ * Attach the merge to the memtable (if bMem is set) and to nRun runs starting
+ * with the newest one.
+ */
+static int lsmMergeBind(lsm_merge *pMerge,lsm_kv_engine *pEngine,int bMem,int nRun)
+{
+	int nIter = nRun + (bMem ? 1 : 0);
+	lsm_iter *aNew;
+	int i;
+	if( nIter > pMerge->nAlloc ){
+		aNew = (lsm_iter *)SyMemBackendAlloc(pMerge->pAlloc,(sxu32)(nIter * sizeof(lsm_iter)));
+		if( aNew == 0 ){
+			return UNQLITE_NOMEM;
+		}
+		for( i = 0 ; i < pMerge->nAlloc ; ++i ){
+			SyBlobRelease(&pMerge->aIter[i].sKey);
+		}
+		if( pMerge->aIter ){
+			SyMemBackendFree(pMerge->pAlloc,pMerge->aIter);
+		}
+		for( i = 0 ; i < nIter ; ++i ){
+			SyBlobInit(&aNew[i].sKey,pMerge->pAlloc);
+		}
+		pMerge->aIter = aNew;
+		pMerge->nAlloc = nIter;
+	}
+	for( i = 0 ; i < nIter ; ++i ){
+		pMerge->aIter[i].pEngine = pEngine;
+		pMerge->aIter[i].pRun = bMem ? (i > 0 ? &pEngine->aRun[i - 1] : 0) : &pEngine->aRun[i];
+		pMerge->aIter[i].pNode = 0;
+		pMerge->aIter[i].bValid = FALSE;
+	}
+	pMerge->nIter = nIter;
+	pMerge->iCur = -1;
+	return UNQLITE_OK;
+}
+/*
+ * Select the source holding the current record: the smallest key when moving forward,
+ * the largest one otherwise. The newest source wins on equal keys.
+ */
+static void lsmMergePick(lsm_merge *pMerge)
+{
+	const void *pKey;
+	sxu32 nKey;
+	int i,iBest = -1,r;
+	for( i = 0 ; i < pMerge->nIter ; ++i ){
+		if( !pMerge->aIter[i].bValid ){
+			continue;
+		}
+		if( iBest >= 0 ){
+			lsmIterKey(&pMerge->aIter[iBest],&pKey,&nKey);
+			r = lsmIterCmp(&pMerge->aIter[i],pKey,nKey);
+			if( (pMerge->iDir > 0 && r >= 0) || (pMerge->iDir < 0 && r <= 0) ){
+				continue;
+			}
+		}
+		iBest = i;
+	}
+	pMerge->iCur = iBest;
+}
+/*
+ * Move every source past the current key in the current direction.
+ */
+static int lsmMergeAdvance(lsm_merge *pMerge)
+{
+	lsm_iter *pCur = &pMerge->aIter[pMerge->iCur];
+	const void *pKey;
+	sxu32 nKey;
+	int i,rc;
+	lsmIterKey(pCur,&pKey,&nKey);
+	for( i = 0 ; i < pMerge->nIter ; ++i ){
+		if( i == pMerge->iCur || !pMerge->aIter[i].bValid ){
+			continue;
+		}
+		/* Shadowed versions of the current record */
+		if( lsmIterCmp(&pMerge->aIter[i],pKey,nKey) == 0 ){
+			rc = lsmIterStep(&pMerge->aIter[i],pMerge->iDir);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+		}
+	}
+	rc = lsmIterStep(pCur,pMerge->iDir);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	lsmMergePick(pMerge);
+	return UNQLITE_OK;
+}
+/*
+ * Skip deleted records.
+ */
+static int lsmMergeSkip(lsm_merge *pMerge)
+{
+	int rc;
+	while( pMerge->iCur >= 0 && !pMerge->bKeepTomb && lsmIterDataLength(&pMerge->aIter[pMerge->iCur]) == LSM_TOMBSTONE ){
+		rc = lsmMergeAdvance(pMerge);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Position every source relative to the given key: iDir > 0 selects the first key
+ * greater than or equal to it, iDir < 0 the last key less than or equal to it.
+ * Equal keys are skipped if bStrict is set.
+ */
+static int lsmMergeSeek(lsm_merge *pMerge,const void *pKey,sxu32 nKey,int iDir,int bStrict)
+{
+	int i,rc;
+	for( i = 0 ; i < pMerge->nIter ; ++i ){
+		if( iDir > 0 ){
+			rc = lsmIterSeekGE(&pMerge->aIter[i],pKey,nKey,bStrict);
+		}else{
+			rc = lsmIterSeekLE(&pMerge->aIter[i],pKey,nKey,bStrict);
+		}
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	pMerge->iDir = iDir;
+	lsmMergePick(pMerge);
+	return lsmMergeSkip(pMerge);
+}
+/*
+ * Position on the first (iDir > 0) or the last (iDir < 0) record.
+ */
+static int lsmMergeEdge(lsm_merge *pMerge,int iDir)
+{
+	int i,rc;
+	for( i = 0 ; i < pMerge->nIter ; ++i ){
+		rc = iDir > 0 ? lsmIterFirst(&pMerge->aIter[i]) : lsmIterLast(&pMerge->aIter[i]);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	pMerge->iDir = iDir;
+	lsmMergePick(pMerge);
+	return lsmMergeSkip(pMerge);
+}
+/*
+ * Move to the next (iDir > 0) or the previous (iDir < 0) record.
+ */
+static int lsmMergeMove(lsm_merge *pMerge,int iDir)
+{
+	const void *pKey;
+	sxu32 nKey;
+	int rc;
+	if( pMerge->iCur < 0 ){
+		return UNQLITE_OK;
+	}
+	if( pMerge->iDir == iDir ){
+		rc = lsmMergeAdvance(pMerge);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		return lsmMergeSkip(pMerge);
+	}
+	/* Direction change: the sources are re-positioned around the current key */
+	lsmIterKey(&pMerge->aIter[pMerge->iCur],&pKey,&nKey);
+	SyBlobReset(&pMerge->sKey);
+	rc = SyBlobAppend(&pMerge->sKey,pKey,nKey);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	return lsmMergeSeek(pMerge,SyBlobData(&pMerge->sKey),SyBlobLength(&pMerge->sKey),iDir,TRUE);
+}
+/*
+ * ----------------------------------------------------------
+ * Run writer and compaction.
+ * ----------------------------------------------------------
+ */
+typedef struct lsm_writer lsm_writer;
+struct lsm_writer
+{
+	lsm_kv_engine *pEngine;
+	pgno iFirst;          /* First page of the run */
+	pgno iNext;           /* Next page to fill */
+	pgno iLimit;          /* End of the reused extent, 0 when growing the file */
+	unqlite_page *pPage;  /* Page being filled */
+	sxu32 iOfft;          /* Write offset in pPage */
+	sxu64 nByte;          /* Total bytes written */
+};
+/*
+ * Acquire the next page of the run. Pages of a reused extent are free in the
+ * committed image so they do not need to be journaled.
+ */
+static int lsmWriterNextPage(lsm_writer *pWriter)
+{
+	const unqlite_kv_io *pIo = pWriter->pEngine->pIo;
+	unqlite_page *pPage;
+	int rc;
+	if( pWriter->pPage ){
+		pIo->xPageUnref(pWriter->pPage);
+		pWriter->pPage = 0;
+	}
+	if( pWriter->iLimit > 0 ){
+		if( pWriter->iNext >= pWriter->iLimit ){
+			return UNQLITE_CORRUPT;
+		}
+		rc = pIo->xGet(pIo->pHandle,pWriter->iNext,&pPage);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		pIo->xDontJournal(pPage);
+	}else{
+		rc = pIo->xNew(pIo->pHandle,&pPage);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		if( pWriter->iFirst < 1 ){
+			pWriter->iFirst = pWriter->iNext = pPage->iPage;
+		}else if( pPage->iPage != pWriter->iNext ){
+			/* Runs must be contiguous */
+			pIo->xPageUnref(pPage);
+			return UNQLITE_CORRUPT;
+		}
+	}
+	rc = pIo->xWrite(pPage);
+	if( rc != UNQLITE_OK ){
+		pIo->xPageUnref(pPage);
+		return rc;
+	}
+	pWriter->pPage = pPage;
+	pWriter->iNext++;
+	pWriter->iOfft = 0;
+	return UNQLITE_OK;
+}
+static int lsmWriterAppend(lsm_writer *pWriter,const void *pData,sxu32 nByte)
+{
+	const unsigned char *zData = (const unsigned char *)pData;
+	sxu32 iPageSize = (sxu32)pWriter->pEngine->iPageSize;
+	sxu32 n;
+	int rc;
+	while( nByte > 0 ){
+		if( pWriter->pPage == 0 || pWriter->iOfft >= iPageSize ){
+			rc = lsmWriterNextPage(pWriter);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+		}
+		n = iPageSize - pWriter->iOfft;
+		if( n > nByte ){
+			n = nByte;
+		}
+		SyMemcpy(zData,&pWriter->pPage->zData[pWriter->iOfft],n);
+		pWriter->iOfft += n;
+		pWriter->nByte += n;
+		zData += n;
+		nByte -= n;
+	}
+	return UNQLITE_OK;
+}
+static int lsmWriterConsumer(const void *pData,unsigned int nLen,void *pUserData)
+{
+	return lsmWriterAppend((lsm_writer *)pUserData,pData,nLen);
+}
+/*
+ * Coalesce a set of extents in place.
+ */
+static int lsmExtentCmp(const void *pA,const void *pB)
+{
+	const lsm_extent *a = (const lsm_extent *)pA,*b = (const lsm_extent *)pB;
+	return a->iFirst < b->iFirst ? -1 : (a->iFirst > b->iFirst ? 1 : 0);
+}
+static void lsmExtentCoalesce(SySet *pSet)
+{
+	lsm_extent *aExt = (lsm_extent *)SySetBasePtr(pSet);
+	sxu32 n = SySetUsed(pSet),i,j;
+	lsm_extent sTmp;
+	if( n < 2 ){
+		return;
+	}
+	/* Insertion sort, the set is small and mostly sorted */
+	for( i = 1 ; i < n ; ++i ){
+		sTmp = aExt[i];
+		for( j = i ; j > 0 && lsmExtentCmp(&aExt[j - 1],&sTmp) > 0 ; --j ){
+			aExt[j] = aExt[j - 1];
+		}
+		aExt[j] = sTmp;
+	}
+	for( i = 0, j = 1 ; j < n ; ++j ){
+		if( aExt[i].iFirst + aExt[i].nPage == aExt[j].iFirst ){
+			aExt[i].nPage += aExt[j].nPage;
+		}else{
+			aExt[++i] = aExt[j];
+		}
+	}
+	pSet->nUsed = i + 1;
+}
+/*
+ * Pick the smallest committed free extent holding at least nPage pages.
+ */
+static int lsmExtentTake(lsm_kv_engine *pEngine,pgno nPage,lsm_extent *pOut)
+{
+	lsm_extent *aExt = (lsm_extent *)SySetBasePtr(&pEngine->sFree);
+	sxu32 n = SySetUsed(&pEngine->sFree),i;
+	int iBest = -1;
+	for( i = 0 ; i < n ; ++i ){
+		if( aExt[i].nPage >= nPage && (iBest < 0 || aExt[i].nPage < aExt[iBest].nPage) ){
+			iBest = (int)i;
+		}
+	}
+	if( iBest < 0 ){
+		return FALSE;
+	}
+	*pOut = aExt[iBest];
+	aExt[iBest] = aExt[n - 1];
+	pEngine->sFree.nUsed--;
+	return TRUE;
+}
+/*
+ * Write the records produced by a merge as a new run.
+ * nBound and nRecBound are upper bounds on the data size and the number of records.
+ * pRun->nRec is zero if the merge produced nothing.
+ */
+static int lsmWriteRun(lsm_kv_engine *pEngine,lsm_merge *pMerge,sxu64 nBound,sxu64 nRecBound,sxu32 iLevel,lsm_run *pRun)
+{
+	sxu32 iPageSize = (sxu32)pEngine->iPageSize;
+	unsigned char zHdr[LSM_IDX_HDR_SZ];
+	unsigned char *zBloom;
+	lsm_extent sExt;
+	lsm_writer sWriter;
+	lsm_iter *pIter;
+	const void *pKey;
+	sxu64 nData,iBlock,iLastBlock = SXU64_HIGH;
+	sxu32 nKey;
+	pgno nPage;
+	int rc;
+	SyZero(pRun,sizeof(lsm_run));
+	SyZero(&sWriter,sizeof(lsm_writer));
+	sWriter.pEngine = pEngine;
+	pRun->iLevel = iLevel;
+	pRun->nBloom = lsmBloomSize(nRecBound);
+	zBloom = (unsigned char *)SyMemBackendAlloc(&pEngine->sAllocator,pRun->nBloom);
+	if( zBloom == 0 ){
+		return UNQLITE_NOMEM;
+	}
+	SyZero(zBloom,pRun->nBloom);
+	SyBlobReset(&pEngine->sIndex);
+	/* Reuse a free extent if one is large enough for the worst case layout */
+	nPage = (pgno)((2 * nBound + LSM_IDX_HDR_SZ * (nBound / LSM_INDEX_BLOCK + 2) + pRun->nBloom) / iPageSize + 2);
+	if( lsmExtentTake(pEngine,nPage,&sExt) ){
+		sWriter.iFirst = sWriter.iNext = sExt.iFirst;
+		sWriter.iLimit = sExt.iFirst + sExt.nPage;
+	}
+	for( rc = UNQLITE_OK ; rc == UNQLITE_OK && pMerge->iCur >= 0 ; rc = lsmMergeMove(pMerge,1) ){
+		pIter = &pMerge->aIter[pMerge->iCur];
+		lsmIterKey(pIter,&pKey,&nKey);
+		nData = lsmIterDataLength(pIter);
+		/* Index the records starting in a new block */
+		iBlock = sWriter.nByte / LSM_INDEX_BLOCK;
+		if( iBlock != iLastBlock ){
+			SyBigEndianPack64(zHdr,sWriter.nByte);
+			SyBigEndianPack32(&zHdr[8],nKey);
+			rc = SyBlobAppend(&pEngine->sIndex,zHdr,LSM_IDX_HDR_SZ);
+			if( rc == UNQLITE_OK ){
+				rc = SyBlobAppend(&pEngine->sIndex,pKey,nKey);
+			}
+			if( rc != UNQLITE_OK ){
+				break;
+			}
+			pRun->nIndex++;
+			iLastBlock = iBlock;
+		}
+		lsmBloomAdd(zBloom,pRun->nBloom,(const unsigned char *)pKey,nKey);
+		SyBigEndianPack32(zHdr,nKey);
+		SyBigEndianPack64(&zHdr[4],nData);
+		rc = lsmWriterAppend(&sWriter,zHdr,LSM_REC_HDR_SZ);
+		if( rc == UNQLITE_OK ){
+			rc = lsmWriterAppend(&sWriter,pKey,nKey);
+		}
+		if( rc == UNQLITE_OK ){
+			rc = lsmIterData(pIter,lsmWriterConsumer,&sWriter);
+		}
+		pRun->nRec++;
+	}
+	if( rc == UNQLITE_OK && pRun->nRec > 0 ){
+		pRun->nData = sWriter.nByte;
+		pRun->nIndexByte = SyBlobLength(&pEngine->sIndex);
+		rc = lsmWriterAppend(&sWriter,SyBlobData(&pEngine->sIndex),(sxu32)pRun->nIndexByte);
+		if( rc == UNQLITE_OK ){
+			rc = lsmWriterAppend(&sWriter,zBloom,pRun->nBloom);
+		}
+		if( rc == UNQLITE_OK ){
+			rc = lsmRunSetup(pEngine,pRun,(const unsigned char *)SyBlobData(&pEngine->sIndex),zBloom);
+		}
+	}
+	if( sWriter.pPage ){
+		/* Zero the unused tail of the last page */
+		SyZero(&sWriter.pPage->zData[sWriter.iOfft],iPageSize - sWriter.iOfft);
+		pEngine->pIo->xPageUnref(sWriter.pPage);
+	}
+	SyMemBackendFree(&pEngine->sAllocator,zBloom);
+	if( sWriter.iLimit > sWriter.iNext ){
+		/* Return the unused part of the extent */
+		sExt.iFirst = sWriter.iNext;
+		sExt.nPage = sWriter.iLimit - sWriter.iNext;
+		SySetPut(&pEngine->sFree,(const void *)&sExt);
+	}
+	pRun->iFirst = sWriter.iFirst;
+	pRun->nPage = (sxu32)(sWriter.iNext - sWriter.iFirst);
+	pRun->bNew = TRUE;
+	if( rc != UNQLITE_OK ){
+		lsmRunRelease(pEngine,pRun);
+		pRun->nRec = 0;
+	}
+	return rc;
+}
+/*
+ * Serialize the run list and the free extents to the storage header.
+ * Extents freed by the current transaction are recorded as free so that they
+ * become reusable once it commits.
+ */
+static int lsmWriteHeader(lsm_kv_engine *pEngine)
+{
+	unsigned char *zHdr;
+	lsm_extent *aExt;
+	lsm_extent sTmp;
+	SySet sAll;
+	sxu32 i,j,n;
+	lsm_run *pRun;
+	int rc;
+	rc = pEngine->pIo->xWrite(pEngine->pHeader);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	zHdr = pEngine->pHeader->zData;
+	SySetInit(&sAll,&pEngine->sAllocator,sizeof(lsm_extent));
+	aExt = (lsm_extent *)SySetBasePtr(&pEngine->sFree);
+	for( i = 0 ; i < SySetUsed(&pEngine->sFree) ; ++i ){
+		SySetPut(&sAll,(const void *)&aExt[i]);
+	}
+	aExt = (lsm_extent *)SySetBasePtr(&pEngine->sPending);
+	for( i = 0 ; i < SySetUsed(&pEngine->sPending) ; ++i ){
+		SySetPut(&sAll,(const void *)&aExt[i]);
+	}
+	lsmExtentCoalesce(&sAll);
+	aExt = (lsm_extent *)SySetBasePtr(&sAll);
+	n = SySetUsed(&sAll);
+	if( n > (sxu32)pEngine->nMaxFree ){
+		/* Keep the largest extents, the others are leaked */
+		for( i = 0 ; i < (sxu32)pEngine->nMaxFree ; ++i ){
+			for( j = i + 1 ; j < n ; ++j ){
+				if( aExt[j].nPage > aExt[i].nPage ){
+					sTmp = aExt[i]; aExt[i] = aExt[j]; aExt[j] = sTmp;
+				}
+			}
+		}
+		n = (sxu32)pEngine->nMaxFree;
+	}
+	SyBigEndianPack32(&zHdr[LSM_HDR_MAGIC],LSM_MAGIC);
+	SyBigEndianPack32(&zHdr[LSM_HDR_NRUN],(sxu32)pEngine->nRun);
+	SyBigEndianPack32(&zHdr[LSM_HDR_NFREE],n);
+	SyBigEndianPack32(&zHdr[12],0);
+	for( i = 0 ; i < (sxu32)pEngine->nRun ; ++i ){
+		unsigned char *zRun = &zHdr[LSM_HDR_SZ + i * LSM_RUN_SZ];
+		pRun = &pEngine->aRun[i];
+		SyBigEndianPack64(zRun,(sxu64)pRun->iFirst);
+		SyBigEndianPack32(&zRun[8],pRun->nPage);
+		SyBigEndianPack32(&zRun[12],pRun->iLevel);
+		SyBigEndianPack64(&zRun[16],pRun->nData);
+		SyBigEndianPack64(&zRun[24],pRun->nRec);
+		SyBigEndianPack64(&zRun[32],pRun->nIndexByte);
+		SyBigEndianPack32(&zRun[40],pRun->nIndex);
+		SyBigEndianPack32(&zRun[44],pRun->nBloom);
+	}
+	for( i = 0 ; i < n ; ++i ){
+		unsigned char *zExt = &zHdr[LSM_HDR_SZ + pEngine->nMaxRun * LSM_RUN_SZ + i * LSM_FREE_SZ];
+		SyBigEndianPack64(zExt,(sxu64)aExt[i].iFirst);
+		SyBigEndianPack64(&zExt[8],(sxu64)aExt[i].nPage);
+	}
+	SySetRelease(&sAll);
+	return UNQLITE_OK;
+}
+/*
+ * Merge the nRun newest runs into a single run of the given level.
+ */
+static int lsmMergeRuns(lsm_kv_engine *pEngine,int nRun,sxu32 iLevel)
+{
+	sxu64 nBound = 0,nRecBound = 0;
+	lsm_merge sMerge;
+	lsm_extent sExt;
+	lsm_run sOut;
+	int i,rc;
+	for( i = 0 ; i < nRun ; ++i ){
+		nBound += pEngine->aRun[i].nData;
+		nRecBound += pEngine->aRun[i].nRec;
+	}
+	/* Tombstones are useless once the oldest run is merged */
+	lsmMergeInit(&sMerge,&pEngine->sAllocator,nRun < pEngine->nRun);
+	rc = lsmMergeBind(&sMerge,pEngine,FALSE,nRun);
+	if( rc == UNQLITE_OK ){
+		rc = lsmMergeEdge(&sMerge,1);
+	}
+	if( rc == UNQLITE_OK ){
+		rc = lsmWriteRun(pEngine,&sMerge,nBound,nRecBound,iLevel,&sOut);
+	}
+	lsmMergeRelease(&sMerge);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	/* Committed input pages become free once the transaction commits, the pages
+	 * of runs written by this transaction can be reused right away */
+	for( i = 0 ; i < nRun ; ++i ){
+		sExt.iFirst = pEngine->aRun[i].iFirst;
+		sExt.nPage = pEngine->aRun[i].nPage;
+		SySetPut(pEngine->aRun[i].bNew ? &pEngine->sFree : &pEngine->sPending,(const void *)&sExt);
+		lsmRunRelease(pEngine,&pEngine->aRun[i]);
+	}
+	lsmExtentCoalesce(&pEngine->sFree);
+	if( sOut.nRec > 0 ){
+		pEngine->aRun[0] = sOut;
+		nRun--;
+		i = 1;
+	}else{
+		i = 0;
+	}
+	if( nRun > 0 ){
+		for( ; i + nRun < pEngine->nRun ; ++i ){
+			pEngine->aRun[i] = pEngine->aRun[i + nRun];
+		}
+		pEngine->nRun -= nRun;
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Incremental compaction, performed each time a run is written: the newest runs
+ * are merged while there are LSM_MERGE_FANOUT of them at the same level, and
+ * everything is merged when the header is about to overflow.
+ */
+static int lsmCompact(lsm_kv_engine *pEngine)
+{
+	int n,rc;
+	while( pEngine->nRun > 1 ){
+		for( n = 1 ; n < pEngine->nRun && pEngine->aRun[n].iLevel == pEngine->aRun[0].iLevel ; ++n );
+		if( n >= LSM_MERGE_FANOUT ){
+			rc = lsmMergeRuns(pEngine,n,pEngine->aRun[0].iLevel + 1);
+		}else if( pEngine->nRun >= pEngine->nMaxRun - 1 ){
+			rc = lsmMergeRuns(pEngine,pEngine->nRun,pEngine->aRun[pEngine->nRun - 1].iLevel + 1);
+		}else{
+			break;
+		}
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Write the memtable out as a level zero run.
+ */
+static int lsmFlush(lsm_kv_engine *pEngine)
+{
+	lsm_merge sMerge;
+	lsm_run sOut;
+	int i,rc;
+	if( pEngine->nMemRec < 1 ){
+		return UNQLITE_OK;
+	}
+	/* Tombstones are not needed when there is no older run */
+	lsmMergeInit(&sMerge,&pEngine->sAllocator,pEngine->nRun > 0);
+	rc = lsmMergeBind(&sMerge,pEngine,TRUE,0);
+	if( rc == UNQLITE_OK ){
+		rc = lsmMergeEdge(&sMerge,1);
+	}
+	if( rc == UNQLITE_OK ){
+		rc = lsmWriteRun(pEngine,&sMerge,pEngine->nMemData,pEngine->nMemRec,0,&sOut);
+	}
+	lsmMergeRelease(&sMerge);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	lsmMemReset(pEngine);
+	pEngine->iGen++;
+	if( sOut.nRec > 0 ){
+		for( i = pEngine->nRun ; i > 0 ; --i ){
+			pEngine->aRun[i] = pEngine->aRun[i - 1];
+		}
+		pEngine->aRun[0] = sOut;
+		pEngine->nRun++;
+		rc = lsmCompact(pEngine);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	return lsmWriteHeader(pEngine);
+}
+/*
+ * Start (or continue) a write transaction.
+ */
+static int lsmBeginWrite(lsm_kv_engine *pEngine)
+{
+	lsm_extent *aExt;
+	sxu32 i;
+	int rc;
+	if( pEngine->pHeader == 0 ){
+		/* Load the storage header */
+		rc = pEngine->pIo->xGet(pEngine->pIo->pHandle,1,0);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	/* Journal the header so that a rollback resets the engine */
+	rc = pEngine->pIo->xWrite(pEngine->pHeader);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	if( pEngine->bSynced ){
+		/* The previous transaction committed, its freed extents can be reused */
+		aExt = (lsm_extent *)SySetBasePtr(&pEngine->sPending);
+		for( i = 0 ; i < SySetUsed(&pEngine->sPending) ; ++i ){
+			SySetPut(&pEngine->sFree,(const void *)&aExt[i]);
+		}
+		SySetReset(&pEngine->sPending);
+		lsmExtentCoalesce(&pEngine->sFree);
+		pEngine->bSynced = FALSE;
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Insert a record, a tombstone if nData is LSM_TOMBSTONE.
+ */
+static int lsmPut(lsm_kv_engine *pEngine,const void *pKey,sxu32 nKey,const void *pData,sxu64 nData)
+{
+	int rc;
+	if( pEngine->nMemRec < 1 ){
+		/* First record since the last flush */
+		rc = lsmBeginWrite(pEngine);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	rc = lsmMemPut(pEngine,pKey,nKey,pData,nData);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	pEngine->iGen++;
+	if( pEngine->nMemByte >= LSM_MEMTABLE_SIZE ){
+		rc = lsmFlush(pEngine);
+	}
+	return rc;
+}
+/*
+ * Exported: xReplace() method.
+ */
+static int lsm_kv_replace(unqlite_kv_engine *pKv,const void *pKey,int nKeyLen,const void *pData,unqlite_int64 nDataLen)
+{
+	if( nDataLen < 0 ){
+		/* Would be taken for a tombstone */
+		return UNQLITE_INVALID;
+	}
+	return lsmPut((lsm_kv_engine *)pKv,pKey,(sxu32)nKeyLen,pData,(sxu64)nDataLen);
+}
+/*
+ * Exported: xAppend() method.
+ */
+static int lsm_kv_append(unqlite_kv_engine *pKv,const void *pKey,int nKeyLen,const void *pData,unqlite_int64 nDataLen)
+{
+	lsm_kv_engine *pEngine = (lsm_kv_engine *)pKv;
+	lsm_iter sIter;
+	int rc;
+	if( nDataLen < 0 ){
+		return UNQLITE_INVALID;
+	}
+	if( pEngine->pHeader == 0 ){
+		/* Load the storage header */
+		rc = pEngine->pIo->xGet(pEngine->pIo->pHandle,1,0);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	lsmIterInit(&sIter,pEngine,0,&pEngine->sAllocator);
+	rc = lsmLookup(pEngine,pKey,(sxu32)nKeyLen,&sIter);
+	if( rc == UNQLITE_NOTFOUND ){
+		SyBlobRelease(&sIter.sKey);
+		return lsmPut(pEngine,pKey,(sxu32)nKeyLen,pData,(sxu64)nDataLen);
+	}
+	/* Old data followed by the new chunk */
+	SyBlobReset(&pEngine->sWorker);
+	if( rc == UNQLITE_OK ){
+		rc = lsmIterData(&sIter,lsmBlobConsumer,&pEngine->sWorker);
+	}
+	SyBlobRelease(&sIter.sKey);
+	if( rc == UNQLITE_OK ){
+		rc = SyBlobAppend(&pEngine->sWorker,pData,(sxu32)nDataLen);
+	}
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	return lsmPut(pEngine,pKey,(sxu32)nKeyLen,SyBlobData(&pEngine->sWorker),SyBlobLength(&pEngine->sWorker));
+}
+/*
+ * Exported: xSync() method.
+ * Invoked before the transaction is committed, the memtable is written out.
+ */
+static int lsm_kv_sync(unqlite_kv_engine *pKv)
+{
+	lsm_kv_engine *pEngine = (lsm_kv_engine *)pKv;
+	int i,rc;
+	rc = lsmFlush(pEngine);
+	if( rc == UNQLITE_OK ){
+		for( i = 0 ; i < pEngine->nRun ; ++i ){
+			pEngine->aRun[i].bNew = FALSE;
+		}
+		pEngine->bSynced = TRUE;
+	}
+	return rc;
+}
+/*
+ * Exported: xOpen() method.
+ */
+static int lsm_kv_open(unqlite_kv_engine *pKv,pgno dbSize)
+{
+	lsm_kv_engine *pEngine = (lsm_kv_engine *)pKv;
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	unqlite_page *pHeader;
+	const unsigned char *zRun,*zExt;
+	unsigned char *zBuf;
+	lsm_extent sExt;
+	sxu32 nMagic,nRun,nFree,i;
+	lsm_run *pRun;
+	sxu64 n64;
+	int rc;
+	/* The page size of an existing database may differ from the default one */
+	pEngine->iPageSize = pIo->xPageSize(pIo->pHandle);
+	pEngine->nMaxRun = ((pEngine->iPageSize - LSM_HDR_SZ) / 2) / LSM_RUN_SZ;
+	if( pEngine->nMaxRun > 64 ){
+		pEngine->nMaxRun = 64;
+	}
+	pEngine->nMaxFree = (pEngine->iPageSize - LSM_HDR_SZ - pEngine->nMaxRun * LSM_RUN_SZ) / LSM_FREE_SZ;
+	pEngine->aRun = (lsm_run *)SyMemBackendAlloc(&pEngine->sAllocator,(sxu32)(pEngine->nMaxRun * sizeof(lsm_run)));
+	if( pEngine->aRun == 0 ){
+		return UNQLITE_NOMEM;
+	}
+	if( dbSize < 1 ){
+		/* A new database, create the header */
+		rc = pIo->xNew(pIo->pHandle,&pHeader);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		rc = pIo->xWrite(pHeader);
+		if( rc != UNQLITE_OK ){
+			pIo->xPageUnref(pHeader);
+			return rc;
+		}
+		SyZero(pHeader->zData,LSM_HDR_SZ);
+		SyBigEndianPack32(&pHeader->zData[LSM_HDR_MAGIC],LSM_MAGIC);
+		pEngine->pHeader = pHeader;
+		return UNQLITE_OK;
+	}
+	/* Acquire the page one of the database */
+	rc = pIo->xGet(pIo->pHandle,1,&pHeader);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	SyBigEndianUnpack32(&pHeader->zData[LSM_HDR_MAGIC],&nMagic);
+	SyBigEndianUnpack32(&pHeader->zData[LSM_HDR_NRUN],&nRun);
+	SyBigEndianUnpack32(&pHeader->zData[LSM_HDR_NFREE],&nFree);
+	if( nMagic != LSM_MAGIC || nRun > (sxu32)pEngine->nMaxRun || nFree > (sxu32)pEngine->nMaxFree ){
+		/* Not a LSM storage image */
+		pIo->xPageUnref(pHeader);
+		return UNQLITE_CORRUPT;
+	}
+	pEngine->pHeader = pHeader;
+	for( i = 0 ; i < nRun ; ++i ){
+		zRun = &pHeader->zData[LSM_HDR_SZ + i * LSM_RUN_SZ];
+		pRun = &pEngine->aRun[i];
+		SyZero(pRun,sizeof(lsm_run));
+		SyBigEndianUnpack64(zRun,&n64);
+		pRun->iFirst = (pgno)n64;
+		SyBigEndianUnpack32(&zRun[8],&pRun->nPage);
+		SyBigEndianUnpack32(&zRun[12],&pRun->iLevel);
+		SyBigEndianUnpack64(&zRun[16],&pRun->nData);
+		SyBigEndianUnpack64(&zRun[24],&pRun->nRec);
+		SyBigEndianUnpack64(&zRun[32],&pRun->nIndexByte);
+		SyBigEndianUnpack32(&zRun[40],&pRun->nIndex);
+		SyBigEndianUnpack32(&zRun[44],&pRun->nBloom);
+		if( pRun->nBloom < 1 || pRun->nIndexByte >= SXU32_HIGH ){
+			return UNQLITE_CORRUPT;
+		}
+		/* Load the index and the bloom filter */
+		zBuf = (unsigned char *)SyMemBackendAlloc(&pEngine->sAllocator,(sxu32)pRun->nIndexByte + pRun->nBloom);
+		if( zBuf == 0 ){
+			return UNQLITE_NOMEM;
+		}
+		rc = lsmRunRead(pEngine,pRun,pRun->nData,zBuf,(sxu32)pRun->nIndexByte + pRun->nBloom);
+		if( rc == UNQLITE_OK ){
+			rc = lsmRunSetup(pEngine,pRun,zBuf,&zBuf[pRun->nIndexByte]);
+		}
+		SyMemBackendFree(&pEngine->sAllocator,zBuf);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		pEngine->nRun++;
+	}
+	for( i = 0 ; i < nFree ; ++i ){
+		zExt = &pHeader->zData[LSM_HDR_SZ + pEngine->nMaxRun * LSM_RUN_SZ + i * LSM_FREE_SZ];
+		SyBigEndianUnpack64(zExt,&n64);
+		sExt.iFirst = (pgno)n64;
+		SyBigEndianUnpack64(&zExt[8],&n64);
+		sExt.nPage = (pgno)n64;
+		SySetPut(&pEngine->sFree,(const void *)&sExt);
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xInit() method.
+ */
+static int lsm_kv_init(unqlite_kv_engine *pKv,int iPageSize)
+{
+	lsm_kv_engine *pEngine = (lsm_kv_engine *)pKv;
+	static sxu32 iEpoch = 0;
+	/* This structure is always zeroed, go to the initialization directly */
+	SyMemBackendInitFromParent(&pEngine->sAllocator,unqliteExportMemBackend());
+	SyMemBackendInitFromParent(&pEngine->sMem,unqliteExportMemBackend());
+	pEngine->iPageSize = iPageSize;
+	pEngine->nHeight = 1;
+	pEngine->iRand = 0x2545F491;
+	/* Cursors of a previous instance (i.e. before a rollback) never match */
+	pEngine->iGen = (sxu64)(++iEpoch) << 32;
+	/* Default comparison function */
+	pEngine->xCmp = SyMemcmp;
+	SySetInit(&pEngine->sFree,&pEngine->sAllocator,sizeof(lsm_extent));
+	SySetInit(&pEngine->sPending,&pEngine->sAllocator,sizeof(lsm_extent));
+	SyBlobInit(&pEngine->sIndex,&pEngine->sAllocator);
+	SyBlobInit(&pEngine->sWorker,&pEngine->sAllocator);
+	/* Pages carry no private data */
+	pEngine->pIo->xSetUnpin(pEngine->pIo->pHandle,0);
+	pEngine->pIo->xSetReload(pEngine->pIo->pHandle,0);
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xRelease() method.
+ */
+static void lsm_kv_release(unqlite_kv_engine *pKv)
+{
+	lsm_kv_engine *pEngine = (lsm_kv_engine *)pKv;
+	/* Release the memtable and the private memory backend */
+	SyMemBackendRelease(&pEngine->sMem);
+	SyMemBackendRelease(&pEngine->sAllocator);
+}
+/*
+ * Exported: xConfig() method.
+ */
+static int lsm_kv_config(unqlite_kv_engine *pKv,int op,va_list ap)
+{
+	lsm_kv_engine *pEngine = (lsm_kv_engine *)pKv;
+	int rc = UNQLITE_OK;
+	switch(op){
+	case UNQLITE_KV_CONFIG_CMP_FUNC: {
+		/* Key comparison function, must be set before any record is stored */
+		ProcCmp xCmp = va_arg(ap,ProcCmp);
+		if( xCmp ){
+			pEngine->xCmp = xCmp;
+		}
+		break;
+									 }
+	default:
+		/* Unknown OP */
+		rc = UNQLITE_UNKNOWN;
+		break;
+	}
+	return rc;
+}
+/*
+ * LSM cursor.
+ * Cursors iterate over a merge of the memtable and the runs. They remember the key of
+ * the current record so that the merge can be rebuilt around it whenever the engine
+ * changes (inserts, flushes, compactions or a rollback).
+ */
+typedef struct lsm_kv_cursor lsm_kv_cursor;
+struct lsm_kv_cursor
+{
+	unqlite_kv_engine *pStore; /* Must be first */
+	/* Private fields */
+	lsm_merge sMerge;          /* Merge iterator */
+	lsm_iter sPoint;           /* Result of an exact lookup */
+	lsm_iter *pRec;            /* Current record, NULL if it must be looked up again */
+	int bMerge;                /* True if sMerge is positioned on the current record */
+	int bValid;                /* True if the cursor points to a record */
+	int bDeleted;              /* The current record was deleted, its successor is next */
+	sxu64 iGen;                /* Engine generation the positions refer to */
+	SyBlob sKey;               /* Key of the current record */
+};
+/*
+ * Invalidate the positions that refer to a previous state of the engine.
+ */
+static void lsmCursorCheck(lsm_kv_cursor *pCur)
+{
+	if( pCur->iGen != ((lsm_kv_engine *)pCur->pStore)->iGen ){
+		pCur->pRec = 0;
+		pCur->bMerge = FALSE;
+	}
+}
+/*
+ * Bind the merge iterator to the current state of the engine.
+ */
+static int lsmCursorBind(lsm_kv_cursor *pCur)
+{
+	lsm_kv_engine *pEngine = (lsm_kv_engine *)pCur->pStore;
+	int rc;
+	if( pEngine->pHeader == 0 ){
+		/* Load the storage header */
+		rc = pEngine->pIo->xGet(pEngine->pIo->pHandle,1,0);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	pCur->bValid = FALSE;
+	pCur->bDeleted = FALSE;
+	pCur->pRec = 0;
+	pCur->bMerge = FALSE;
+	pCur->iGen = pEngine->iGen;
+	return lsmMergeBind(&pCur->sMerge,pEngine,TRUE,pEngine->nRun);
+}
+/*
+ * Remember the record the merge iterator points to.
+ */
+static int lsmCursorSettle(lsm_kv_cursor *pCur)
+{
+	const void *pKey;
+	sxu32 nKey;
+	int rc;
+	if( pCur->sMerge.iCur < 0 ){
+		pCur->bValid = FALSE;
+		return UNQLITE_DONE;
+	}
+	pCur->pRec = &pCur->sMerge.aIter[pCur->sMerge.iCur];
+	lsmIterKey(pCur->pRec,&pKey,&nKey);
+	SyBlobReset(&pCur->sKey);
+	rc = SyBlobAppend(&pCur->sKey,pKey,nKey);
+	pCur->bValid = rc == UNQLITE_OK;
+	pCur->bMerge = TRUE;
+	return rc;
+}
+/*
+ * Move in the given direction. The merge is rebuilt around the saved key
+ * if the engine changed since the cursor was positioned.
+ */
+static int lsmCursorMove(lsm_kv_cursor *pCur,int iDir)
+{
+	int rc;
+	lsmCursorCheck(pCur);
+	if( pCur->bMerge ){
+		rc = lsmMergeMove(&pCur->sMerge,iDir);
+	}else{
+		rc = lsmCursorBind(pCur);
+		if( rc == UNQLITE_OK ){
+			rc = lsmMergeSeek(&pCur->sMerge,SyBlobData(&pCur->sKey),SyBlobLength(&pCur->sKey),iDir,TRUE);
+		}
+	}
+	if( rc != UNQLITE_OK ){
+		pCur->bValid = FALSE;
+		return rc;
+	}
+	return lsmCursorSettle(pCur);
+}
+/*
+ * Position the cursor after a deleted record.
+ */
+static int lsmCursorResolve(lsm_kv_cursor *pCur)
+{
+	if( !pCur->bDeleted ){
+		return UNQLITE_OK;
+	}
+	pCur->bDeleted = FALSE;
+	pCur->bMerge = FALSE;
+	return lsmCursorMove(pCur,1);
+}
+/*
+ * Exported: xCursorInit() method.
+ */
+static void lsmCursorInit(unqlite_kv_cursor *pCursor)
+{
+	lsm_kv_cursor *pCur = (lsm_kv_cursor *)pCursor;
+	SyMemBackend *pAlloc = (SyMemBackend *)unqliteExportMemBackend();
+	/* Survives engine resets */
+	lsmMergeInit(&pCur->sMerge,pAlloc,FALSE);
+	lsmIterInit(&pCur->sPoint,(lsm_kv_engine *)pCur->pStore,0,pAlloc);
+	SyBlobInit(&pCur->sKey,pAlloc);
+	pCur->bValid = FALSE;
+}
+/*
+ * Exported: xFirst() method.
+ */
+static int lsmCursorFirst(unqlite_kv_cursor *pCursor)
+{
+	lsm_kv_cursor *pCur = (lsm_kv_cursor *)pCursor;
+	int rc;
+	rc = lsmCursorBind(pCur);
+	if( rc == UNQLITE_OK ){
+		rc = lsmMergeEdge(&pCur->sMerge,1);
+	}
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	return lsmCursorSettle(pCur);
+}
+/*
+ * Exported: xLast() method.
+ */
+static int lsmCursorLast(unqlite_kv_cursor *pCursor)
+{
+	lsm_kv_cursor *pCur = (lsm_kv_cursor *)pCursor;
+	int rc;
+	rc = lsmCursorBind(pCur);
+	if( rc == UNQLITE_OK ){
+		rc = lsmMergeEdge(&pCur->sMerge,-1);
+	}
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	return lsmCursorSettle(pCur);
+}
+/*
+ * Exported: xSeek() method.
+ */
+static int lsmCursorSeek(unqlite_kv_cursor *pCursor,const void *pKey,int nByte,int iPos)
+{
+	lsm_kv_cursor *pCur = (lsm_kv_cursor *)pCursor;
+	lsm_kv_engine *pEngine = (lsm_kv_engine *)pCur->pStore;
+	int rc;
+	rc = lsmCursorBind(pCur);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	if( iPos == UNQLITE_CURSOR_MATCH_LE || iPos == UNQLITE_CURSOR_MATCH_GE ){
+		rc = lsmMergeSeek(&pCur->sMerge,pKey,(sxu32)nByte,iPos == UNQLITE_CURSOR_MATCH_GE ? 1 : -1,FALSE);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		rc = lsmCursorSettle(pCur);
+		return rc == UNQLITE_DONE ? UNQLITE_NOTFOUND : rc;
+	}
+	/* Exact match: point lookup guarded by the bloom filters */
+	pCur->sPoint.pEngine = pEngine;
+	rc = lsmLookup(pEngine,pKey,(sxu32)nByte,&pCur->sPoint);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	SyBlobReset(&pCur->sKey);
+	rc = SyBlobAppend(&pCur->sKey,pKey,(sxu32)nByte);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	pCur->pRec = &pCur->sPoint;
+	pCur->bValid = TRUE;
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xValid() method.
+ */
+static int lsmCursorValid(unqlite_kv_cursor *pCursor)
+{
+	lsm_kv_cursor *pCur = (lsm_kv_cursor *)pCursor;
+	lsmCursorResolve(pCur);
+	return pCur->bValid;
+}
+/*
+ * Exported: xNext() method.
+ */
+static int lsmCursorNext(unqlite_kv_cursor *pCursor)
+{
+	lsm_kv_cursor *pCur = (lsm_kv_cursor *)pCursor;
+	if( pCur->bDeleted ){
+		/* The successor of the deleted record is the next one */
+		return lsmCursorResolve(pCur);
+	}
+	if( !pCur->bValid ){
+		return UNQLITE_DONE;
+	}
+	return lsmCursorMove(pCur,1);
+}
+/*
+ * Exported: xPrev() method.
+ */
+static int lsmCursorPrev(unqlite_kv_cursor *pCursor)
+{
+	lsm_kv_cursor *pCur = (lsm_kv_cursor *)pCursor;
+	if( pCur->bDeleted ){
+		pCur->bDeleted = FALSE;
+		pCur->bMerge = FALSE;
+	}
+	if( !pCur->bValid ){
+		return UNQLITE_DONE;
+	}
+	return lsmCursorMove(pCur,-1);
+}
+/*
+ * Exported: xKeyLength() method.
+ */
+static int lsmCursorKeyLength(unqlite_kv_cursor *pCursor,int *pLen)
+{
+	lsm_kv_cursor *pCur = (lsm_kv_cursor *)pCursor;
+	lsmCursorResolve(pCur);
+	if( !pCur->bValid ){
+		return UNQLITE_INVALID;
+	}
+	*pLen = (int)SyBlobLength(&pCur->sKey);
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xKey() method.
+ */
+static int lsmCursorKey(unqlite_kv_cursor *pCursor,int (*xConsumer)(const void *,unsigned int,void *),void *pUserData)
+{
+	lsm_kv_cursor *pCur = (lsm_kv_cursor *)pCursor;
+	int rc;
+	lsmCursorResolve(pCur);
+	if( !pCur->bValid ){
+		return UNQLITE_INVALID;
+	}
+	/* The key is cached in the cursor */
+	rc = xConsumer(SyBlobData(&pCur->sKey),SyBlobLength(&pCur->sKey),pUserData);
+	return rc != UNQLITE_OK ? UNQLITE_ABORT : UNQLITE_OK;
+}
+/*
+ * Locate the current record, looking it up again if the engine changed.
+ */
+static int lsmCursorRecord(lsm_kv_cursor *pCur,lsm_iter **ppRec)
+{
+	lsm_kv_engine *pEngine = (lsm_kv_engine *)pCur->pStore;
+	int rc;
+	lsmCursorResolve(pCur);
+	if( !pCur->bValid ){
+		return UNQLITE_INVALID;
+	}
+	lsmCursorCheck(pCur);
+	if( pCur->pRec == 0 ){
+		pCur->sPoint.pEngine = pEngine;
+		rc = lsmLookup(pEngine,SyBlobData(&pCur->sKey),SyBlobLength(&pCur->sKey),&pCur->sPoint);
+		if( rc != UNQLITE_OK ){
+			/* Deleted under the cursor */
+			return rc;
+		}
+		pCur->pRec = &pCur->sPoint;
+		pCur->iGen = pEngine->iGen;
+	}
+	*ppRec = pCur->pRec;
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xDataLength() method.
+ */
+static int lsmCursorDataLength(unqlite_kv_cursor *pCursor,unqlite_int64 *pLen)
+{
+	lsm_iter *pRec;
+	int rc;
+	rc = lsmCursorRecord((lsm_kv_cursor *)pCursor,&pRec);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	*pLen = (unqlite_int64)lsmIterDataLength(pRec);
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xData() method.
+ */
+static int lsmCursorData(unqlite_kv_cursor *pCursor,int (*xConsumer)(const void *,unsigned int,void *),void *pUserData)
+{
+	lsm_iter *pRec;
+	int rc;
+	rc = lsmCursorRecord((lsm_kv_cursor *)pCursor,&pRec);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	return lsmIterData(pRec,xConsumer,pUserData);
+}
+/*
+ * Exported: xDelete() method.
+ * A tombstone is inserted, the cursor is left pointing to the next record.
+ */
+static int lsmCursorDelete(unqlite_kv_cursor *pCursor)
+{
+	lsm_kv_cursor *pCur = (lsm_kv_cursor *)pCursor;
+	int rc;
+	lsmCursorResolve(pCur);
+	if( !pCur->bValid ){
+		return UNQLITE_INVALID;
+	}
+	rc = lsmPut((lsm_kv_engine *)pCur->pStore,SyBlobData(&pCur->sKey),SyBlobLength(&pCur->sKey),0,LSM_TOMBSTONE);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	/* The successor is located lazily */
+	pCur->bDeleted = TRUE;
+	return UNQLITE_OK;
+}
+/*
+ * Exported: xReset() method.
+ */
+static void lsmCursorReset(unqlite_kv_cursor *pCursor)
+{
+	lsmCursorFirst(pCursor);
+}
+/*
+ * Exported: xCursorRelease() method.
+ */
+static void lsmCursorRelease(unqlite_kv_cursor *pCursor)
+{
+	lsm_kv_cursor *pCur = (lsm_kv_cursor *)pCursor;
+	lsmMergeRelease(&pCur->sMerge);
+	SyBlobRelease(&pCur->sPoint.sKey);
+	SyBlobRelease(&pCur->sKey);
+}
+/*
+ * Export the LSM KV storage engine.
+ */
+UNQLITE_PRIVATE const unqlite_kv_methods * unqliteExportLsmKvStorage(void)
+{
+	static const unqlite_kv_methods sLsmStore = {
+		"lsm",                      /* zName */
+		sizeof(lsm_kv_engine),      /* szKv */
+		sizeof(lsm_kv_cursor),      /* szCursor */
+		2,                          /* iVersion */
+		lsm_kv_init,                /* xInit */
+		lsm_kv_release,             /* xRelease */
+		lsm_kv_config,              /* xConfig */
+		lsm_kv_open,                /* xOpen */
+		lsm_kv_replace,             /* xReplace */
+		lsm_kv_append,              /* xAppend */
+		lsmCursorInit,              /* xCursorInit */
+		lsmCursorSeek,              /* xSeek */
+		lsmCursorFirst,             /* xFirst */
+		lsmCursorLast,              /* xLast */
+		lsmCursorValid,             /* xValid */
+		lsmCursorNext,              /* xNext */
+		lsmCursorPrev,              /* xPrev */
+		lsmCursorDelete,            /* xDelete */
+		lsmCursorKeyLength,         /* xKeyLength */
+		lsmCursorKey,               /* xKey */
+		lsmCursorDataLength,        /* xDataLength */
+		lsmCursorData,              /* xData */
+		lsmCursorReset,             /* xReset */
+		lsmCursorRelease,           /* xRelease */
+		lsm_kv_sync,                /* xSync */
+		0,                          /* xBucket */
+		0,                          /* xDataRef */
+		0,                          /* xReserve */
+		0,                          /* xVacuum */
+		0                           /* bSharedRead */
+	};
+	return &sLsmStore;
+}
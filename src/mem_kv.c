@@ -78,13 +78,13 @@ static mem_hash_record * MemHashNewRecord(
 	/* Total number of bytes to alloc */
 	nByte = sizeof(mem_hash_record) + nKey;
 	/* Allocate a new instance */
-	pRecord = (mem_hash_record *)SyMemBackendAlloc(pAlloc,nByte);
+	pRecord = (mem_hash_record *)SyMemBackendPoolAlloc(pAlloc,nByte);
 	if( pRecord == 0 ){
 		return 0;
 	}
 	pDupData = (void *)SyMemBackendAlloc(pAlloc,(sxu32)nData);
 	if( pDupData == 0 ){
-		SyMemBackendFree(pAlloc,pRecord);
+		SyMemBackendPoolFree(pAlloc,pRecord);
 		return 0;
 	}
 	zPtr = (char *)pRecord;
@@ -143,7 +143,7 @@ static void MemHashUnlinkRecord(mem_hash_kv_engine *pEngine,mem_hash_record *pEn
 	pEngine->nRecord--;
 	/* Release the entry */
 	SyMemBackendFree(pAlloc,(void *)pEntry->pData);
-	SyMemBackendFree(pAlloc,pEntry); /* Key is also stored here */
+	SyMemBackendPoolFree(pAlloc,pEntry); /* Key is also stored here */
 }
 /*
  * Perform a lookup for a given entry.
@@ -438,21 +438,12 @@ static int MemHashCursorSeek(unqlite_kv_cursor *pCursor,const void *pKey,int nBy
 	return UNQLITE_OK;
 }
 /*
- * Builtin hash function.
+ * Builtin hash function: 64-bit hash of the whole key folded to 32 bits.
  */
 static sxu32 MemHashFunc(const void *pSrc,sxu32 nLen)
 {
-	register unsigned char *zIn = (unsigned char *)pSrc;
-	unsigned char *zEnd;
-	sxu32 nH = 5381;
-	zEnd = &zIn[nLen];
-	for(;;){
-		if( zIn >= zEnd ){ break; } nH = nH * 33 + zIn[0] ; zIn++;
-		if( zIn >= zEnd ){ break; } nH = nH * 33 + zIn[0] ; zIn++;
-		if( zIn >= zEnd ){ break; } nH = nH * 33 + zIn[0] ; zIn++;
-		if( zIn >= zEnd ){ break; } nH = nH * 33 + zIn[0] ; zIn++;
-	}	
-	return nH;
+	sxu64 nH = SyBinHash64(pSrc,nLen);
+	return (sxu32)(nH ^ (nH >> 32));
 }
 /* Default bucket size */
 #define MEM_HASH_BUCKET_SIZE 64
@@ -672,7 +663,13 @@ UNQLITE_PRIVATE const unqlite_kv_methods * unqliteExportMemKvStorage(void)
 		MemHashCursorDataLength,    /* xDataLength */
 		MemHashCursorData,          /* xData */
 		MemHashCursorReset,         /* xReset */
-		0        /* xRelease */                        
+		0,                          /* xRelease */
+		0,                          /* xSync */
+		0,                          /* xBucket */
+		0,                          /* xDataRef */
+		0,                          /* xReserve */
+		0,                          /* xVacuum */
+		0                           /* bSharedRead */
 	};
 	return &sMemStore;
 }
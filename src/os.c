@@ -29,6 +29,36 @@ UNQLITE_PRIVATE int unqliteOsWrite(unqlite_file *id, const void *pBuf, unqlite_i
 {
   return id->pMethods->xWrite(id, pBuf, amt, offset);
 }
+UNQLITE_PRIVATE int unqliteOsWritev(unqlite_file *id, const unqlite_iovec *aVec, int nVec, unqlite_int64 offset)
+{
+  int rc = UNQLITE_OK;
+  int i;
+  if( id->pMethods->iVersion > 1 && id->pMethods->xWritev ){
+    return id->pMethods->xWritev(id, aVec, nVec, offset);
+  }
+  /* No vectored I/O, one write per buffer */
+  for( i = 0 ; i < nVec && rc == UNQLITE_OK ; i++ ){
+    rc = id->pMethods->xWrite(id, aVec[i].pData, aVec[i].iAmt, offset);
+    offset += aVec[i].iAmt;
+  }
+  return rc;
+}
+UNQLITE_PRIVATE int unqliteOsPrefetch(unqlite_file *id, unqlite_int64 amt, unqlite_int64 offset)
+{
+  if( id->pMethods->iVersion > 2 && id->pMethods->xPrefetch ){
+    return id->pMethods->xPrefetch(id, amt, offset);
+  }
+  /* No asynchronous read, the data is read by the next xRead() */
+  return UNQLITE_OK;
+}
+UNQLITE_PRIVATE int unqliteOsDiscard(unqlite_file *id, unqlite_int64 amt, unqlite_int64 offset)
+{
+  if( id->pMethods->iVersion > 3 && id->pMethods->xDiscard ){
+    return id->pMethods->xDiscard(id, amt, offset);
+  }
+  /* Nothing to release, the blocks are kept */
+  return UNQLITE_OK;
+}
 UNQLITE_PRIVATE int unqliteOsTruncate(unqlite_file *id, unqlite_int64 size)
 {
   return id->pMethods->xTruncate(id, size);
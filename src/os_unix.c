@@ -50,6 +50,39 @@
 # include <sys/mount.h>
 #endif
 /*
+** pwritev() is used for vectored writes where known to be available.
+*/
+#ifndef HAVE_PWRITEV
+# if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#  define HAVE_PWRITEV 1
+# else
+#  define HAVE_PWRITEV 0
+# endif
+#endif
+/*
+** Maximum number of buffers passed to a single pwritev() call.
+*/
+#define UNIX_WRITEV_MAX 64
+/*
+** Hole punching (fallocate() through its system call so that no feature
+** test macro is required) is used to release the unused tail of compressed pages.
+*/
+#ifndef HAVE_PUNCH_HOLE
+# if defined(__linux__) && (defined(__LP64__) || defined(_LP64))
+#  define HAVE_PUNCH_HOLE 1
+# else
+#  define HAVE_PUNCH_HOLE 0
+# endif
+#endif
+#if HAVE_PUNCH_HOLE
+# include <sys/syscall.h>
+# include <linux/falloc.h>
+#endif
+/*
+** Only the whole blocks of this size inside a discarded range are released.
+*/
+#define UNIX_DISCARD_ALIGN 4096
+/*
 ** Allowed values of unixFile.fsFlags
 */
 #define UNQLITE_FSFLAGS_IS_MSDOS     0x1
@@ -1091,6 +1124,77 @@ static int unixWrite(
   }
   return UNQLITE_OK;
 }
+#if HAVE_PWRITEV
+/*
+** Write nVec buffers back to back starting at the given offset using
+** as few pwritev() calls as possible. A short write is completed
+** buffer by buffer using unixWrite().
+*/
+static int unixWritev(
+  unqlite_file *id,
+  const unqlite_iovec *aVec,
+  int nVec,
+  unqlite_int64 offset
+){
+  unixFile *pFile = (unixFile*)id;
+  struct iovec aIov[UNIX_WRITEV_MAX];
+  unqlite_int64 got;
+  int i, n, rc;
+
+  while( nVec>0 ){
+    n = nVec>UNIX_WRITEV_MAX ? UNIX_WRITEV_MAX : nVec;
+    for(i=0; i<n; i++){
+      aIov[i].iov_base = (void *)aVec[i].pData;
+      aIov[i].iov_len = (size_t)aVec[i].iAmt;
+    }
+    got = pwritev(pFile->h, aIov, n, (off_t)offset);
+    if( got<0 ){
+      pFile->lastErrno = errno;
+      return UNQLITE_IOERR;
+    }
+    for(i=0; i<n; i++){
+      if( got<aVec[i].iAmt ){
+        /* Short write, finish this buffer */
+        rc = unixWrite(id, &((const char *)aVec[i].pData)[got], aVec[i].iAmt-got, offset+got);
+        if( rc!=UNQLITE_OK ){
+          return rc;
+        }
+        got = 0;
+      }else{
+        got -= aVec[i].iAmt;
+      }
+      offset += aVec[i].iAmt;
+    }
+    aVec += n;
+    nVec -= n;
+  }
+  return UNQLITE_OK;
+}
+#endif
+/*
+** Release the blocks inside the given range without changing the file size.
+** This is only a hint: Partial blocks are left untouched and errors (i.e.
+** a file system without hole punching support) are ignored.
+*/
+static int unixDiscard(
+  unqlite_file *id,
+  unqlite_int64 amt,
+  unqlite_int64 offset
+){
+#if HAVE_PUNCH_HOLE && defined(FALLOC_FL_PUNCH_HOLE) && defined(__NR_fallocate)
+  unixFile *pFile = (unixFile*)id;
+  unqlite_int64 iStart = (offset + UNIX_DISCARD_ALIGN - 1) & ~((unqlite_int64)UNIX_DISCARD_ALIGN - 1);
+  unqlite_int64 iEnd = (offset + amt) & ~((unqlite_int64)UNIX_DISCARD_ALIGN - 1);
+  if( iEnd > iStart ){
+    syscall(__NR_fallocate, pFile->h, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE, (off_t)iStart, (off_t)(iEnd - iStart));
+  }
+#else
+  SXUNUSED(id);
+  SXUNUSED(amt);
+  SXUNUSED(offset);
+#endif
+  return UNQLITE_OK;
+}
 /*
 ** We do not trust systems to provide a working fdatasync().  Some do.
 ** Others do no.  To be safe, we will stick with the (slower) fsync().
@@ -1286,7 +1390,7 @@ static int unixSectorSize(unqlite_file *NotUsed){
 ** unqlite_file for Windows systems.
 */
 static const unqlite_io_methods unixIoMethod = {
-  1,                              /* iVersion */
+  4,                              /* iVersion */
   unixClose,                       /* xClose */
   unixRead,                        /* xRead */
   unixWrite,                       /* xWrite */
@@ -1297,6 +1401,13 @@ static const unqlite_io_methods unixIoMethod = {
   unixUnlock,                      /* xUnlock */
   unixCheckReservedLock,           /* xCheckReservedLock */
   unixSectorSize,                  /* xSectorSize */
+#if HAVE_PWRITEV
+  unixWritev,                      /* xWritev */
+#else
+  0,                               /* xWritev */
+#endif
+  0,                               /* xPrefetch */
+  unixDiscard,                     /* xDiscard */
 };
 /****************************************************************************
 **************************** unqlite_vfs methods ****************************
@@ -1744,6 +1855,556 @@ static int unixFullPathname(
   }
   return UNQLITE_OK;
 }
+#if defined(UNQLITE_ENABLE_IO_URING) && defined(__linux__)
+/****************************************************************************
+**************************** io_uring VFS ***********************************
+**
+** This division contains an optional VFS that submits the page writes and
+** the syncs through a per-file io_uring instance. Buffers handed to xWritev()
+** are queued and submitted together with a single io_uring_enter() when the
+** caller waits for them (xWritev() with nVec set to 0) or when the file is
+** synced. The sync is queued behind the pending writes (IOSQE_IO_DRAIN) so
+** that a flush followed by a sync cost a single system call.
+** xPrefetch() queues a read of the range into a buffer owned by the ring and
+** submits it without waiting. The completion is reaped by the next xRead()
+** which is then served from that buffer when it covers the requested range.
+** Everything else is served by the regular unix methods. When io_uring is
+** not available (old kernel, seccomp filter, ...) the file silently fall back
+** to the regular unix methods.
+**
+** The ring is driven through the raw system calls so that no external
+** library is required.
+*/
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+/*
+** Number of submission queue entries and of queued buffers per file.
+*/
+#define UNIX_URING_ENTRIES 64
+#define UNIX_URING_IOV     1024
+/*
+** Maximum number of outstanding prefetched reads per file.
+*/
+#define UNIX_URING_READ    32
+/*
+** A queued operation. Each vectored write is a single submission whose
+** buffers are stored in the UnixRing.aIov[] pool.
+*/
+typedef struct UnixRingOp UnixRingOp;
+struct UnixRingOp {
+  int iIov;                       /* First buffer in the pool */
+  int nIov;                       /* Number of buffers (0 for a sync) */
+  int iRead;                      /* Prefetched read index or -1 for a write or a sync */
+  unqlite_int64 iOfst;            /* Offset of the write */
+  unqlite_int64 nByte;            /* Total bytes to write */
+};
+/*
+** State of a prefetched read.
+*/
+#define UNIX_READ_FREE    0       /* Unused entry */
+#define UNIX_READ_PENDING 1       /* Submitted, not yet reaped */
+#define UNIX_READ_DONE    2       /* Reaped, data available */
+#define UNIX_READ_STALE   3       /* Submitted but no longer wanted (The file was written) */
+/*
+** A prefetched read. The buffer is owned by the ring.
+*/
+typedef struct UnixRingRead UnixRingRead;
+struct UnixRingRead {
+  int iState;                     /* One of the UNIX_READ_* states above */
+  char *zBuf;                     /* Read buffer */
+  struct iovec sIov;              /* Vector handed to IORING_OP_READV */
+  unqlite_int64 iOfst;            /* Offset of the read */
+  unqlite_int64 nAvail;           /* Bytes actually read once reaped */
+};
+/*
+** An io_uring instance associated with an open file.
+*/
+typedef struct UnixRing UnixRing;
+struct UnixRing {
+  int fd;                         /* io_uring file descriptor */
+  unsigned *pSqHead,*pSqTail;     /* Submission queue head and tail */
+  unsigned *pSqArray;             /* Submission queue index array */
+  unsigned nSqMask;               /* Submission queue mask */
+  struct io_uring_sqe *aSqe;      /* Submission queue entries */
+  unsigned *pCqHead,*pCqTail;     /* Completion queue head and tail */
+  unsigned nCqMask;               /* Completion queue mask */
+  struct io_uring_cqe *aCqe;      /* Completion queue entries */
+  void *pSqMap,*pCqMap;           /* Ring mappings */
+  size_t nSqMap,nCqMap,nSqeMap;   /* Mapping sizes */
+  unsigned nEntries;              /* Submission queue size */
+  unsigned nQueued;               /* Entries queued but not yet submitted */
+  unsigned nInflight;             /* Entries queued or submitted but not yet reaped */
+  int nIov;                       /* Used buffers in the pool */
+  int nRead;                      /* Entries of aRead[] not in the UNIX_READ_FREE state */
+  UnixRingOp aOp[UNIX_URING_ENTRIES]; /* Queued operations, indexed by submission slot */
+  struct iovec aIov[UNIX_URING_IOV];  /* Buffer pool (Buffers must stay valid until completion) */
+  UnixRingRead aRead[UNIX_URING_READ]; /* Prefetched reads */
+};
+/*
+** A file opened through the io_uring VFS.
+*/
+typedef struct unixUringFile unixUringFile;
+struct unixUringFile {
+  unixFile sBase;                 /* Regular unix file. MUST BE FIRST */
+  UnixRing *pRing;                /* Associated ring */
+};
+/*
+** Release a prefetched read.
+*/
+static void unixRingReadRelease(UnixRing *pRing, UnixRingRead *pRead){
+  unqlite_free(pRead->zBuf);
+  pRead->zBuf = 0;
+  pRead->iState = UNIX_READ_FREE;
+  pRing->nRead--;
+}
+/*
+** Forget every prefetched read. Must be called before the file is written
+** or unlocked so that stale data is never served. Reads still in flight are
+** released when reaped.
+*/
+static void unixRingDropReads(UnixRing *pRing){
+  int i;
+  for(i=0; i<UNIX_URING_READ && pRing->nRead>0; i++){
+    UnixRingRead *pRead = &pRing->aRead[i];
+    if( pRead->iState==UNIX_READ_PENDING ){
+      pRead->iState = UNIX_READ_STALE;
+    }else if( pRead->iState==UNIX_READ_DONE ){
+      unixRingReadRelease(pRing, pRead);
+    }
+  }
+}
+/*
+** Release an io_uring instance.
+*/
+static void unixRingRelease(UnixRing *pRing){
+  int i;
+  for(i=0; i<UNIX_URING_READ; i++){
+    if( pRing->aRead[i].zBuf ) unqlite_free(pRing->aRead[i].zBuf);
+  }
+  if( pRing->aSqe ) munmap(pRing->aSqe, pRing->nSqeMap);
+  if( pRing->pCqMap && pRing->pCqMap!=pRing->pSqMap ) munmap(pRing->pCqMap, pRing->nCqMap);
+  if( pRing->pSqMap ) munmap(pRing->pSqMap, pRing->nSqMap);
+  if( pRing->fd>=0 ) close(pRing->fd);
+  unqlite_free(pRing);
+}
+/*
+** Create a new io_uring instance. Return NULL when io_uring is not
+** available on this system.
+*/
+static UnixRing * unixRingInit(void){
+  struct io_uring_params sParams;
+  UnixRing *pRing;
+  unsigned char *zSq,*zCq;
+  pRing = (UnixRing *)unqlite_malloc(sizeof(UnixRing));
+  if( pRing==0 ){
+    return 0;
+  }
+  SyZero(pRing, sizeof(UnixRing));
+  SyZero(&sParams, sizeof(sParams));
+  pRing->fd = (int)syscall(__NR_io_uring_setup, UNIX_URING_ENTRIES, &sParams);
+  if( pRing->fd<0 ){
+    unqlite_free(pRing);
+    return 0;
+  }
+  if( sParams.sq_entries>UNIX_URING_ENTRIES ){
+    /* Submission slots are used to index aOp[] */
+    close(pRing->fd);
+    unqlite_free(pRing);
+    return 0;
+  }
+  pRing->nSqMap = sParams.sq_off.array + sParams.sq_entries*sizeof(unsigned);
+  pRing->nCqMap = sParams.cq_off.cqes + sParams.cq_entries*sizeof(struct io_uring_cqe);
+  if( sParams.features & IORING_FEAT_SINGLE_MMAP ){
+    if( pRing->nCqMap>pRing->nSqMap ) pRing->nSqMap = pRing->nCqMap;
+    pRing->nCqMap = pRing->nSqMap;
+  }
+  pRing->pSqMap = mmap(0, pRing->nSqMap, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, pRing->fd, IORING_OFF_SQ_RING);
+  if( pRing->pSqMap==MAP_FAILED ){
+    pRing->pSqMap = 0;
+    unixRingRelease(pRing);
+    return 0;
+  }
+  if( sParams.features & IORING_FEAT_SINGLE_MMAP ){
+    pRing->pCqMap = pRing->pSqMap;
+  }else{
+    pRing->pCqMap = mmap(0, pRing->nCqMap, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, pRing->fd, IORING_OFF_CQ_RING);
+    if( pRing->pCqMap==MAP_FAILED ){
+      pRing->pCqMap = 0;
+      unixRingRelease(pRing);
+      return 0;
+    }
+  }
+  pRing->nSqeMap = sParams.sq_entries*sizeof(struct io_uring_sqe);
+  pRing->aSqe = (struct io_uring_sqe *)mmap(0, pRing->nSqeMap, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, pRing->fd, IORING_OFF_SQES);
+  if( pRing->aSqe==MAP_FAILED ){
+    pRing->aSqe = 0;
+    unixRingRelease(pRing);
+    return 0;
+  }
+  zSq = (unsigned char *)pRing->pSqMap;
+  zCq = (unsigned char *)pRing->pCqMap;
+  pRing->pSqHead = (unsigned *)&zSq[sParams.sq_off.head];
+  pRing->pSqTail = (unsigned *)&zSq[sParams.sq_off.tail];
+  pRing->nSqMask = *(unsigned *)&zSq[sParams.sq_off.ring_mask];
+  pRing->pSqArray = (unsigned *)&zSq[sParams.sq_off.array];
+  pRing->pCqHead = (unsigned *)&zCq[sParams.cq_off.head];
+  pRing->pCqTail = (unsigned *)&zCq[sParams.cq_off.tail];
+  pRing->nCqMask = *(unsigned *)&zCq[sParams.cq_off.ring_mask];
+  pRing->aCqe = (struct io_uring_cqe *)&zCq[sParams.cq_off.cqes];
+  pRing->nEntries = sParams.sq_entries;
+  return pRing;
+}
+/*
+** Grab the next free submission queue entry. Its slot number is stored
+** in *pSlot. The caller must make sure the queue is not full.
+*/
+static struct io_uring_sqe * unixRingGetSqe(UnixRing *pRing, unsigned *pSlot){
+  unsigned iTail = *pRing->pSqTail;
+  unsigned iSlot = iTail & pRing->nSqMask;
+  struct io_uring_sqe *pSqe = &pRing->aSqe[iSlot];
+  SyZero(pSqe, sizeof(struct io_uring_sqe));
+  pRing->pSqArray[iSlot] = iSlot;
+  pSqe->user_data = iSlot;
+  *pSlot = iSlot;
+  return pSqe;
+}
+/*
+** Publish the entries grabbed so far to the kernel.
+*/
+static void unixRingPublish(UnixRing *pRing, unsigned nEntry){
+  __atomic_store_n(pRing->pSqTail, *pRing->pSqTail + nEntry, __ATOMIC_RELEASE);
+  pRing->nQueued += nEntry;
+  pRing->nInflight += nEntry;
+}
+/*
+** Hand the queued entries to the kernel without waiting for their completion.
+** Entries the kernel did not accept are submitted by the next unixRingWait().
+*/
+static void unixRingSubmit(UnixRing *pRing){
+  int n;
+  if( pRing->nQueued<1 ){
+    return;
+  }
+  n = (int)syscall(__NR_io_uring_enter, pRing->fd, pRing->nQueued, 0, 0, 0, 0);
+  if( n>0 ){
+    pRing->nQueued -= (unsigned)n>pRing->nQueued ? pRing->nQueued : (unsigned)n;
+  }
+}
+/*
+** Complete a short vectored write with regular writes.
+*/
+static int unixRingFinishWrite(unixUringFile *pFile, UnixRingOp *pOp, unqlite_int64 nDone){
+  struct iovec *aIov = &pFile->pRing->aIov[pOp->iIov];
+  unqlite_int64 iOfst = pOp->iOfst;
+  int i,rc;
+  for(i=0; i<pOp->nIov; i++){
+    unqlite_int64 nLen = (unqlite_int64)aIov[i].iov_len;
+    if( nDone>=nLen ){
+      nDone -= nLen;
+    }else{
+      rc = unixWrite((unqlite_file *)pFile, &((const char *)aIov[i].iov_base)[nDone], nLen - nDone, iOfst + nDone);
+      if( rc!=UNQLITE_OK ){
+        return rc;
+      }
+      nDone = 0;
+    }
+    iOfst += nLen;
+  }
+  return UNQLITE_OK;
+}
+/*
+** Submit the queued entries and wait until every in-flight entry completes.
+** Short writes are completed with regular writes.
+*/
+static int unixRingWait(unixUringFile *pFile){
+  UnixRing *pRing = pFile->pRing;
+  int rc = UNQLITE_OK;
+  while( pRing->nInflight>0 ){
+    unsigned iHead,iTail;
+    int n;
+    n = (int)syscall(__NR_io_uring_enter, pRing->fd, pRing->nQueued, pRing->nInflight, IORING_ENTER_GETEVENTS, 0, 0);
+    if( n<0 ){
+      if( errno==EINTR ) continue;
+      pFile->sBase.lastErrno = errno;
+      return UNQLITE_IOERR;
+    }
+    pRing->nQueued -= (unsigned)n>pRing->nQueued ? pRing->nQueued : (unsigned)n;
+    /* Reap the completions */
+    iHead = *pRing->pCqHead;
+    iTail = __atomic_load_n(pRing->pCqTail, __ATOMIC_ACQUIRE);
+    while( iHead!=iTail ){
+      struct io_uring_cqe *pCqe = &pRing->aCqe[iHead & pRing->nCqMask];
+      UnixRingOp *pOp = &pRing->aOp[pCqe->user_data];
+      if( pOp->iRead>=0 ){
+        /* Prefetched read, errors are reported by the regular read */
+        UnixRingRead *pRead = &pRing->aRead[pOp->iRead];
+        if( pRead->iState==UNIX_READ_STALE ){
+          unixRingReadRelease(pRing, pRead);
+        }else{
+          pRead->nAvail = pCqe->res>0 ? (unqlite_int64)pCqe->res : 0;
+          pRead->iState = UNIX_READ_DONE;
+        }
+      }else if( pCqe->res<0 ){
+        pFile->sBase.lastErrno = -pCqe->res;
+        rc = UNQLITE_IOERR;
+      }else if( pCqe->res<pOp->nByte && rc==UNQLITE_OK ){
+        /* Short write, finish it synchronously */
+        rc = unixRingFinishWrite(pFile, pOp, pCqe->res);
+      }
+      iHead++;
+      pRing->nInflight--;
+    }
+    __atomic_store_n(pRing->pCqHead, iHead, __ATOMIC_RELEASE);
+  }
+  pRing->nIov = 0;
+  return rc;
+}
+/*
+** Queue nVec writes. A call with nVec set to 0 submits the queued writes
+** and wait for their completion.
+*/
+static int unixUringWritev(unqlite_file *id, const unqlite_iovec *aVec, int nVec, unqlite_int64 iOfst){
+  unixUringFile *pFile = (unixUringFile *)id;
+  UnixRing *pRing = pFile->pRing;
+  struct io_uring_sqe *pSqe;
+  UnixRingOp *pOp;
+  unsigned iSlot;
+  int i,rc;
+  if( nVec<1 ){
+    return unixRingWait(pFile);
+  }
+  if( nVec>UNIX_URING_IOV ){
+    /* Too many buffers, write synchronously */
+    rc = unixRingWait(pFile);
+    unixRingDropReads(pRing);
+    for(i=0; i<nVec && rc==UNQLITE_OK; i++){
+      rc = unixWrite(id, aVec[i].pData, aVec[i].iAmt, iOfst);
+      iOfst += aVec[i].iAmt;
+    }
+    return rc;
+  }
+  if( pRing->nInflight>=pRing->nEntries || pRing->nIov+nVec>UNIX_URING_IOV ){
+    /* Queue full */
+    rc = unixRingWait(pFile);
+    if( rc!=UNQLITE_OK ){
+      return rc;
+    }
+  }
+  /* The prefetched data may predate this write */
+  unixRingDropReads(pRing);
+  pSqe = unixRingGetSqe(pRing, &iSlot);
+  pOp = &pRing->aOp[iSlot];
+  pOp->iIov = pRing->nIov;
+  pOp->nIov = nVec;
+  pOp->iRead = -1;
+  pOp->iOfst = iOfst;
+  pOp->nByte = 0;
+  for(i=0; i<nVec; i++){
+    pRing->aIov[pRing->nIov].iov_base = (void *)aVec[i].pData;
+    pRing->aIov[pRing->nIov].iov_len = (size_t)aVec[i].iAmt;
+    pRing->nIov++;
+    pOp->nByte += aVec[i].iAmt;
+  }
+  pSqe->opcode = IORING_OP_WRITEV;
+  pSqe->fd = pFile->sBase.h;
+  pSqe->addr = (unsigned long)&pRing->aIov[pOp->iIov];
+  pSqe->len = (unsigned)nVec;
+  pSqe->off = (unsigned long long)iOfst;
+  unixRingPublish(pRing, 1);
+  return UNQLITE_OK;
+}
+/*
+** Sync the file through the ring. The sync is ordered after any pending
+** write so that both are submitted in a single batch.
+*/
+static int unixUringSync(unqlite_file *id, int flags){
+  unixUringFile *pFile = (unixUringFile *)id;
+  UnixRing *pRing = pFile->pRing;
+  struct io_uring_sqe *pSqe;
+  unsigned iSlot;
+  int rc;
+  if( pFile->sBase.dirfd>=0 ){
+    /* First sync of a new file, the directory must be synced as well */
+    rc = unixRingWait(pFile);
+    return rc==UNQLITE_OK ? unixSync(id, flags) : rc;
+  }
+  if( pRing->nInflight>=pRing->nEntries ){
+    rc = unixRingWait(pFile);
+    if( rc!=UNQLITE_OK ){
+      return rc;
+    }
+  }
+  pSqe = unixRingGetSqe(pRing, &iSlot);
+  pRing->aOp[iSlot].nIov = 0;
+  pRing->aOp[iSlot].iRead = -1;
+  pRing->aOp[iSlot].nByte = 0;
+  pSqe->opcode = IORING_OP_FSYNC;
+  pSqe->fd = pFile->sBase.h;
+  pSqe->flags = IOSQE_IO_DRAIN;
+  if( flags & UNQLITE_SYNC_DATAONLY ){
+    pSqe->fsync_flags = IORING_FSYNC_DATASYNC;
+  }
+  unixRingPublish(pRing, 1);
+  return unixRingWait(pFile);
+}
+/*
+** Queue a read of the given range into a buffer owned by the ring and
+** submit it without waiting. The data is picked up by unixUringRead().
+*/
+static int unixUringPrefetch(unqlite_file *id, unqlite_int64 amt, unqlite_int64 offset){
+  unixUringFile *pFile = (unixUringFile *)id;
+  UnixRing *pRing = pFile->pRing;
+  struct io_uring_sqe *pSqe;
+  UnixRingRead *pRead;
+  UnixRingOp *pOp;
+  unsigned iSlot;
+  int i;
+  if( amt<1 || pRing->nInflight>=pRing->nEntries || pRing->nRead>=UNIX_URING_READ ){
+    /* Only a hint, the range is read by the regular read */
+    return UNQLITE_OK;
+  }
+  for(i=0; i<UNIX_URING_READ; i++){
+    if( pRing->aRead[i].iState==UNIX_READ_FREE ) break;
+  }
+  pRead = &pRing->aRead[i];
+  pRead->zBuf = (char *)unqlite_malloc((unsigned int)amt);
+  if( pRead->zBuf==0 ){
+    return UNQLITE_OK;
+  }
+  pRead->iState = UNIX_READ_PENDING;
+  pRead->iOfst = offset;
+  pRead->nAvail = 0;
+  pRead->sIov.iov_base = pRead->zBuf;
+  pRead->sIov.iov_len = (size_t)amt;
+  pRing->nRead++;
+  pSqe = unixRingGetSqe(pRing, &iSlot);
+  pOp = &pRing->aOp[iSlot];
+  pOp->iIov = 0;
+  pOp->nIov = 0;
+  pOp->iRead = i;
+  pOp->iOfst = offset;
+  pOp->nByte = amt;
+  pSqe->opcode = IORING_OP_READV;
+  pSqe->fd = pFile->sBase.h;
+  pSqe->addr = (unsigned long)&pRead->sIov;
+  pSqe->len = 1;
+  pSqe->off = (unsigned long long)offset;
+  unixRingPublish(pRing, 1);
+  unixRingSubmit(pRing);
+  return UNQLITE_OK;
+}
+/*
+** Reap the pending operations and serve the read from a prefetched buffer
+** covering the requested range if any. A prefetched buffer is used once.
+*/
+static int unixUringRead(unqlite_file *id, void *pBuf, unqlite_int64 amt, unqlite_int64 offset){
+  unixUringFile *pFile = (unixUringFile *)id;
+  UnixRing *pRing = pFile->pRing;
+  int i,rc;
+  rc = unixRingWait(pFile);
+  if( rc!=UNQLITE_OK ){
+    return rc;
+  }
+  for(i=0; i<UNIX_URING_READ && pRing->nRead>0; i++){
+    UnixRingRead *pRead = &pRing->aRead[i];
+    if( pRead->iState==UNIX_READ_DONE && offset>=pRead->iOfst &&
+      offset+amt<=pRead->iOfst+pRead->nAvail ){
+        SyMemcpy(&pRead->zBuf[offset-pRead->iOfst], pBuf, (sxu32)amt);
+        unixRingReadRelease(pRing, pRead);
+        return UNQLITE_OK;
+    }
+  }
+  return unixRead(id, pBuf, amt, offset);
+}
+/*
+** The remaining methods complete the pending operations first, then defer
+** to the regular unix methods.
+*/
+static int unixUringWrite(unqlite_file *id, const void *pBuf, unqlite_int64 amt, unqlite_int64 offset){
+  int rc = unixRingWait((unixUringFile *)id);
+  unixRingDropReads(((unixUringFile *)id)->pRing);
+  return rc==UNQLITE_OK ? unixWrite(id, pBuf, amt, offset) : rc;
+}
+static int unixUringTruncate(unqlite_file *id, sxi64 nByte){
+  int rc = unixRingWait((unixUringFile *)id);
+  unixRingDropReads(((unixUringFile *)id)->pRing);
+  return rc==UNQLITE_OK ? unixTruncate(id, nByte) : rc;
+}
+static int unixUringUnlock(unqlite_file *id, int eFileLock){
+  /* Another process may write the file once the lock is released */
+  unixRingDropReads(((unixUringFile *)id)->pRing);
+  return unixUnlock(id, eFileLock);
+}
+static int unixUringDiscard(unqlite_file *id, unqlite_int64 amt, unqlite_int64 offset){
+  int rc = unixRingWait((unixUringFile *)id);
+  unixRingDropReads(((unixUringFile *)id)->pRing);
+  return rc==UNQLITE_OK ? unixDiscard(id, amt, offset) : rc;
+}
+static int unixUringClose(unqlite_file *id){
+  unixUringFile *pFile = (unixUringFile *)id;
+  if( pFile->pRing ){
+    unixRingWait(pFile);
+    unixRingRelease(pFile->pRing);
+    pFile->pRing = 0;
+  }
+  return unixClose(id);
+}
+static const unqlite_io_methods unixUringIoMethod = {
+  4,                               /* iVersion */
+  unixUringClose,                  /* xClose */
+  unixUringRead,                   /* xRead */
+  unixUringWrite,                  /* xWrite */
+  unixUringTruncate,               /* xTruncate */
+  unixUringSync,                   /* xSync */
+  unixFileSize,                    /* xFileSize */
+  unixLock,                        /* xLock */
+  unixUringUnlock,                 /* xUnlock */
+  unixCheckReservedLock,           /* xCheckReservedLock */
+  unixSectorSize,                  /* xSectorSize */
+  unixUringWritev,                 /* xWritev */
+  unixUringPrefetch,               /* xPrefetch */
+  unixUringDiscard,                /* xDiscard */
+};
+/*
+** Open a file and attach an io_uring instance to it. Fall back to
+** the regular unix methods when io_uring is not available.
+*/
+static int unixUringOpen(unqlite_vfs *pVfs, const char *zPath, unqlite_file *pId, unsigned int flags){
+  unixUringFile *pFile = (unixUringFile *)pId;
+  int rc;
+  rc = unixOpen(pVfs, zPath, pId, flags);
+  if( rc!=UNQLITE_OK ){
+    return rc;
+  }
+  pFile->pRing = unixRingInit();
+  if( pFile->pRing ){
+    pFile->sBase.pMethod = &unixUringIoMethod;
+  }
+  return UNQLITE_OK;
+}
+/*
+ * Export the io_uring Vfs.
+ */
+UNQLITE_PRIVATE const unqlite_vfs * unqliteExportUringVfs(void)
+{
+	static const unqlite_vfs sUringvfs = {
+		"Unix-io_uring",     /* Vfs name */
+		1,                   /* Vfs structure version */
+		sizeof(unixUringFile), /* szOsFile */
+		MAX_PATHNAME,        /* mxPathName */
+		unixUringOpen,       /* xOpen */
+		unixDelete,          /* xDelete */
+		unixAccess,          /* xAccess */
+		unixFullPathname,    /* xFullPathname */
+		0,                   /* xTmp */
+		unixSleep,           /* xSleep */
+		unixCurrentTime,     /* xCurrentTime */
+		0,                   /* xGetLastError */
+	};
+	return &sUringvfs;
+}
+#endif /* UNQLITE_ENABLE_IO_URING && __linux__ */
 /*
  * Export the Unix Vfs.
  */
@@ -571,6 +571,9 @@ static const unqlite_io_methods winIoMethod = {
   winUnlock,                      /* xUnlock */
   winCheckReservedLock,           /* xCheckReservedLock */
   winSectorSize,                  /* xSectorSize */
+  0,                              /* xWritev */
+  0,                              /* xPrefetch */
+  0,                              /* xDiscard */
 };
 /*
  * Windows VFS Methods.
@@ -154,6 +154,26 @@ static const unsigned char aJournalMagic[] = {
 ** size as a single disk sector. See also setSectorSize().
 */
 #define JOURNAL_HDR_SZ(pPager) (pPager->iSectorSize)
+/*
+** Write-ahead log files begin with the following magic string.
+*/
+static const unsigned char aWalMagic[] = {
+  0x3b, 0x91, 0xe4, 0x0d, 0xc7, 0x58, 0x2f, 0xa1,
+};
+/*
+** Write-ahead log header and frame header sizes (See the block comment
+** above pager_wal_cksum() for the log format).
+*/
+#define WAL_HDR_SZ           16
+#define WAL_FRAME_HDR_SZ     24
+#define WAL_FRAME_SZ(pPager) (WAL_FRAME_HDR_SZ + (pPager)->iPageSize)
+/*
+** Copy the write-ahead log content back to the database file once the log
+** hold this many committed frames.
+*/
+#ifndef UNQLITE_WAL_AUTOCHECKPOINT
+#define UNQLITE_WAL_AUTOCHECKPOINT 1000
+#endif
 /*
  * Database page handle.
  * Each raw disk page is represented in memory by an instance
@@ -177,6 +197,8 @@ struct Page {
   Page *pDirtyPrev;             /* Previous element in list of dirty pages */
   Page *pNextCollide,*pPrevCollide; /* Collission chain */
   Page *pNextHot,*pPrevHot;    /* Hot dirty pages chain */
+  Page *pNextLru,*pPrevLru;    /* 2Q replacement chain (A1 or Am list) */
+  sxu32 iSnap;                   /* Newest snapshot this page image was saved in */
 };
 /* Bit values for Page.flags */
 #define PAGE_DIRTY             0x002  /* Page has changed */
@@ -189,6 +211,59 @@ struct Page {
 #define PAGE_DONT_MAKE_HOT     0x080  /* Dont make this page Hot. In other words,
 									   * do not link it to the hot dirty list.
 									   */
+#define PAGE_CACHE_AM          0x100  /* Page was referenced more than once (Am list) */
+#define PAGE_MMAP              0x200  /* Page content lives in the memory view of the database */
+#define PAGE_PRIVATE_COPY      0x400  /* Page content was copied out of the memory view */
+#define PAGE_READ_AHEAD        0x800  /* Page was loaded by read-ahead and not referenced yet */
+/*
+ * An entry in the WAL index. Map a page number to the offset
+ * of its latest frame in the write-ahead log.
+ */
+typedef struct WalEntry WalEntry;
+struct WalEntry {
+  pgno iNum;                     /* Page number */
+  sxi64 iOfft;                   /* Offset of the latest frame holding this page */
+  WalEntry *pNext;               /* Next entry in the collision chain */
+};
+/*
+ * A read-only snapshot of the database image taken by [unqlite_kv_cursor_snapshot()].
+ * The snapshot is served by its own instance of the KV engine whose pages are
+ * private copies taken out of the pager on first access. Before a later
+ * transaction modifies a page, its committed image is saved in each active
+ * snapshot that does not hold it yet (copy-on-write) so that the snapshot
+ * keeps seeing the image it was taken from while writers go ahead.
+ */
+typedef struct SnapPage SnapPage;
+typedef struct Snapshot Snapshot;
+struct SnapPage {
+  /* Must correspond to unqlite_page */
+  unsigned char *zData;           /* Content of this page */
+  void *pUserData;                /* Extra content */
+  pgno pgno;                      /* Page number for this page */
+  /* Private */
+  Snapshot *pSnap;                /* Snapshot this page is part of */
+  int nRef;                       /* Number of users of this page */
+  int bKeep;                      /* Committed image saved before a change, never evicted */
+  SnapPage *pNextCollide,*pPrevCollide; /* Collission chain */
+  SnapPage *pNext,*pPrev;         /* List of all pages, most recently used first */
+};
+struct Snapshot {
+  Pager *pPager;                  /* Pager this snapshot was taken from */
+  unqlite_kv_engine *pEngine;     /* KV engine instance reading the snapshot */
+  unqlite_kv_io sIo;              /* IO methods of the engine instance */
+  pgno dbSize;                    /* Number of pages in the snapshot image */
+  sxu32 iId;                      /* Snapshot ID */
+  int bStale;                     /* Database changed by another process */
+  void (*xPageUnpin)(void *);     /* Page Unpin callback */
+  void (*xPageReload)(void *);    /* Page Reload callback */
+  unsigned char *zTmpPage;        /* Temporary page */
+  SnapPage **apHash;              /* Page table */
+  sxu32 nSize;                    /* apHash[] size: Must be a power of two  */
+  sxu32 nPage;                    /* Total number of pages held */
+  sxu32 nKeep;                    /* Pages saved before a change */
+  SnapPage *pAll,*pTail;          /* List of all pages */
+  Snapshot *pNext,*pPrev;         /* Active snapshots of the pager */
+};
 /*
  * Each active database pager is represented by an instance of
  * the following structure.
@@ -200,12 +275,16 @@ struct Pager
   unqlite_kv_engine *pEngine;    /* Underlying KV storage engine */
   char *zFilename;               /* Name of the database file */
   char *zJournal;                /* Name of the journal file */
+  char *zWal;                    /* Name of the write-ahead log file */
   unqlite_vfs *pVfs;             /* Underlying virtual file system */
   unqlite_file *pfd,*pjfd;       /* File descriptors for database and journal */
+  unqlite_file *pwfd;            /* Write-ahead log file descriptor */
   pgno dbSize;                   /* Number of pages in the file */
   pgno dbOrigSize;               /* dbSize before the current change */
   sxi64 dbByteSize;              /* Database size in bytes */
   void *pMmap;                   /* Read-only Memory view (mmap) of the whole file if requested (UNQLITE_OPEN_MMAP). */
+  sxi64 nMapSize;                /* Size of the memory view in bytes */
+  pgno nMapPage;                 /* Total number of pages backed by the memory view */
   sxu32 nRec;                    /* Number of pages written to the journal */
   SyPRNGCtx sPrng;               /* PRNG Context */
   sxu32 cksumInit;               /* Quasi-random value added to every checksum */
@@ -225,9 +304,14 @@ struct Pager
   int is_mem;                    /* True for an in-memory database */
   int is_rdonly;                 /* True for a read-only database */
   int no_jrnl;                   /* TRUE to omit journaling */
+  int no_retain;                 /* TRUE to drop the page cache after each commit */
+  int is_wal;                    /* TRUE for write-ahead log journal mode (UNQLITE_OPEN_WAL) */
   int iPageSize;                 /* Page size in bytes (default 4K) */
   int iSectorSize;               /* Size of a single sector on disk */
   unsigned char *zTmpPage;       /* Temporary page */
+  const unqlite_page_codec *pCodec; /* Page compression codec (NULL when disabled) */
+  unsigned char *zCodecPage;     /* Compressed page buffer, set once the codec of the database is known */
+  int nReserve;                  /* Bytes reserved at the end of each page by the codec (Hidden from the KV engine) */
   Page *pFirstDirty;             /* First dirty pages */
   Page *pDirty;                  /* Transient list of dirty pages */
   Page *pAll;                    /* List of all pages */
@@ -238,6 +322,25 @@ struct Pager
   sxu32 nSize;                   /* apHash[] size: Must be a power of two  */
   sxu32 nPage;                   /* Total number of page loaded in memory */
   sxu32 nCacheMax;               /* Maximum page to cache*/
+  Page *pA1,*pA1Tail;            /* 2Q: Pages referenced only once (FIFO) */
+  Page *pAm,*pAmTail;            /* 2Q: Pages referenced more than once (LRU) */
+  sxu32 nA1;                     /* Total number of pages in the A1 list */
+  sxu64 nCacheHit;               /* Total number of page cache hits */
+  sxu64 nCacheMiss;              /* Total number of page cache misses */
+  sxu64 nCacheEvict;             /* Total number of evicted pages */
+  int nReadAhead;                /* Read-ahead window in pages (0 to disable) */
+  sxu32 iChangeCount;            /* File change counter (Incremented on each commit) */
+  sxu32 iChangeOfft;             /* Offset of the file change counter in the database header */
+  WalEntry **apWal;              /* WAL index: Latest frame of each logged page */
+  sxu32 nWalSize;                /* apWal[] size: Must be a power of two */
+  sxu32 nWalEntry;               /* Total number of entries in the WAL index */
+  sxi64 iWalOfft;                /* Offset of the next frame in the write-ahead log */
+  sxi64 iWalCommit;              /* End of the last committed frame */
+  sxi64 iWalSize;                /* Log size seen by the last index refresh */
+  sxu32 iWalSalt;                /* Salt of the current log generation */
+  unsigned char *zWalFrame;      /* Frame buffer (Last appended frame) */
+  Snapshot *pSnap;               /* Active snapshots (newest first) */
+  sxu32 iSnapId;                 /* ID of the newest snapshot */
 };
 /* Control flags */
 #define PAGER_CTRL_COMMIT_ERR   0x001 /* Commit error */
@@ -284,17 +387,6 @@ static int WriteInt32(unqlite_file *pFd,sxu32 iNum,sxi64 iOfft)
 	return rc;
 }
 /*
-** Write a 64-bit integer into the given file descriptor.
-*/
-static int WriteInt64(unqlite_file *pFd,sxu64 iNum,sxi64 iOfft)
-{
-	unsigned char zBuf[8];
-	int rc;
-	SyBigEndianPack64(zBuf,iNum);
-	rc = unqliteOsWrite(pFd,zBuf,sizeof(zBuf),iOfft);
-	return rc;
-}
-/*
 ** The maximum allowed sector size. 64KiB. If the xSectorsize() method 
 ** returns a value larger than this, then MAX_SECTOR_SIZE is used instead.
 ** This could conceivably cause corruption following a power failure on
@@ -370,18 +462,72 @@ static Page * pager_alloc_page(Pager *pPager,pgno num_page)
 	pNew->pgno = num_page;
 	return pNew;
 }
+/*
+ * Allocate a page whose content lives in the memory view of the database.
+ * No content buffer is allocated until the page is made writeable.
+ */
+static Page * pager_alloc_mapped_page(Pager *pPager,pgno num_page)
+{
+	Page *pNew;
+	
+	pNew = (Page *)SyMemBackendPoolAlloc(pPager->pAllocator,sizeof(Page));
+	if( pNew == 0 ){
+		return 0;
+	}
+	/* Zero the structure */
+	SyZero(pNew,sizeof(Page));
+	/* Point to the memory view */
+	pNew->zData = &((unsigned char *)pPager->pMmap)[num_page * pPager->iPageSize];
+	/* Fill in the structure */
+	pNew->pPager = pPager;
+	pNew->flags = PAGE_MMAP;
+	pNew->nRef = 1;
+	pNew->pgno = num_page;
+	return pNew;
+}
+/*
+ * Move the content of a page backed by the memory view to a private buffer
+ * so that it can be modified. zSrc is the content to copy, or NULL to zero
+ * the buffer.
+ */
+static int pager_page_private_copy(Pager *pPager,Page *pPage,const unsigned char *zSrc)
+{
+	unsigned char *zBuf;
+	zBuf = (unsigned char *)SyMemBackendPoolAlloc(pPager->pAllocator,(sxu32)pPager->iPageSize);
+	if( zBuf == 0 ){
+		unqliteGenOutofMem(pPager->pDb);
+		return UNQLITE_NOMEM;
+	}
+	if( zSrc ){
+		SyMemcpy(zSrc,zBuf,(sxu32)pPager->iPageSize);
+	}else{
+		SyZero(zBuf,(sxu32)pPager->iPageSize);
+	}
+	pPage->zData = zBuf;
+	pPage->flags &= ~PAGE_MMAP;
+	pPage->flags |= PAGE_PRIVATE_COPY;
+	return UNQLITE_OK;
+}
+/*
+ * A page was written to the database file, drop its private copy
+ * and point it back to the memory view.
+ */
+static void pager_page_drop_private_copy(Pager *pPager,Page *pPage)
+{
+	if( (pPage->flags & PAGE_PRIVATE_COPY) == 0 || pPage->pgno >= pPager->nMapPage ){
+		return;
+	}
+	SyMemBackendPoolFree(pPager->pAllocator,pPage->zData);
+	pPage->zData = &((unsigned char *)pPager->pMmap)[pPage->pgno * pPager->iPageSize];
+	pPage->flags &= ~PAGE_PRIVATE_COPY;
+	pPage->flags |= PAGE_MMAP;
+}
 /*
  * Increment the reference count of a given page.
  */
 static void page_ref(Page *pPage)
 {
-    if( pPage->pPager->pAllocator->pMutexMethods ){
-        SyMutexEnter(pPage->pPager->pAllocator->pMutexMethods, pPage->pPager->pAllocator->pMutex);
-    }
 	pPage->nRef++;
-    if( pPage->pPager->pAllocator->pMutexMethods ){
-        SyMutexLeave(pPage->pPager->pAllocator->pMutexMethods, pPage->pPager->pAllocator->pMutex);
-    }
 }
 /*
  * Release an in-memory page after its reference count reach zero.
@@ -395,6 +541,9 @@ static int pager_release_page(Pager *pPager,Page *pPage)
 			pPager->xPageUnpin(pPage->pUserData);
 		}
 		pPage->pUserData = 0;
+		if( pPage->flags & PAGE_PRIVATE_COPY ){
+			SyMemBackendPoolFree(pPager->pAllocator,pPage->zData);
+		}
 		SyMemBackendPoolFree(pPager->pAllocator,pPage);
 	}else{
 		/* Dirty page, it will be released later when a dirty commit
@@ -406,19 +555,36 @@ static int pager_release_page(Pager *pPager,Page *pPage)
 }
 /* Forward declaration */
 static int pager_unlink_page(Pager *pPager,Page *pPage);
+/*
+ * Link an unused dirty page to the hot dirty list so that it
+ * get written by the next dirty commit.
+ */
+static void pager_link_hot_page(Pager *pPager,Page *pPage)
+{
+	if( pPage->flags & PAGE_HOT_DIRTY ){
+		/* Already linked */
+		return;
+	}
+	pPage->pPrevHot = pPage->pNextHot = 0;
+	if( pPager->pFirstHot == 0 ){
+		pPager->pFirstHot = pPager->pHotDirty = pPage;
+	}else{
+		pPage->pNextHot = pPager->pHotDirty;
+		if( pPager->pHotDirty ){
+			pPager->pHotDirty->pPrevHot = pPage;
+		}
+		pPager->pHotDirty = pPage;
+	}
+	pPager->nHot++;
+	pPage->flags |= PAGE_HOT_DIRTY;
+}
 /*
  * Decrement the reference count of a given page.
  */
 static void page_unref(Page *pPage)
 {
 	int nRef;
-    if( pPage->pPager->pAllocator->pMutexMethods ){
-        SyMutexEnter(pPage->pPager->pAllocator->pMutexMethods, pPage->pPager->pAllocator->pMutex);
-    }
 	nRef = pPage->nRef--;
-    if( pPage->pPager->pAllocator->pMutexMethods ){
-        SyMutexLeave(pPage->pPager->pAllocator->pMutexMethods, pPage->pPager->pAllocator->pMutex);
-    }
 	if( nRef == 0){
 		Pager *pPager = pPage->pPager;
 		if( !(pPage->flags & PAGE_DIRTY)  ){
@@ -430,24 +596,80 @@ static void page_unref(Page *pPage)
 				/* Do not add this page to the hot dirty list */
 				return;
 			}
-			if( !(pPage->flags & PAGE_HOT_DIRTY) ){
-				/* Add to the hot dirty list */
-				pPage->pPrevHot = 0;
-				if( pPager->pFirstHot == 0 ){
-					pPager->pFirstHot = pPager->pHotDirty = pPage;
-				}else{
-					pPage->pNextHot = pPager->pHotDirty;
-					if( pPager->pHotDirty ){
-						pPager->pHotDirty->pPrevHot = pPage;
-					}
-					pPager->pHotDirty = pPage;
-				}
-				pPager->nHot++;
-				pPage->flags |= PAGE_HOT_DIRTY;
-			}
+			/* Add to the hot dirty list */
+			pager_link_hot_page(pPager,pPage);
 		}
 	}
 }
+/*
+ * The page cache replacement policy is a simplified 2Q.
+ * Freshly loaded pages enter the A1 list (FIFO) and are promoted
+ * to the Am list (LRU) on their second reference. Victims are taken
+ * from the tail of the A1 list first so that a sequential scan does
+ * not flush the frequently used pages out of the cache.
+ */
+static void pager_lru_unlink(Pager *pPager,Page *pPage)
+{
+	if( pPage->pPrevLru == 0 && pPager->pA1 != pPage && pPager->pAm != pPage ){
+		/* Not linked */
+		return;
+	}
+	if( pPage->pPrevLru ){
+		pPage->pPrevLru->pNextLru = pPage->pNextLru;
+	}else if( pPage->flags & PAGE_CACHE_AM ){
+		pPager->pAm = pPage->pNextLru;
+	}else{
+		pPager->pA1 = pPage->pNextLru;
+	}
+	if( pPage->pNextLru ){
+		pPage->pNextLru->pPrevLru = pPage->pPrevLru;
+	}else if( pPage->flags & PAGE_CACHE_AM ){
+		pPager->pAmTail = pPage->pPrevLru;
+	}else{
+		pPager->pA1Tail = pPage->pPrevLru;
+	}
+	if( !(pPage->flags & PAGE_CACHE_AM) ){
+		pPager->nA1--;
+	}
+	pPage->pNextLru = pPage->pPrevLru = 0;
+}
+/*
+ * Link a page at the head of the A1 or Am list.
+ */
+static void pager_lru_link(Pager *pPager,Page *pPage)
+{
+	Page **ppHead,**ppTail;
+	if( pPage->flags & PAGE_CACHE_AM ){
+		ppHead = &pPager->pAm;
+		ppTail = &pPager->pAmTail;
+	}else{
+		ppHead = &pPager->pA1;
+		ppTail = &pPager->pA1Tail;
+		pPager->nA1++;
+	}
+	pPage->pPrevLru = 0;
+	pPage->pNextLru = *ppHead;
+	if( *ppHead ){
+		(*ppHead)->pPrevLru = pPage;
+	}
+	*ppHead = pPage;
+	if( *ppTail == 0 ){
+		*ppTail = pPage;
+	}
+}
+/*
+ * A cached page was referenced again, promote it to the head of the Am list.
+ */
+static void pager_lru_touch(Pager *pPager,Page *pPage)
+{
+	if( (pPage->flags & PAGE_CACHE_AM) && pPager->pAm == pPage ){
+		/* Already the most recently used page */
+		return;
+	}
+	pager_lru_unlink(pPager,pPage);
+	pPage->flags |= PAGE_CACHE_AM;
+	pager_lru_link(pPager,pPage);
+}
 /*
  * Link a freshly created page to the list of active page.
  */
@@ -464,6 +686,9 @@ static int pager_link_page(Pager *pPager,Page *pPage)
 	/* Link to the list of active pages */
 	MACRO_LD_PUSH(pPager->pAll,pPage);
 	pPager->nPage++;
+	/* Enter the cache through the A1 list */
+	pPage->flags &= ~PAGE_CACHE_AM;
+	pager_lru_link(pPager,pPage);
 	if( (pPager->nPage >= pPager->nSize * 4)  && pPager->nPage < 100000 ){
 		/* Grow the hashtable */
 		sxu32 nNewSize = pPager->nSize << 1;
@@ -518,6 +743,8 @@ static int pager_unlink_page(Pager *pPager,Page *pPage)
 	}
 	MACRO_LD_REMOVE(pPager->pAll,pPage);
 	pPager->nPage--;
+	/* Remove from the replacement lists */
+	pager_lru_unlink(pPager,pPage);
 	return UNQLITE_OK;
 }
 /*
@@ -531,11 +758,110 @@ static int pager_fill_page(Pager *pPager,pgno iNum,void *pContents)
 	if( pPage == 0 ){
 		return SXERR_NOTFOUND;
 	}
+	if( pPage->flags & PAGE_MMAP ){
+		/* The memory view already reflect the file content */
+		return UNQLITE_OK;
+	}
 	/* Reflect the change */
 	SyMemcpy(pContents,pPage->zData,pPager->iPageSize);
 
 	return UNQLITE_OK;
 }
+/*
+ * Lookup the latest frame of a given page in the WAL index.
+ */
+static WalEntry * pager_wal_lookup(Pager *pPager,pgno iNum)
+{
+	WalEntry *pEntry;
+	if( pPager->nWalEntry < 1 ){
+		/* Don't bother hashing */
+		return 0;
+	}
+	pEntry = pPager->apWal[PAGE_HASH(iNum) & (pPager->nWalSize - 1)];
+	while( pEntry ){
+		if( pEntry->iNum == iNum ){
+			return pEntry;
+		}
+		/* Point to the next entry in the collision chain */
+		pEntry = pEntry->pNext;
+	}
+	/* Page not logged */
+	return 0;
+}
+/*
+ * Record the offset of the latest frame of a given page in the WAL index.
+ */
+static int pager_wal_index_insert(Pager *pPager,pgno iNum,sxi64 iOfft)
+{
+	WalEntry *pEntry;
+	sxu32 iBucket;
+	pEntry = pager_wal_lookup(pPager,iNum);
+	if( pEntry ){
+		/* Newer frame */
+		pEntry->iOfft = iOfft;
+		return UNQLITE_OK;
+	}
+	if( pPager->apWal == 0 || pPager->nWalEntry >= pPager->nWalSize * 4 ){
+		/* Grow the hashtable */
+		sxu32 nNewSize = pPager->nWalSize > 0 ? pPager->nWalSize << 1 : 128;
+		WalEntry *pNext,**apNew;
+		sxu32 n;
+		apNew = (WalEntry **)SyMemBackendAlloc(pPager->pAllocator,nNewSize * sizeof(WalEntry *));
+		if( apNew ){
+			/* Zero the new table */
+			SyZero((void *)apNew,nNewSize * sizeof(WalEntry *));
+			/* Rehash all entries */
+			for( n = 0 ; n < pPager->nWalSize ; ++n ){
+				pEntry = pPager->apWal[n];
+				while( pEntry ){
+					pNext = pEntry->pNext;
+					iBucket = PAGE_HASH(pEntry->iNum) & (nNewSize - 1);
+					pEntry->pNext = apNew[iBucket];
+					apNew[iBucket] = pEntry;
+					pEntry = pNext;
+				}
+			}
+			/* Release the old table and reflect the change */
+			if( pPager->apWal ){
+				SyMemBackendFree(pPager->pAllocator,(void *)pPager->apWal);
+			}
+			pPager->apWal = apNew;
+			pPager->nWalSize = nNewSize;
+		}else if( pPager->apWal == 0 ){
+			return UNQLITE_NOMEM;
+		}
+	}
+	pEntry = (WalEntry *)SyMemBackendPoolAlloc(pPager->pAllocator,sizeof(WalEntry));
+	if( pEntry == 0 ){
+		return UNQLITE_NOMEM;
+	}
+	pEntry->iNum = iNum;
+	pEntry->iOfft = iOfft;
+	/* Install in the corresponding bucket */
+	iBucket = PAGE_HASH(iNum) & (pPager->nWalSize - 1);
+	pEntry->pNext = pPager->apWal[iBucket];
+	pPager->apWal[iBucket] = pEntry;
+	pPager->nWalEntry++;
+	return UNQLITE_OK;
+}
+/*
+ * Discard all entries of the WAL index.
+ */
+static void pager_wal_index_reset(Pager *pPager)
+{
+	WalEntry *pEntry,*pNext;
+	sxu32 n;
+	for( n = 0 ; n < pPager->nWalSize ; ++n ){
+		pEntry = pPager->apWal[n];
+		while( pEntry ){
+			pNext = pEntry->pNext;
+			SyMemBackendPoolFree(pPager->pAllocator,pEntry);
+			pEntry = pNext;
+		}
+		pPager->apWal[n] = 0;
+	}
+	pPager->nWalEntry = 0;
+}
 /*
  * Read the content of a page from disk.
  */
@@ -544,15 +870,74 @@ static int pager_get_page_contents(Pager *pPager,Page *pPage,int noContent)
 	int rc = UNQLITE_OK;
 	if( pPager->is_mem || noContent || pPage->pgno >= pPager->dbSize ){
 		/* Do not bother reading, zero the page contents only */
+		if( pPage->flags & PAGE_MMAP ){
+			return pager_page_private_copy(pPager,pPage,0);
+		}
 		SyZero(pPage->zData,pPager->iPageSize);
 		return UNQLITE_OK;
 	}
-	if( (pPager->iOpenFlags & UNQLITE_OPEN_MMAP) && (pPager->pMmap /* Paranoid edition */) ){
-		unsigned char *zMap = (unsigned char *)pPager->pMmap;
-		pPage->zData = &zMap[pPage->pgno * pPager->iPageSize];
+	if( pPager->nWalEntry > 0 ){
+		WalEntry *pEntry = pager_wal_lookup(pPager,pPage->pgno);
+		if( pEntry ){
+			/* The latest image of this page is in the write-ahead log */
+			if( pPage->flags & PAGE_MMAP ){
+				/* Not in the memory view, read into a private copy */
+				rc = pager_page_private_copy(pPager,pPage,0);
+				if( rc != UNQLITE_OK ){
+					return rc;
+				}
+			}
+			rc = unqliteOsRead(pPager->pwfd,pPage->zData,pPager->iPageSize,pEntry->iOfft + WAL_FRAME_HDR_SZ);
+			return rc;
+		}
+	}
+	if( pPage->flags & PAGE_MMAP ){
+		/* Content is already in the memory view */
 	}else{
 		/* Read content */
 		rc = unqliteOsRead(pPager->pfd,pPage->zData,pPager->iPageSize,pPage->pgno * pPager->iPageSize);
+		if( rc == UNQLITE_OK && pPager->zCodecPage && pPage->pgno > 0 ){
+			/* Decompress */
+			rc = unqliteCodecDecode(pPager->pCodec,pPage->zData,pPager->iPageSize,pPager->zCodecPage);
+			if( rc != UNQLITE_OK ){
+				unqliteGenErrorFormat(pPager->pDb,"Malformed compressed image of page %qu",pPage->pgno);
+			}
+		}
+	}
+	return rc;
+}
+/*
+ * Write a page image to its slot in the database file. When a page codec is
+ * installed, the image is compressed and the unused tail of the slot is handed
+ * back to the file system. The database header (page zero) is always stored raw.
+ */
+static int pager_write_image(Pager *pPager,pgno iNum,const unsigned char *zData)
+{
+	sxi64 iOfft = (sxi64)iNum * pPager->iPageSize;
+	sxi64 nSize;
+	int nByte = 0;
+	int rc;
+	if( pPager->zCodecPage && iNum > 0 ){
+		nByte = unqliteCodecEncode(pPager->pCodec,zData,pPager->iPageSize,pPager->zCodecPage);
+	}
+	if( nByte < 1 ){
+		/* Raw image */
+		return unqliteOsWrite(pPager->pfd,zData,pPager->iPageSize,iOfft);
+	}
+	rc = unqliteOsWrite(pPager->pfd,pPager->zCodecPage,nByte,iOfft);
+	if( rc != UNQLITE_OK || nByte >= pPager->iPageSize ){
+		/* Escaped raw image */
+		return rc;
+	}
+	/* The file must cover the whole slot so that the page can be read back
+	 * before the transaction grow the file (i.e. spilled then evicted).
+	 */
+	rc = unqliteOsFileSize(pPager->pfd,&nSize);
+	if( rc == UNQLITE_OK && nSize < iOfft + pPager->iPageSize ){
+		rc = unqliteOsTruncate(pPager->pfd,iOfft + pPager->iPageSize);
+	}
+	if( rc == UNQLITE_OK ){
+		rc = unqliteOsDiscard(pPager->pfd,pPager->iPageSize - nByte,iOfft + nByte);
 	}
 	return rc;
 }
@@ -965,7 +1350,7 @@ static int pager_play_back_one_page(Pager *pPager,sxi64 *pOfft,unsigned char *zT
 		return UNQLITE_OK;
 	}
 	/* playback */
-	rc = unqliteOsWrite(pPager->pfd,zData,pPager->iPageSize,iNum * pPager->iPageSize);
+	rc = pager_write_image(pPager,iNum,zData);
 	if( rc == UNQLITE_OK ){
 		/* Flush the cache */
 		pager_fill_page(pPager,iNum,zData);
@@ -1269,73 +1654,546 @@ fail:
 	return rc;
 }
 /*
- * Write the unqlite header (First page). (Big-Endian)
+** Write-ahead log (WAL) journal mode. (UNQLITE_OPEN_WAL)
+**
+** In WAL mode the rollback journal is not used. Instead, committed pages
+** are appended to a log file next to the database and the database file
+** itself is only updated when the log is checkpointed. A checkpoint copies
+** the latest image of each logged page back to the database file. A commit
+** thus write each dirty page once and sync a single file.
+**
+** The log starts with a 16 bytes header:
+**
+**    - 8 bytes: Magic number.
+**    - 4 bytes: Page size.
+**    - 4 bytes: Salt (Changed each time the log is reset).
+**
+** The header is followed by zero or more frames:
+**
+**    - 8 bytes: Page number.
+**    - 8 bytes: Database size in pages for the last frame of a transaction,
+**               zero otherwise.
+**    - 8 bytes: Checksum of the first 16 bytes of the frame header and the
+**               page content, seeded with the salt.
+**    - Page content.
+**
+** Frames following the last valid commit frame are ignored.
+** The WAL index (an in-memory hashtable) maps each logged page to its
+** latest frame so that the log is consulted before the database file.
+**
+** Each handle builds its own index from the log since the VFS does not
+** offer shared memory. Readers hold a SHARED lock only, the writer takes
+** the RESERVED lock to append frames and never needs an EXCLUSIVE lock to
+** commit, so readers in other processes keep running during writes. They
+** index the frames committed meanwhile when they start their next read
+** (See unqlitePagerRefresh()). The log is only reset by a checkpoint which
+** runs under an EXCLUSIVE lock, that is when no other handle is reading,
+** so an indexed frame is never overwritten under a reader.
+*/
+static void pager_wal_cksum(const unsigned char *zIn,sxu32 nByte,sxu32 *aCksum)
+{
+	sxu32 s1 = aCksum[0],s2 = aCksum[1];
+	sxu32 w1,w2;
+	sxu32 n;
+	for( n = 0 ; n + 8 <= nByte ; n += 8 ){
+		SyBigEndianUnpack32(&zIn[n],&w1);
+		SyBigEndianUnpack32(&zIn[n+4],&w2);
+		s1 += w1 + s2;
+		s2 += w2 + s1;
+	}
+	aCksum[0] = s1;
+	aCksum[1] = s2;
+}
+/*
+ * Compute the checksum of the frame held in the given buffer.
  */
-static int pager_write_db_header(Pager *pPager)
+static void pager_wal_frame_cksum(Pager *pPager,const unsigned char *zFrame,sxu32 *aCksum)
 {
-	unsigned char *zRaw = pPager->pHeader->zData;
-	unqlite_kv_engine *pEngine = pPager->pEngine;
-	sxu32 nDos;
-	sxu16 nLen;
-	/* Database signature */
-	SyMemcpy(UNQLITE_DB_SIG,zRaw,sizeof(UNQLITE_DB_SIG)-1);
-	zRaw += sizeof(UNQLITE_DB_SIG)-1;
-	/* Database magic number */
-	SyBigEndianPack32(zRaw,UNQLITE_DB_MAGIC);
-	zRaw += 4; /* 4 byte magic number */
-	/* Database creation time */
-	SyZero(&pPager->tmCreate,sizeof(Sytm));
-	if( pPager->pVfs->xCurrentTime ){
-		pPager->pVfs->xCurrentTime(pPager->pVfs,&pPager->tmCreate);
+	aCksum[0] = pPager->iWalSalt;
+	aCksum[1] = 0;
+	pager_wal_cksum(zFrame,16,aCksum);
+	pager_wal_cksum(&zFrame[WAL_FRAME_HDR_SZ],(sxu32)pPager->iPageSize,aCksum);
+}
+/*
+ * Start a new log generation. A fresh header with a new salt is written
+ * so that frames left over from the previous generation are never replayed.
+ */
+static int pager_wal_reset(Pager *pPager)
+{
+	unsigned char zHdr[WAL_HDR_SZ];
+	int rc;
+	SyRandomness(&pPager->sPrng,(void *)&pPager->iWalSalt,sizeof(sxu32));
+	SyMemcpy(aWalMagic,zHdr,sizeof(aWalMagic));
+	SyBigEndianPack32(&zHdr[8],(sxu32)pPager->iPageSize);
+	SyBigEndianPack32(&zHdr[12],pPager->iWalSalt);
+	rc = unqliteOsWrite(pPager->pwfd,zHdr,WAL_HDR_SZ,0);
+	if( rc != UNQLITE_OK ){
+		return rc;
 	}
-	/* DOS time format (4 bytes) */
-	SyTimeFormatToDos(&pPager->tmCreate,&nDos);
-	SyBigEndianPack32(zRaw,nDos);
-	zRaw += 4; /* 4 byte DOS time */
-	/* Sector size */
-	SyBigEndianPack32(zRaw,(sxu32)pPager->iSectorSize);
-	zRaw += 4; /* 4 byte sector size */
-	/* Page size */
-	SyBigEndianPack32(zRaw,(sxu32)pPager->iPageSize);
-	zRaw += 4; /* 4 byte page size */
-	/* Key value storage engine */
-	nLen = (sxu16)SyStrlen(pEngine->pIo->pMethods->zName);
-	SyBigEndianPack16(zRaw,nLen); /* 2 byte storage engine name */
-	zRaw += 2;
-	SyMemcpy((const void *)pEngine->pIo->pMethods->zName,(void *)zRaw,nLen);
-	zRaw += nLen;
-	/* All rest are meta-data available to the host application */
-	return UNQLITE_OK;
+	rc = unqliteOsTruncate(pPager->pwfd,WAL_HDR_SZ);
+	pPager->iWalOfft = pPager->iWalCommit = pPager->iWalSize = WAL_HDR_SZ;
+	pager_wal_index_reset(pPager);
+	return rc;
 }
 /*
- * Read the unqlite header (first page). (Big-Endian)
+ * Index the transactions committed to the log since the last call and
+ * return the number of newly indexed frames in *pNew. Frames past the last
+ * valid commit frame (i.e. a transaction in progress in another process or
+ * a torn write) are left out.
  */
-static int pager_extract_header(Pager *pPager,const unsigned char *zRaw,sxu32 nByte)
+static int pager_wal_index_load(Pager *pPager,int *pNew)
 {
-	const unsigned char *zEnd = &zRaw[nByte];
-	sxu32 nDos,iMagic;
-	sxu16 nLen;
-	char *zKv;
-	/* Database signature */
-	if( SyMemcmp(UNQLITE_DB_SIG,zRaw,sizeof(UNQLITE_DB_SIG)-1) != 0 ){
-		/* Corrupt database */
-		return UNQLITE_CORRUPT;
+	unsigned char zHdr[WAL_HDR_SZ];
+	sxu32 iPageSize,aCksum[2],s1,s2;
+	sxi64 iOfft,iCommit,nSize = 0;
+	pgno iNum,nCommit,dbSize = 0;
+	int rc;
+	*pNew = 0;
+	rc = unqliteOsFileSize(pPager->pwfd,&nSize);
+	if( rc != UNQLITE_OK || nSize == pPager->iWalSize ){
+		/* Nothing was appended since the last call */
+		return rc;
 	}
-	zRaw += sizeof(UNQLITE_DB_SIG)-1;
-	/* Database magic number */
-	SyBigEndianUnpack32(zRaw,&iMagic);
-	zRaw += 4; /* 4 byte magic number */
-	if( iMagic != UNQLITE_DB_MAGIC ){
-		/* Corrupt database */
-		return UNQLITE_CORRUPT;
+	if( pPager->iWalCommit < WAL_HDR_SZ ){
+		/* Read the log header first */
+		pPager->iWalSize = nSize;
+		if( nSize < WAL_HDR_SZ ){
+			/* Empty log */
+			return UNQLITE_OK;
+		}
+		rc = unqliteOsRead(pPager->pwfd,zHdr,WAL_HDR_SZ,0);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		SyBigEndianUnpack32(&zHdr[8],&iPageSize);
+		if( SyMemcmp(aWalMagic,zHdr,sizeof(aWalMagic)) != 0 || iPageSize < UNQLITE_MIN_PAGE_SIZE
+			|| iPageSize > UNQLITE_MAX_PAGE_SIZE || ((iPageSize-1)&iPageSize) != 0 
+			|| (pPager->zWalFrame && (int)iPageSize != pPager->iPageSize) ){
+				/* Not a valid log, ignore */
+				return UNQLITE_OK;
+		}
+		if( pPager->zWalFrame == 0 ){
+			pPager->iPageSize = (int)iPageSize;
+			pPager->zWalFrame = (unsigned char *)SyMemBackendAlloc(pPager->pAllocator,(sxu32)WAL_FRAME_SZ(pPager));
+			if( pPager->zWalFrame == 0 ){
+				unqliteGenOutofMem(pPager->pDb);
+				return UNQLITE_NOMEM;
+			}
+		}
+		SyBigEndianUnpack32(&zHdr[12],&pPager->iWalSalt);
+		pPager->iWalOfft = pPager->iWalCommit = WAL_HDR_SZ;
 	}
-	/* Database creation time */
-	SyBigEndianUnpack32(zRaw,&nDos);
-	zRaw += 4; /* 4 byte DOS time format */
-	SyDosTimeFormat(nDos,&pPager->tmCreate);
-	/* Sector size */
-	SyBigEndianUnpack32(zRaw,(sxu32 *)&pPager->iSectorSize);
-	zRaw += 4; /* 4 byte sector size */
+	/* Locate the last valid commit frame */
+	iCommit = pPager->iWalCommit;
+	for( iOfft = iCommit ; iOfft + WAL_FRAME_SZ(pPager) <= nSize ; iOfft += WAL_FRAME_SZ(pPager) ){
+		rc = unqliteOsRead(pPager->pwfd,pPager->zWalFrame,WAL_FRAME_SZ(pPager),iOfft);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		SyBigEndianUnpack32(&pPager->zWalFrame[16],&s1);
+		SyBigEndianUnpack32(&pPager->zWalFrame[20],&s2);
+		pager_wal_frame_cksum(pPager,pPager->zWalFrame,aCksum);
+		if( aCksum[0] != s1 || aCksum[1] != s2 ){
+			/* Torn or stale frame */
+			break;
+		}
+		SyBigEndianUnpack64(&pPager->zWalFrame[8],&nCommit);
+		if( nCommit > 0 ){
+			iCommit = iOfft + WAL_FRAME_SZ(pPager);
+			/* Database size after this transaction */
+			dbSize = nCommit;
+		}
+	}
+	/* Index the committed frames */
+	for( iOfft = pPager->iWalCommit ; iOfft < iCommit ; iOfft += WAL_FRAME_SZ(pPager) ){
+		rc = ReadInt64(pPager->pwfd,&iNum,iOfft);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		rc = pager_wal_index_insert(pPager,iNum,iOfft);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		(*pNew)++;
+	}
+	if( dbSize > 0 ){
+		pPager->dbSize = dbSize;
+	}
+	pPager->iWalOfft = pPager->iWalCommit = iCommit;
+	pPager->iWalSize = nSize;
+	return UNQLITE_OK;
+}
+/*
+ * Open the write-ahead log (if not yet done) and allocate the frame buffer.
+ * A fresh log header is written if the log is empty. The RESERVED lock must
+ * be held by the caller so that the log is never initialized twice.
+ */
+static int pager_wal_open(Pager *pPager)
+{
+	int rc;
+	if( pPager->pwfd && pPager->iWalCommit >= WAL_HDR_SZ ){
+		/* Already opened */
+		return UNQLITE_OK;
+	}
+	if( pPager->zWalFrame == 0 ){
+		pPager->zWalFrame = (unsigned char *)SyMemBackendAlloc(pPager->pAllocator,(sxu32)WAL_FRAME_SZ(pPager));
+		if( pPager->zWalFrame == 0 ){
+			unqliteGenOutofMem(pPager->pDb);
+			return UNQLITE_NOMEM;
+		}
+	}
+	if( pPager->pwfd == 0 ){
+		rc = unqliteOsOpen(pPager->pVfs,pPager->pAllocator,pPager->zWal,&pPager->pwfd,UNQLITE_OPEN_CREATE|UNQLITE_OPEN_READWRITE);
+		if( rc != UNQLITE_OK ){
+			unqliteGenErrorFormat(pPager->pDb,"IO error while opening write-ahead log file: %s",pPager->zWal);
+			return rc;
+		}
+	}
+	/* Write the log header */
+	rc = pager_wal_reset(pPager);
+	return rc;
+}
+/*
+ * Append a page image to the write-ahead log. The frame is not part of
+ * a committed transaction until pager_wal_commit() is called.
+ */
+static int pager_wal_append(Pager *pPager,Page *pPage)
+{
+	unsigned char *zFrame;
+	sxu32 aCksum[2];
+	int rc;
+	rc = pager_wal_open(pPager);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	zFrame = pPager->zWalFrame;
+	SyBigEndianPack64(zFrame,pPage->pgno);
+	SyBigEndianPack64(&zFrame[8],0);
+	SyMemcpy((const void *)pPage->zData,(void *)&zFrame[WAL_FRAME_HDR_SZ],(sxu32)pPager->iPageSize);
+	pager_wal_frame_cksum(pPager,zFrame,aCksum);
+	SyBigEndianPack32(&zFrame[16],aCksum[0]);
+	SyBigEndianPack32(&zFrame[20],aCksum[1]);
+	rc = unqliteOsWrite(pPager->pwfd,zFrame,WAL_FRAME_SZ(pPager),pPager->iWalOfft);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	/* Readers will now fetch this page from the log */
+	rc = pager_wal_index_insert(pPager,pPage->pgno,pPager->iWalOfft);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	pPager->iWalOfft += WAL_FRAME_SZ(pPager);
+	return UNQLITE_OK;
+}
+/*
+ * Commit the frames appended since the last commit. The last frame is
+ * flagged as a commit frame (Still in the frame buffer) and the log is
+ * synced.
+ */
+static int pager_wal_commit(Pager *pPager)
+{
+	unsigned char *zFrame = pPager->zWalFrame;
+	sxu32 aCksum[2];
+	int rc;
+	if( pPager->pwfd == 0 || pPager->iWalOfft == pPager->iWalCommit ){
+		/* Nothing was logged */
+		return UNQLITE_OK;
+	}
+	/* Flag the last frame as the commit frame */
+	SyBigEndianPack64(&zFrame[8],pPager->dbSize);
+	pager_wal_frame_cksum(pPager,zFrame,aCksum);
+	SyBigEndianPack32(&zFrame[16],aCksum[0]);
+	SyBigEndianPack32(&zFrame[20],aCksum[1]);
+	rc = unqliteOsWrite(pPager->pwfd,zFrame,WAL_FRAME_HDR_SZ,pPager->iWalOfft - WAL_FRAME_SZ(pPager));
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	/* Make the transaction durable */
+	rc = unqliteOsSync(pPager->pwfd,UNQLITE_SYNC_NORMAL);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	pPager->iWalCommit = pPager->iWalSize = pPager->iWalOfft;
+	return UNQLITE_OK;
+}
+/*
+ * Copy the latest image of each logged page back to the database file
+ * and reset the log. Only committed frames must be present in the log
+ * and the EXCLUSIVE lock must be held when this function is called.
+ */
+static int pager_wal_checkpoint(Pager *pPager)
+{
+	unsigned char *zData;
+	WalEntry *pEntry;
+	sxu32 n;
+	int rc;
+	if( pPager->pwfd == 0 || pPager->iWalCommit <= WAL_HDR_SZ ){
+		/* Empty log */
+		return UNQLITE_OK;
+	}
+	zData = &pPager->zWalFrame[WAL_FRAME_HDR_SZ];
+	for( n = 0 ; n < pPager->nWalSize ; ++n ){
+		for( pEntry = pPager->apWal[n] ; pEntry ; pEntry = pEntry->pNext ){
+			rc = unqliteOsRead(pPager->pwfd,zData,pPager->iPageSize,pEntry->iOfft + WAL_FRAME_HDR_SZ);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+			rc = pager_write_image(pPager,pEntry->iNum,zData);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+		}
+	}
+	if( pPager->dbSize > 0 ){
+		/* Drop the pages truncated by the logged transactions (See unqlite_vacuum()) or
+		 * complete the last slot when it was written compressed.
+		 */
+		sxi64 nSize = 0;
+		if( unqliteOsFileSize(pPager->pfd,&nSize) == UNQLITE_OK && nSize != (sxi64)(pPager->dbSize * pPager->iPageSize) ){
+			rc = unqliteOsTruncate(pPager->pfd,pPager->dbSize * pPager->iPageSize);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+		}
+	}
+	/* The database file must be durable before the log is reset */
+	rc = unqliteOsSync(pPager->pfd,UNQLITE_SYNC_FULL);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	rc = pager_wal_reset(pPager);
+	return rc;
+}
+/*
+ * Discard the frames of an aborted transaction and rebuild the WAL index
+ * from the committed frames.
+ */
+static int pager_wal_rollback(Pager *pPager)
+{
+	sxi64 iOfft;
+	pgno iNum;
+	int rc;
+	if( pPager->pwfd == 0 || pPager->iWalOfft == pPager->iWalCommit ){
+		/* Nothing to discard */
+		return UNQLITE_OK;
+	}
+	rc = unqliteOsTruncate(pPager->pwfd,pPager->iWalCommit);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	pPager->iWalOfft = pPager->iWalSize = pPager->iWalCommit;
+	pager_wal_index_reset(pPager);
+	for( iOfft = WAL_HDR_SZ ; iOfft < pPager->iWalCommit ; iOfft += WAL_FRAME_SZ(pPager) ){
+		rc = ReadInt64(pPager->pwfd,&iNum,iOfft);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		rc = pager_wal_index_insert(pPager,iNum,iOfft);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Attach a write-ahead log found next to the database. This is done regardless
+ * of the journal mode of this pager and must be called with the shared lock
+ * held, before the database header is read.
+ * When no other handle is using the database, the committed frames (i.e. left
+ * behind by a handle that was not closed properly) are copied back to the
+ * database file and the log is deleted. Otherwise the log is live: it is
+ * indexed and the pager switch to WAL mode so that it reads the latest
+ * committed pages and writes to the log as the other handles do.
+ */
+static int pager_wal_recover(Pager *pPager)
+{
+	int exists = 0;
+	int nNew = 0;
+	int rc;
+	rc = unqliteOsAccess(pPager->pVfs,pPager->zWal,UNQLITE_ACCESS_EXISTS,&exists);
+	if( rc != UNQLITE_OK || !exists ){
+		/* No log to recover */
+		return UNQLITE_OK;
+	}
+	rc = unqliteOsOpen(pPager->pVfs,pPager->pAllocator,pPager->zWal,&pPager->pwfd,
+		pPager->is_rdonly ? UNQLITE_OPEN_READONLY : UNQLITE_OPEN_READWRITE);
+	if( rc != UNQLITE_OK ){
+		unqliteGenErrorFormat(pPager->pDb,"IO error while opening write-ahead log file: '%s'",pPager->zWal);
+		return rc;
+	}
+	/* Index the committed frames */
+	rc = pager_wal_index_load(pPager,&nNew);
+	if( rc != UNQLITE_OK ){
+		goto fail;
+	}
+	if( !pPager->is_rdonly && pager_lock_db(pPager,EXCLUSIVE_LOCK) == UNQLITE_OK ){
+		/* No other handle is reading, copy the log back to the database file */
+		if( pPager->iWalCommit > WAL_HDR_SZ ){
+			rc = pager_wal_checkpoint(pPager);
+		}
+		goto fail;
+	}
+	/* Switch back to shared lock (Drop any pending lock taken above) */
+	pager_unlock_db(pPager,SHARED_LOCK);
+	if( pPager->iWalCommit <= WAL_HDR_SZ && pPager->is_rdonly ){
+		/* Nothing to read from the log */
+		goto fail;
+	}
+	/* Live log, operate in WAL mode from now on */
+	pPager->is_wal = 1;
+	pPager->no_jrnl = 1;
+	pPager->iOpenFlags &= ~UNQLITE_OPEN_MMAP;
+	return UNQLITE_OK;
+fail:
+	pager_wal_index_reset(pPager);
+	if( pPager->zWalFrame ){
+		SyMemBackendFree(pPager->pAllocator,pPager->zWalFrame);
+		pPager->zWalFrame = 0;
+	}
+	unqliteOsCloseFree(pPager->pAllocator,pPager->pwfd);
+	pPager->pwfd = 0;
+	pPager->iWalOfft = pPager->iWalCommit = pPager->iWalSize = 0;
+	if( rc == UNQLITE_OK && pPager->iLock == EXCLUSIVE_LOCK ){
+		/* Delete the log */
+		unqliteOsDelete(pPager->pVfs,pPager->zWal,TRUE);
+	}
+	/* Switch back to shared lock */
+	pager_unlock_db(pPager,SHARED_LOCK);
+	return rc;
+}
+/*
+ * Obtain a read-only memory view of the whole database file (UNQLITE_OPEN_MMAP)
+ * or replace the current one after the file was resized.
+ * Clean pages points straight into the view, only pages that are made
+ * writeable get a private copy (See page_write()). This rely on the view
+ * reflecting writes made through the file descriptor, which is the case
+ * on systems with a unified buffer cache (Linux, *BSD, Mac OS X, Windows).
+ */
+static int pager_map_db(Pager *pPager)
+{
+	const jx9_vfs *pVfs = jx9ExportBuiltinVfs();
+	void *pOld = pPager->pMmap;
+	sxi64 nOld = pPager->nMapSize;
+	void *pMap = 0;
+	sxi64 nSize = 0;
+	Page *pPage;
+	pgno nPage;
+	int rc;
+	if( pVfs == 0 || pVfs->xMmap == 0 || pVfs->xMmap(pPager->zFilename,&pMap,&nSize) != JX9_OK ){
+		/* Generate a warning */
+		unqliteGenError(pPager->pDb,"Cannot obtain a read-only memory view of the target database");
+		if( pOld == 0 ){
+			pPager->iOpenFlags &= ~UNQLITE_OPEN_MMAP;
+		}
+		/* Not a fatal error, keep using the old view if any */
+		return UNQLITE_OK;
+	}
+	nPage = (pgno)(nSize / pPager->iPageSize);
+	for( pPage = pPager->pAll ; pPage ; pPage = pPage->pNext ){
+		if( (pPage->flags & PAGE_MMAP) && pPage->pgno >= nPage ){
+			/* Page past the end of the truncated file */
+			rc = pager_page_private_copy(pPager,pPage,0);
+			if( rc != UNQLITE_OK ){
+				pVfs->xUnmap(pMap,nSize);
+				return rc;
+			}
+		}
+	}
+	/* Point the cached pages to the new view */
+	for( pPage = pPager->pAll ; pPage ; pPage = pPage->pNext ){
+		if( pPage->flags & PAGE_MMAP ){
+			pPage->zData = &((unsigned char *)pMap)[pPage->pgno * pPager->iPageSize];
+		}
+	}
+	pPager->pMmap = pMap;
+	pPager->nMapSize = nSize;
+	pPager->nMapPage = nPage;
+	if( pOld ){
+		pVfs->xUnmap(pOld,nOld);
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Write the unqlite header (First page). (Big-Endian)
+ */
+static int pager_write_db_header(Pager *pPager)
+{
+	unsigned char *zRaw = pPager->pHeader->zData;
+	unqlite_kv_engine *pEngine = pPager->pEngine;
+	sxu32 nDos;
+	sxu16 nLen;
+	/* Database signature */
+	SyMemcpy(UNQLITE_DB_SIG,zRaw,sizeof(UNQLITE_DB_SIG)-1);
+	zRaw += sizeof(UNQLITE_DB_SIG)-1;
+	/* Database magic number */
+	SyBigEndianPack32(zRaw,UNQLITE_DB_MAGIC);
+	zRaw += 4; /* 4 byte magic number */
+	/* Database creation time */
+	SyZero(&pPager->tmCreate,sizeof(Sytm));
+	if( pPager->pVfs->xCurrentTime ){
+		pPager->pVfs->xCurrentTime(pPager->pVfs,&pPager->tmCreate);
+	}
+	/* DOS time format (4 bytes) */
+	SyTimeFormatToDos(&pPager->tmCreate,&nDos);
+	SyBigEndianPack32(zRaw,nDos);
+	zRaw += 4; /* 4 byte DOS time */
+	/* Sector size */
+	SyBigEndianPack32(zRaw,(sxu32)pPager->iSectorSize);
+	zRaw += 4; /* 4 byte sector size */
+	/* Page size */
+	SyBigEndianPack32(zRaw,(sxu32)pPager->iPageSize);
+	zRaw += 4; /* 4 byte page size */
+	/* Key value storage engine */
+	nLen = (sxu16)SyStrlen(pEngine->pIo->pMethods->zName);
+	SyBigEndianPack16(zRaw,nLen); /* 2 byte storage engine name */
+	zRaw += 2;
+	SyMemcpy((const void *)pEngine->pIo->pMethods->zName,(void *)zRaw,nLen);
+	zRaw += nLen;
+	/* File change counter (4 bytes) */
+	pPager->iChangeOfft = (sxu32)(zRaw - pPager->pHeader->zData);
+	SyBigEndianPack32(zRaw,pPager->iChangeCount);
+	zRaw += 4;
+	/* Page compression codec (2 byte length, zero when disabled) */
+	nLen = pPager->pCodec ? (sxu16)SyStrlen(pPager->pCodec->zName) : 0;
+	SyBigEndianPack16(zRaw,nLen);
+	zRaw += 2;
+	if( nLen > 0 ){
+		SyMemcpy((const void *)pPager->pCodec->zName,(void *)zRaw,nLen);
+		zRaw += nLen;
+	}
+	/* All rest are meta-data available to the host application */
+	return UNQLITE_OK;
+}
+/*
+ * Read the unqlite header (first page). (Big-Endian)
+ */
+static int pager_extract_header(Pager *pPager,const unsigned char *zRaw,sxu32 nByte)
+{
+	const unsigned char *zStart = zRaw;
+	const unsigned char *zEnd = &zRaw[nByte];
+	sxu32 nDos,iMagic;
+	sxu16 nLen;
+	char *zKv;
+	/* Database signature */
+	if( SyMemcmp(UNQLITE_DB_SIG,zRaw,sizeof(UNQLITE_DB_SIG)-1) != 0 ){
+		/* Corrupt database */
+		return UNQLITE_CORRUPT;
+	}
+	zRaw += sizeof(UNQLITE_DB_SIG)-1;
+	/* Database magic number */
+	SyBigEndianUnpack32(zRaw,&iMagic);
+	zRaw += 4; /* 4 byte magic number */
+	if( iMagic != UNQLITE_DB_MAGIC ){
+		/* Corrupt database */
+		return UNQLITE_CORRUPT;
+	}
+	/* Database creation time */
+	SyBigEndianUnpack32(zRaw,&nDos);
+	zRaw += 4; /* 4 byte DOS time format */
+	SyDosTimeFormat(nDos,&pPager->tmCreate);
+	/* Sector size */
+	SyBigEndianUnpack32(zRaw,(sxu32 *)&pPager->iSectorSize);
+	zRaw += 4; /* 4 byte sector size */
 	/* Page size */
 	SyBigEndianUnpack32(zRaw,(sxu32 *)&pPager->iPageSize);
 	zRaw += 4; /* 4 byte page size */
@@ -1361,6 +2219,61 @@ static int pager_extract_header(Pager *pPager,const unsigned char *zRaw,sxu32 nB
 		return UNQLITE_NOMEM;
 	}
 	SyStringInitFromBuf(&pPager->sKv,zKv,nLen);
+	zRaw += nLen;
+	/* File change counter (Zero for databases created by older releases) */
+	pPager->iChangeOfft = (sxu32)(zRaw - zStart);
+	pPager->iChangeCount = 0;
+	if( zEnd - zRaw >= 4 ){
+		SyBigEndianUnpack32(zRaw,&pPager->iChangeCount);
+		zRaw += 4;
+	}
+	/* Page compression codec (Absent for databases created by older releases) */
+	pPager->pCodec = 0;
+	if( zEnd - zRaw >= 2 ){
+		SyBigEndianUnpack16(zRaw,&nLen);
+		zRaw += 2;
+		if( nLen > 0 ){
+			if( nLen > (sxu16)(zEnd - zRaw) ){
+				return UNQLITE_CORRUPT;
+			}
+			pPager->pCodec = unqliteFindPageCodec((const char *)zRaw,nLen);
+			if( pPager->pCodec == 0 ){
+				/* Codec not installed */
+				return UNQLITE_NOTIMPLEMENTED;
+			}
+		}
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Release the underlying KV engine instance and initialize it again with
+ * the current page size.
+ */
+static int pager_kv_engine_init(Pager *pPager)
+{
+	unqlite_kv_engine *pEngine = pPager->pEngine;
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	Page *pPtr;
+	int rc;
+	/* Drop the page state derived by the engine instance being released */
+	for( pPtr = pPager->pAll ; pPtr ; pPtr = pPtr->pNext ){
+		pPtr->pUserData = 0;
+	}
+	if( pIo->pMethods->xRelease ){
+		/* Call the release callback */
+		pIo->pMethods->xRelease(pEngine);
+	}
+	/* Zero the structure */
+	SyZero(pEngine,(sxu32)pIo->pMethods->szKv);
+	/* Fill in */
+	pEngine->pIo = pIo;
+	if( pIo->pMethods->xInit ){
+		/* Call the init method */
+		rc = pIo->pMethods->xInit(pEngine,pPager->iPageSize - pPager->nReserve);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
 	return UNQLITE_OK;
 }
 /*
@@ -1369,6 +2282,8 @@ static int pager_extract_header(Pager *pPager,const unsigned char *zRaw,sxu32 nB
 static int pager_read_db_header(Pager *pPager)
 {
 	unsigned char zRaw[UNQLITE_MIN_PAGE_SIZE]; /* Minimum page size */
+	WalEntry *pEntry = 0;     /* Header page in the write-ahead log */
+	pgno nWalPage = 0;        /* Database size recorded in the log */
 	sxi64 n = 0;              /* Size of db file in bytes */
 	int rc;
 	/* Get the file size first */
@@ -1377,17 +2292,26 @@ static int pager_read_db_header(Pager *pPager)
 		return rc;
 	}
 	pPager->dbByteSize = n;
-	if( n > 0 ){
+	if( pPager->is_wal && pPager->iWalCommit > WAL_HDR_SZ ){
+		/* Live log, the latest committed header may not be checkpointed yet */
+		pEntry = pager_wal_lookup(pPager,0);
+		nWalPage = pPager->dbSize;
+	}
+	if( n > 0 || pEntry ){
 		unqlite_kv_methods *pMethods;
 		SyString *pKv;
 		pgno nPage;
-		if( n < UNQLITE_MIN_PAGE_SIZE ){
+		if( pEntry ){
+			/* Read the database header from the log */
+			rc = unqliteOsRead(pPager->pwfd,zRaw,sizeof(zRaw),pEntry->iOfft + WAL_FRAME_HDR_SZ);
+		}else if( n < UNQLITE_MIN_PAGE_SIZE ){
 			/* A valid unqlite database must be at least 512 bytes long */
 			unqliteGenError(pPager->pDb,"Malformed database image");
 			return UNQLITE_CORRUPT;
+		}else{
+			/* Read the database header */
+			rc = unqliteOsRead(pPager->pfd,zRaw,sizeof(zRaw),0);
 		}
-		/* Read the database header */
-		rc = unqliteOsRead(pPager->pfd,zRaw,sizeof(zRaw),0);
 		if( rc != UNQLITE_OK ){
 			unqliteGenError(pPager->pDb,"IO error while reading database header");
 			return rc;
@@ -1395,7 +2319,8 @@ static int pager_read_db_header(Pager *pPager)
 		/* Extract the header */
 		rc = pager_extract_header(pPager,zRaw,sizeof(zRaw));
 		if( rc != UNQLITE_OK ){
-			unqliteGenError(pPager->pDb,rc == UNQLITE_NOMEM ? "Unqlite is running out of memory" : "Malformed database image");
+			unqliteGenError(pPager->pDb,rc == UNQLITE_NOMEM ? "Unqlite is running out of memory" :
+				(rc == UNQLITE_NOTIMPLEMENTED ? "The page codec of this database is not installed" : "Malformed database image"));
 			return rc;
 		}
 		/* Update pager state  */
@@ -1403,6 +2328,10 @@ static int pager_read_db_header(Pager *pPager)
 		if( nPage==0 && n>0 ){
 			nPage = 1;
 		}
+		if( nWalPage > 0 ){
+			/* Size after the last transaction committed to the log */
+			nPage = nWalPage;
+		}
 		pPager->dbSize = nPage;
 		/* Laod the target Key/Value storage engine */
 		pKv = &pPager->sKv;
@@ -1430,6 +2359,23 @@ static int pager_read_db_header(Pager *pPager)
 		return UNQLITE_NOMEM;
 	}
 	SyZero(pPager->zTmpPage,(sxu32)pPager->iPageSize);
+	if( pPager->pCodec && pPager->zCodecPage == 0 ){
+		/* Compressed page buffer */
+		pPager->zCodecPage = (unsigned char *)SyMemBackendAlloc(pPager->pAllocator,(sxu32)pPager->iPageSize);
+		if( pPager->zCodecPage == 0 ){
+			unqliteGenOutofMem(pPager->pDb);
+			return UNQLITE_NOMEM;
+		}
+		/* The memory view would expose the compressed images */
+		pPager->iOpenFlags &= ~UNQLITE_OPEN_MMAP;
+		/* Hide the reserved tail of each page from the KV engine */
+		pPager->nReserve = UNQLITE_CODEC_RESERVE;
+		rc = pager_kv_engine_init(pPager);
+		if( rc != UNQLITE_OK ){
+			unqliteGenErrorFormat(pPager->pDb,"xInit() method of the underlying KV engine '%z' failed",&pPager->sKv);
+			return rc;
+		}
+	}
 	return UNQLITE_OK;
 }
 /*
@@ -1494,29 +2440,22 @@ static int pager_shared_lock(Pager *pPager)
 					return rc;
 				}
 			}
+			/* Recover or attach any write-ahead log left behind */
+			rc = pager_wal_recover(pPager);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
 			/* Read the database header */
 			rc = pager_read_db_header(pPager);
 			if( rc != UNQLITE_OK ){
 				return rc;
 			}
-			if(pPager->dbSize > 0 ){
-				if( pPager->iOpenFlags & UNQLITE_OPEN_MMAP ){
-					const jx9_vfs *pVfs = jx9ExportBuiltinVfs();
-					/* Obtain a read-only memory view of the whole file */
-					if( pVfs && pVfs->xMmap ){
-						int vr;
-						vr = pVfs->xMmap(pPager->zFilename,&pPager->pMmap,&pPager->dbByteSize);
-						if( vr != JX9_OK ){
-							/* Generate a warning */
-							unqliteGenError(pPager->pDb,"Cannot obtain a read-only memory view of the target database");
-							pPager->iOpenFlags &= ~UNQLITE_OPEN_MMAP;
-						}
-					}else{
-						/* Generate a warning */
-						unqliteGenError(pPager->pDb,"Cannot obtain a read-only memory view of the target database");
-						pPager->iOpenFlags &= ~UNQLITE_OPEN_MMAP;
-					}
-				}
+			if( pPager->dbSize > 0 && (pPager->iOpenFlags & UNQLITE_OPEN_MMAP) ){
+				/* Obtain a read-only memory view of the whole file */
+				rc = pager_map_db(pPager);
+				if( rc != UNQLITE_OK ){
+					return rc;
+				}
 			}
 			/* Update the pager state */
 			pPager->iState = PAGER_READER;
@@ -1540,11 +2479,158 @@ static int pager_shared_lock(Pager *pPager)
 	}
 	return rc;
 }
+/*
+ * Release the in-memory state of the underlying KV engine and reload it
+ * from the database header (i.e. after a rollback or after the other
+ * handles have committed new transactions).
+ */
+static int pager_kv_engine_reset(Pager *pPager)
+{
+	unqlite_kv_engine *pEngine = pPager->pEngine;
+	const unqlite_kv_io *pIo = pEngine->pIo;
+	int rc;
+	rc = pager_kv_engine_init(pPager);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	if( pIo->pMethods->xOpen ){
+		/* Call the xOpen method */
+		rc = pIo->pMethods->xOpen(pEngine,pPager->dbSize);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Invalidate the page cache after the database file have been changed
+ * by another process. Unused pages are discarded while pages that are still
+ * referenced have their content reloaded from disk. In both cases, the KV
+ * engine is notified via its xPageReload() callback so that it can drop
+ * any state it derived from the old page content.
+ */
+static int pager_cache_reload(Pager *pPager)
+{
+	Page *pNext,*pPtr = pPager->pAll;
+	int rc;
+	while( pPtr ){
+		pNext = pPtr->pNext;
+		if( pPtr->nRef < 1 ){
+			if( pPager->xPageReload && pPtr->pUserData ){
+				pPager->xPageReload(pPtr->pUserData);
+			}
+			pPtr->pUserData = 0;
+			pager_unlink_page(pPager,pPtr);
+			pager_release_page(pPager,pPtr);
+		}else{
+			/* Page in use, refresh its content */
+			rc = pager_get_page_contents(pPager,pPtr,0);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+		}
+		pPtr = pNext;
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Index the transactions committed to the log by other handles since the
+ * last call and invalidate the page cache if any. The log is opened first
+ * if it was created after this pager attached to the database, in which
+ * case a pager in rollback journal mode switch to WAL mode.
+ */
+static int pager_wal_refresh(Pager *pPager)
+{
+	Snapshot *pSnap;
+	int exists = 0;
+	int nNew = 0;
+	int rc;
+	if( pPager->pwfd == 0 ){
+		rc = unqliteOsAccess(pPager->pVfs,pPager->zWal,UNQLITE_ACCESS_EXISTS,&exists);
+		if( rc != UNQLITE_OK || !exists ){
+			return rc;
+		}
+		rc = unqliteOsOpen(pPager->pVfs,pPager->pAllocator,pPager->zWal,&pPager->pwfd,
+			pPager->is_rdonly ? UNQLITE_OPEN_READONLY : UNQLITE_OPEN_READWRITE);
+		if( rc != UNQLITE_OK ){
+			unqliteGenErrorFormat(pPager->pDb,"IO error while opening write-ahead log file: '%s'",pPager->zWal);
+			return rc;
+		}
+	}
+	rc = pager_wal_index_load(pPager,&nNew);
+	if( rc != UNQLITE_OK || nNew < 1 ){
+		return rc;
+	}
+	if( !pPager->is_wal ){
+		/* Another handle is running in WAL mode, log the changes from now on */
+		pPager->is_wal = 1;
+		pPager->no_jrnl = 1;
+	}
+	/* Invalidate the cache and the snapshots */
+	for( pSnap = pPager->pSnap ; pSnap ; pSnap = pSnap->pNext ){
+		pSnap->bStale = 1;
+	}
+	rc = pager_cache_reload(pPager);
+	if( rc != UNQLITE_OK || pPager->iState < PAGER_READER ){
+		return rc;
+	}
+	/* The KV engine may have cached the old header (i.e. the bucket map) */
+	rc = pager_kv_engine_reset(pPager);
+	return rc;
+}
+/*
+ * Compare the file change counter stored in the database header against
+ * the value seen by this pager. A mismatch means that another process
+ * have written to the database and the page cache must be invalidated.
+ */
+static int pager_check_change_counter(Pager *pPager)
+{
+	Snapshot *pSnap;
+	sxu32 iChangeCount;
+	sxi64 n;
+	int rc;
+	if( pPager->is_mem ){
+		/* Nothing to check */
+		return UNQLITE_OK;
+	}
+	/* Pick up the transactions committed to the write-ahead log */
+	rc = pager_wal_refresh(pPager);
+	if( rc != UNQLITE_OK || pPager->is_wal || pPager->dbSize < 1 || pPager->iChangeOfft < 1 ){
+		/* The database file is only written by a checkpoint in WAL mode */
+		return rc;
+	}
+	rc = ReadInt32(pPager->pfd,&iChangeCount,pPager->iChangeOfft);
+	if( rc != UNQLITE_OK || iChangeCount == pPager->iChangeCount ){
+		/* Cache still valid */
+		return rc;
+	}
+	pPager->iChangeCount = iChangeCount;
+	/* Refresh the database size */
+	rc = unqliteOsFileSize(pPager->pfd,&n);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	pPager->dbByteSize = n;
+	pPager->dbSize = (pgno)(n / pPager->iPageSize);
+	if( pPager->pMmap && n != pPager->nMapSize ){
+		/* The file was resized, replace the memory view */
+		rc = pager_map_db(pPager);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	/* Invalidate the cache and the snapshots */
+	for( pSnap = pPager->pSnap ; pSnap ; pSnap = pSnap->pNext ){
+		pSnap->bStale = 1;
+	}
+	rc = pager_cache_reload(pPager);
+	return rc;
+}
 /*
 ** Begin a write-transaction on the specified pager object. If a 
 ** write-transaction has already been opened, this function is a no-op.
 */
-UNQLITE_PRIVATE int unqlitePagerBegin(Pager *pPager)
+static int pager_begin(Pager *pPager)
 {
 	int rc;
 	/* Obtain a shared lock on the database first */
@@ -1563,6 +2649,19 @@ UNQLITE_PRIVATE int unqlitePagerBegin(Pager *pPager)
 	/* Obtain a reserved lock on the database */
 	rc = pager_wait_on_lock(pPager,RESERVED_LOCK);
 	if( rc == UNQLITE_OK ){
+		/* Make sure the cached pages are still valid */
+		rc = pager_check_change_counter(pPager);
+		if( rc != UNQLITE_OK ){
+			goto fail;
+		}
+		if( pPager->is_wal && pPager->pwfd && pPager->iWalCommit >= WAL_HDR_SZ && pPager->iWalSize > pPager->iWalCommit ){
+			/* Drop the frames of a transaction that was never committed (i.e. crashed writer) */
+			rc = unqliteOsTruncate(pPager->pwfd,pPager->iWalCommit);
+			if( rc != UNQLITE_OK ){
+				goto fail;
+			}
+			pPager->iWalSize = pPager->iWalCommit;
+		}
 		/* Create the bitvec */
 		pPager->pVec = unqliteBitvecCreate(pPager->pAllocator,pPager->dbSize);
 		if( pPager->pVec == 0 ){
@@ -1592,6 +2691,19 @@ fail:
 	pager_unlock_db(pPager,SHARED_LOCK);
 	return rc;
 }
+/*
+ * Refer to [pager_begin()].
+ * The pager state is changed under the latch so that snapshot readers
+ * running concurrently never observe a half updated page cache.
+ */
+UNQLITE_PRIVATE int unqlitePagerBegin(Pager *pPager)
+{
+	int rc;
+	unqliteLatchEnter(pPager->pDb);
+	rc = pager_begin(pPager);
+	unqliteLatchLeave(pPager->pDb);
+	return rc;
+}
 /*
 ** This function is called at the start of every write transaction.
 ** There must already be a RESERVED or EXCLUSIVE lock on the database 
@@ -1655,6 +2767,10 @@ static int unqliteFinalizeJournal(Pager *pPager,int *pRetry,int close_jrnl)
 {
 	int rc;
 	*pRetry = 0;
+	if( pPager->is_wal ){
+		/* Appending to the write-ahead log does not require the exclusive lock */
+		return UNQLITE_OK;
+	}
 	/* Grab the exclusive lock first */
 	rc = pager_lock_db(pPager,EXCLUSIVE_LOCK);
 	if( rc != UNQLITE_OK ){
@@ -1706,25 +2822,35 @@ static int unqliteFinalizeJournal(Pager *pPager,int *pRetry,int close_jrnl)
 static int page_write(Pager *pPager,Page *pPage)
 {
 	int rc;
+	if( pPage->flags & PAGE_MMAP ){
+		/* The memory view is read-only, work on a private copy */
+		rc = pager_page_private_copy(pPager,pPage,pPage->zData);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
 	if( !pPager->is_mem && !pPager->no_jrnl ){
 		/* Write the page to the transaction journal */
 		if( pPage->pgno < pPager->dbOrigSize && !unqliteBitvecTest(pPager->pVec,pPage->pgno) ){
-			sxu32 cksum;
+			unsigned char zPgno[8],zCksum[4];
+			unqlite_iovec aVec[3];
 			if( pPager->nRec == SXU32_HIGH ){
 				/* Journal Limit reached */
 				unqliteGenError(pPager->pDb,"Journal record limit reached, commit your changes");
 				return UNQLITE_LIMIT;
 			}
-			/* Write the page number */
-			rc = WriteInt64(pPager->pjfd,pPage->pgno,pPager->iJournalOfft);
-			if( rc != UNQLITE_OK ){ return rc; }
-			/* Write the raw page */
+			/* Write the page number, the raw page and its checksum in a single shot */
+			SyBigEndianPack64(zPgno,pPage->pgno);
+			SyBigEndianPack32(zCksum,pager_cksum(pPager,pPage->zData));
+			aVec[0].pData = zPgno;        aVec[0].iAmt = sizeof(zPgno);
 			/** CODEC */
-			rc = unqliteOsWrite(pPager->pjfd,pPage->zData,pPager->iPageSize,pPager->iJournalOfft + 8);
-			if( rc != UNQLITE_OK ){ return rc; }
-			/* Compute the checksum */
-			cksum = pager_cksum(pPager,pPage->zData);
-			rc = WriteInt32(pPager->pjfd,cksum,pPager->iJournalOfft + 8 + pPager->iPageSize);
+			aVec[1].pData = pPage->zData; aVec[1].iAmt = pPager->iPageSize;
+			aVec[2].pData = zCksum;       aVec[2].iAmt = sizeof(zCksum);
+			rc = unqliteOsWritev(pPager->pjfd,aVec,3,pPager->iJournalOfft);
+			if( rc == UNQLITE_OK ){
+				/* Wait for the record, the buffers above are local */
+				rc = unqliteOsWritev(pPager->pjfd,0,0,0);
+			}
 			if( rc != UNQLITE_OK ){ return rc; }
 			/* Update the journal offset */
 			pPager->iJournalOfft += 8 /* page num */ + pPager->iPageSize + 4 /* cksum */;
@@ -1745,6 +2871,104 @@ static int page_write(Pager *pPager,Page *pPage)
 	}	
 	return UNQLITE_OK;
 }
+/*
+ * Write a single page to the database file or append it to the
+ * write-ahead log in WAL mode.
+ */
+static int pager_write_page(Pager *pPager,Page *pPage)
+{
+	int rc;
+	if( pPager->is_wal ){
+		rc = pager_wal_append(pPager,pPage);
+	}else{
+		rc = pager_write_image(pPager,pPage->pgno,pPage->zData);
+		if( rc == UNQLITE_OK ){
+			/* The memory view now reflect the page content */
+			pager_page_drop_private_copy(pPager,pPage);
+		}
+	}
+	return rc;
+}
+/*
+ * Maximum number of adjacent pages written with a single vectored write.
+ */
+#define PAGER_MAX_WRITEV 64
+/*
+ * Write a run of pages with adjacent page numbers. The run is handed to
+ * the vectored write method of the underlying file if any.
+ */
+static int pager_write_run(Pager *pPager,Page **apRun,int nRun)
+{
+	unqlite_iovec aVec[PAGER_MAX_WRITEV];
+	int i,rc;
+	if( nRun < 2 || pPager->is_wal || pPager->zCodecPage ){
+		/* Compressed pages are written one at a time */
+		for( i = 0 ; i < nRun ; i++ ){
+			rc = pager_write_page(pPager,apRun[i]);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+		}
+		return UNQLITE_OK;
+	}
+	for( i = 0 ; i < nRun ; i++ ){
+		aVec[i].pData = apRun[i]->zData;
+		aVec[i].iAmt = pPager->iPageSize;
+	}
+	/* The write may be queued by the underlying file, the buffers must stay
+	 * valid until the next write barrier (see pager_write_page_list()).
+	 */
+	rc = unqliteOsWritev(pPager->pfd,aVec,nRun,apRun[0]->pgno * pPager->iPageSize);
+	return rc;
+}
+/*
+ * Write a list of dirty pages sorted by page number and linked through
+ * pDirtyPrev (pPrevHot if bHot is set). Pages with adjacent page numbers
+ * are coalesced into a single write.
+ * Return the first page of the run that failed to be written or NULL
+ * on success.
+ */
+static Page * pager_write_page_list(Pager *pPager,Page *pList,int bHot,int *pRc)
+{
+	Page *apRun[PAGER_MAX_WRITEV];
+	Page *pPage;
+	int nRun = 0;
+	int rc;
+	for( pPage = pList ; pPage ; pPage = bHot ? pPage->pPrevHot : pPage->pDirtyPrev ){
+		if( pPage->flags & PAGE_DONT_WRITE ){
+			continue;
+		}
+		if( nRun > 0 && (nRun >= PAGER_MAX_WRITEV || pPage->pgno != apRun[nRun - 1]->pgno + 1) ){
+			rc = pager_write_run(pPager,apRun,nRun);
+			if( rc != UNQLITE_OK ){
+				/* Wait for the queued writes before the buffers are released */
+				unqliteOsWritev(pPager->pfd,0,0,0);
+				*pRc = rc;
+				return apRun[0];
+			}
+			nRun = 0;
+		}
+		apRun[nRun++] = pPage;
+	}
+	if( nRun > 0 ){
+		rc = pager_write_run(pPager,apRun,nRun);
+		if( rc != UNQLITE_OK ){
+			unqliteOsWritev(pPager->pfd,0,0,0);
+			*pRc = rc;
+			return apRun[0];
+		}
+	}
+	if( !pPager->is_wal ){
+		/* Write barrier: wait for the queued writes to complete */
+		rc = unqliteOsWritev(pPager->pfd,0,0,0);
+		if( rc != UNQLITE_OK ){
+			*pRc = rc;
+			return pList;
+		}
+	}
+	*pRc = UNQLITE_OK;
+	return 0;
+}
 /*
 ** The argument is the first in a linked list of dirty pages connected
 ** by the PgHdr.pDirty pointer. This function writes each one of the
@@ -1759,24 +2983,23 @@ static int page_write(Pager *pPager,Page *pPage)
 */
 static int pager_write_dirty_pages(Pager *pPager,Page *pDirty)
 {
-	int rc = UNQLITE_OK;
-	Page *pNext;
+	Page *pNext,*pFail;
+	int rc;
+	/* Write the pages first */
+	pFail = pager_write_page_list(pPager,pDirty,FALSE,&rc);
 	for(;;){
-		if( pDirty == 0 ){
+		if( pDirty == 0 || pDirty == pFail /* A rollback should be done */ ){
 			break;
 		}
 		/* Point to the next dirty page */
 		pNext = pDirty->pDirtyPrev; /* Not a bug: Reverse link */
 		if( (pDirty->flags & PAGE_DONT_WRITE) == 0 ){
-			rc = unqliteOsWrite(pPager->pfd,pDirty->zData,pPager->iPageSize,pDirty->pgno * pPager->iPageSize);
-			if( rc != UNQLITE_OK ){
-				/* A rollback should be done */
-				break;
-			}
+			/* The memory view now reflect the page content */
+			pager_page_drop_private_copy(pPager,pDirty);
 		}
 		/* Remove stale flags */
-		pDirty->flags &= ~(PAGE_DIRTY|PAGE_DONT_WRITE|PAGE_NEED_SYNC|PAGE_IN_JOURNAL|PAGE_HOT_DIRTY);
-		if( pDirty->nRef < 1 ){
+		pDirty->flags &= ~(PAGE_DIRTY|PAGE_DONT_WRITE|PAGE_NEED_SYNC|PAGE_IN_JOURNAL|PAGE_HOT_DIRTY|PAGE_DONT_MAKE_HOT);
+		if( pDirty->nRef < 1 && pPager->no_retain ){
 			/* Unlink the page now it is unused */
 			pager_unlink_page(pPager,pDirty);
 			/* Release the page */
@@ -1804,19 +3027,18 @@ static int pager_write_dirty_pages(Pager *pPager,Page *pDirty)
 */
 static int pager_write_hot_dirty_pages(Pager *pPager,Page *pDirty)
 {
-	int rc = UNQLITE_OK;
-	Page *pNext;
+	Page *pNext,*pFail;
+	int rc;
+	/* Write the pages first */
+	pFail = pager_write_page_list(pPager,pDirty,TRUE,&rc);
 	for(;;){
-		if( pDirty == 0 ){
+		if( pDirty == 0 || pDirty == pFail ){
 			break;
 		}
 		/* Point to the next page */
 		pNext = pDirty->pPrevHot; /* Not a bug: Reverse link */
 		if( (pDirty->flags & PAGE_DONT_WRITE) == 0 ){
-			rc = unqliteOsWrite(pPager->pfd,pDirty->zData,pPager->iPageSize,pDirty->pgno * pPager->iPageSize);
-			if( rc != UNQLITE_OK ){
-				break;
-			}
+			pager_page_drop_private_copy(pPager,pDirty);
 		}
 		/* Remove stale flags */
 		pDirty->flags &= ~(PAGE_DIRTY|PAGE_DONT_WRITE|PAGE_NEED_SYNC|PAGE_IN_JOURNAL|PAGE_HOT_DIRTY);
@@ -1831,15 +3053,19 @@ static int pager_write_hot_dirty_pages(Pager *pPager,Page *pDirty)
 		}else{
 			pPager->pFirstDirty = pDirty->pDirtyPrev;
 		}
-		/* Discard */
-		pager_unlink_page(pPager,pDirty);
-		/* Release the page */
-		pager_release_page(pPager,pDirty);
+		if( pPager->no_retain ){
+			/* Discard */
+			pager_unlink_page(pPager,pDirty);
+			/* Release the page */
+			pager_release_page(pPager,pDirty);
+		}
 		/* Next hot page */
 		pDirty = pNext;
 	}
 	return rc;
 }
+/* Forward declaration */
+static void pager_cache_shrink(Pager *pPager);
 /*
  * Commit a transaction: Phase one.
  */
@@ -1876,12 +3102,34 @@ static int pager_commit_phase1(Pager *pPager)
 			return rc;
 		}
 	}
-	if( pPager->iFlags & PAGER_CTRL_DIRTY_COMMIT ){
-		/* Synce the database first if a dirty commit have been applied */
-		unqliteOsSync(pPager->pfd,UNQLITE_SYNC_NORMAL);
+	if( pPager->is_wal ){
+		/* Append the dirty pages to the write-ahead log and commit them */
+		rc = pager_write_dirty_pages(pPager,pDirty);
+		if( rc == UNQLITE_OK ){
+			rc = pager_wal_commit(pPager);
+		}
+	}else{
+		if( pPager->iFlags & PAGER_CTRL_DIRTY_COMMIT ){
+			/* Synce the database first if a dirty commit have been applied */
+			unqliteOsSync(pPager->pfd,UNQLITE_SYNC_NORMAL);
+		}
+		/* Bump the file change counter so that other processes can tell that
+		 * their cached pages are stale.
+		 */
+		pPager->iChangeCount++;
+		if( pPager->iChangeOfft > 0 ){
+			Page *pHdr = pager_fetch_page(pPager,0);
+			if( pHdr && (pHdr->flags & PAGE_MMAP) == 0 ){
+				SyBigEndianPack32(&pHdr->zData[pPager->iChangeOfft],pPager->iChangeCount);
+			}
+		}
+		/* Write the dirty pages */
+		rc = pager_write_dirty_pages(pPager,pDirty);
+		if( rc == UNQLITE_OK && pPager->iChangeOfft > 0 ){
+			/* Write the file change counter */
+			rc = WriteInt32(pPager->pfd,pPager->iChangeCount,pPager->iChangeOfft);
+		}
 	}
-	/* Write the dirty pages */
-	rc = pager_write_dirty_pages(pPager,pDirty);
 	if( rc != UNQLITE_OK ){
 		/* Rollback your DB */
 		pPager->iFlags |= PAGER_CTRL_COMMIT_ERR;
@@ -1889,26 +3137,32 @@ static int pager_commit_phase1(Pager *pPager)
 		unqliteGenError(pPager->pDb,"IO error while writing dirty pages, rollback your database");
 		return rc;
 	}
-	/* release all pages */
-    {
-        Page *p;
-
-        while (1) {
-            p = pPager->pAll;
-            if (p == NULL) {
-                break;
-            }
-            pager_unlink_page(pPager, p);
-        }
-    }
-	/* If the file on disk is not the same size as the database image,
-     * then use unqliteOsTruncate to grow or shrink the file here.
-     */
-	if( pPager->dbSize != pPager->dbOrigSize ){
-		unqliteOsTruncate(pPager->pfd,pPager->iPageSize * pPager->dbSize);
-	}
-	/* Sync the database file */
-	unqliteOsSync(pPager->pfd,UNQLITE_SYNC_FULL);
+	if( pPager->no_retain ){
+		/* Release all unused pages. Pages that are still referenced (i.e. by an
+		 * open cursor) stay linked and are released by their last page_unref().
+		 */
+		Page *p,*pNext;
+		for( p = pPager->pAll ; p ; p = pNext ){
+			pNext = p->pNext;
+			if( p->nRef < 1 ){
+				pager_unlink_page(pPager,p);
+				pager_release_page(pPager,p);
+			}
+		}
+	}else if( pPager->nPage > pPager->nCacheMax ){
+		/* Clean pages are kept for the next transaction, trim the cache */
+		pager_cache_shrink(pPager);
+	}
+	if( !pPager->is_wal ){
+		/* If the file on disk is not the same size as the database image,
+		 * then use unqliteOsTruncate to grow or shrink the file here.
+		 */
+		if( pPager->dbSize != pPager->dbOrigSize ){
+			unqliteOsTruncate(pPager->pfd,pPager->iPageSize * pPager->dbSize);
+		}
+		/* Sync the database file */
+		unqliteOsSync(pPager->pfd,UNQLITE_SYNC_FULL);
+	}
 	/* Remove stale flags */
 	pPager->iJournalOfft = 0;
 	pPager->nRec = 0;
@@ -1928,6 +3182,14 @@ static int pager_commit_phase2(Pager *pPager)
 				/* Finally, unlink the journal file */
 				unqliteOsDelete(pPager->pVfs,pPager->zJournal,1);
 			}
+			if( pPager->is_wal && 
+				(pPager->iWalCommit - WAL_HDR_SZ) / WAL_FRAME_SZ(pPager) >= UNQLITE_WAL_AUTOCHECKPOINT &&
+				pager_lock_db(pPager,EXCLUSIVE_LOCK) == UNQLITE_OK ){
+				/* No other handle is reading, copy the log content back to the database file.
+				 * A failure here is not fatal since the log is consulted first and is left intact.
+				 */
+				pager_wal_checkpoint(pPager);
+			}
 			/* Downgrade to shraed lock */
 			pager_unlock_db(pPager,SHARED_LOCK);
 			pPager->iState = PAGER_READER;
@@ -1995,9 +3257,17 @@ static int pager_dirty_commit(Pager *pPager)
 **   * the database file synced.
 **   * the journal file is deleted.
 */
-UNQLITE_PRIVATE int unqlitePagerCommit(Pager *pPager)
+static int pager_commit(Pager *pPager)
 {
+	unqlite_kv_engine *pEngine = pPager->pEngine;
 	int rc;
+	if( pEngine && pEngine->pIo->pMethods->iVersion > 1 && pEngine->pIo->pMethods->xSync ){
+		/* Let the engine write out its buffered records */
+		rc = pEngine->pIo->pMethods->xSync(pEngine);
+		if( rc != UNQLITE_OK ){
+			goto fail;
+		}
+	}
 	/* Commit: Phase One */
 	rc = pager_commit_phase1(pPager);
 	if( rc != UNQLITE_OK ){
@@ -2009,7 +3279,14 @@ UNQLITE_PRIVATE int unqlitePagerCommit(Pager *pPager)
 		goto fail;
 	}
 	/* Remove stale flags */
-	pPager->iFlags &= ~PAGER_CTRL_COMMIT_ERR;
+	pPager->iFlags &= ~(PAGER_CTRL_COMMIT_ERR|PAGER_CTRL_DIRTY_COMMIT);
+	if( (pPager->iOpenFlags & UNQLITE_OPEN_MMAP) && 
+		(pPager->dbSize > pPager->nMapPage + (pPager->nMapPage >> 3) || (!pPager->is_wal && pPager->dbSize < pPager->nMapPage)) ){
+		/* The file grew or was truncated, remap. Growth under 1/8 of the view
+		 * is left to regular reads so that appends do not remap on each commit.
+		 */
+		pager_map_db(pPager);
+	}
 	/* All done */
 	return UNQLITE_OK;
 fail:
@@ -2017,15 +3294,24 @@ fail:
 	pPager->pDb->iFlags |= UNQLITE_FL_DISABLE_AUTO_COMMIT;
 	return rc;
 }
+/*
+ * Refer to [pager_commit()].
+ */
+UNQLITE_PRIVATE int unqlitePagerCommit(Pager *pPager)
+{
+	int rc;
+	unqliteLatchEnter(pPager->pDb);
+	rc = pager_commit(pPager);
+	unqliteLatchLeave(pPager->pDb);
+	return rc;
+}
 /*
  * Reset the pager to its initial state. This is caused by
  * a rollback operation.
  */
 static int pager_reset_state(Pager *pPager,int bResetKvEngine)
 {
-	unqlite_kv_engine *pEngine = pPager->pEngine;
 	Page *pNext,*pPtr = pPager->pAll;
-	const unqlite_kv_io *pIo;
 	int rc;
 	/* Remove stale flags */
 	pPager->iFlags &= ~(PAGER_CTRL_COMMIT_ERR|PAGER_CTRL_DIRTY_COMMIT);
@@ -2033,7 +3319,7 @@ static int pager_reset_state(Pager *pPager,int bResetKvEngine)
 	pPager->nRec = 0;
 	/* Database original size */
 	pPager->dbSize = pPager->dbOrigSize;
-	/* Discard all in-memory pages */
+	/* Discard all unused in-memory pages */
 	for(;;){
 		if( pPtr == 0 ){
 			break;
@@ -2041,20 +3327,27 @@ static int pager_reset_state(Pager *pPager,int bResetKvEngine)
 		pNext = pPtr->pNext; /* Reverse link */
 		/* Remove stale flags */
 		pPtr->flags &= ~(PAGE_DIRTY|PAGE_DONT_WRITE|PAGE_NEED_SYNC|PAGE_IN_JOURNAL|PAGE_HOT_DIRTY);
-		/* Release the page */
-		pager_release_page(pPager,pPtr);
+		if( pPtr->nRef < 1 ){
+			/* Release the page */
+			pager_unlink_page(pPager,pPtr);
+			pager_release_page(pPager,pPtr);
+		}else{
+			/* Page still referenced (i.e. by an open cursor), it stay linked
+			 * and its content is restored from disk. The KV engine state derived
+			 * from the old content is dropped.
+			 */
+			pPtr->pUserData = 0;
+			rc = pager_get_page_contents(pPager,pPtr,0);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+		}
 		/* Point to the next page */
 		pPtr = pNext;
 	}
-	pPager->pAll = 0;
-	pPager->nPage = 0;
 	pPager->pDirty = pPager->pFirstDirty = 0;
 	pPager->pHotDirty = pPager->pFirstHot = 0;
 	pPager->nHot = 0;
-	if( pPager->apHash ){
-		/* Zero the table */
-		SyZero((void *)pPager->apHash,sizeof(Page *) * pPager->nSize);
-	}
 	if( pPager->pVec ){
 		unqliteBitvecDestroy(pPager->pVec);
 		pPager->pVec = 0;
@@ -2064,28 +3357,9 @@ static int pager_reset_state(Pager *pPager,int bResetKvEngine)
 	pPager->iState = PAGER_READER;
 	if( bResetKvEngine ){
 		/* Reset the underlying KV engine */
-		pIo = pEngine->pIo;
-		if( pIo->pMethods->xRelease ){
-			/* Call the release callback */
-			pIo->pMethods->xRelease(pEngine);
-		}
-		/* Zero the structure */
-		SyZero(pEngine,(sxu32)pIo->pMethods->szKv);
-		/* Fill in */
-		pEngine->pIo = pIo;
-		if( pIo->pMethods->xInit ){
-			/* Call the init method */
-			rc = pIo->pMethods->xInit(pEngine,pPager->iPageSize);
-			if( rc != UNQLITE_OK ){
-				return rc;
-			}
-		}
-		if( pIo->pMethods->xOpen ){
-			/* Call the xOpen method */
-			rc = pIo->pMethods->xOpen(pEngine,pPager->dbSize);
-			if( rc != UNQLITE_OK ){
-				return rc;
-			}
+		rc = pager_kv_engine_reset(pPager);
+		if( rc != UNQLITE_OK ){
+			return rc;
 		}
 	}
 	/* All done */
@@ -2109,7 +3383,7 @@ static int pager_reset_state(Pager *pPager,int bResetKvEngine)
 ** rollback is successful.
 **
 */
-UNQLITE_PRIVATE int unqlitePagerRollback(Pager *pPager,int bResetKvEngine)
+static int pager_rollback(Pager *pPager,int bResetKvEngine)
 {
 	int rc = UNQLITE_OK;
 	if( pPager->iState < PAGER_WRITER_LOCKED ){
@@ -2144,6 +3418,15 @@ UNQLITE_PRIVATE int unqlitePagerRollback(Pager *pPager,int bResetKvEngine)
 				}
 			}
 		}
+		if( pPager->is_wal ){
+			/* Discard the frames written by dirty commits */
+			rc = pager_wal_rollback(pPager);
+			if( rc != UNQLITE_OK ){
+				pPager->pDb->iFlags |= UNQLITE_FL_DISABLE_AUTO_COMMIT;
+				unqliteGenError(pPager->pDb,"IO error while rolling back the write-ahead log");
+				return rc;
+			}
+		}
 		/* Unlink the journal file */
 		unqliteOsDelete(pPager->pVfs,pPager->zJournal,1);
 		/* Reset the pager state */
@@ -2161,6 +3444,17 @@ UNQLITE_PRIVATE int unqlitePagerRollback(Pager *pPager,int bResetKvEngine)
 	}
 	return UNQLITE_OK;
 }
+/*
+ * Refer to [pager_rollback()].
+ */
+UNQLITE_PRIVATE int unqlitePagerRollback(Pager *pPager,int bResetKvEngine)
+{
+	int rc;
+	unqliteLatchEnter(pPager->pDb);
+	rc = pager_rollback(pPager,bResetKvEngine);
+	unqliteLatchLeave(pPager->pDb);
+	return rc;
+}
 /*
  *  Mark a data page as non writeable.
  */
@@ -2173,44 +3467,316 @@ static int unqlitePagerDontWrite(unqlite_page *pMyPage)
 	return UNQLITE_OK;
 }
 /*
-** Mark a data page as writeable. This routine must be called before 
-** making changes to a page. The caller must check the return value 
-** of this function and be careful not to change any page data unless 
-** this routine returns UNQLITE_OK.
-*/
-static int unqlitePageWrite(unqlite_page *pMyPage)
+ * Snapshot page cache.
+ * Pages are either private copies taken out of the pager on first access
+ * (evicted when the snapshot hold more than the pager cache limit) or images
+ * saved before a change (bKeep) which live until the snapshot is released.
+ * The caller must hold the latch of the database handle.
+ */
+static SnapPage * snapshot_fetch_page(Snapshot *pSnap,pgno iNum)
 {
-	Page *pPage = (Page *)pMyPage;
-	Pager *pPager = pPage->pPager;
-	int rc;
-	/* Begin the write transaction */
-	rc = unqlitePagerBegin(pPager);
-	if( rc != UNQLITE_OK ){
-		return rc;
+	SnapPage *pEntry;
+	if( pSnap->nPage < 1 ){
+		return 0;
 	}
-	if( pPager->iState == PAGER_WRITER_LOCKED ){
-		/* The journal file needs to be opened. Higher level routines have already
-		 ** obtained the necessary locks to begin the write-transaction, but the
-		 ** rollback journal might not yet be open. Open it now if this is the case.
-		 */
-		rc = unqliteOpenJournal(pPager);
-		if( rc != UNQLITE_OK ){
-			return rc;
+	pEntry = pSnap->apHash[PAGE_HASH(iNum) & (pSnap->nSize - 1)];
+	while( pEntry ){
+		if( pEntry->pgno == iNum ){
+			return pEntry;
 		}
+		pEntry = pEntry->pNextCollide;
 	}
-	if( pPager->nHot > 127 ){
-		/* Write hot dirty pages */
-		rc = pager_dirty_commit(pPager);
-		if( rc != UNQLITE_OK ){
-			/* A rollback must be done */
-			unqliteGenError(pPager->pDb,"Please perform a rollback");
-			return rc;
+	return 0;
+}
+/*
+ * Move a snapshot page to the head of the list of all pages.
+ */
+static void snapshot_touch_page(Snapshot *pSnap,SnapPage *pPage)
+{
+	if( pSnap->pAll == pPage ){
+		return;
+	}
+	/* Unlink */
+	pPage->pPrev->pNext = pPage->pNext;
+	if( pPage->pNext ){
+		pPage->pNext->pPrev = pPage->pPrev;
+	}else{
+		pSnap->pTail = pPage->pPrev;
+	}
+	/* Push */
+	pPage->pPrev = 0;
+	pPage->pNext = pSnap->pAll;
+	pSnap->pAll->pPrev = pPage;
+	pSnap->pAll = pPage;
+}
+/*
+ * Install a page in the snapshot page table.
+ */
+static void snapshot_link_page(Snapshot *pSnap,SnapPage *pPage)
+{
+	sxu32 nBucket;
+	if( pSnap->nPage >= pSnap->nSize * 4 && pSnap->nPage < 100000 ){
+		/* Grow the hashtable */
+		sxu32 nNewSize = pSnap->nSize << 1;
+		SnapPage *pEntry,**apNew;
+		apNew = (SnapPage **)SyMemBackendAlloc(pSnap->pPager->pAllocator,nNewSize * sizeof(SnapPage *));
+		if( apNew ){
+			SyZero((void *)apNew,nNewSize * sizeof(SnapPage *));
+			/* Rehash all entries */
+			for( pEntry = pSnap->pAll ; pEntry ; pEntry = pEntry->pNext ){
+				nBucket = PAGE_HASH(pEntry->pgno) & (nNewSize - 1);
+				pEntry->pPrevCollide = 0;
+				pEntry->pNextCollide = apNew[nBucket];
+				if( apNew[nBucket] ){
+					apNew[nBucket]->pPrevCollide = pEntry;
+				}
+				apNew[nBucket] = pEntry;
+			}
+			SyMemBackendFree(pSnap->pPager->pAllocator,(void *)pSnap->apHash);
+			pSnap->apHash = apNew;
+			pSnap->nSize = nNewSize;
+		}
+	}
+	nBucket = PAGE_HASH(pPage->pgno) & (pSnap->nSize - 1);
+	pPage->pNextCollide = pSnap->apHash[nBucket];
+	if( pSnap->apHash[nBucket] ){
+		pSnap->apHash[nBucket]->pPrevCollide = pPage;
+	}
+	pSnap->apHash[nBucket] = pPage;
+	/* Link to the head of the list of all pages */
+	pPage->pNext = pSnap->pAll;
+	if( pSnap->pAll ){
+		pSnap->pAll->pPrev = pPage;
+	}else{
+		pSnap->pTail = pPage;
+	}
+	pSnap->pAll = pPage;
+	pSnap->nPage++;
+}
+/*
+ * Remove a page from the snapshot and release it.
+ */
+static void snapshot_release_page(Snapshot *pSnap,SnapPage *pPage)
+{
+	sxu32 nBucket = PAGE_HASH(pPage->pgno) & (pSnap->nSize - 1);
+	if( pPage->pPrevCollide ){
+		pPage->pPrevCollide->pNextCollide = pPage->pNextCollide;
+	}else{
+		pSnap->apHash[nBucket] = pPage->pNextCollide;
+	}
+	if( pPage->pNextCollide ){
+		pPage->pNextCollide->pPrevCollide = pPage->pPrevCollide;
+	}
+	if( pPage->pPrev ){
+		pPage->pPrev->pNext = pPage->pNext;
+	}else{
+		pSnap->pAll = pPage->pNext;
+	}
+	if( pPage->pNext ){
+		pPage->pNext->pPrev = pPage->pPrev;
+	}else{
+		pSnap->pTail = pPage->pPrev;
+	}
+	pSnap->nPage--;
+	if( pPage->bKeep ){
+		pSnap->nKeep--;
+	}
+	/* Invoke the unpin callback if available */
+	if( pSnap->xPageUnpin && pPage->pUserData ){
+		pSnap->xPageUnpin(pPage->pUserData);
+	}
+	SyMemBackendPoolFree(pSnap->pPager->pAllocator,pPage);
+}
+/*
+ * Allocate a snapshot page holding a copy of the given image.
+ */
+static SnapPage * snapshot_new_page(Snapshot *pSnap,pgno iNum,const unsigned char *zImage)
+{
+	Pager *pPager = pSnap->pPager;
+	SnapPage *pNew;
+	pNew = (SnapPage *)SyMemBackendPoolAlloc(pPager->pAllocator,sizeof(SnapPage)+pPager->iPageSize);
+	if( pNew == 0 ){
+		return 0;
+	}
+	SyZero(pNew,sizeof(SnapPage));
+	pNew->zData = (unsigned char *)&pNew[1];
+	pNew->pgno = iNum;
+	pNew->pSnap = pSnap;
+	pNew->nRef = 1;
+	if( zImage ){
+		SyMemcpy((const void *)zImage,pNew->zData,(sxu32)pPager->iPageSize);
+	}
+	snapshot_link_page(pSnap,pNew);
+	return pNew;
+}
+/*
+ * Evict the least recently used copies that are not in use once the
+ * snapshot hold more copies than the pager cache limit.
+ */
+static void snapshot_cache_shrink(Snapshot *pSnap)
+{
+	SnapPage *pPrev,*pPage = pSnap->pTail;
+	while( pPage && pSnap->nPage - pSnap->nKeep > pSnap->pPager->nCacheMax ){
+		pPrev = pPage->pPrev;
+		if( pPage->nRef < 1 && !pPage->bKeep ){
+			snapshot_release_page(pSnap,pPage);
+		}
+		pPage = pPrev;
+	}
+}
+/*
+ * Save the committed image of a page in each active snapshot that does not
+ * hold it yet. This must be done before the page is modified.
+ */
+static int pager_snapshot_save(Pager *pPager,Page *pPage)
+{
+	Snapshot *pSnap;
+	SnapPage *pCopy;
+	int rc = UNQLITE_OK;
+	if( pPage->iSnap == pPager->iSnapId ){
+		/* Already saved in every active snapshot */
+		return UNQLITE_OK;
+	}
+	unqliteLatchEnter(pPager->pDb);
+	for( pSnap = pPager->pSnap ; pSnap ; pSnap = pSnap->pNext ){
+		if( pPage->pgno < 1 || pPage->pgno >= pSnap->dbSize ){
+			/* Not part of the snapshot image */
+			continue;
+		}
+		pCopy = snapshot_fetch_page(pSnap,pPage->pgno);
+		if( pCopy == 0 ){
+			pCopy = snapshot_new_page(pSnap,pPage->pgno,pPage->zData);
+			if( pCopy == 0 ){
+				unqliteGenOutofMem(pPager->pDb);
+				rc = UNQLITE_NOMEM;
+				break;
+			}
+			/* Not in use */
+			pCopy->nRef = 0;
+		}
+		if( !pCopy->bKeep ){
+			pCopy->bKeep = 1;
+			pSnap->nKeep++;
+		}
+	}
+	if( rc == UNQLITE_OK ){
+		pPage->iSnap = pPager->iSnapId;
+	}
+	unqliteLatchLeave(pPager->pDb);
+	return rc;
+}
+/*
+** Mark a data page as writeable. This routine must be called before 
+** making changes to a page. The caller must check the return value 
+** of this function and be careful not to change any page data unless 
+** this routine returns UNQLITE_OK.
+*/
+static int unqlitePageWrite(unqlite_page *pMyPage)
+{
+	Page *pPage = (Page *)pMyPage;
+	Pager *pPager = pPage->pPager;
+	int rc;
+	/* Begin the write transaction */
+	rc = unqlitePagerBegin(pPager);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	if( pPager->iState == PAGER_WRITER_LOCKED ){
+		/* The journal file needs to be opened. Higher level routines have already
+		 ** obtained the necessary locks to begin the write-transaction, but the
+		 ** rollback journal might not yet be open. Open it now if this is the case.
+		 */
+		rc = unqliteOpenJournal(pPager);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	if( pPager->nHot > 127 ){
+		/* Write hot dirty pages */
+		rc = pager_dirty_commit(pPager);
+		if( rc != UNQLITE_OK ){
+			/* A rollback must be done */
+			unqliteGenError(pPager->pDb,"Please perform a rollback");
+			return rc;
+		}
+	}
+	if( pPager->pSnap ){
+		/* Save the committed image in the active snapshots first */
+		rc = pager_snapshot_save(pPager,pPage);
+		if( rc != UNQLITE_OK ){
+			return rc;
 		}
 	}
 	/* Write the page to the journal file */
 	rc = page_write(pPager,pPage);
 	return rc;
 }
+/*
+ * Return the least recently used page in the given 2Q list that
+ * is candidate for eviction. That is, a clean page with no users.
+ */
+static Page * pager_lru_victim(Pager *pPager,Page *pTail)
+{
+	Page *pPage = pTail;
+	while( pPage ){
+		if( pPage->nRef < 1 && !(pPage->flags & PAGE_DIRTY) && pPage != pPager->pHeader ){
+			return pPage;
+		}
+		pPage = pPage->pPrevLru;
+	}
+	return 0;
+}
+/*
+ * Make room in the page cache when the total number of loaded pages
+ * exceed the limit set via [unqlite_config(UNQLITE_CONFIG_MAX_PAGE_CACHE)].
+ * Clean pages are released first. If every candidate page is dirty and a
+ * write-transaction is active, the unused dirty pages are spilled to disk
+ * via a dirty commit and the operation is retried once.
+ */
+static void pager_cache_shrink(Pager *pPager)
+{
+	int nSpill = 0;
+	Page *pPage;
+	if( pPager->is_mem ){
+		/* In-memory database: Pages live only in the cache */
+		return;
+	}
+	while( pPager->nPage > pPager->nCacheMax ){
+		pPage = 0;
+		if( pPager->nA1 > (pPager->nCacheMax >> 2) ){
+			/* A1 list is over its share (25%) of the cache */
+			pPage = pager_lru_victim(pPager,pPager->pA1Tail);
+		}
+		if( pPage == 0 ){
+			pPage = pager_lru_victim(pPager,pPager->pAmTail);
+			if( pPage == 0 ){
+				pPage = pager_lru_victim(pPager,pPager->pA1Tail);
+			}
+		}
+		if( pPage == 0 ){
+			Page *pEntry;
+			if( nSpill++ > 0 || pPager->iState < PAGER_WRITER_CACHEMOD ){
+				/* Nothing to evict */
+				break;
+			}
+			/* Queue the unused dirty pages for a dirty commit */
+			for( pEntry = pPager->pAll ; pEntry ; pEntry = pEntry->pNext ){
+				if( pEntry->nRef < 1 && (pEntry->flags & PAGE_DIRTY) && 
+					!(pEntry->flags & PAGE_DONT_MAKE_HOT) && pEntry != pPager->pHeader ){
+						pager_link_hot_page(pPager,pEntry);
+				}
+			}
+			if( pPager->nHot < 1 || pager_dirty_commit(pPager) != UNQLITE_OK ){
+				break;
+			}
+			continue;
+		}
+		/* Evict this page */
+		pager_unlink_page(pPager,pPage);
+		pager_release_page(pPager,pPage);
+		pPager->nCacheEvict++;
+	}
+}
 /*
 ** Acquire a reference to page number pgno in pager pPager (a page
 ** reference has type unqlite_page*). If the requested reference is 
@@ -2244,62 +3810,536 @@ static int unqlitePagerAcquire(
 		return pPage ? UNQLITE_OK : UNQLITE_NOTFOUND;
 	}
 	if( pPage == 0 ){
-		/* Allocate a new page */
-		pPage = pager_alloc_page(pPager,pgno);
-		if( pPage == 0 ){
-			unqliteGenOutofMem(pPager->pDb);
-			return UNQLITE_NOMEM;
-		}
-		/* Read page contents */
-		rc = pager_get_page_contents(pPager,pPage,noContent);
-		if( rc != UNQLITE_OK ){
-			SyMemBackendPoolFree(pPager->pAllocator,pPage);
-			return rc;
-		}
-		/* Link the page */
-		pager_link_page(pPager,pPage);
-	}else{
-		if( ppPage ){
-			page_ref(pPage);
-		}
+		/* Allocate a new page */
+		if( pgno < pPager->nMapPage && pgno < pPager->dbSize && !noContent ){
+			/* Backed by the memory view */
+			pPage = pager_alloc_mapped_page(pPager,pgno);
+		}else{
+			pPage = pager_alloc_page(pPager,pgno);
+		}
+		if( pPage == 0 ){
+			unqliteGenOutofMem(pPager->pDb);
+			return UNQLITE_NOMEM;
+		}
+		/* Read page contents */
+		rc = pager_get_page_contents(pPager,pPage,noContent);
+		if( rc != UNQLITE_OK ){
+			SyMemBackendPoolFree(pPager->pAllocator,pPage);
+			return rc;
+		}
+		/* Link the page */
+		pager_link_page(pPager,pPage);
+		pPager->nCacheMiss++;
+		if( pPager->nPage > pPager->nCacheMax ){
+			/* Cache limit reached, release some pages */
+			pager_cache_shrink(pPager);
+		}
+	}else{
+		pPager->nCacheHit++;
+		if( pPage->flags & PAGE_READ_AHEAD ){
+			/* First real reference of a page loaded by read-ahead, treat it as freshly loaded */
+			pager_lru_unlink(pPager,pPage);
+			pPage->flags &= ~(PAGE_READ_AHEAD|PAGE_CACHE_AM);
+			pager_lru_link(pPager,pPage);
+		}else{
+			/* Promote to the frequently used list */
+			pager_lru_touch(pPager,pPage);
+		}
+		if( ppPage ){
+			page_ref(pPage);
+		}
+	}
+	/* All done, page is loaded in memeory */
+	if( ppPage ){
+		*ppPage = (unqlite_page *)pPage;
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Shrink the database image to nPage pages. The truncated pages are journaled
+ * first so that a rollback restore them, then dropped from the cache.
+ * The file itself is truncated when the transaction is committed.
+ */
+static int pager_truncate_image(Pager *pPager,pgno nPage)
+{
+	Page *pNext,*pPage;
+	unqlite_page *pRaw;
+	pgno iNum;
+	int rc;
+	if( nPage < 2 || nPage >= pPager->dbSize ){
+		/* Page 0 and the engine header are never truncated */
+		return UNQLITE_OK;
+	}
+	for( pPage = pPager->pAll ; pPage ; pPage = pPage->pNext ){
+		if( pPage->pgno >= nPage && pPage->nRef > 0 ){
+			unqliteGenError(pPager->pDb,"Cannot truncate the database while its last pages are in use");
+			return UNQLITE_LOCKED;
+		}
+	}
+	for( iNum = nPage ; pPager->pSnap && iNum < pPager->dbSize ; ++iNum ){
+		/* The active snapshots must keep the truncated pages */
+		rc = unqlitePagerAcquire(pPager,iNum,&pRaw,0,0);
+		if( rc == UNQLITE_OK ){
+			rc = pager_snapshot_save(pPager,(Page *)pRaw);
+			page_unref((Page *)pRaw);
+		}
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	for( iNum = nPage ; iNum < pPager->dbSize && iNum < pPager->dbOrigSize ; ++iNum ){
+		if( pPager->pVec && unqliteBitvecTest(pPager->pVec,iNum) ){
+			/* Already journaled */
+			continue;
+		}
+		rc = unqlitePagerAcquire(pPager,iNum,&pRaw,0,0);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		rc = unqlitePageWrite(pRaw);
+		page_unref((Page *)pRaw);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	/* Discard the truncated pages */
+	for( pPage = pPager->pAll ; pPage ; pPage = pNext ){
+		pNext = pPage->pNext;
+		if( pPage->pgno < nPage ){
+			continue;
+		}
+		if( pPage->flags & PAGE_DIRTY ){
+			if( pPage->pDirtyPrev ){
+				pPage->pDirtyPrev->pDirtyNext = pPage->pDirtyNext;
+			}else{
+				pPager->pDirty = pPage->pDirtyNext;
+			}
+			if( pPage->pDirtyNext ){
+				pPage->pDirtyNext->pDirtyPrev = pPage->pDirtyPrev;
+			}else{
+				pPager->pFirstDirty = pPage->pDirtyPrev;
+			}
+		}
+		if( pPage->flags & PAGE_HOT_DIRTY ){
+			if( pPage->pPrevHot ){
+				pPage->pPrevHot->pNextHot = pPage->pNextHot;
+			}else{
+				pPager->pHotDirty = pPage->pNextHot;
+			}
+			if( pPage->pNextHot ){
+				pPage->pNextHot->pPrevHot = pPage->pPrevHot;
+			}else{
+				pPager->pFirstHot = pPage->pPrevHot;
+			}
+			pPager->nHot--;
+		}
+		pPage->flags &= ~(PAGE_DIRTY|PAGE_HOT_DIRTY);
+		pager_unlink_page(pPager,pPage);
+		pager_release_page(pPager,pPage);
+	}
+	pPager->dbSize = nPage;
+	return UNQLITE_OK;
+}
+/*
+ * Default read-ahead window in pages.
+ */
+#define PAGER_READ_AHEAD 32
+/*
+ * Return the number of adjacent uncached pages starting at aPgno[0] that
+ * must be read from the database file. Zero is returned when the first
+ * page is new, mapped, cached or logged.
+ */
+static int pager_read_ahead_run(Pager *pPager,const pgno *aPgno,int nPage)
+{
+	pgno iFirst = aPgno[0];
+	int nRun;
+	if( iFirst >= pPager->dbSize || iFirst < pPager->nMapPage || 
+		pager_fetch_page(pPager,iFirst) || (pPager->nWalEntry > 0 && pager_wal_lookup(pPager,iFirst)) ){
+		/* Nothing to read */
+		return 0;
+	}
+	nRun = 1;
+	while( nRun < nPage && aPgno[nRun] == iFirst + nRun && iFirst + nRun < pPager->dbSize &&
+		pager_fetch_page(pPager,iFirst + nRun) == 0 && 
+		(pPager->nWalEntry < 1 || pager_wal_lookup(pPager,iFirst + nRun) == 0) ){
+		nRun++;
+	}
+	return nRun;
+}
+/*
+ * Load a batch of pages that are about to be requested (i.e. by a cursor scan)
+ * into the page cache. Pages with adjacent page numbers are read with a single
+ * read. Every run is first announced to the VFS via xPrefetch() so that the
+ * reads can proceed concurrently when the VFS supports asynchronous I/O.
+ * The loaded pages are left unreferenced so that they can be evicted as
+ * usual. Return the number of entries of aPgno[] that were processed.
+ */
+static int pager_read_ahead(Pager *pPager,const pgno *aPgno,int nPage)
+{
+	unsigned char *zBuf;
+	int nWindow,nRun;
+	int i,j,rc;
+	nWindow = pPager->nReadAhead;
+	if( (sxu32)nWindow > (pPager->nCacheMax >> 3) ){
+		/* Do not flush the cache */
+		nWindow = (int)(pPager->nCacheMax >> 3);
+	}
+	if( nWindow < 1 || pPager->is_mem || nPage < 1 ){
+		return 0;
+	}
+	if( nPage > nWindow ){
+		nPage = nWindow;
+	}
+	rc = pager_shared_lock(pPager);
+	if( rc != UNQLITE_OK ){
+		return 0;
+	}
+	/* Start the reads of every run first */
+	i = 0;
+	while( i < nPage ){
+		nRun = pager_read_ahead_run(pPager,&aPgno[i],nPage - i);
+		if( nRun < 1 ){
+			i++;
+			continue;
+		}
+		unqliteOsPrefetch(pPager->pfd,nRun * pPager->iPageSize,aPgno[i] * pPager->iPageSize);
+		i += nRun;
+	}
+	/* Then collect them */
+	zBuf = 0;
+	i = 0;
+	while( i < nPage ){
+		pgno iFirst = aPgno[i];
+		nRun = pager_read_ahead_run(pPager,&aPgno[i],nPage - i);
+		if( nRun < 1 ){
+			i++;
+			continue;
+		}
+		if( zBuf == 0 ){
+			zBuf = (unsigned char *)SyMemBackendAlloc(pPager->pAllocator,(sxu32)(nPage * pPager->iPageSize));
+			if( zBuf == 0 ){
+				break;
+			}
+		}
+		rc = unqliteOsRead(pPager->pfd,zBuf,nRun * pPager->iPageSize,iFirst * pPager->iPageSize);
+		if( rc != UNQLITE_OK ){
+			/* Read-ahead is only a hint */
+			break;
+		}
+		for( j = 0 ; j < nRun ; j++ ){
+			Page *pNew = pager_alloc_page(pPager,iFirst + j);
+			if( pNew == 0 ){
+				break;
+			}
+			SyMemcpy(&zBuf[j * pPager->iPageSize],pNew->zData,(sxu32)pPager->iPageSize);
+			if( pPager->zCodecPage && pNew->pgno > 0 &&
+				unqliteCodecDecode(pPager->pCodec,pNew->zData,pPager->iPageSize,pPager->zCodecPage) != UNQLITE_OK ){
+					/* Leave it to the regular read to report the corruption */
+					pager_release_page(pPager,pNew);
+					break;
+			}
+			pNew->nRef = 0;
+			pager_link_page(pPager,pNew);
+			/* Park in the Am list until referenced so that the A1 list
+			 * turnover does not evict it before the cursor reach it.
+			 */
+			pager_lru_touch(pPager,pNew);
+			pNew->flags |= PAGE_READ_AHEAD;
+		}
+		i += nRun;
+	}
+	if( zBuf ){
+		SyMemBackendFree(pPager->pAllocator,zBuf);
+	}
+	if( pPager->nPage > pPager->nCacheMax ){
+		pager_cache_shrink(pPager);
+	}
+	return nPage;
+}
+/*
+ * Return true if we are dealing with an in-memory database.
+ */
+static int unqliteInMemory(const char *zFilename)
+{
+	sxu32 n;
+	if( SX_EMPTY_STR(zFilename) ){
+		/* NULL or the empty string means an in-memory database */
+		return TRUE;
+	}
+	n = SyStrlen(zFilename);
+	if( n == sizeof(":mem:") - 1 && 
+		SyStrnicmp(zFilename,":mem:",sizeof(":mem:") - 1) == 0 ){
+			return TRUE;
+	}
+	if( n == sizeof(":memory:") - 1 && 
+		SyStrnicmp(zFilename,":memory:",sizeof(":memory:") - 1) == 0 ){
+			return TRUE;
+	}
+	return FALSE;
+}
+/*
+ * Acquire a page of a snapshot. Pages that are not held by the snapshot
+ * are copied out of the pager cache or read from the database file (or the
+ * write-ahead log) without being loaded in the pager cache.
+ */
+static int unqliteSnapAcquire(Snapshot *pSnap,pgno iNum,unqlite_page **ppPage,int fetchOnly)
+{
+	Pager *pPager = pSnap->pPager;
+	SnapPage *pPage;
+	Page *pLive,sPage;
+	int rc = UNQLITE_OK;
+	unqliteLatchEnter(pPager->pDb);
+	pPage = snapshot_fetch_page(pSnap,iNum);
+	if( pPage ){
+		snapshot_touch_page(pSnap,pPage);
+		if( ppPage && !fetchOnly ){
+			pPage->nRef++;
+		}
+	}else if( fetchOnly ){
+		rc = UNQLITE_NOTFOUND;
+	}else if( ppPage ){
+		if( pSnap->bStale && iNum < pSnap->dbSize ){
+			unqliteGenError(pPager->pDb,"Snapshot invalidated by a change from another process");
+			rc = UNQLITE_ABORT;
+			goto done;
+		}
+		pLive = iNum < pSnap->dbSize ? pager_fetch_page(pPager,iNum) : 0;
+		pPage = snapshot_new_page(pSnap,iNum,pLive ? pLive->zData : 0);
+		if( pPage == 0 ){
+			unqliteGenOutofMem(pPager->pDb);
+			rc = UNQLITE_NOMEM;
+			goto done;
+		}
+		if( pLive == 0 ){
+			if( iNum < pSnap->dbSize ){
+				/* Unchanged since the snapshot was taken, read the stored image */
+				SyZero(&sPage,sizeof(Page));
+				sPage.zData = pPage->zData;
+				sPage.pgno = iNum;
+				rc = pager_get_page_contents(pPager,&sPage,0);
+			}else{
+				SyZero(pPage->zData,(sxu32)pPager->iPageSize);
+			}
+			if( rc != UNQLITE_OK ){
+				snapshot_release_page(pSnap,pPage);
+				pPage = 0;
+				goto done;
+			}
+		}
+		snapshot_cache_shrink(pSnap);
+	}
+done:
+	unqliteLatchLeave(pPager->pDb);
+	if( ppPage ){
+		*ppPage = (unqlite_page *)pPage;
+	}
+	return rc;
+}
+/* 
+ * Refer to [unqliteSnapAcquire()]
+ */
+static int unqliteSnapIoPageGet(unqlite_kv_handle pHandle,pgno iNum,unqlite_page **ppPage)
+{
+	return unqliteSnapAcquire((Snapshot *)pHandle,iNum,ppPage,0);
+}
+/* 
+ * Refer to [unqliteSnapAcquire()]
+ */
+static int unqliteSnapIoPageLookup(unqlite_kv_handle pHandle,pgno iNum,unqlite_page **ppPage)
+{
+	return unqliteSnapAcquire((Snapshot *)pHandle,iNum,ppPage,1);
+}
+/*
+ * A snapshot is read-only.
+ */
+static int unqliteSnapIoNewPage(unqlite_kv_handle pHandle,unqlite_page **ppPage)
+{
+	SXUNUSED(pHandle);
+	SXUNUSED(ppPage);
+	return UNQLITE_READ_ONLY;
+}
+static int unqliteSnapIoPageWrite(unqlite_page *pPage)
+{
+	if( pPage == 0 ){
+		/* TICKET 1433-0348 */
+		return UNQLITE_OK;
+	}
+	return UNQLITE_READ_ONLY;
+}
+static int unqliteSnapIoPageNoop(unqlite_page *pPage)
+{
+	SXUNUSED(pPage);
+	return UNQLITE_OK;
+}
+static int unqliteSnapIoTruncate(unqlite_kv_handle pHandle,pgno nPage)
+{
+	SXUNUSED(pHandle);
+	SXUNUSED(nPage);
+	return UNQLITE_READ_ONLY;
+}
+static int unqliteSnapIoReadOnly(unqlite_kv_handle pHandle)
+{
+	SXUNUSED(pHandle);
+	return 1;
+}
+/* 
+ * Increment the reference count of a snapshot page.
+ */
+static int unqliteSnapIoPageRef(unqlite_page *pRaw)
+{
+	SnapPage *pPage = (SnapPage *)pRaw;
+	if( pPage ){
+		unqlite *pDb = pPage->pSnap->pPager->pDb;
+		unqliteLatchEnter(pDb);
+		pPage->nRef++;
+		unqliteLatchLeave(pDb);
+	}
+	return UNQLITE_OK;
+}
+/* 
+ * Release a snapshot page after its reference count reach zero.
+ * Saved images are kept, only their parsed content is dropped.
+ */
+static int unqliteSnapIoPageUnRef(unqlite_page *pRaw)
+{
+	SnapPage *pPage = (SnapPage *)pRaw;
+	Snapshot *pSnap;
+	int nRef;
+	if( pPage == 0 ){
+		return UNQLITE_OK;
 	}
-	/* All done, page is loaded in memeory */
-	if( ppPage ){
-		*ppPage = (unqlite_page *)pPage;
+	pSnap = pPage->pSnap;
+	unqliteLatchEnter(pSnap->pPager->pDb);
+	nRef = pPage->nRef--;
+	if( nRef == 0 ){
+		if( pPage->bKeep ){
+			if( pSnap->xPageUnpin && pPage->pUserData ){
+				pSnap->xPageUnpin(pPage->pUserData);
+			}
+			pPage->pUserData = 0;
+			pPage->nRef = 0;
+		}else{
+			snapshot_release_page(pSnap,pPage);
+		}
 	}
+	unqliteLatchLeave(pSnap->pPager->pDb);
 	return UNQLITE_OK;
 }
+static int unqliteSnapIoPageSize(unqlite_kv_handle pHandle)
+{
+	return ((Snapshot *)pHandle)->pPager->iPageSize - ((Snapshot *)pHandle)->pPager->nReserve;
+}
+static unsigned char * unqliteSnapIoTempPage(unqlite_kv_handle pHandle)
+{
+	return ((Snapshot *)pHandle)->zTmpPage;
+}
+static void unqliteSnapIoPageUnpin(unqlite_kv_handle pHandle,void (*xPageUnpin)(void *))
+{
+	((Snapshot *)pHandle)->xPageUnpin = xPageUnpin;
+}
+static void unqliteSnapIoPageReload(unqlite_kv_handle pHandle,void (*xPageReload)(void *))
+{
+	((Snapshot *)pHandle)->xPageReload = xPageReload;
+}
+static void unqliteSnapIoErr(unqlite_kv_handle pHandle,const char *zErr)
+{
+	unqliteGenError(((Snapshot *)pHandle)->pPager->pDb,zErr);
+}
+static pgno unqliteSnapIoPageCount(unqlite_kv_handle pHandle)
+{
+	return ((Snapshot *)pHandle)->dbSize;
+}
+static void unqliteSnapIoLatch(unqlite_kv_handle pHandle,int bEnter)
+{
+	unqlite *pDb = ((Snapshot *)pHandle)->pPager->pDb;
+	if( bEnter ){
+		unqliteLatchEnter(pDb);
+	}else{
+		unqliteLatchLeave(pDb);
+	}
+}
 /*
- * Return true if we are dealing with an in-memory database.
+ * Init the IO methods of the KV engine instance reading a snapshot.
+ * Read-ahead is not available, the snapshot does not use the pager cache.
  */
-static int unqliteInMemory(const char *zFilename)
+static void pager_snapshot_io_init(Snapshot *pSnap,unqlite_kv_methods *pMethods)
 {
-	sxu32 n;
-	if( SX_EMPTY_STR(zFilename) ){
-		/* NULL or the empty string means an in-memory database */
-		return TRUE;
+	unqlite_kv_io *pIo = &pSnap->sIo;
+	pIo->pHandle = pSnap;
+	pIo->pMethods = pMethods;
+
+	pIo->xGet    = unqliteSnapIoPageGet;
+	pIo->xLookup = unqliteSnapIoPageLookup;
+	pIo->xNew    = unqliteSnapIoNewPage;
+
+	pIo->xWrite     = unqliteSnapIoPageWrite;
+	pIo->xDontWrite = unqliteSnapIoPageNoop;
+	pIo->xDontJournal = unqliteSnapIoPageNoop;
+	pIo->xDontMkHot = unqliteSnapIoPageNoop;
+
+	pIo->xPageRef   = unqliteSnapIoPageRef;
+	pIo->xPageUnref = unqliteSnapIoPageUnRef;
+
+	pIo->xPageSize = unqliteSnapIoPageSize;
+	pIo->xReadOnly = unqliteSnapIoReadOnly;
+
+	pIo->xTmpPage = unqliteSnapIoTempPage;
+
+	pIo->xSetUnpin = unqliteSnapIoPageUnpin;
+	pIo->xSetReload = unqliteSnapIoPageReload;
+
+	pIo->xErr = unqliteSnapIoErr;
+	pIo->xPrefetch = 0;
+	pIo->xPageCount = unqliteSnapIoPageCount;
+	pIo->xTruncate = unqliteSnapIoTruncate;
+	pIo->xLatch = unqliteSnapIoLatch;
+}
+/*
+ * Release a snapshot, its KV engine instance and its pages.
+ */
+static void pager_snapshot_release(Snapshot *pSnap)
+{
+	Pager *pPager = pSnap->pPager;
+	SnapPage *pNext,*pPage;
+	unqliteLatchEnter(pPager->pDb);
+	if( pSnap->pPrev ){
+		pSnap->pPrev->pNext = pSnap->pNext;
+	}else if( pPager->pSnap == pSnap ){
+		pPager->pSnap = pSnap->pNext;
+	}
+	if( pSnap->pNext ){
+		pSnap->pNext->pPrev = pSnap->pPrev;
+	}
+	if( pSnap->pEngine ){
+		if( pSnap->sIo.pMethods->xRelease ){
+			pSnap->sIo.pMethods->xRelease(pSnap->pEngine);
+		}
+		SyMemBackendFree(pPager->pAllocator,(void *)pSnap->pEngine);
 	}
-	n = SyStrlen(zFilename);
-	if( n == sizeof(":mem:") - 1 && 
-		SyStrnicmp(zFilename,":mem:",sizeof(":mem:") - 1) == 0 ){
-			return TRUE;
+	/* The parsed content went with the engine, free the raw pages */
+	for( pPage = pSnap->pAll ; pPage ; pPage = pNext ){
+		pNext = pPage->pNext;
+		SyMemBackendPoolFree(pPager->pAllocator,pPage);
 	}
-	if( n == sizeof(":memory:") - 1 && 
-		SyStrnicmp(zFilename,":memory:",sizeof(":memory:") - 1) == 0 ){
-			return TRUE;
+	if( pSnap->apHash ){
+		SyMemBackendFree(pPager->pAllocator,(void *)pSnap->apHash);
 	}
-	return FALSE;
+	if( pSnap->zTmpPage ){
+		SyMemBackendFree(pPager->pAllocator,(void *)pSnap->zTmpPage);
+	}
+	SyMemBackendFree(pPager->pAllocator,(void *)pSnap);
+	unqliteLatchLeave(pPager->pDb);
 }
 /*
- * Allocate a new KV cursor.
+ * Allocate a new cursor on the given KV engine instance.
  */
-UNQLITE_PRIVATE int unqliteInitCursor(unqlite *pDb,unqlite_kv_cursor **ppOut)
+static int pager_init_cursor(unqlite *pDb,unqlite_kv_engine *pStore,unqlite_kv_cursor **ppOut)
 {
 	unqlite_kv_methods *pMethods;
 	unqlite_kv_cursor *pCur;
 	sxu32 nByte;
 	/* Storage engine methods */
-	pMethods = pDb->sDB.pPager->pEngine->pIo->pMethods;
+	pMethods = pStore->pIo->pMethods;
 	if( pMethods->szCursor < 1 ){
 		/* Implementation does not supprt cursors */
 		unqliteGenErrorFormat(pDb,"Storage engine '%s' does not support cursors",pMethods->zName);
@@ -2317,7 +4357,7 @@ UNQLITE_PRIVATE int unqliteInitCursor(unqlite *pDb,unqlite_kv_cursor **ppOut)
 	/* Zero the structure */
 	SyZero(pCur,nByte);
 	/* Save the cursor */
-	pCur->pStore = pDb->sDB.pPager->pEngine;
+	pCur->pStore = pStore;
 	/* Invoke the initialization callback if any */
 	if( pMethods->xCursorInit ){
 		pMethods->xCursorInit(pCur);
@@ -2326,20 +4366,32 @@ UNQLITE_PRIVATE int unqliteInitCursor(unqlite *pDb,unqlite_kv_cursor **ppOut)
 	*ppOut = pCur;
 	return UNQLITE_OK;
 }
+/*
+ * Allocate a new KV cursor.
+ */
+UNQLITE_PRIVATE int unqliteInitCursor(unqlite *pDb,unqlite_kv_cursor **ppOut)
+{
+	return pager_init_cursor(pDb,pDb->sDB.pPager->pEngine,ppOut);
+}
 /*
  * Release a cursor.
  */
 UNQLITE_PRIVATE int unqliteReleaseCursor(unqlite *pDb,unqlite_kv_cursor *pCur)
 {
+	unqlite_kv_engine *pStore = pCur->pStore;
 	unqlite_kv_methods *pMethods;
 	/* Storage engine methods */
-	pMethods = pDb->sDB.pPager->pEngine->pIo->pMethods;
+	pMethods = pStore->pIo->pMethods;
 	/* Invoke the release callback if available */
 	if( pMethods->xCursorRelease ){
 		pMethods->xCursorRelease(pCur);
 	}
 	/* Finally, free the whole instance */
 	SyMemBackendPoolFree(&pDb->sMem,pCur);
+	if( pStore->pIo->xGet == unqliteSnapIoPageGet ){
+		/* Snapshot cursor, release the snapshot as well */
+		pager_snapshot_release((Snapshot *)pStore->pIo->pHandle);
+	}
 	return UNQLITE_OK;
 }
 /*
@@ -2355,6 +4407,10 @@ static void pager_release_kv_engine(Pager *pPager)
 		unqliteReleaseCursor(pPager->pDb,pStorage->pCursor);
 		pStorage->pCursor = 0;
 	}
+	/* Release the idle cursors of the concurrent readers */
+	while( SySetUsed(&pStorage->aReader) > 0 ){
+		unqliteReleaseCursor(pPager->pDb,*(unqlite_kv_cursor **)SySetPop(&pStorage->aReader));
+	}
 	if( pEngine->pIo->pMethods->xRelease ){
 		pEngine->pIo->pMethods->xRelease(pEngine);
 	}
@@ -2426,12 +4482,235 @@ fail:
 	SyMemBackendFree(&pDb->sMem,pIo);
 	return rc;
 }
+#if defined(UNQLITE_ENABLE_THREADS)
+/*
+ * Return TRUE if the storage engine can be read by concurrent readers, each with
+ * its own cursor. The database must be opened for reading first.
+ */
+UNQLITE_PRIVATE int unqlitePagerSharedRead(Pager *pPager)
+{
+	unqlite_kv_methods *pMethods;
+	if( pPager->iState < PAGER_READER || pPager->pEngine == 0 ){
+		return FALSE;
+	}
+	pMethods = pPager->pEngine->pIo->pMethods;
+	return pMethods->iVersion >= 7 && pMethods->bSharedRead;
+}
+#endif
+/*
+ * Return TRUE if transactions were committed to the write-ahead log by other
+ * handles since the last refresh (See below). Cheap enough to be called
+ * before each read.
+ */
+UNQLITE_PRIVATE int unqlitePagerLogChanged(Pager *pPager)
+{
+	sxi64 nSize = 0;
+	if( !pPager->is_wal || pPager->iState != PAGER_READER ){
+		/* Not in WAL mode or the handle is writing */
+		return FALSE;
+	}
+	if( pPager->pwfd == 0 ){
+		int exists = 0;
+		unqliteOsAccess(pPager->pVfs,pPager->zWal,UNQLITE_ACCESS_EXISTS,&exists);
+		return exists;
+	}
+	if( unqliteOsFileSize(pPager->pwfd,&nSize) != UNQLITE_OK ){
+		return FALSE;
+	}
+	return nSize != pPager->iWalSize;
+}
+/*
+ * Make the transactions committed to the write-ahead log by other handles
+ * visible to this one. Rollback journal mode handles do not need this since
+ * the database file cannot change while they hold their shared lock.
+ */
+UNQLITE_PRIVATE int unqlitePagerRefresh(Pager *pPager)
+{
+	int rc;
+	if( !pPager->is_wal || pPager->iState != PAGER_READER ){
+		return UNQLITE_OK;
+	}
+	unqliteLatchEnter(pPager->pDb);
+	rc = pager_wal_refresh(pPager);
+	unqliteLatchLeave(pPager->pDb);
+	return rc;
+}
 /*
  * Return the underlying KV storage engine instance.
  */
 UNQLITE_PRIVATE unqlite_kv_engine * unqlitePagerGetKvEngine(unqlite *pDb)
 {
-	return pDb->sDB.pPager->pEngine;
+	Pager *pPager = pDb->sDB.pPager;
+	if( pPager->iState == PAGER_OPEN && !pPager->is_mem ){
+		/* Install the engine recorded in the database header now rather than
+		 * on first page access, which would release the returned instance.
+		 */
+		pager_shared_lock(pPager);
+	}
+	return pPager->pEngine;
+}
+/*
+ * Save in a new snapshot the committed image of the pages changed by the
+ * pending transaction. That is, the original images recorded in the journal
+ * or, when journaling is omitted and nothing was written yet, the images
+ * still in the database file (or the write-ahead log).
+ */
+static int pager_snapshot_load_pending(Pager *pPager,Snapshot *pSnap)
+{
+	sxi64 iOfft = JOURNAL_HDR_SZ(pPager);
+	unsigned char zPgno[8];
+	SnapPage *pPage;
+	Page *pDirty,sPage;
+	sxu64 iNum;
+	int rc;
+	if( pPager->pjfd == 0 ){
+		for( pDirty = pPager->pDirty ; pDirty ; pDirty = pDirty->pDirtyNext ){
+			if( pDirty->pgno < 1 || pDirty->pgno >= pSnap->dbSize ){
+				continue;
+			}
+			pPage = snapshot_new_page(pSnap,pDirty->pgno,0);
+			if( pPage == 0 ){
+				unqliteGenOutofMem(pPager->pDb);
+				return UNQLITE_NOMEM;
+			}
+			pPage->nRef = 0;
+			pPage->bKeep = 1;
+			pSnap->nKeep++;
+			SyZero(&sPage,sizeof(Page));
+			sPage.zData = pPage->zData;
+			sPage.pgno = pDirty->pgno;
+			rc = pager_get_page_contents(pPager,&sPage,0);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+		}
+		return UNQLITE_OK;
+	}
+	while( iOfft + 8 + pPager->iPageSize + 4 <= pPager->iJournalOfft ){
+		rc = unqliteOsRead(pPager->pjfd,zPgno,sizeof(zPgno),iOfft);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		SyBigEndianUnpack64(zPgno,&iNum);
+		if( iNum > 0 && iNum < pSnap->dbSize && snapshot_fetch_page(pSnap,(pgno)iNum) == 0 ){
+			pPage = snapshot_new_page(pSnap,(pgno)iNum,0);
+			if( pPage == 0 ){
+				unqliteGenOutofMem(pPager->pDb);
+				return UNQLITE_NOMEM;
+			}
+			pPage->nRef = 0;
+			pPage->bKeep = 1;
+			pSnap->nKeep++;
+			rc = unqliteOsRead(pPager->pjfd,pPage->zData,pPager->iPageSize,iOfft + 8);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+		}
+		iOfft += 8 /* page num */ + pPager->iPageSize + 4 /* cksum */;
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Take a snapshot of the last committed database image and open a read-only
+ * cursor on it. The snapshot is released with the cursor.
+ */
+UNQLITE_PRIVATE int unqlitePagerSnapshotCursor(Pager *pPager,unqlite_kv_cursor **ppOut)
+{
+	unqlite *pDb = pPager->pDb;
+	unqlite_kv_methods *pMethods;
+	Snapshot *pSnap;
+	pgno nPage;
+	int rc;
+	if( pPager->is_mem || pPager->pEngine == 0 ){
+		unqliteGenError(pDb,"Snapshots are not supported by in-memory databases");
+		return UNQLITE_NOTIMPLEMENTED;
+	}
+	rc = pager_shared_lock(pPager);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	if( pPager->iState >= PAGER_WRITER_CACHEMOD && pPager->pjfd == 0 &&
+		((pPager->iFlags & PAGER_CTRL_DIRTY_COMMIT) || pPager->dbSize < pPager->dbOrigSize) ){
+		/* No journal and the committed image of some changed pages was overwritten */
+		unqliteGenError(pDb,"Commit or rollback the pending changes before taking a snapshot");
+		return UNQLITE_LOCKED;
+	}
+	nPage = pPager->iState >= PAGER_WRITER_LOCKED ? pPager->dbOrigSize : pPager->dbSize;
+	if( nPage < 2 ){
+		unqliteGenError(pDb,"Empty database, nothing to snapshot");
+		return UNQLITE_EMPTY;
+	}
+	pMethods = pPager->pEngine->pIo->pMethods;
+	pSnap = (Snapshot *)SyMemBackendAlloc(pPager->pAllocator,sizeof(Snapshot));
+	if( pSnap == 0 ){
+		unqliteGenOutofMem(pDb);
+		return UNQLITE_NOMEM;
+	}
+	SyZero(pSnap,sizeof(Snapshot));
+	pSnap->pPager = pPager;
+	pSnap->dbSize = nPage;
+	pSnap->nSize = 64;
+	pSnap->apHash = (SnapPage **)SyMemBackendAlloc(pPager->pAllocator,pSnap->nSize * sizeof(SnapPage *));
+	pSnap->zTmpPage = (unsigned char *)SyMemBackendAlloc(pPager->pAllocator,(sxu32)pPager->iPageSize);
+	pSnap->pEngine = (unqlite_kv_engine *)SyMemBackendAlloc(pPager->pAllocator,(sxu32)pMethods->szKv);
+	if( pSnap->apHash == 0 || pSnap->zTmpPage == 0 || pSnap->pEngine == 0 ){
+		if( pSnap->pEngine ){
+			/* Not initialized yet */
+			SyMemBackendFree(pPager->pAllocator,(void *)pSnap->pEngine);
+			pSnap->pEngine = 0;
+		}
+		unqliteGenOutofMem(pDb);
+		rc = UNQLITE_NOMEM;
+		goto fail;
+	}
+	SyZero((void *)pSnap->apHash,pSnap->nSize * sizeof(SnapPage *));
+	SyZero(pSnap->pEngine,(sxu32)pMethods->szKv);
+	if( pPager->iState >= PAGER_WRITER_CACHEMOD ){
+		/* Pages changed by the pending transaction */
+		rc = pager_snapshot_load_pending(pPager,pSnap);
+		if( rc != UNQLITE_OK ){
+			SyMemBackendFree(pPager->pAllocator,(void *)pSnap->pEngine);
+			pSnap->pEngine = 0;
+			goto fail;
+		}
+	}
+	/* A private engine instance reading the snapshot pages */
+	pager_snapshot_io_init(pSnap,pMethods);
+	pSnap->pEngine->pIo = &pSnap->sIo;
+	if( pMethods->xInit ){
+		rc = pMethods->xInit(pSnap->pEngine,unqliteGetPageSize() - pPager->nReserve);
+		if( rc != UNQLITE_OK ){
+			/* Nothing to release */
+			SyMemBackendFree(pPager->pAllocator,(void *)pSnap->pEngine);
+			pSnap->pEngine = 0;
+			goto fail;
+		}
+		pSnap->pEngine->pIo = &pSnap->sIo;
+	}
+	if( pMethods->xOpen ){
+		rc = pMethods->xOpen(pSnap->pEngine,pSnap->dbSize);
+		if( rc != UNQLITE_OK ){
+			unqliteGenErrorFormat(pDb,"xOpen() method of the underlying KV engine '%z' failed",&pPager->sKv);
+			goto fail;
+		}
+	}
+	rc = pager_init_cursor(pDb,pSnap->pEngine,ppOut);
+	if( rc != UNQLITE_OK ){
+		goto fail;
+	}
+	/* Pages modified from now on are saved in this snapshot first */
+	unqliteLatchEnter(pDb);
+	pSnap->iId = ++pPager->iSnapId;
+	pSnap->pNext = pPager->pSnap;
+	if( pPager->pSnap ){
+		pPager->pSnap->pPrev = pSnap;
+	}
+	pPager->pSnap = pSnap;
+	unqliteLatchLeave(pDb);
+	return UNQLITE_OK;
+fail:
+	pager_snapshot_release(pSnap);
+	return rc;
 }
 /*
 * Allocate and initialize a new Pager object. The pager should
@@ -2450,7 +4729,7 @@ UNQLITE_PRIVATE int unqlitePagerOpen(
   )
 {
 	unqlite_kv_methods *pMethods = 0;
-	int is_mem,rd_only,no_jrnl;
+	int is_mem,rd_only,no_jrnl,is_wal;
 	Pager *pPager;
 	sxu32 nByte;
 	sxu32 nLen;
@@ -2482,6 +4761,15 @@ UNQLITE_PRIVATE int unqlitePagerOpen(
 		/* Omit journaling for in-memory database */
 		no_jrnl = 1;
 	}
+	is_wal = !is_mem && !rd_only && (iFlags & UNQLITE_OPEN_WAL) != 0;
+	if( is_wal ){
+		/* The write-ahead log replace the rollback journal */
+		no_jrnl = 1;
+	}
+	if( is_mem || is_wal ){
+		/* No file to map, or pages that live in the log rather than in the file */
+		iFlags &= ~UNQLITE_OPEN_MMAP;
+	}
 	/* Total number of bytes to allocate */
 	nByte = sizeof(Pager);
 	nLen = 0;
@@ -2511,6 +4799,7 @@ UNQLITE_PRIVATE int unqlitePagerOpen(
 	SyZero(pPager->apHash,nByte);
 	pPager->is_mem = is_mem;
 	pPager->no_jrnl = no_jrnl;
+	pPager->is_wal = is_wal;
 	pPager->is_rdonly = rd_only;
 	pPager->iOpenFlags = iFlags;
 	pPager->pVfs = pVfs;
@@ -2518,6 +4807,7 @@ UNQLITE_PRIVATE int unqlitePagerOpen(
 	SyRandomness(&pPager->sPrng,(void *)&pPager->cksumInit,sizeof(sxu32));
 	/* Unlimited cache size */
 	pPager->nCacheMax = SXU32_HIGH;
+	pPager->nReadAhead = PAGER_READ_AHEAD;
 	/* Copy filename and journal name */
 	if( !is_mem ){
 		pPager->zFilename = (char *)&pPager[1];
@@ -2544,6 +4834,15 @@ UNQLITE_PRIVATE int unqlitePagerOpen(
 		SyMemcpy(UNQLITE_JOURNAL_FILE_SUFFIX,&pPager->zJournal[nLen],sizeof(UNQLITE_JOURNAL_FILE_SUFFIX)-1);
 		/* Append the nul terminator to the journal path */
 		pPager->zJournal[nLen + ( sizeof(UNQLITE_JOURNAL_FILE_SUFFIX) - 1)] = 0;
+		/* Same for the write-ahead log */
+		pPager->zWal = (char *) SyMemBackendAlloc(pPager->pAllocator,nLen + sizeof(UNQLITE_WAL_FILE_SUFFIX) + sizeof(char));
+		if( pPager->zWal == 0 ){
+			rc = UNQLITE_NOMEM;
+			goto fail;
+		}
+		SyMemcpy(pPager->zFilename,pPager->zWal,nLen);
+		SyMemcpy(UNQLITE_WAL_FILE_SUFFIX,&pPager->zWal[nLen],sizeof(UNQLITE_WAL_FILE_SUFFIX)-1);
+		pPager->zWal[nLen + ( sizeof(UNQLITE_WAL_FILE_SUFFIX) - 1)] = 0;
 	}
 	/* Finally, register the selected KV engine */
 	rc = unqlitePagerRegisterKvEngine(pPager,pMethods);
@@ -2565,8 +4864,9 @@ fail:
 	return rc;
 }
 /*
- * Set a cache limit. Note that, this is a simple hint, the pager is not
- * forced to honor this limit.
+ * Set a cache limit. Unused clean pages are evicted when the limit is
+ * reached. Note that, this is still a hint, pages that are in use or
+ * dirty are never evicted so the pager is not forced to honor this limit.
  */
 UNQLITE_PRIVATE int unqlitePagerSetCachesize(Pager *pPager,int mxPage)
 {
@@ -2576,17 +4876,112 @@ UNQLITE_PRIVATE int unqlitePagerSetCachesize(Pager *pPager,int mxPage)
 	pPager->nCacheMax = mxPage;
 	return UNQLITE_OK;
 }
+/*
+ * Keep (Default) or drop the clean cached pages when a transaction is committed.
+ */
+UNQLITE_PRIVATE void unqlitePagerRetainCache(Pager *pPager,int bRetain)
+{
+	pPager->no_retain = bRetain ? 0 : 1;
+}
+/*
+ * Select the Key/Value storage engine of a database that has not been accessed yet.
+ * The engine recorded in the header of an existing database still takes precedence.
+ */
+UNQLITE_PRIVATE int unqlitePagerSwitchKvEngine(Pager *pPager,unqlite_kv_methods *pMethods)
+{
+	int rc;
+	if( pPager->pEngine && pMethods == pPager->pEngine->pIo->pMethods ){
+		/* Same implementation */
+		return UNQLITE_OK;
+	}
+	if( pPager->is_mem || pPager->iState != PAGER_OPEN ){
+		/* In-memory database or storage already in use */
+		unqliteGenError(pPager->pDb,"The Key/Value storage engine cannot be changed at this stage");
+		return UNQLITE_LOCKED;
+	}
+	rc = unqlitePagerRegisterKvEngine(pPager,pMethods);
+	if( rc == UNQLITE_OK ){
+		SyStringInitFromBuf(&pPager->sKv,pMethods->zName,SyStrlen(pMethods->zName));
+	}
+	return rc;
+}
+/*
+ * Select the page compression codec of a new database.
+ * The codec of an existing database is the one recorded in its header.
+ */
+UNQLITE_PRIVATE int unqlitePagerSetCodec(Pager *pPager,const unqlite_page_codec *pCodec)
+{
+	if( pPager->is_mem || pPager->iState != PAGER_OPEN ){
+		/* In-memory database or storage already in use */
+		unqliteGenError(pPager->pDb,"The page codec cannot be changed at this stage");
+		return UNQLITE_LOCKED;
+	}
+	pPager->pCodec = pCodec;
+	return UNQLITE_OK;
+}
+/*
+ * Set the read-ahead window of cursor scans (0 to disable).
+ */
+UNQLITE_PRIVATE void unqlitePagerSetReadAhead(Pager *pPager,int nPage)
+{
+	pPager->nReadAhead = nPage > 0 ? nPage : 0;
+}
+/*
+ * Report the page cache counters (hits, misses and evicted pages).
+ */
+UNQLITE_PRIVATE void unqlitePagerCacheStats(Pager *pPager,sxu64 *pHit,sxu64 *pMiss,sxu64 *pEvict)
+{
+	if( pHit ){
+		*pHit = pPager->nCacheHit;
+	}
+	if( pMiss ){
+		*pMiss = pPager->nCacheMiss;
+	}
+	if( pEvict ){
+		*pEvict = pPager->nCacheEvict;
+	}
+}
 /*
  * Shutdown the page cache. Free all memory and close the database file.
  */
 UNQLITE_PRIVATE int unqlitePagerClose(Pager *pPager)
 {
+	/* Release the snapshots left open */
+	while( pPager->pSnap ){
+		pager_snapshot_release(pPager->pSnap);
+	}
 	/* Release the KV engine */
 	pager_release_kv_engine(pPager);
 	if( pPager->iOpenFlags & UNQLITE_OPEN_MMAP ){
 		const jx9_vfs *pVfs = jx9ExportBuiltinVfs();
 		if( pVfs && pVfs->xUnmap && pPager->pMmap ){
-			pVfs->xUnmap(pPager->pMmap,pPager->dbByteSize);
+			pVfs->xUnmap(pPager->pMmap,pPager->nMapSize);
+		}
+	}
+	if( pPager->pwfd ){
+		int rc = UNQLITE_OK;
+		if( !pPager->is_rdonly ){
+			/* Discard the frames of an uncommitted transaction */
+			rc = pager_wal_rollback(pPager);
+		}
+		if( rc == UNQLITE_OK && !pPager->is_rdonly && pPager->iLock >= SHARED_LOCK &&
+			pager_lock_db(pPager,EXCLUSIVE_LOCK) == UNQLITE_OK ){
+			/* Last handle on the database, transfer the log content to the database file
+			 * then remove the log. Otherwise the log is left to the other handles.
+			 */
+			int nNew;
+			rc = pager_wal_index_load(pPager,&nNew);
+			if( rc == UNQLITE_OK ){
+				rc = pager_wal_checkpoint(pPager);
+			}
+			unqliteOsCloseFree(pPager->pAllocator,pPager->pwfd);
+			pPager->pwfd = 0;
+			if( rc == UNQLITE_OK ){
+				unqliteOsDelete(pPager->pVfs,pPager->zWal,TRUE);
+			}
+		}else{
+			unqliteOsCloseFree(pPager->pAllocator,pPager->pwfd);
+			pPager->pwfd = 0;
 		}
 	}
 	if( !pPager->is_mem && pPager->iState > PAGER_OPEN ){
@@ -2630,8 +5025,11 @@ UNQLITE_PRIVATE sxu32 unqlitePagerRandomNum(Pager *pPager)
  */
 static int unqliteKvIoPageGet(unqlite_kv_handle pHandle,pgno iNum,unqlite_page **ppPage)
 {
+	Pager *pPager = (Pager *)pHandle;
 	int rc;
-	rc = unqlitePagerAcquire((Pager *)pHandle,iNum,ppPage,0,0);
+	unqliteLatchEnter(pPager->pDb);
+	rc = unqlitePagerAcquire(pPager,iNum,ppPage,0,0);
+	unqliteLatchLeave(pPager->pDb);
 	return rc;
 }
 /* 
@@ -2639,8 +5037,11 @@ static int unqliteKvIoPageGet(unqlite_kv_handle pHandle,pgno iNum,unqlite_page *
  */
 static int unqliteKvIoPageLookup(unqlite_kv_handle pHandle,pgno iNum,unqlite_page **ppPage)
 {
+	Pager *pPager = (Pager *)pHandle;
 	int rc;
-	rc = unqlitePagerAcquire((Pager *)pHandle,iNum,ppPage,1,0);
+	unqliteLatchEnter(pPager->pDb);
+	rc = unqlitePagerAcquire(pPager,iNum,ppPage,1,0);
+	unqliteLatchLeave(pPager->pDb);
 	return rc;
 }
 /* 
@@ -2653,10 +5054,12 @@ static int unqliteKvIoNewPage(unqlite_kv_handle pHandle,unqlite_page **ppPage)
 	/* 
 	 * Acquire a reader-lock first so that pPager->dbSize get initialized.
 	 */
+	unqliteLatchEnter(pPager->pDb);
 	rc = pager_shared_lock(pPager);
 	if( rc == UNQLITE_OK ){
 		rc = unqlitePagerAcquire(pPager,pPager->dbSize == 0 ? /* Page 0 is reserved */ 1 : pPager->dbSize ,ppPage,0,0);
 	}
+	unqliteLatchLeave(pPager->pDb);
 	return rc;
 }
 /* 
@@ -2664,12 +5067,16 @@ static int unqliteKvIoNewPage(unqlite_kv_handle pHandle,unqlite_page **ppPage)
  */
 static int unqliteKvIopageWrite(unqlite_page *pPage)
 {
+	unqlite *pDb;
 	int rc;
 	if( pPage == 0 ){
 		/* TICKET 1433-0348 */
 		return UNQLITE_OK;
 	}
+	pDb = ((Page *)pPage)->pPager->pDb;
+	unqliteLatchEnter(pDb);
 	rc = unqlitePageWrite(pPage);
+	unqliteLatchLeave(pDb);
 	return rc;
 }
 /* 
@@ -2744,7 +5151,10 @@ static int unqliteKvIoPageDontMakeHot(unqlite_page *pRaw)
 static int unqliteKvIopage_ref(unqlite_page *pPage)
 {
 	if( pPage ){
+		unqlite *pDb = ((Page *)pPage)->pPager->pDb;
+		unqliteLatchEnter(pDb);
 		page_ref((Page *)pPage);
+		unqliteLatchLeave(pDb);
 	}
 	return UNQLITE_OK;
 }
@@ -2754,7 +5164,10 @@ static int unqliteKvIopage_ref(unqlite_page *pPage)
 static int unqliteKvIoPageUnRef(unqlite_page *pPage)
 {
 	if( pPage ){
+		unqlite *pDb = ((Page *)pPage)->pPager->pDb;
+		unqliteLatchEnter(pDb);
 		page_unref((Page *)pPage);
+		unqliteLatchLeave(pDb);
 	}
 	return UNQLITE_OK;
 }
@@ -2770,7 +5183,8 @@ static int unqliteKvIoReadOnly(unqlite_kv_handle pHandle)
  */
 static int unqliteKvIoPageSize(unqlite_kv_handle pHandle)
 {
-	return ((Pager *)pHandle)->iPageSize;
+	/* The reserved tail is not visible to the engine */
+	return ((Pager *)pHandle)->iPageSize - ((Pager *)pHandle)->nReserve;
 }
 /* 
  * Refer to the declaration of the [Pager] structure
@@ -2806,6 +5220,58 @@ static void unqliteKvIoErr(unqlite_kv_handle pHandle,const char *zErr)
 	Pager *pPager = (Pager *)pHandle;
 	unqliteGenError(pPager->pDb,zErr);
 }
+/*
+ * Read-ahead the given pages.
+ * [i.e: Prefetch the next buckets of a cursor scan].
+ */
+static int unqliteKvIoPrefetch(unqlite_kv_handle pHandle,const pgno *aPgno,int nPage)
+{
+	Pager *pPager = (Pager *)pHandle;
+	int n;
+	unqliteLatchEnter(pPager->pDb);
+	n = pager_read_ahead(pPager,aPgno,nPage);
+	unqliteLatchLeave(pPager->pDb);
+	return n;
+}
+/*
+ * Total number of pages in the database image.
+ */
+static pgno unqliteKvIoPageCount(unqlite_kv_handle pHandle)
+{
+	return ((Pager *)pHandle)->dbSize;
+}
+/*
+ * Enter or leave the latch guarding the page cache while readers run concurrently.
+ * [i.e: Around the parsing of a cached page shared by the readers].
+ */
+static void unqliteKvIoLatch(unqlite_kv_handle pHandle,int bEnter)
+{
+	Pager *pPager = (Pager *)pHandle;
+	if( bEnter ){
+		unqliteLatchEnter(pPager->pDb);
+	}else{
+		unqliteLatchLeave(pPager->pDb);
+	}
+}
+/*
+ * Refer to [pager_truncate_image()]
+ */
+static int unqliteKvIoTruncate(unqlite_kv_handle pHandle,pgno nPage)
+{
+	Pager *pPager = (Pager *)pHandle;
+	int rc;
+	unqliteLatchEnter(pPager->pDb);
+	/* Make sure a write transaction is opened */
+	rc = unqlitePagerBegin(pPager);
+	if( rc == UNQLITE_OK && pPager->iState == PAGER_WRITER_LOCKED ){
+		rc = unqliteOpenJournal(pPager);
+	}
+	if( rc == UNQLITE_OK ){
+		rc = pager_truncate_image(pPager,nPage);
+	}
+	unqliteLatchLeave(pPager->pDb);
+	return rc;
+}
 /*
  * Init an instance of the [unqlite_kv_io] structure.
  */
@@ -2835,6 +5301,10 @@ static int pager_kv_io_init(Pager *pPager,unqlite_kv_methods *pMethods,unqlite_k
 	pIo->xSetReload = unqliteKvIoPageReload;
 
 	pIo->xErr = unqliteKvIoErr;
+	pIo->xPrefetch = unqliteKvIoPrefetch;
+	pIo->xPageCount = unqliteKvIoPageCount;
+	pIo->xTruncate = unqliteKvIoTruncate;
+	pIo->xLatch = unqliteKvIoLatch;
 
 	return UNQLITE_OK;
 }
@@ -102,6 +102,7 @@ struct unqlite_db
 	Pager *pPager;              /* Pager and Transaction manager */
 	jx9 *pJx9;                  /* Jx9 Engine handle */
 	unqlite_kv_cursor *pCursor; /* Database cursor for common usage */
+	SySet aReader;              /* Idle cursors of the concurrent readers */
 };
 /*
  * Each database connection is an instance of the following structure.
@@ -114,6 +115,17 @@ struct unqlite
 #if defined(UNQLITE_ENABLE_THREADS)
 	const SyMutexMethods *pMethods;  /* Mutex methods */
 	SyMutex *pMutex;                 /* Per-handle mutex */
+	SyMutex *pLatch;                 /* Short-held latch shared by the concurrent readers */
+	sxu32 nReader;                   /* Readers running without the per-handle mutex */
+	sxu32 nWriter;                   /* Writers queued on the per-handle mutex */
+	SyEvent *pReadEvent;             /* Notified when the last concurrent reader leaves */
+	sxu32 nCommitWindow;             /* Group commit window in microseconds (0: disabled) */
+	sxu32 nCommitMax;                /* Maximum number of commit requests per batch */
+	sxu32 nCommitWait;               /* Commit requests collected in the current batch */
+	sxu32 iCommitBatch;              /* Batch sequence number */
+	int bCommitLeader;               /* True while a thread is collecting the current batch */
+	int iCommitRc;                   /* Result of the last batch commit */
+	SyEvent *pCommitEvent;           /* Notified when the batch is full or committed */
 #endif
 	unqlite_vm *pVms;                /* List of active VM */
 	sxi32 iVm;                       /* Total number of active VM */
@@ -122,6 +134,17 @@ struct unqlite
 	sxu32 nMagic;                    /* Sanity check against misuse */
 };
 #define UNQLITE_FL_DISABLE_AUTO_COMMIT   0x001 /* Disable auto-commit on close */
+/*
+ * Enter or leave the recursive latch guarding the page cache, the error log
+ * and the reader state of a database handle while readers run concurrently.
+ */
+#if defined(UNQLITE_ENABLE_THREADS)
+#define unqliteLatchEnter(DB) SyMutexEnter((DB)->pMethods,(DB)->pLatch)
+#define unqliteLatchLeave(DB) SyMutexLeave((DB)->pMethods,(DB)->pLatch)
+#else
+#define unqliteLatchEnter(DB) ((void)(DB))
+#define unqliteLatchLeave(DB) ((void)(DB))
+#endif
 /*
  * VM control flags (Mostly related to collection handling).
  */
@@ -164,14 +187,36 @@ struct unqlite_col
 	jx9_int64 nTotRec; /* Total number of records in the collection */
 	int iFlags;        /* Control flags (see below) */
 	unqlite_col_record **apRecord; /* Hashtable of loaded records */
-	unqlite_col_record *pList;     /* Linked list of records */
+	unqlite_col_record *pList;     /* Linked list of records (Most recently used first) */
+	unqlite_col_record *pTail;     /* Least recently used record */
 	sxu32 nRec;        /* Total number of records in apRecord[] */     
 	sxu32 nRecSize;    /* apRecord[] size */
 	Sytm sCreation;    /* Colleation creation time */
 	unqlite_kv_cursor *pCursor; /* Cursor pointing to the raw binary data */
+	SySet aIndex;      /* Indexed fields (SyString instances) */
+	SyBlob sIndex;     /* Index key and data working buffer */
 	unqlite_col *pNext,*pPrev;  /* Next and previous collection in the chain */
 	unqlite_col *pNextCol,*pPrevCol; /* Collision chain */
 };
+/*
+ * A term of a declarative record filter (Refer to db_fetch_all()).
+ * Terms are evaluated directly on the binary JSON encoding of each record.
+ */
+typedef struct unqlite_col_filter unqlite_col_filter;
+struct unqlite_col_filter
+{
+	SyString sField;   /* Top level field name (points into sName) */
+	sxi32 iOp;         /* Comparison operator (see below) */
+	jx9_value sName;   /* Private copy of the field name */
+	jx9_value sValue;  /* Private copy of the value to compare with */
+};
+/* Filter operators */
+#define UNQLITE_FILTER_EQ 1 /* == */
+#define UNQLITE_FILTER_NE 2 /* != */
+#define UNQLITE_FILTER_LT 3 /* <  */
+#define UNQLITE_FILTER_LE 4 /* <= */
+#define UNQLITE_FILTER_GT 5 /* >  */
+#define UNQLITE_FILTER_GE 6 /* >= */
 /*
  * Each unQLite Virtual Machine resulting from successful compilation of
  * a Jx9 script is represented by an instance of the following structure.
@@ -188,6 +233,10 @@ struct unqlite_vm
 	sxu32 iCol;                /* Total number of loaded collections */
 	sxu32 iColSize;            /* apCol[] size  */
 	jx9_vm *pJx9Vm;            /* Compiled Jx9 script*/
+	sxu32 nMaxRecord;          /* Maximum number of cached records per collection */
+	sxu64 nRecHit;             /* Record cache hits */
+	sxu64 nRecMiss;            /* Record cache misses */
+	sxu64 nRecEvict;           /* Records evicted from the cache */
 	unqlite_vm *pNext,*pPrev;  /* Linked list of active unQLite VM */
 	sxu32 nMagic;              /* Magic number to avoid misuse */
 };
@@ -220,6 +269,12 @@ struct unqlite_vm
 # undef UNQLITE_DEFAULT_PAGE_SIZE
 #endif
 # define UNQLITE_DEFAULT_PAGE_SIZE 4096 /* 4K */
+/*
+ * Default number of decoded records each collection keep in its cache.
+ */
+#ifndef UNQLITE_DEFAULT_RECORD_CACHE
+# define UNQLITE_DEFAULT_RECORD_CACHE 4096
+#endif
 /* Forward declaration */
 typedef struct Bitvec Bitvec;
 /* Private library functions */
@@ -234,6 +289,10 @@ UNQLITE_PRIVATE unqlite_kv_methods * unqliteFindKVStore(
 	const char *zName, /* Storage engine name [i.e. Hash, B+tree, LSM, etc.] */
 	sxu32 nByte        /* zName length */
 	);
+UNQLITE_PRIVATE const unqlite_page_codec * unqliteFindPageCodec(
+	const char *zName, /* Codec name [i.e. lz] */
+	sxu32 nByte        /* zName length */
+	);
 UNQLITE_PRIVATE int unqliteGetPageSize(void);
 UNQLITE_PRIVATE int unqliteGenError(unqlite *pDb,const char *zErr);
 UNQLITE_PRIVATE int unqliteGenErrorFormat(unqlite *pDb,const char *zFmt,...);
@@ -244,6 +303,7 @@ UNQLITE_PRIVATE int unqliteCreateCollection(unqlite_vm *pVm,SyString *pName);
 UNQLITE_PRIVATE jx9_int64 unqliteCollectionLastRecordId(unqlite_col *pCol);
 UNQLITE_PRIVATE jx9_int64 unqliteCollectionCurrentRecordId(unqlite_col *pCol);
 UNQLITE_PRIVATE int unqliteCollectionCacheRemoveRecord(unqlite_col *pCol,jx9_int64 nId);
+UNQLITE_PRIVATE void unqliteVmTrimRecordCache(unqlite_vm *pVm);
 UNQLITE_PRIVATE jx9_int64 unqliteCollectionTotalRecords(unqlite_col *pCol);
 UNQLITE_PRIVATE void unqliteCollectionResetRecordCursor(unqlite_col *pCol);
 UNQLITE_PRIVATE int unqliteCollectionFetchNextRecord(unqlite_col *pCol,jx9_value *pValue);
@@ -254,6 +314,14 @@ UNQLITE_PRIVATE int unqliteCollectionPut(unqlite_col *pCol,jx9_value *pValue,int
 UNQLITE_PRIVATE int unqliteCollectionDropRecord(unqlite_col *pCol,jx9_int64 nId,int wr_header,int log_err);
 UNQLITE_PRIVATE int unqliteCollectionUpdateRecord(unqlite_col *pCol,jx9_int64 nId, jx9_value *pValue,int iFlag);
 UNQLITE_PRIVATE int unqliteDropCollection(unqlite_col *pCol);
+UNQLITE_PRIVATE int unqliteCollectionCreateIndex(unqlite_col *pCol,SyString *pField);
+UNQLITE_PRIVATE int unqliteCollectionDropIndex(unqlite_col *pCol,SyString *pField);
+UNQLITE_PRIVATE int unqliteCollectionFetchByField(unqlite_col *pCol,SyString *pField,jx9_value *pKey,jx9_value *pArray);
+UNQLITE_PRIVATE int unqliteCollectionFilterInit(jx9_value *pFilter,SySet *pTerms);
+UNQLITE_PRIVATE void unqliteCollectionFilterRelease(SySet *pTerms);
+UNQLITE_PRIVATE int unqliteCollectionFieldsInit(jx9_value *pList,SySet *pFields);
+UNQLITE_PRIVATE int unqliteCollectionProjectRecord(SySet *pFields,jx9_value *pRecord,jx9_value *pOut);
+UNQLITE_PRIVATE int unqliteCollectionFetchNextMatch(unqlite_col *pCol,SySet *pTerms,SySet *pFields,jx9_value *pValue);
 /* unql_jx9.c */
 UNQLITE_PRIVATE int unqliteRegisterJx9Functions(unqlite_vm *pVm);
 /* fastjson.c */
@@ -269,15 +337,50 @@ UNQLITE_PRIVATE sxi32 FastJsonDecode(
 	const unsigned char **pzPtr,
 	int iNest /* Nesting limit */
 	);
+UNQLITE_PRIVATE sxi32 FastJsonFetchField(
+	const void *pIn,      /* Binary JSON  */
+	sxu32 nByte,          /* Chunk delimiter */
+	SyString *pField,     /* Field name */
+	const unsigned char **pzValue /* OUT: Encoded value */
+	);
+UNQLITE_PRIVATE sxi32 FastJsonDecodeFields(
+	const void *pIn,  /* Binary JSON  */
+	sxu32 nByte,      /* Chunk delimiter */
+	SyString *aField, /* Fields to decode */
+	sxu32 nField,     /* aField[] length */
+	jx9_value *pOut   /* Decoded value */
+	);
+UNQLITE_PRIVATE sxi32 FastJsonCompare(
+	const unsigned char *zIn,  /* Encoded value */
+	const unsigned char *zEnd, /* End of input */
+	jx9_value *pValue,         /* Value to compare with */
+	sxi32 *pRes                /* OUT: Comparison result */
+	);
 /* vfs.c [io_win.c, io_unix.c ] */
 UNQLITE_PRIVATE const unqlite_vfs * unqliteExportBuiltinVfs(void);
+#if defined(UNQLITE_ENABLE_IO_URING) && defined(__linux__)
+UNQLITE_PRIVATE const unqlite_vfs * unqliteExportUringVfs(void);
+#endif
 /* mem_kv.c */
 UNQLITE_PRIVATE const unqlite_kv_methods * unqliteExportMemKvStorage(void);
 /* lhash_kv.c */
 UNQLITE_PRIVATE const unqlite_kv_methods * unqliteExportDiskKvStorage(void);
+/* btree_kv.c */
+UNQLITE_PRIVATE const unqlite_kv_methods * unqliteExportBtreeKvStorage(void);
+/* lsm_kv.c */
+UNQLITE_PRIVATE const unqlite_kv_methods * unqliteExportLsmKvStorage(void);
+/* codec.c */
+/* Bytes reserved at the end of each page when a page codec is in use */
+#define UNQLITE_CODEC_RESERVE 4
+UNQLITE_PRIVATE const unqlite_page_codec * unqliteExportLzCodec(void);
+UNQLITE_PRIVATE int unqliteCodecEncode(const unqlite_page_codec *pCodec,const unsigned char *zPage,int nPage,unsigned char *zOut);
+UNQLITE_PRIVATE int unqliteCodecDecode(const unqlite_page_codec *pCodec,unsigned char *zPage,int nPage,unsigned char *zTmp);
 /* os.c */
 UNQLITE_PRIVATE int unqliteOsRead(unqlite_file *id, void *pBuf, unqlite_int64 amt, unqlite_int64 offset);
 UNQLITE_PRIVATE int unqliteOsWrite(unqlite_file *id, const void *pBuf, unqlite_int64 amt, unqlite_int64 offset);
+UNQLITE_PRIVATE int unqliteOsWritev(unqlite_file *id, const unqlite_iovec *aVec, int nVec, unqlite_int64 offset);
+UNQLITE_PRIVATE int unqliteOsPrefetch(unqlite_file *id, unqlite_int64 amt, unqlite_int64 offset);
+UNQLITE_PRIVATE int unqliteOsDiscard(unqlite_file *id, unqlite_int64 amt, unqlite_int64 offset);
 UNQLITE_PRIVATE int unqliteOsTruncate(unqlite_file *id, unqlite_int64 size);
 UNQLITE_PRIVATE int unqliteOsSync(unqlite_file *id, int flags);
 UNQLITE_PRIVATE int unqliteOsFileSize(unqlite_file *id, unqlite_int64 *pSize);
@@ -304,6 +407,9 @@ UNQLITE_PRIVATE void unqliteBitvecDestroy(Bitvec *p);
 UNQLITE_PRIVATE int unqliteInitCursor(unqlite *pDb,unqlite_kv_cursor **ppOut);
 UNQLITE_PRIVATE int unqliteReleaseCursor(unqlite *pDb,unqlite_kv_cursor *pCur);
 UNQLITE_PRIVATE int unqlitePagerSetCachesize(Pager *pPager,int mxPage);
+UNQLITE_PRIVATE void unqlitePagerRetainCache(Pager *pPager,int bRetain);
+UNQLITE_PRIVATE void unqlitePagerSetReadAhead(Pager *pPager,int nPage);
+UNQLITE_PRIVATE void unqlitePagerCacheStats(Pager *pPager,sxu64 *pHit,sxu64 *pMiss,sxu64 *pEvict);
 UNQLITE_PRIVATE int unqlitePagerClose(Pager *pPager);
 UNQLITE_PRIVATE int unqlitePagerOpen(
   unqlite_vfs *pVfs,       /* The virtual file system to use */
@@ -312,7 +418,15 @@ UNQLITE_PRIVATE int unqlitePagerOpen(
   unsigned int iFlags      /* flags controlling this file */
   );
 UNQLITE_PRIVATE int unqlitePagerRegisterKvEngine(Pager *pPager,unqlite_kv_methods *pMethods);
+UNQLITE_PRIVATE int unqlitePagerSwitchKvEngine(Pager *pPager,unqlite_kv_methods *pMethods);
+UNQLITE_PRIVATE int unqlitePagerSetCodec(Pager *pPager,const unqlite_page_codec *pCodec);
 UNQLITE_PRIVATE unqlite_kv_engine * unqlitePagerGetKvEngine(unqlite *pDb);
+#if defined(UNQLITE_ENABLE_THREADS)
+UNQLITE_PRIVATE int unqlitePagerSharedRead(Pager *pPager);
+#endif
+UNQLITE_PRIVATE int unqlitePagerLogChanged(Pager *pPager);
+UNQLITE_PRIVATE int unqlitePagerRefresh(Pager *pPager);
+UNQLITE_PRIVATE int unqlitePagerSnapshotCursor(Pager *pPager,unqlite_kv_cursor **ppOut);
 UNQLITE_PRIVATE int unqlitePagerBegin(Pager *pPager);
 UNQLITE_PRIVATE int unqlitePagerCommit(Pager *pPager);
 UNQLITE_PRIVATE int unqlitePagerRollback(Pager *pPager,int bResetKvEngine);
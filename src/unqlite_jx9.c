@@ -291,10 +291,19 @@ static int unqliteBuiltin_db_fetch_by_id(jx9_context *pCtx,int argc,jx9_value **
 	return JX9_OK;
 }
 /*
- * array db_fetch_all(string $col_name,[callback filter_callback])
- * array db_get_all(string $col_name,[callback filter_callback])
+ * array db_fetch_all(string $col_name,[callback filter_callback,[array $fields]])
+ * array db_fetch_all(string $col_name,[object|array $filter,[array $fields]])
+ * array db_get_all(string $col_name,[callback filter_callback,[array $fields]])
  *   Retrieve all records of a given collection and apply the given
  *   callback if available to filter records.
+ *   Instead of a callback, a declarative filter of the form
+ *   {field: 'age', op: '>', value: 30} or an array of such terms
+ *   (which must all match) may be given. Supported operators are
+ *   ==, !=, <, <=, > and >=. The filter is evaluated directly on the
+ *   stored binary JSON so that only matching records are decoded.
+ *   If a list of fields is given, only these top level fields (plus __id)
+ *   are returned. Unless a callback is used, the other fields are skipped
+ *   without being decoded. Pass null as the filter to project all records.
  * Parameter
  *   col_name: Collection name
  * Return
@@ -330,43 +339,80 @@ static int unqliteBuiltin_db_fetch_all(jx9_context *pCtx,int argc,jx9_value **ar
 	if( pCol ){
 		jx9_value *pValue,*pArray,*pCallback = 0;
 		jx9_value sResult; /* Callback result */
+		SySet aFilter;     /* Compiled declarative filter */
+		SySet aFields;     /* Projected fields */
+		int iFilter = 0;
 		/* Allocate an empty scalar value and an empty JSON array */
 		pArray = jx9_context_new_array(pCtx);
 		pValue = jx9_context_new_scalar(pCtx);
-		jx9MemObjInit(pCtx->pVm,&sResult);
 		if( pValue == 0 || pArray == 0 ){
 			jx9_context_throw_error(pCtx,JX9_CTX_ERR,"Jx9 is running out of memory");
 			jx9_result_null(pCtx);
 			return JX9_OK;
 		}
+		SySetInit(&aFilter,&pVm->sAlloc,sizeof(unqlite_col_filter));
+		SySetInit(&aFields,&pVm->sAlloc,sizeof(SyString));
+		rc = UNQLITE_OK;
 		if( argc > 1 && jx9_value_is_callable(argv[1]) ){
 			pCallback = argv[1];
+		}else if( argc > 1 && (jx9_value_is_json_object(argv[1]) || jx9_value_is_json_array(argv[1])) ){
+			rc = unqliteCollectionFilterInit(argv[1],&aFilter);
+			iFilter = 1;
+		}
+		if( rc == UNQLITE_OK && argc > 2 && !jx9_value_is_null(argv[2]) ){
+			rc = unqliteCollectionFieldsInit(argv[2],&aFields);
+		}
+		if( rc != UNQLITE_OK ){
+			unqliteCollectionFilterRelease(&aFilter);
+			SySetRelease(&aFields);
+			jx9_context_throw_error(pCtx,JX9_CTX_ERR,
+				"Invalid filter or field list, expecting {field: name, op: operator, value: value} and [name,...]");
+			jx9_result_null(pCtx);
+			return JX9_OK;
 		}
 		unqliteCollectionResetRecordCursor(pCol);
-		/* Fetch collection records one after one */
-		while( UNQLITE_OK == unqliteCollectionFetchNextRecord(pCol,pValue) ){
-			if( pCallback ){
-				jx9_value *apArg[2];
-				/* Invoke the filter callback */
-				apArg[0] = pValue;
-				rc = jx9VmCallUserFunction(pCtx->pVm,pCallback,1,apArg,&sResult);
-				if( rc == JX9_OK ){
-					int iResult; /* Callback result */
-					/* Extract callback result */
-					iResult = jx9_value_to_bool(&sResult);
-					if( !iResult ){
-						/* Discard the result */
-						unqliteCollectionCacheRemoveRecord(pCol,unqliteCollectionCurrentRecordId(pCol) - 1);
-						continue;
+		if( pCallback == 0 && (iFilter || SySetUsed(&aFields) > 0) ){
+			/* Only matching records (and the projected fields) are decoded */
+			while( UNQLITE_OK == unqliteCollectionFetchNextMatch(pCol,iFilter ? &aFilter : 0,&aFields,pValue) ){
+				/* Put the value in the JSON array */
+				jx9_array_add_elem(pArray,0,pValue);
+				/* Release the value */
+				jx9_value_null(pValue);
+			}
+		}else{
+			jx9MemObjInit(pCtx->pVm,&sResult);
+			/* Fetch collection records one after one */
+			while( UNQLITE_OK == unqliteCollectionFetchNextRecord(pCol,pValue) ){
+				if( pCallback ){
+					jx9_value *apArg[2];
+					/* Invoke the filter callback */
+					apArg[0] = pValue;
+					rc = jx9VmCallUserFunction(pCtx->pVm,pCallback,1,apArg,&sResult);
+					if( rc == JX9_OK ){
+						int iResult; /* Callback result */
+						/* Extract callback result */
+						iResult = jx9_value_to_bool(&sResult);
+						if( !iResult ){
+							/* Discard the result */
+							unqliteCollectionCacheRemoveRecord(pCol,unqliteCollectionCurrentRecordId(pCol) - 1);
+							continue;
+						}
 					}
 				}
+				if( SySetUsed(&aFields) > 0 ){
+					/* Keep the projected fields only */
+					unqliteCollectionProjectRecord(&aFields,pValue,&sResult);
+					jx9MemObjStore(&sResult,pValue);
+				}
+				/* Put the value in the JSON array */
+				jx9_array_add_elem(pArray,0,pValue);
+				/* Release the value */
+				jx9_value_null(pValue);
 			}
-			/* Put the value in the JSON array */
-			jx9_array_add_elem(pArray,0,pValue);
-			/* Release the value */
-			jx9_value_null(pValue);
+			jx9MemObjRelease(&sResult);
 		}
-		jx9MemObjRelease(&sResult);
+		unqliteCollectionFilterRelease(&aFilter);
+		SySetRelease(&aFields);
 		/* Finally, return our array */
 		jx9_result_value(pCtx,pArray);
 		/* pValue will be automatically released as soon we return from
@@ -804,6 +850,181 @@ static int unqliteBuiltin_db_update_record(jx9_context *pCtx,int argc,jx9_value
     jx9_result_bool(pCtx,rc == UNQLITE_OK);
     return JX9_OK;
 }
+/*
+ * bool db_create_index(string $col_name,string $field)
+ *   Create an index on a top level field of the records of a given collection.
+ *   Existing records are indexed right away and the index is maintained on
+ *   each store, update or drop.
+ * Parameter
+ *   col_name: Collection name.
+ *   field: Name of the field to index.
+ * Return
+ *    TRUE on success. FALSE on failure.
+ */
+static int unqliteBuiltin_db_create_index(jx9_context *pCtx,int argc,jx9_value **argv)
+{
+	unqlite_col *pCol;
+	const char *zName;
+	unqlite_vm *pVm;
+	SyString sName;
+	SyString sField;
+	int nByte;
+	int rc;
+	/* Extract collection name */
+	if( argc < 2 ){
+		/* Missing arguments */
+		jx9_context_throw_error(pCtx,JX9_CTX_ERR,"Missing collection name and/or field name");
+		/* Return false */
+		jx9_result_bool(pCtx,0);
+		return JX9_OK;
+	}
+	zName = jx9_value_to_string(argv[0],&nByte);
+	if( nByte < 1){
+		jx9_context_throw_error(pCtx,JX9_CTX_ERR,"Invalid collection name");
+		/* Return false */
+		jx9_result_bool(pCtx,0);
+		return JX9_OK;
+	}
+	SyStringInitFromBuf(&sName,zName,nByte);
+	/* Extract the field name */
+	zName = jx9_value_to_string(argv[1],&nByte);
+	if( nByte < 1){
+		jx9_context_throw_error(pCtx,JX9_CTX_ERR,"Invalid field name");
+		/* Return false */
+		jx9_result_bool(pCtx,0);
+		return JX9_OK;
+	}
+	SyStringInitFromBuf(&sField,zName,nByte);
+	pVm = (unqlite_vm *)jx9_context_user_data(pCtx);
+	/* Fetch the collection */
+	pCol = unqliteCollectionFetch(pVm,&sName,UNQLITE_VM_AUTO_LOAD);
+	if( pCol == 0 ){
+		jx9_context_throw_error_format(pCtx,JX9_CTX_ERR,"No such collection '%z'",&sName);
+		/* Return false */
+		jx9_result_bool(pCtx,0);
+		return JX9_OK;
+	}
+	/* Create the index */
+	rc = unqliteCollectionCreateIndex(pCol,&sField);
+	/* Processing result */
+	jx9_result_bool(pCtx,rc == UNQLITE_OK);
+	return JX9_OK;
+}
+/*
+ * bool db_drop_index(string $col_name,string $field)
+ *   Drop an index from a given collection.
+ * Parameter
+ *   col_name: Collection name.
+ *   field: Name of the indexed field.
+ * Return
+ *    TRUE on success. FALSE on failure (No such index).
+ */
+static int unqliteBuiltin_db_drop_index(jx9_context *pCtx,int argc,jx9_value **argv)
+{
+	unqlite_col *pCol;
+	const char *zName;
+	unqlite_vm *pVm;
+	SyString sName;
+	SyString sField;
+	int nByte;
+	int rc;
+	/* Extract collection name */
+	if( argc < 2 ){
+		/* Missing arguments */
+		jx9_context_throw_error(pCtx,JX9_CTX_ERR,"Missing collection name and/or field name");
+		/* Return false */
+		jx9_result_bool(pCtx,0);
+		return JX9_OK;
+	}
+	zName = jx9_value_to_string(argv[0],&nByte);
+	if( nByte < 1){
+		jx9_context_throw_error(pCtx,JX9_CTX_ERR,"Invalid collection name");
+		/* Return false */
+		jx9_result_bool(pCtx,0);
+		return JX9_OK;
+	}
+	SyStringInitFromBuf(&sName,zName,nByte);
+	/* Extract the field name */
+	zName = jx9_value_to_string(argv[1],&nByte);
+	SyStringInitFromBuf(&sField,zName,nByte);
+	pVm = (unqlite_vm *)jx9_context_user_data(pCtx);
+	/* Fetch the collection */
+	pCol = unqliteCollectionFetch(pVm,&sName,UNQLITE_VM_AUTO_LOAD);
+	if( pCol == 0 ){
+		jx9_context_throw_error_format(pCtx,JX9_CTX_ERR,"No such collection '%z'",&sName);
+		/* Return false */
+		jx9_result_bool(pCtx,0);
+		return JX9_OK;
+	}
+	/* Drop the index */
+	rc = unqliteCollectionDropIndex(pCol,&sField);
+	/* Processing result */
+	jx9_result_bool(pCtx,rc == UNQLITE_OK);
+	return JX9_OK;
+}
+/*
+ * array db_fetch_by_field(string $col_name,string $field,value $value)
+ * array db_get_by_field(string $col_name,string $field,value $value)
+ *   Retrieve the records of a given collection whose top level field
+ *   is equal (same type and value) to the given scalar value.
+ *   The field index is used if available (Refer to db_create_index()),
+ *   otherwise the whole collection is scanned.
+ * Parameter
+ *   col_name: Collection name
+ *   field: Field name
+ *   value: Lookup value
+ * Return
+ *    Matching records (JSON array) on success. NULL on failure.
+ */
+static int unqliteBuiltin_db_fetch_by_field(jx9_context *pCtx,int argc,jx9_value **argv)
+{
+	unqlite_col *pCol;
+	const char *zName;
+	unqlite_vm *pVm;
+	SyString sName;
+	SyString sField;
+	int nByte;
+	/* Extract collection name */
+	if( argc < 3 ){
+		/* Missing arguments */
+		jx9_context_throw_error(pCtx,JX9_CTX_ERR,"Missing collection name, field name and/or lookup value");
+		/* Return NULL */
+		jx9_result_null(pCtx);
+		return JX9_OK;
+	}
+	zName = jx9_value_to_string(argv[0],&nByte);
+	if( nByte < 1){
+		jx9_context_throw_error(pCtx,JX9_CTX_ERR,"Invalid collection name");
+		/* Return NULL */
+		jx9_result_null(pCtx);
+		return JX9_OK;
+	}
+	SyStringInitFromBuf(&sName,zName,nByte);
+	/* Extract the field name */
+	zName = jx9_value_to_string(argv[1],&nByte);
+	SyStringInitFromBuf(&sField,zName,nByte);
+	pVm = (unqlite_vm *)jx9_context_user_data(pCtx);
+	/* Fetch the collection */
+	pCol = unqliteCollectionFetch(pVm,&sName,UNQLITE_VM_AUTO_LOAD);
+	if( pCol ){
+		jx9_value *pArray;
+		/* Allocate an empty JSON array */
+		pArray = jx9_context_new_array(pCtx);
+		if( pArray == 0 ){
+			jx9_context_throw_error(pCtx,JX9_CTX_ERR,"Jx9 is running out of memory");
+			jx9_result_null(pCtx);
+			return JX9_OK;
+		}
+		/* Collect the matching records */
+		unqliteCollectionFetchByField(pCol,&sField,argv[2],pArray);
+		/* Finally, return our array */
+		jx9_result_value(pCtx,pArray);
+	}else{
+		/* No such collection, return null */
+		jx9_result_null(pCtx);
+	}
+	return JX9_OK;
+}
 /*
  * bool db_set_schema(string $col_name, object $json_object)
  *   Set a schema for a given collection.
@@ -1015,6 +1236,10 @@ UNQLITE_PRIVATE int unqliteRegisterJx9Functions(unqlite_vm *pVm)
 		{ "db_update_record",  unqliteBuiltin_db_update_record  },
 		{ "db_set_schema",     unqliteBuiltin_db_set_schema     },
 		{ "db_get_schema",     unqliteBuiltin_db_get_schema     },
+		{ "db_create_index",   unqliteBuiltin_db_create_index   },
+		{ "db_drop_index",     unqliteBuiltin_db_drop_index     },
+		{ "db_fetch_by_field", unqliteBuiltin_db_fetch_by_field },
+		{ "db_get_by_field",   unqliteBuiltin_db_fetch_by_field },
 		{ "db_begin",          unqliteBuiltin_db_begin          },
 		{ "db_commit",         unqliteBuiltin_db_commit         },
 		{ "db_rollback",       unqliteBuiltin_db_rollback       },
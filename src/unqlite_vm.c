@@ -47,6 +47,57 @@ static unqlite_col_record * CollectionCacheFetchRecord(
 	/* No such record */
 	return 0;
 }
+/*
+ * Link a record at the head (Most recently used end) of the LRU list.
+ */
+static void CollectionCacheLinkRecord(unqlite_col *pCol,unqlite_col_record *pRecord)
+{
+	pRecord->pNext = pRecord->pPrev = 0;
+	MACRO_LD_PUSH(pCol->pList,pRecord);
+	if( pCol->pTail == 0 ){
+		pCol->pTail = pRecord;
+	}
+}
+/*
+ * Unlink a record from the LRU list.
+ */
+static void CollectionCacheUnlinkRecord(unqlite_col *pCol,unqlite_col_record *pRecord)
+{
+	if( pCol->pTail == pRecord ){
+		pCol->pTail = pRecord->pPrev;
+	}
+	MACRO_LD_REMOVE(pCol->pList,pRecord);
+	pRecord->pNext = pRecord->pPrev = 0;
+}
+/*
+ * Remove a record from the hashtable and the LRU list and release it.
+ */
+static void CollectionCacheDiscardRecord(unqlite_col *pCol,unqlite_col_record *pRecord)
+{
+	if( pRecord->pPrevCol ){
+		pRecord->pPrevCol->pNextCol = pRecord->pNextCol;
+	}else{
+		sxu32 iBucket = COL_RECORD_HASH(pRecord->nId) & (pCol->nRecSize - 1);
+		pCol->apRecord[iBucket] = pRecord->pNextCol;
+	}
+	if( pRecord->pNextCol ){
+		pRecord->pNextCol->pPrevCol = pRecord->pPrevCol;
+	}
+	CollectionCacheUnlinkRecord(pCol,pRecord);
+	pCol->nRec--;
+	jx9MemObjRelease(&pRecord->sValue);
+	SyMemBackendPoolFree(&pCol->pVm->sAlloc,(void *)pRecord);
+}
+/*
+ * Evict least recently used records until at most nMax are left.
+ */
+static void CollectionCacheTrim(unqlite_col *pCol,sxu32 nMax)
+{
+	while( pCol->nRec > nMax && pCol->pTail ){
+		CollectionCacheDiscardRecord(pCol,pCol->pTail);
+		pCol->pVm->nRecEvict++;
+	}
+}
 /*
  * Install a freshly created record in a given collection. 
  */
@@ -57,14 +108,23 @@ static int CollectionCacheInstallRecord(
 	)
 {
 	unqlite_col_record *pRecord;
+	sxu32 nMax = pCol->pVm->nMaxRecord;
 	sxu32 iBucket;
 	/* Fetch the record first */
 	pRecord = CollectionCacheFetchRecord(pCol,nId);
 	if( pRecord ){
 		/* Record already installed, overwrite its old value  */
 		jx9MemObjStore(pValue,&pRecord->sValue);
+		CollectionCacheUnlinkRecord(pCol,pRecord);
+		CollectionCacheLinkRecord(pCol,pRecord);
+		return UNQLITE_OK;
+	}
+	if( nMax < 1 ){
+		/* Record cache disabled */
 		return UNQLITE_OK;
 	}
+	/* Make room for the new record */
+	CollectionCacheTrim(pCol,nMax - 1);
 	/* Allocate a new instance */
 	pRecord = (unqlite_col_record *)SyMemBackendPoolAlloc(&pCol->pVm->sAlloc,sizeof(unqlite_col_record));
 	if( pRecord == 0 ){
@@ -85,7 +145,7 @@ static int CollectionCacheInstallRecord(
 	}
 	pCol->apRecord[iBucket] = pRecord;
 	/* Link */
-	MACRO_LD_PUSH(pCol->pList,pRecord);
+	CollectionCacheLinkRecord(pCol,pRecord);
 	pCol->nRec++;
 	if( (pCol->nRec >= pCol->nRecSize * 3) && pCol->nRec < 100000 ){
 		/* Allocate a new larger table */
@@ -142,20 +202,21 @@ UNQLITE_PRIVATE int unqliteCollectionCacheRemoveRecord(
 		/* No such record */
 		return UNQLITE_NOTFOUND;
 	}
-	if( pRecord->pPrevCol ){
-		pRecord->pPrevCol->pNextCol = pRecord->pNextCol;
-	}else{
-		sxu32 iBucket = COL_RECORD_HASH(nId) & (pCol->nRecSize - 1);
-		pCol->apRecord[iBucket] = pRecord->pNextCol;
-	}
-	if( pRecord->pNextCol ){
-		pRecord->pNextCol->pPrevCol = pRecord->pPrevCol;
-	}
-	/* Unlink */
-	MACRO_LD_REMOVE(pCol->pList,pRecord);
-	pCol->nRec--;
+	CollectionCacheDiscardRecord(pCol,pRecord);
 	return UNQLITE_OK;
 }
+/*
+ * Apply the record cache limit of a VM to its loaded collections.
+ */
+UNQLITE_PRIVATE void unqliteVmTrimRecordCache(unqlite_vm *pVm)
+{
+	unqlite_col *pCol = pVm->pCol;
+	sxu32 n;
+	for( n = 0 ; n < pVm->iCol && pCol ; ++n ){
+		CollectionCacheTrim(pCol,pVm->nMaxRecord);
+		pCol = pCol->pNext;
+	}
+}
 /*
  * Discard a collection and its records.
  */
@@ -174,7 +235,7 @@ static int CollectionCacheRelease(unqlite_col *pCol)
 	}
 	SyMemBackendFree(&pVm->sAlloc,(void *)pCol->apRecord);
 	pCol->nRec = pCol->nRecSize = 0;
-	pCol->pList = 0;
+	pCol->pList = pCol->pTail = 0;
 	return UNQLITE_OK;
 }
 /*
@@ -415,6 +476,71 @@ static int CollectionLoadHeader(unqlite_col *pCol)
 	}
 	return UNQLITE_OK;
 }
+/*
+ * Secondary indexes.
+ * An index maps the values of a top level field of the collection records
+ * to the IDs of the records holding them. Each distinct value is stored in
+ * the underlying KV store under the key <collection>\1<field>\1<value> and
+ * its data is the list of matching record IDs (8 bytes big-endian each).
+ * The names of the indexed fields are stored under the key <collection>\1idx.
+ */
+/*
+ * Read the data of the index key held in the first nKeyLen bytes of pBuf.
+ * On success, the data is appended to the key and the collection cursor
+ * is left pointing to the entry.
+ */
+static int CollectionIndexRead(unqlite_col *pCol,SyBlob *pBuf,sxu32 nKeyLen)
+{
+	int rc;
+	/* Reset the cursor */
+	unqlite_kv_cursor_reset(pCol->pCursor);
+	/* Seek the cursor to the desired location */
+	rc = unqlite_kv_cursor_seek(pCol->pCursor,SyBlobData(pBuf),(int)nKeyLen,UNQLITE_CURSOR_MATCH_EXACT);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	rc = unqlite_kv_cursor_data_callback(pCol->pCursor,unqliteDataConsumer,pBuf);
+	return rc;
+}
+/*
+ * Load the names of the indexed fields of a given collection.
+ */
+static int CollectionIndexLoad(unqlite_col *pCol)
+{
+	SyBlob *pIndex = &pCol->sIndex;
+	unsigned char *zRaw,*zEnd;
+	SyString sField;
+	sxu32 nKeyLen;
+	sxu32 nLen;
+	char *zDup;
+	int rc;
+	SyBlobReset(pIndex);
+	SyBlobFormat(pIndex,"%z\1idx",&pCol->sName);
+	nKeyLen = SyBlobLength(pIndex);
+	rc = CollectionIndexRead(pCol,pIndex,nKeyLen);
+	if( rc != UNQLITE_OK ){
+		/* No index defined on this collection */
+		return UNQLITE_OK;
+	}
+	zRaw = (unsigned char *)SyBlobDataAt(pIndex,nKeyLen);
+	zEnd = &zRaw[SyBlobLength(pIndex) - nKeyLen];
+	while( zEnd - zRaw >= 4 ){
+		/* Field name length (4 bytes big-endian) followed by the name */
+		SyBigEndianUnpack32(zRaw,&nLen);
+		zRaw += 4;
+		if( nLen > (sxu32)(zEnd - zRaw) ){
+			return UNQLITE_CORRUPT;
+		}
+		zDup = SyMemBackendStrDup(&pCol->pVm->sAlloc,(const char *)zRaw,nLen);
+		if( zDup == 0 ){
+			return UNQLITE_NOMEM;
+		}
+		SyStringInitFromBuf(&sField,zDup,nLen);
+		SySetPut(&pCol->aIndex,(const void *)&sField);
+		zRaw += nLen;
+	}
+	return UNQLITE_OK;
+}
 /*
  * Load or create a binary collection.
  */
@@ -465,6 +591,8 @@ static int unqliteVmLoadCollection(
 	/* Fill in the structure */
 	SyBlobInit(&pCol->sWorker,&pVm->sAlloc);
 	SyBlobInit(&pCol->sHeader,&pVm->sAlloc);
+	SyBlobInit(&pCol->sIndex,&pVm->sAlloc);
+	SySetInit(&pCol->aIndex,&pVm->sAlloc,sizeof(SyString));
 	pCol->pVm = pVm;
 	pCol->pCursor = pCursor;
 	/* Duplicate collection name */
@@ -509,6 +637,12 @@ static int unqliteVmLoadCollection(
 			unqliteGenErrorFormat(pDb,"Corrupt collection '%z' header",&pCol->sName);
 			goto fail;
 		}
+		/* Load the index definitions */
+		rc = CollectionIndexLoad(pCol);
+		if( rc != UNQLITE_OK ){
+			unqliteGenErrorFormat(pDb,"Corrupt collection '%z' index list",&pCol->sName);
+			goto fail;
+		}
 	}
 	/* Finally install the collection */
 	unqliteVmInstallCollection(pVm,pCol);
@@ -528,6 +662,8 @@ fail:
 		}
 		SyBlobRelease(&pCol->sHeader);
 		SyBlobRelease(&pCol->sWorker);
+		SyBlobRelease(&pCol->sIndex);
+		SySetRelease(&pCol->aIndex);
 		jx9MemObjRelease(&pCol->sSchema);
 		SyMemBackendPoolFree(&pVm->sAlloc,pCol);
 	}
@@ -587,25 +723,12 @@ UNQLITE_PRIVATE void unqliteCollectionResetRecordCursor(unqlite_col *pCol)
 	pCol->nCurid = 0;
 }
 /*
- * Fetch a record by its unique ID.
+ * Load the raw binary JSON of a record in the collection working buffer.
  */
-UNQLITE_PRIVATE int unqliteCollectionFetchRecordById(
-	unqlite_col *pCol, /* Target collection */
-	jx9_int64 nId,     /* Unique record ID */
-	jx9_value *pValue  /* OUT: record value */
-	)
+static int CollectionLoadRawRecord(unqlite_col *pCol,jx9_int64 nId)
 {
 	SyBlob *pWorker = &pCol->sWorker;
-	unqlite_col_record *pRec;
 	int rc;
-	jx9_value_null(pValue);
-	/* Perform a cache lookup first */
-	pRec = CollectionCacheFetchRecord(pCol,nId);
-	if( pRec ){
-		/* Copy record value */
-		jx9MemObjStore(&pRec->sValue,pValue);
-		return UNQLITE_OK;
-	}
 	/* Reset the working buffer */
 	SyBlobReset(pWorker);
 	/* Generate the unique ID */
@@ -623,6 +746,55 @@ UNQLITE_PRIVATE int unqliteCollectionFetchRecordById(
 	/* Consume the binary JSON */
 	SyBlobReset(pWorker);
 	unqlite_kv_cursor_data_callback(pCol->pCursor,unqliteDataConsumer,pWorker);
+	return UNQLITE_OK;
+}
+/*
+ * Decode a record as stored, bypassing the cache. The cached value share its
+ * hashmap with the values handed to the scripts which may have changed it
+ * since, so the index maintenance must work on the stored image.
+ */
+static int CollectionFetchStoredRecord(unqlite_col *pCol,jx9_int64 nId,jx9_value *pValue)
+{
+	SyBlob *pWorker = &pCol->sWorker;
+	int rc;
+	jx9_value_null(pValue);
+	rc = CollectionLoadRawRecord(pCol,nId);
+	if( rc != UNQLITE_OK || SyBlobLength(pWorker) < 1 ){
+		return rc;
+	}
+	/* Decode the binary JSON */
+	rc = FastJsonDecode(SyBlobData(pWorker),SyBlobLength(pWorker),pValue,0,0);
+	return rc;
+}
+/*
+ * Fetch a record by its unique ID and install it in the cache if iCache is true.
+ */
+static int CollectionFetchRecord(
+	unqlite_col *pCol, /* Target collection */
+	jx9_int64 nId,     /* Unique record ID */
+	jx9_value *pValue, /* OUT: record value */
+	int iCache         /* True to install the record in the cache */
+	)
+{
+	SyBlob *pWorker = &pCol->sWorker;
+	unqlite_col_record *pRec;
+	int rc;
+	jx9_value_null(pValue);
+	/* Perform a cache lookup first */
+	pRec = CollectionCacheFetchRecord(pCol,nId);
+	if( pRec ){
+		/* Copy record value and mark it as the most recently used */
+		jx9MemObjStore(&pRec->sValue,pValue);
+		CollectionCacheUnlinkRecord(pCol,pRec);
+		CollectionCacheLinkRecord(pCol,pRec);
+		pCol->pVm->nRecHit++;
+		return UNQLITE_OK;
+	}
+	pCol->pVm->nRecMiss++;
+	rc = CollectionLoadRawRecord(pCol,nId);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
 	if( SyBlobLength(pWorker) < 1 ){
 		unqliteGenErrorFormat(pCol->pVm->pDb,
 			"Empty record '%qd'",nId
@@ -631,13 +803,26 @@ UNQLITE_PRIVATE int unqliteCollectionFetchRecordById(
 	}else{
 		/* Decode the binary JSON */
 		rc = FastJsonDecode(SyBlobData(pWorker),SyBlobLength(pWorker),pValue,0,0);
-		if( rc == UNQLITE_OK ){
+		if( rc == UNQLITE_OK && iCache ){
 			/* Install the record in the cache */
 			CollectionCacheInstallRecord(pCol,nId,pValue);
 		}
 	}
 	return rc;
 }
+/*
+ * Fetch a record by its unique ID.
+ */
+UNQLITE_PRIVATE int unqliteCollectionFetchRecordById(
+	unqlite_col *pCol, /* Target collection */
+	jx9_int64 nId,     /* Unique record ID */
+	jx9_value *pValue  /* OUT: record value */
+	)
+{
+	int rc;
+	rc = CollectionFetchRecord(pCol,nId,pValue,1);
+	return rc;
+}
 /*
  * Fetch the next record from a given collection.
  */ 
@@ -661,6 +846,282 @@ UNQLITE_PRIVATE int unqliteCollectionFetchNextRecord(unqlite_col *pCol,jx9_value
 	}
 	return rc;
 }
+/*
+ * Translate a filter operator to its UNQLITE_FILTER_* code.
+ * Return 0 on unknown operator.
+ */
+static sxi32 CollectionFilterOp(const char *zOp,int nLen)
+{
+	static const struct {
+		const char *zOp;
+		sxi32 iOp;
+	} aOp[] = {
+		{ "==", UNQLITE_FILTER_EQ },
+		{ "=",  UNQLITE_FILTER_EQ },
+		{ "!=", UNQLITE_FILTER_NE },
+		{ "<>", UNQLITE_FILTER_NE },
+		{ "<",  UNQLITE_FILTER_LT },
+		{ "<=", UNQLITE_FILTER_LE },
+		{ ">",  UNQLITE_FILTER_GT },
+		{ ">=", UNQLITE_FILTER_GE }
+	};
+	sxu32 n;
+	for( n = 0 ; n < SX_ARRAYSIZE(aOp) ; ++n ){
+		if( (int)SyStrlen(aOp[n].zOp) == nLen && SyMemcmp(aOp[n].zOp,zOp,(sxu32)nLen) == 0 ){
+			return aOp[n].iOp;
+		}
+	}
+	return 0;
+}
+/*
+ * Compile a single filter term of the form {field: 'name', op: '>', value: 30}.
+ * A missing 'op' defaults to '=='. The field name and the value are copied since
+ * the term entries may be relocated by the VM while the filter is evaluated.
+ */
+static int CollectionFilterAddTerm(jx9_value *pTerm,SySet *pTerms)
+{
+	unqlite_col_filter sTerm;
+	jx9_value *pField,*pOp,*pValue;
+	const char *zOp = "==";
+	int nLen = (int)sizeof("==")-1;
+	if( !jx9_value_is_json_object(pTerm) ){
+		return UNQLITE_INVALID;
+	}
+	pField = jx9_array_fetch(pTerm,"field",-1);
+	if( pField == 0 || !jx9_value_is_string(pField) ){
+		return UNQLITE_INVALID;
+	}
+	pOp = jx9_array_fetch(pTerm,"op",-1);
+	if( pOp ){
+		if( !jx9_value_is_string(pOp) ){
+			return UNQLITE_INVALID;
+		}
+		zOp = jx9_value_to_string(pOp,&nLen);
+	}
+	sTerm.iOp = CollectionFilterOp(zOp,nLen);
+	if( sTerm.iOp == 0 ){
+		return UNQLITE_INVALID;
+	}
+	jx9MemObjInit(pTerm->pVm,&sTerm.sName);
+	jx9MemObjInit(pTerm->pVm,&sTerm.sValue);
+	jx9MemObjStore(pField,&sTerm.sName);
+	pValue = jx9_array_fetch(pTerm,"value",-1);
+	if( pValue ){
+		jx9MemObjStore(pValue,&sTerm.sValue);
+	}
+	/* The field name blob is owned by the set entry from now on */
+	SyStringInitFromBuf(&sTerm.sField,SyBlobData(&sTerm.sName.sBlob),SyBlobLength(&sTerm.sName.sBlob));
+	if( SySetPut(pTerms,(const void *)&sTerm) != SXRET_OK ){
+		jx9MemObjRelease(&sTerm.sName);
+		jx9MemObjRelease(&sTerm.sValue);
+		return UNQLITE_NOMEM;
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Compile a declarative record filter into pTerms (unqlite_col_filter instances).
+ * The filter is either a single term {field: 'name', op: '>', value: 30} or a JSON
+ * array of such terms which must all match. Compiled terms are released using
+ * unqliteCollectionFilterRelease().
+ */
+UNQLITE_PRIVATE int unqliteCollectionFilterInit(jx9_value *pFilter,SySet *pTerms)
+{
+	jx9_hashmap_node *pNode;
+	jx9_hashmap *pMap;
+	int rc;
+	if( jx9_value_is_json_object(pFilter) ){
+		return CollectionFilterAddTerm(pFilter,pTerms);
+	}
+	if( !jx9_value_is_json_array(pFilter) ){
+		return UNQLITE_INVALID;
+	}
+	pMap = (jx9_hashmap *)pFilter->x.pOther;
+	jx9HashmapResetLoopCursor(pMap);
+	while( (pNode = jx9HashmapGetNextEntry(pMap)) != 0 ){
+		rc = CollectionFilterAddTerm(jx9HashmapGetNodeValue(pNode),pTerms);
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Release a compiled filter.
+ */
+UNQLITE_PRIVATE void unqliteCollectionFilterRelease(SySet *pTerms)
+{
+	unqlite_col_filter *aTerm = (unqlite_col_filter *)SySetBasePtr(pTerms);
+	sxu32 n;
+	for( n = 0 ; n < SySetUsed(pTerms) ; ++n ){
+		jx9MemObjRelease(&aTerm[n].sName);
+		jx9MemObjRelease(&aTerm[n].sValue);
+	}
+	SySetRelease(pTerms);
+}
+/*
+ * Collect the projected field names of a JSON array of strings into pFields
+ * (SyString instances pointing into pList). The special __id field is always
+ * part of the projection.
+ */
+UNQLITE_PRIVATE int unqliteCollectionFieldsInit(jx9_value *pList,SySet *pFields)
+{
+	jx9_hashmap_node *pNode;
+	jx9_hashmap *pMap;
+	jx9_value *pEntry;
+	SyString sField;
+	if( !jx9_value_is_json_array(pList) ){
+		return UNQLITE_INVALID;
+	}
+	SyStringInitFromBuf(&sField,"__id",sizeof("__id")-1);
+	SySetPut(pFields,(const void *)&sField);
+	pMap = (jx9_hashmap *)pList->x.pOther;
+	jx9HashmapResetLoopCursor(pMap);
+	while( (pNode = jx9HashmapGetNextEntry(pMap)) != 0 ){
+		pEntry = jx9HashmapGetNodeValue(pNode);
+		if( !jx9_value_is_string(pEntry) ){
+			return UNQLITE_INVALID;
+		}
+		SyStringInitFromBuf(&sField,SyBlobData(&pEntry->sBlob),SyBlobLength(&pEntry->sBlob));
+		if( SySetPut(pFields,(const void *)&sField) != SXRET_OK ){
+			return UNQLITE_NOMEM;
+		}
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Copy the projected fields (Refer to unqliteCollectionFieldsInit()) of an
+ * already decoded record to pOut.
+ */
+UNQLITE_PRIVATE int unqliteCollectionProjectRecord(SySet *pFields,jx9_value *pRecord,jx9_value *pOut)
+{
+	SyString *aField = (SyString *)SySetBasePtr(pFields);
+	jx9_hashmap_node *pNode;
+	jx9_hashmap *pMap,*pSrc;
+	jx9_value sKey,sVal;
+	const char *zKey;
+	int nKey;
+	sxu32 n;
+	int rc = UNQLITE_OK;
+	if( !jx9_value_is_json_object(pRecord) ){
+		jx9MemObjStore(pRecord,pOut);
+		return UNQLITE_OK;
+	}
+	pMap = (jx9_hashmap *)jx9NewHashmap(pRecord->pVm,0,0);
+	if( pMap == 0 ){
+		return UNQLITE_NOMEM;
+	}
+	pMap->iFlags |= HASHMAP_JSON_OBJECT;
+	jx9MemObjInit(pRecord->pVm,&sKey);
+	jx9MemObjInit(pRecord->pVm,&sVal);
+	pSrc = (jx9_hashmap *)pRecord->x.pOther;
+	jx9HashmapResetLoopCursor(pSrc);
+	/* Keep the record order */
+	while( (pNode = jx9HashmapGetNextEntry(pSrc)) != 0 ){
+		jx9HashmapExtractNodeKey(pNode,&sKey);
+		zKey = jx9_value_to_string(&sKey,&nKey);
+		for( n = 0 ; n < SySetUsed(pFields) ; ++n ){
+			if( aField[n].nByte == (sxu32)nKey && SyMemcmp(aField[n].zString,zKey,(sxu32)nKey) == 0 ){
+				break;
+			}
+		}
+		if( n >= SySetUsed(pFields) ){
+			continue;
+		}
+		jx9MemObjStore(jx9HashmapGetNodeValue(pNode),&sVal);
+		rc = jx9HashmapInsert(pMap,&sKey,&sVal);
+		if( rc != UNQLITE_OK ){
+			break;
+		}
+	}
+	jx9MemObjRelease(&sKey);
+	jx9MemObjRelease(&sVal);
+	jx9MemObjRelease(pOut);
+	MemObjSetType(pOut,MEMOBJ_HASHMAP);
+	pOut->x.pOther = pMap;
+	return rc;
+}
+/*
+ * Evaluate a compiled filter on the binary JSON of a record.
+ * A record lacking a filtered field or holding a value not comparable
+ * with the filter value never matches except for the '!=' operator in
+ * the latter case.
+ */
+static int CollectionFilterMatch(SySet *pTerms,const void *pData,sxu32 nByte)
+{
+	const unsigned char *zEnd = &((const unsigned char *)pData)[nByte];
+	unqlite_col_filter *aTerm = (unqlite_col_filter *)SySetBasePtr(pTerms);
+	const unsigned char *zValue;
+	sxi32 iRes;
+	sxu32 n;
+	int rc;
+	for( n = 0 ; n < SySetUsed(pTerms) ; ++n ){
+		rc = FastJsonFetchField(pData,nByte,&aTerm[n].sField,&zValue);
+		if( rc != SXRET_OK ){
+			return 0;
+		}
+		rc = FastJsonCompare(zValue,zEnd,&aTerm[n].sValue,&iRes);
+		if( rc != SXRET_OK ){
+			if( rc == SXERR_INVALID && aTerm[n].iOp == UNQLITE_FILTER_NE ){
+				continue;
+			}
+			return 0;
+		}
+		switch(aTerm[n].iOp){
+		case UNQLITE_FILTER_EQ: rc = iRes == 0; break;
+		case UNQLITE_FILTER_NE: rc = iRes != 0; break;
+		case UNQLITE_FILTER_LT: rc = iRes <  0; break;
+		case UNQLITE_FILTER_LE: rc = iRes <= 0; break;
+		case UNQLITE_FILTER_GT: rc = iRes >  0; break;
+		case UNQLITE_FILTER_GE: rc = iRes >= 0; break;
+		default:                rc = 0;         break;
+		}
+		if( !rc ){
+			return 0;
+		}
+	}
+	return 1;
+}
+/*
+ * Fetch the next record of a given collection matching a compiled filter.
+ * The filter is evaluated on the raw binary JSON so that only matching records
+ * get decoded. If pFields (SyString instances) is not empty, only these top level
+ * fields (plus __id) are decoded. Matching records are not installed in the cache.
+ */
+UNQLITE_PRIVATE int unqliteCollectionFetchNextMatch(unqlite_col *pCol,SySet *pTerms,SySet *pFields,jx9_value *pValue)
+{
+	SyBlob *pWorker = &pCol->sWorker;
+	int rc;
+	for(;;){
+		if( pCol->nCurid >= pCol->nLastid ){
+			/* No more records, reset the record cursor ID */
+			pCol->nCurid = 0;
+			/* Return to the caller */
+			return SXERR_EOF;
+		}
+		rc = CollectionLoadRawRecord(pCol,pCol->nCurid);
+		/* Increment the record ID */
+		pCol->nCurid++;
+		if( rc == UNQLITE_NOTFOUND ){
+			continue;
+		}
+		if( rc != UNQLITE_OK ){
+			return rc;
+		}
+		if( SyBlobLength(pWorker) < 1 ||
+			(pTerms && !CollectionFilterMatch(pTerms,SyBlobData(pWorker),SyBlobLength(pWorker))) ){
+			continue;
+		}
+		/* Decode the matching record */
+		jx9_value_null(pValue);
+		if( pFields && SySetUsed(pFields) > 0 ){
+			rc = FastJsonDecodeFields(SyBlobData(pWorker),SyBlobLength(pWorker),
+				(SyString *)SySetBasePtr(pFields),SySetUsed(pFields),pValue);
+		}else{
+			rc = FastJsonDecode(SyBlobData(pWorker),SyBlobLength(pWorker),pValue,0,0);
+		}
+		return rc;
+	}
+}
 /*
  * Judge a collection whether exists
  */
@@ -712,6 +1173,413 @@ UNQLITE_PRIVATE int unqliteCollectionSetSchema(unqlite_col *pCol,jx9_value *pVal
 	rc = CollectionSetHeader(0,pCol,-1,-1,pValue);
 	return rc;
 }
+/*
+ * Encode a field value so that it can be used as part of an index key.
+ * Only scalar values are indexed. Integral reals share the key of the
+ * equivalent integer.
+ */
+static int CollectionIndexEncodeValue(jx9_value *pValue,SyBlob *pOut)
+{
+	if( jx9_value_is_string(pValue) ){
+		const char *zValue;
+		int nByte;
+		zValue = jx9_value_to_string(pValue,&nByte);
+		SyBlobAppend(pOut,"s",sizeof(char));
+		return SyBlobAppend(pOut,(const void *)zValue,(sxu32)nByte);
+	}else if( jx9_value_is_float(pValue) ){
+		double rValue = jx9_value_to_double(pValue);
+		sxu64 iBits;
+		if( rValue >= -9.2e18 && rValue <= 9.2e18 && (double)(jx9_int64)rValue == rValue ){
+			SyBlobAppend(pOut,"i",sizeof(char));
+			return SyBlobAppendBig64(pOut,(sxu64)(jx9_int64)rValue);
+		}
+		SyMemcpy((const void *)&rValue,(void *)&iBits,sizeof(sxu64));
+		SyBlobAppend(pOut,"r",sizeof(char));
+		return SyBlobAppendBig64(pOut,iBits);
+	}else if( jx9_value_is_int(pValue) ){
+		SyBlobAppend(pOut,"i",sizeof(char));
+		return SyBlobAppendBig64(pOut,(sxu64)jx9_value_to_int64(pValue));
+	}else if( jx9_value_is_bool(pValue) ){
+		return SyBlobAppend(pOut,jx9_value_to_bool(pValue) ? "b1" : "b0",2);
+	}else if( jx9_value_is_null(pValue) ){
+		return SyBlobAppend(pOut,"n",sizeof(char));
+	}
+	/* Arrays, objects and resources are not indexed */
+	return UNQLITE_INVALID;
+}
+/*
+ * Build the index key of a given field value.
+ */
+static int CollectionIndexValueKey(unqlite_col *pCol,SyString *pField,jx9_value *pValue,SyBlob *pOut)
+{
+	int rc;
+	SyBlobReset(pOut);
+	SyBlobFormat(pOut,"%z\1%z\1",&pCol->sName,pField);
+	rc = CollectionIndexEncodeValue(pValue,pOut);
+	return rc;
+}
+/*
+ * Build the index key of a given record.
+ */
+static int CollectionIndexKey(unqlite_col *pCol,SyString *pField,jx9_value *pRecord,SyBlob *pOut)
+{
+	jx9_value *pValue;
+	if( !jx9_value_is_json_object(pRecord) ){
+		return UNQLITE_NOTFOUND;
+	}
+	pValue = jx9_array_fetch(pRecord,pField->zString,(int)pField->nByte);
+	if( pValue == 0 ){
+		/* Field not present in this record */
+		return UNQLITE_NOTFOUND;
+	}
+	return CollectionIndexValueKey(pCol,pField,pValue,pOut);
+}
+/*
+ * Add a record ID to the index entry of its field value.
+ */
+static int CollectionIndexInsert(unqlite_col *pCol,SyString *pField,jx9_int64 nId,jx9_value *pRecord)
+{
+	SyBlob *pIndex = &pCol->sIndex;
+	unqlite_kv_methods *pMethods;
+	unqlite_kv_engine *pEngine;
+	unsigned char zId[8];
+	sxu32 nKeyLen;
+	int rc;
+	rc = CollectionIndexKey(pCol,pField,pRecord,pIndex);
+	if( rc != UNQLITE_OK ){
+		/* Nothing to index */
+		return UNQLITE_OK;
+	}
+	/* Point to the underlying KV store */
+	pEngine = unqlitePagerGetKvEngine(pCol->pVm->pDb);
+	pMethods = pEngine->pIo->pMethods;
+	nKeyLen = SyBlobLength(pIndex);
+	SyBigEndianPack64(zId,(sxu64)nId);
+	if( pMethods->xAppend ){
+		rc = pMethods->xAppend(pEngine,SyBlobData(pIndex),(int)nKeyLen,(const void *)zId,sizeof(zId));
+		return rc;
+	}
+	/* Read, modify and write back the list of IDs */
+	CollectionIndexRead(pCol,pIndex,nKeyLen);
+	SyBlobAppend(pIndex,(const void *)zId,sizeof(zId));
+	rc = pMethods->xReplace(pEngine,
+		SyBlobData(pIndex),(int)nKeyLen,
+		SyBlobDataAt(pIndex,nKeyLen),(unqlite_int64)(SyBlobLength(pIndex) - nKeyLen)
+		);
+	return rc;
+}
+/*
+ * Remove a record ID from the index entry of its field value.
+ */
+static int CollectionIndexRemove(unqlite_col *pCol,SyString *pField,jx9_int64 nId,jx9_value *pRecord)
+{
+	SyBlob *pIndex = &pCol->sIndex;
+	unsigned char *zIds,*zEnd,*zPtr;
+	unqlite_kv_engine *pEngine;
+	sxu32 nKeyLen;
+	sxu64 iId;
+	int rc;
+	rc = CollectionIndexKey(pCol,pField,pRecord,pIndex);
+	if( rc != UNQLITE_OK ){
+		/* Not indexed */
+		return UNQLITE_OK;
+	}
+	nKeyLen = SyBlobLength(pIndex);
+	rc = CollectionIndexRead(pCol,pIndex,nKeyLen);
+	if( rc != UNQLITE_OK ){
+		return rc == UNQLITE_NOTFOUND ? UNQLITE_OK : rc;
+	}
+	zIds = (unsigned char *)SyBlobDataAt(pIndex,nKeyLen);
+	zEnd = &zIds[(SyBlobLength(pIndex) - nKeyLen) & ~7];
+	for( zPtr = zIds ; zPtr < zEnd ; zPtr += 8 ){
+		SyBigEndianUnpack64(zPtr,&iId);
+		if( (jx9_int64)iId == nId ){
+			break;
+		}
+	}
+	if( zPtr >= zEnd ){
+		/* Not in the list */
+		return UNQLITE_OK;
+	}
+	if( zEnd - zIds <= 8 ){
+		/* Last record holding this value, drop the entry */
+		rc = unqlite_kv_cursor_delete_entry(pCol->pCursor);
+		return rc;
+	}
+	/* Shift the remaining IDs so that the list stays in insertion order */
+	for( ; &zPtr[8] < zEnd ; zPtr += 8 ){
+		SyMemcpy((const void *)&zPtr[8],(void *)zPtr,8);
+	}
+	pEngine = unqlitePagerGetKvEngine(pCol->pVm->pDb);
+	rc = pEngine->pIo->pMethods->xReplace(pEngine,
+		SyBlobData(pIndex),(int)nKeyLen,
+		(const void *)zIds,(unqlite_int64)(zEnd - zIds - 8)
+		);
+	return rc;
+}
+/*
+ * Reflect a record change in the collection indexes. pOld is the previous
+ * content of the record (NULL for a new record) and pNew its new content
+ * (NULL when the record is dropped).
+ */
+static int CollectionIndexUpdate(unqlite_col *pCol,jx9_int64 nId,jx9_value *pOld,jx9_value *pNew)
+{
+	SyString *aField = (SyString *)SySetBasePtr(&pCol->aIndex);
+	SyBlob *pWorker = &pCol->sWorker;
+	sxu32 n;
+	int rc;
+	for( n = 0 ; n < SySetUsed(&pCol->aIndex) ; ++n ){
+		if( pOld && pNew ){
+			/* Nothing to do when the indexed value did not change */
+			int iOld = CollectionIndexKey(pCol,&aField[n],pOld,pWorker);
+			int iNew = CollectionIndexKey(pCol,&aField[n],pNew,&pCol->sIndex);
+			if( iOld == iNew && (iOld != UNQLITE_OK || (SyBlobLength(pWorker) == SyBlobLength(&pCol->sIndex) &&
+				SyMemcmp(SyBlobData(pWorker),SyBlobData(&pCol->sIndex),SyBlobLength(pWorker)) == 0)) ){
+				continue;
+			}
+		}
+		if( pOld ){
+			rc = CollectionIndexRemove(pCol,&aField[n],nId,pOld);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+		}
+		if( pNew ){
+			rc = CollectionIndexInsert(pCol,&aField[n],nId,pNew);
+			if( rc != UNQLITE_OK ){
+				return rc;
+			}
+		}
+	}
+	return UNQLITE_OK;
+}
+/*
+ * Write the names of the indexed fields of a given collection.
+ */
+static int CollectionIndexSave(unqlite_col *pCol)
+{
+	SyString *aField = (SyString *)SySetBasePtr(&pCol->aIndex);
+	SyBlob *pIndex = &pCol->sIndex;
+	unqlite_kv_engine *pEngine;
+	sxu32 nKeyLen;
+	sxu32 n;
+	int rc;
+	SyBlobReset(pIndex);
+	SyBlobFormat(pIndex,"%z\1idx",&pCol->sName);
+	nKeyLen = SyBlobLength(pIndex);
+	if( SySetUsed(&pCol->aIndex) < 1 ){
+		/* No more indexes, drop the list */
+		unqlite_kv_cursor_reset(pCol->pCursor);
+		rc = unqlite_kv_cursor_seek(pCol->pCursor,SyBlobData(pIndex),(int)nKeyLen,UNQLITE_CURSOR_MATCH_EXACT);
+		if( rc == UNQLITE_OK ){
+			rc = unqlite_kv_cursor_delete_entry(pCol->pCursor);
+		}
+		return rc == UNQLITE_NOTFOUND ? UNQLITE_OK : rc;
+	}
+	for( n = 0 ; n < SySetUsed(&pCol->aIndex) ; ++n ){
+		SyBlobAppendBig32(pIndex,aField[n].nByte);
+		SyBlobAppend(pIndex,(const void *)aField[n].zString,aField[n].nByte);
+	}
+	pEngine = unqlitePagerGetKvEngine(pCol->pVm->pDb);
+	rc = pEngine->pIo->pMethods->xReplace(pEngine,
+		SyBlobData(pIndex),(int)nKeyLen,
+		SyBlobDataAt(pIndex,nKeyLen),(unqlite_int64)(SyBlobLength(pIndex) - nKeyLen)
+		);
+	return rc;
+}
+/*
+ * Return the position of a given field in the list of indexed fields or -1.
+ */
+static sxi32 CollectionIndexFind(unqlite_col *pCol,SyString *pField)
+{
+	SyString *aField = (SyString *)SySetBasePtr(&pCol->aIndex);
+	sxu32 n;
+	for( n = 0 ; n < SySetUsed(&pCol->aIndex) ; ++n ){
+		if( SyStringCmp(pField,&aField[n],SyMemcmp) == 0 ){
+			return (sxi32)n;
+		}
+	}
+	return -1;
+}
+/*
+ * Remove the entries of the indexes [iFirst,iFirst+nField) from the
+ * underlying KV store.
+ */
+static int CollectionIndexPurge(unqlite_col *pCol,sxu32 iFirst,sxu32 nField)
+{
+	SyString *aField = (SyString *)SySetBasePtr(&pCol->aIndex);
+	SyBlob *pIndex = &pCol->sIndex;
+	jx9_value sRecord;
+	jx9_int64 nId;
+	sxu32 n;
+	int rc = UNQLITE_OK;
+	jx9MemObjInit(pCol->pVm->pJx9Vm,&sRecord);
+	for( nId = 0 ; nId < pCol->nLastid ; ++nId ){
+		if( CollectionFetchStoredRecord(pCol,nId,&sRecord) != UNQLITE_OK ){
+			continue;
+		}
+		for( n = iFirst ; n < iFirst + nField ; ++n ){
+			if( CollectionIndexKey(pCol,&aField[n],&sRecord,pIndex) != UNQLITE_OK ){
+				continue;
+			}
+			unqlite_kv_cursor_reset(pCol->pCursor);
+			rc = unqlite_kv_cursor_seek(pCol->pCursor,SyBlobData(pIndex),(int)SyBlobLength(pIndex),UNQLITE_CURSOR_MATCH_EXACT);
+			if( rc == UNQLITE_OK ){
+				/* Entry shared by all the records holding this value */
+				rc = unqlite_kv_cursor_delete_entry(pCol->pCursor);
+			}
+			if( rc != UNQLITE_OK && rc != UNQLITE_NOTFOUND ){
+				jx9MemObjRelease(&sRecord);
+				return rc;
+			}
+		}
+	}
+	jx9MemObjRelease(&sRecord);
+	return UNQLITE_OK;
+}
+/*
+ * Create an index on a top level field of the records of a given collection.
+ * Existing records are indexed right away.
+ */
+UNQLITE_PRIVATE int unqliteCollectionCreateIndex(unqlite_col *pCol,SyString *pField)
+{
+	unqlite_kv_engine *pEngine;
+	jx9_value sRecord;
+	SyString sField;
+	jx9_int64 nId;
+	char *zDup;
+	int rc;
+	if( CollectionIndexFind(pCol,pField) >= 0 ){
+		/* Already indexed */
+		return UNQLITE_OK;
+	}
+	pEngine = unqlitePagerGetKvEngine(pCol->pVm->pDb);
+	if( pEngine->pIo->pMethods->xReplace == 0 ){
+		unqliteGenErrorFormat(pCol->pVm->pDb,
+			"Cannot create index on collection '%z' due to a read-only Key/Value storage engine",
+			&pCol->sName
+			);
+		return UNQLITE_READ_ONLY;
+	}
+	zDup = SyMemBackendStrDup(&pCol->pVm->sAlloc,pField->zString,pField->nByte);
+	if( zDup == 0 ){
+		unqliteGenOutofMem(pCol->pVm->pDb);
+		return UNQLITE_NOMEM;
+	}
+	SyStringInitFromBuf(&sField,zDup,pField->nByte);
+	/* Index the existing records */
+	jx9MemObjInit(pCol->pVm->pJx9Vm,&sRecord);
+	rc = UNQLITE_OK;
+	for( nId = 0 ; nId < pCol->nLastid ; ++nId ){
+		if( CollectionFetchStoredRecord(pCol,nId,&sRecord) != UNQLITE_OK ){
+			/* Dropped record */
+			continue;
+		}
+		rc = CollectionIndexInsert(pCol,&sField,nId,&sRecord);
+		if( rc != UNQLITE_OK ){
+			break;
+		}
+	}
+	jx9MemObjRelease(&sRecord);
+	if( rc == UNQLITE_OK ){
+		rc = SySetPut(&pCol->aIndex,(const void *)&sField);
+		if( rc == UNQLITE_OK ){
+			rc = CollectionIndexSave(pCol);
+		}
+	}
+	if( rc != UNQLITE_OK ){
+		unqliteGenErrorFormat(pCol->pVm->pDb,
+			"IO error while creating index '%z' on collection '%z'",
+			&sField,&pCol->sName
+			);
+	}
+	return rc;
+}
+/*
+ * Drop an index from a given collection.
+ */
+UNQLITE_PRIVATE int unqliteCollectionDropIndex(unqlite_col *pCol,SyString *pField)
+{
+	SyString *aField = (SyString *)SySetBasePtr(&pCol->aIndex);
+	SyString *pLast;
+	sxi32 iIdx;
+	int rc;
+	iIdx = CollectionIndexFind(pCol,pField);
+	if( iIdx < 0 ){
+		/* No such index */
+		return UNQLITE_NOTFOUND;
+	}
+	/* Remove the index entries */
+	rc = CollectionIndexPurge(pCol,(sxu32)iIdx,1);
+	if( rc != UNQLITE_OK ){
+		return rc;
+	}
+	SyMemBackendFree(&pCol->pVm->sAlloc,(void *)aField[iIdx].zString);
+	/* Fill the hole with the last entry */
+	pLast = (SyString *)SySetPop(&pCol->aIndex);
+	if( pLast != &aField[iIdx] ){
+		aField[iIdx] = *pLast;
+	}
+	rc = CollectionIndexSave(pCol);
+	return rc;
+}
+/*
+ * Fetch the records of a given collection whose field pField is equal (same type and value)
+ * to pKey and append them to pArray. An index is used if available, otherwise the whole
+ * collection is scanned.
+ */
+UNQLITE_PRIVATE int unqliteCollectionFetchByField(unqlite_col *pCol,SyString *pField,jx9_value *pKey,jx9_value *pArray)
+{
+	jx9_value sRecord;
+	sxu32 nKeyLen;
+	jx9_int64 nId;
+	SyBlob sKey;
+	int rc;
+	SyBlobInit(&sKey,&pCol->pVm->sAlloc);
+	rc = CollectionIndexValueKey(pCol,pField,pKey,&sKey);
+	if( rc != UNQLITE_OK ){
+		/* Lookup value cannot match an indexed value */
+		SyBlobRelease(&sKey);
+		return UNQLITE_OK;
+	}
+	nKeyLen = SyBlobLength(&sKey);
+	jx9MemObjInit(pCol->pVm->pJx9Vm,&sRecord);
+	if( CollectionIndexFind(pCol,pField) >= 0 ){
+		unsigned char *zIds,*zEnd;
+		sxu32 nOfft;
+		sxu64 iId;
+		/* Index lookup */
+		rc = CollectionIndexRead(pCol,&sKey,nKeyLen);
+		nOfft = nKeyLen;
+		while( rc == UNQLITE_OK && nOfft + 8 <= SyBlobLength(&sKey) ){
+			zIds = (unsigned char *)SyBlobDataAt(&sKey,nOfft);
+			SyBigEndianUnpack64(zIds,&iId);
+			nOfft += 8;
+			if( CollectionFetchRecord(pCol,(jx9_int64)iId,&sRecord,0) != UNQLITE_OK ||
+				CollectionIndexKey(pCol,pField,&sRecord,&pCol->sIndex) != UNQLITE_OK ){
+				continue;
+			}
+			zEnd = (unsigned char *)SyBlobData(&pCol->sIndex);
+			if( SyBlobLength(&pCol->sIndex) == nKeyLen && SyMemcmp(SyBlobData(&sKey),zEnd,nKeyLen) == 0 ){
+				jx9_array_add_elem(pArray,0,&sRecord);
+			}
+		}
+	}else{
+		/* No index, scan the whole collection */
+		for( nId = 0 ; nId < pCol->nLastid ; ++nId ){
+			if( CollectionFetchRecord(pCol,nId,&sRecord,0) != UNQLITE_OK ||
+				CollectionIndexKey(pCol,pField,&sRecord,&pCol->sIndex) != UNQLITE_OK ){
+				continue;
+			}
+			if( SyBlobLength(&pCol->sIndex) == nKeyLen && SyMemcmp(SyBlobData(&sKey),SyBlobData(&pCol->sIndex),nKeyLen) == 0 ){
+				jx9_array_add_elem(pArray,0,&sRecord);
+			}
+		}
+	}
+	jx9MemObjRelease(&sRecord);
+	SyBlobRelease(&sKey);
+	return UNQLITE_OK;
+}
 /*
  * Perform a store operation on a given collection.
  */
@@ -773,6 +1641,10 @@ static int CollectionStore(
 	if( rc == UNQLITE_OK ){
 		/* Save the value in the cache */
 		CollectionCacheInstallRecord(pCol,pCol->nLastid,pValue);
+		/* Index the record */
+		rc = CollectionIndexUpdate(pCol,pCol->nLastid,0,pValue);
+	}
+	if( rc == UNQLITE_OK ){
 		/* Increment the unique __id */
 		pCol->nLastid++;
 		pCol->nTotRec++;
@@ -918,7 +1790,14 @@ UNQLITE_PRIVATE int unqliteCollectionDropRecord(
 	)
 {
 	SyBlob *pWorker = &pCol->sWorker;
+	jx9_value sOld,*pOld = 0;
 	int rc;		
+	if( SySetUsed(&pCol->aIndex) > 0 ){
+		/* Stored content of the record, needed to maintain the indexes */
+		jx9MemObjInit(pCol->pVm->pJx9Vm,&sOld);
+		CollectionFetchStoredRecord(pCol,nId,&sOld);
+		pOld = &sOld;
+	}
 	/* Reset the working buffer */
 	SyBlobReset(pWorker);
 	/* Prepare the unique ID for this record */
@@ -931,6 +1810,9 @@ UNQLITE_PRIVATE int unqliteCollectionDropRecord(
 		UNQLITE_CURSOR_MATCH_EXACT
 		);
 	if( rc != UNQLITE_OK ){
+		if( pOld ){
+			jx9MemObjRelease(pOld);
+		}
 		return rc;
 	}
 	/* Remove the record from the storage engine */
@@ -939,7 +1821,11 @@ UNQLITE_PRIVATE int unqliteCollectionDropRecord(
 	unqliteCollectionCacheRemoveRecord(pCol,nId);
 	if( rc == UNQLITE_OK ){
 		pCol->nTotRec--;
-		if( wr_header ){
+		if( pOld ){
+			/* Remove the record from the indexes */
+			rc = CollectionIndexUpdate(pCol,nId,pOld,0);
+		}
+		if( rc == UNQLITE_OK && wr_header ){
 			/* Relect in the collection header */
 			rc = CollectionSetHeader(0,pCol,-1,pCol->nTotRec,0);
 		}
@@ -951,6 +1837,9 @@ UNQLITE_PRIVATE int unqliteCollectionDropRecord(
 				);
 		}
 	}
+	if( pOld ){
+		jx9MemObjRelease(pOld);
+	}
 	return rc;
 }
 /*
@@ -963,6 +1852,16 @@ UNQLITE_PRIVATE int unqliteCollectionUpdateRecord(unqlite_col *pCol,jx9_int64 nI
         /* Iterate over the array and store its members in the collection */
         rc = jx9_array_walk(pValue,CollectionRecordArrayWalker,pCol);
         SXUNUSED(iFlag); /* cc warning */
+    }else if( SySetUsed(&pCol->aIndex) > 0 ){
+        jx9_value sOld;
+        /* Stored content of the record, needed to maintain the indexes */
+        jx9MemObjInit(pCol->pVm->pJx9Vm,&sOld);
+        CollectionFetchStoredRecord(pCol,nId,&sOld);
+        rc = CollectionUpdate(pCol,nId,pValue);
+        if( rc == UNQLITE_OK ){
+            rc = CollectionIndexUpdate(pCol,nId,&sOld,pValue);
+        }
+        jx9MemObjRelease(&sOld);
     }else{
         rc = CollectionUpdate(pCol,nId,pValue);
     }
@@ -995,6 +1894,17 @@ UNQLITE_PRIVATE int unqliteDropCollection(unqlite_col *pCol)
 			);
 		return rc;
 	}
+	if( SySetUsed(&pCol->aIndex) > 0 ){
+		SyString *aField = (SyString *)SySetBasePtr(&pCol->aIndex);
+		sxu32 n;
+		/* Drop the indexes first so that records are not unindexed one by one */
+		CollectionIndexPurge(pCol,0,SySetUsed(&pCol->aIndex));
+		for( n = 0 ; n < SySetUsed(&pCol->aIndex) ; ++n ){
+			SyMemBackendFree(&pVm->sAlloc,(void *)aField[n].zString);
+		}
+		SySetReset(&pCol->aIndex);
+		CollectionIndexSave(pCol);
+	}
 	/* Drop collection records */
 	for( nId = 0 ; nId < pCol->nLastid ; ++nId ){
 		unqliteCollectionDropRecord(pCol,nId,0,0);
@@ -1003,6 +1913,8 @@ UNQLITE_PRIVATE int unqliteDropCollection(unqlite_col *pCol)
 	CollectionCacheRelease(pCol);
 	SyBlobRelease(&pCol->sHeader);
 	SyBlobRelease(&pCol->sWorker);
+	SyBlobRelease(&pCol->sIndex);
+	SySetRelease(&pCol->aIndex);
 	SyMemBackendFree(&pVm->sAlloc,(void *)SyStringData(&pCol->sName));
 	unqliteReleaseCursor(pVm->pDb,pCol->pCursor);
 	/* Unlink */
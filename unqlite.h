@@ -94,6 +94,7 @@
 /* Forward declaration to public objects */
 typedef struct unqlite_io_methods unqlite_io_methods;
 typedef struct unqlite_kv_methods unqlite_kv_methods;
+typedef struct unqlite_page_codec unqlite_page_codec;
 typedef struct unqlite_kv_engine unqlite_kv_engine;
 typedef struct jx9_io_stream unqlite_io_stream;
 typedef struct jx9_context unqlite_context;
@@ -393,6 +394,11 @@ typedef sxi64 unqlite_int64;
 #define UNQLITE_CONFIG_KV_ENGINE           4  /* ONE ARGUMENT: const char *zKvName */
 #define UNQLITE_CONFIG_DISABLE_AUTO_COMMIT 5  /* NO ARGUMENTS */
 #define UNQLITE_CONFIG_GET_KV_NAME         6  /* ONE ARGUMENT: const char **pzPtr */
+#define UNQLITE_CONFIG_CACHE_STATS         7  /* THREE ARGUMENTS: unqlite_int64 *pHit, unqlite_int64 *pMiss, unqlite_int64 *pEvict */
+#define UNQLITE_CONFIG_DISABLE_CACHE_RETAIN 8 /* NO ARGUMENTS */
+#define UNQLITE_CONFIG_GROUP_COMMIT        9  /* TWO ARGUMENTS: int iWindowMicroSec, int nMaxBatch */
+#define UNQLITE_CONFIG_READ_AHEAD          10 /* ONE ARGUMENT: int nPage (0 to disable) */
+#define UNQLITE_CONFIG_PAGE_CODEC          11 /* ONE ARGUMENT: const char *zCodec */
 /*
  * UnQLite/Jx9 Virtual Machine Configuration Commands.
  *
@@ -423,6 +429,8 @@ typedef sxi64 unqlite_int64;
 #define UNQLITE_VM_CONFIG_IO_STREAM       11  /* ONE ARGUMENT: const unqlite_io_stream *pStream */
 #define UNQLITE_VM_CONFIG_ARGV_ENTRY      12  /* ONE ARGUMENT: const char *zValue */
 #define UNQLITE_VM_CONFIG_EXTRACT_OUTPUT  13  /* TWO ARGUMENTS: const void **ppOut, unsigned int *pOutputLen */
+#define UNQLITE_VM_CONFIG_RECORD_CACHE   14  /* ONE ARGUMENT: int nMaxRecord */
+#define UNQLITE_VM_CONFIG_RECORD_CACHE_STATS 15  /* THREE ARGUMENTS: unqlite_int64 *pHit, unqlite_int64 *pMiss, unqlite_int64 *pEvict */
 /*
  * Storage engine configuration commands.
  *
@@ -438,6 +446,7 @@ typedef sxi64 unqlite_int64;
  */
 #define UNQLITE_KV_CONFIG_HASH_FUNC  1 /* ONE ARGUMENT: unsigned int (*xHash)(const void *,unsigned int) */
 #define UNQLITE_KV_CONFIG_CMP_FUNC   2 /* ONE ARGUMENT: int (*xCmp)(const void *,const void *,unsigned int) */
+#define UNQLITE_KV_CONFIG_ZIP_THRESHOLD 3 /* ONE ARGUMENT: unsigned int nThreshold (0 to disable) */
 /*
  * Global Library Configuration Commands.
  *
@@ -470,6 +479,7 @@ typedef sxi64 unqlite_int64;
 #define UNQLITE_LIB_CONFIG_VFS                    6 /* ONE ARGUMENT: const unqlite_vfs *pVfs */
 #define UNQLITE_LIB_CONFIG_STORAGE_ENGINE         7 /* ONE ARGUMENT: unqlite_kv_methods *pStorage */
 #define UNQLITE_LIB_CONFIG_PAGE_SIZE              8 /* ONE ARGUMENT: int iPageSize */
+#define UNQLITE_LIB_CONFIG_PAGE_CODEC             9 /* ONE ARGUMENT: const unqlite_page_codec *pCodec */
 /*
  * These bit values are intended for use in the 3rd parameter to the [unqlite_open()] interface
  * and in the 4th parameter to the xOpen method of the [unqlite_vfs] object.
@@ -483,6 +493,7 @@ typedef sxi64 unqlite_int64;
 #define UNQLITE_OPEN_OMIT_JOURNALING  0x00000040  /* Omit journaling for this database. Ok for [unqlite_open] */
 #define UNQLITE_OPEN_IN_MEMORY        0x00000080  /* An in memory database. Ok for [unqlite_open]*/
 #define UNQLITE_OPEN_MMAP             0x00000100  /* Obtain a memory view of the whole file. Ok for [unqlite_open] */
+#define UNQLITE_OPEN_WAL              0x00000200  /* Write-ahead log journal mode (Readers run during writes). Ok for [unqlite_open] */
 /*
  * Synchronization Type Flags
  *
@@ -524,6 +535,17 @@ typedef struct unqlite_file unqlite_file;
 struct unqlite_file {
   const unqlite_io_methods *pMethods;  /* Methods for an open file. MUST BE FIRST */
 };
+/*
+ * CAPIREF: OS Interface: I/O Vector
+ *
+ * A single buffer of a vectored write request. Refer to the xWritev()
+ * method of the [unqlite_io_methods] object below.
+ */
+typedef struct unqlite_iovec unqlite_iovec;
+struct unqlite_iovec {
+  const void *pData;   /* Buffer to write */
+  unqlite_int64 iAmt;  /* Buffer length in bytes */
+};
 /*
  * CAPIREF: OS Interface: File Methods Object
  *
@@ -563,6 +585,27 @@ struct unqlite_file {
  * the file. The sector size is the minimum write that can be performed without
  * disturbing other bytes in the file.
  *
+ * The xWritev() method is only available when iVersion is 2 or greater and may
+ * be NULL. It writes nVec buffers back to back starting at offset iOfst, with
+ * a single system call if possible (i.e. pwritev()). The pager use it to flush
+ * runs of adjacent dirty pages and fall back to xWrite() when it is missing.
+ * An implementation may queue the write and return immediately, in which case
+ * the buffers must stay valid until the next call with nVec set to 0 which
+ * must wait for every queued write to complete and report any error.
+ *
+ * The xPrefetch() method is only available when iVersion is 3 or greater and may
+ * be NULL. It tells that the iAmt bytes starting at offset iOfst are about to be
+ * read so that an implementation can start an asynchronous read and return
+ * immediately. The data is then handed to the next xRead() of the same range.
+ * Prefetching is only a hint and failures are silently ignored. The pager use
+ * it to overlap the reads of a read-ahead batch.
+ *
+ * The xDiscard() method is only available when iVersion is 4 or greater and may
+ * be NULL. It tells that the iAmt bytes starting at offset iOfst are no longer
+ * needed so that the file system can release the underlying blocks (i.e. hole
+ * punching) without changing the file size. The content of the range is undefined
+ * afterwards. The pager use it to drop the unused tail of compressed pages.
+ *
  */
 struct unqlite_io_methods {
   int iVersion;                 /* Structure version number (currently 1) */
@@ -576,6 +619,12 @@ struct unqlite_io_methods {
   int (*xUnlock)(unqlite_file*, int);
   int (*xCheckReservedLock)(unqlite_file*, int *pResOut);
   int (*xSectorSize)(unqlite_file*);
+  /* Methods above are valid for version 1 */
+  int (*xWritev)(unqlite_file*, const unqlite_iovec *aVec, int nVec, unqlite_int64 iOfst);
+  /* Methods above are valid for version 2 */
+  int (*xPrefetch)(unqlite_file*, unqlite_int64 iAmt, unqlite_int64 iOfst);
+  /* Methods above are valid for version 3 */
+  int (*xDiscard)(unqlite_file*, unqlite_int64 iAmt, unqlite_int64 iOfst);
 };
 /*
  * CAPIREF: OS Interface Object
@@ -697,6 +746,10 @@ struct unqlite_kv_io
 	void (*xSetUnpin)(unqlite_kv_handle,void (*xPageUnpin)(void *)); 
 	void (*xSetReload)(unqlite_kv_handle,void (*xPageReload)(void *));
 	void (*xErr)(unqlite_kv_handle,const char *);
+	int (*xPrefetch)(unqlite_kv_handle,const pgno *,int); /* Read-ahead hint, return the number of processed pages */
+	pgno (*xPageCount)(unqlite_kv_handle);                 /* Total number of pages in the database image */
+	int (*xTruncate)(unqlite_kv_handle,pgno);              /* Shrink the database image, the pages past the end must be unused */
+	void (*xLatch)(unqlite_kv_handle,int);                 /* Enter (non-zero) or leave the latch guarding the page cache */
 };
 /*
  * Key/Value Storage Engine Cursor Object
@@ -749,7 +802,7 @@ struct unqlite_kv_methods
   const char *zName; /* Storage engine name [i.e. Hash, B+tree, LSM, R-tree, Mem, etc.]*/
   int szKv;          /* 'unqlite_kv_engine' subclass size */
   int szCursor;      /* 'unqlite_kv_cursor' subclass size */
-  int iVersion;      /* Structure version, currently 1 */
+  int iVersion;      /* Structure version, currently 7 */
   /* Storage engine methods */
   int (*xInit)(unqlite_kv_engine *,int iPageSize);
   void (*xRelease)(unqlite_kv_engine *);
@@ -779,6 +832,39 @@ struct unqlite_kv_methods
   int (*xData)(unqlite_kv_cursor *,int (*xConsumer)(const void *,unsigned int,void *),void *pUserData);
   void (*xReset)(unqlite_kv_cursor *);
   void (*xCursorRelease)(unqlite_kv_cursor *);
+  /* Flush buffered records before the transaction is committed (iVersion >= 2) */
+  int (*xSync)(unqlite_kv_engine *);
+  /* Bucket holding the given key, used to group batched operations (iVersion >= 3) */
+  int (*xBucket)(unqlite_kv_engine *,const void *pKey,int nKeyLen,pgno *piBucket);
+  /* Point to the cursor data in place and pin the page holding it (iVersion >= 4) */
+  int (*xDataRef)(unqlite_kv_cursor *,const void **ppData,unqlite_int64 *pLen,unqlite_page **ppPage);
+  /* Pre-size an empty storage for the expected records before a bulk load (iVersion >= 5) */
+  int (*xReserve)(unqlite_kv_engine *,unqlite_int64 nRecord,unqlite_int64 nByte);
+  /* Reclaim free pages and shrink the database image (iVersion >= 6) */
+  int (*xVacuum)(unqlite_kv_engine *,int nPage,unqlite_int64 *pRemain);
+  /* Non-zero if distinct cursors may seek and read concurrently (iVersion >= 7) */
+  int bSharedRead;
+};
+/*
+ * Page Compression Codec.
+ *
+ * A page codec is defined by an instance of the following object. When a codec is
+ * selected at database creation via [unqlite_config()] with a configuration verb set
+ * to UNQLITE_CONFIG_PAGE_CODEC, its name is recorded in the database header and each
+ * page is compressed before it reach the disk. UnQLite come with a built-in LZ77 codec
+ * named "lz". Registration of a codec at run-time is done via [unqlite_lib_config()]
+ * with a configuration verb set to UNQLITE_LIB_CONFIG_PAGE_CODEC.
+ *
+ * xCompress() compress nIn bytes into pOut and return the compressed length or zero
+ * when the result does not fit in nOut bytes. xDecompress() return the decompressed
+ * length or a negative value on malformed input, it must never write past nOut bytes.
+ */
+struct unqlite_page_codec
+{
+  const char *zName; /* Codec name recorded in the database header [i.e. lz] */
+  int iVersion;      /* Structure version, currently 1 */
+  int (*xCompress)(const void *pIn,int nIn,void *pOut,int nOut);
+  int (*xDecompress)(const void *pIn,int nIn,void *pOut,int nOut);
 };
 /*
  * UnQLite journal file suffix.
@@ -786,6 +872,12 @@ struct unqlite_kv_methods
 #ifndef UNQLITE_JOURNAL_FILE_SUFFIX
 #define UNQLITE_JOURNAL_FILE_SUFFIX "_unqlite_journal"
 #endif
+/*
+ * UnQLite write-ahead log file suffix (UNQLITE_OPEN_WAL).
+ */
+#ifndef UNQLITE_WAL_FILE_SUFFIX
+#define UNQLITE_WAL_FILE_SUFFIX "_unqlite_wal"
+#endif
 /*
  * Call Context - Error Message Severity Level.
  *
@@ -816,8 +908,17 @@ UNQLITE_APIEXPORT int unqlite_kv_append_fmt(unqlite *pDb,const void *pKey,int nK
 UNQLITE_APIEXPORT int unqlite_kv_fetch(unqlite *pDb,const void *pKey,int nKeyLen,void *pBuf,unqlite_int64 /* in|out */*pBufLen);
 UNQLITE_APIEXPORT int unqlite_kv_fetch_callback(unqlite *pDb,const void *pKey,
 	                    int nKeyLen,int (*xConsumer)(const void *,unsigned int,void *),void *pUserData);
+UNQLITE_APIEXPORT int unqlite_kv_fetch_ref(unqlite *pDb,const void *pKey,int nKeyLen,
+	                    const void **ppData,unqlite_int64 *pDataLen,unqlite_page **ppRef);
+UNQLITE_APIEXPORT int unqlite_kv_release_ref(unqlite *pDb,unqlite_page *pRef);
 UNQLITE_APIEXPORT int unqlite_kv_delete(unqlite *pDb,const void *pKey,int nKeyLen);
+UNQLITE_APIEXPORT int unqlite_kv_store_batch(unqlite *pDb,int nEntry,const void **apKey,const int *anKeyLen,
+	                    const void **apData,const unqlite_int64 *anDataLen);
+UNQLITE_APIEXPORT int unqlite_kv_fetch_batch(unqlite *pDb,int nEntry,const void **apKey,const int *anKeyLen,
+	                    void **apBuf,unqlite_int64 /* in|out */*anBufLen,int *aRc);
 UNQLITE_APIEXPORT int unqlite_kv_config(unqlite *pDb,int iOp,...);
+UNQLITE_APIEXPORT int unqlite_bulk_load(unqlite *pDb,unqlite_int64 nByteHint,
+	                    int (*xNext)(void *,const void **ppKey,int *pKeyLen,const void **ppData,unqlite_int64 *pDataLen),void *pUserData);
 
 /* Document (JSON) Store Interfaces powered by the Jx9 Scripting Language */
 UNQLITE_APIEXPORT int unqlite_compile(unqlite *pDb,const char *zJx9,int nByte,unqlite_vm **ppOut);
@@ -832,6 +933,7 @@ UNQLITE_APIEXPORT unqlite_value * unqlite_vm_extract_variable(unqlite_vm *pVm,co
 /*  Cursor Iterator Interfaces */
 UNQLITE_APIEXPORT int unqlite_kv_cursor_init(unqlite *pDb,unqlite_kv_cursor **ppOut);
 UNQLITE_APIEXPORT int unqlite_kv_cursor_release(unqlite *pDb,unqlite_kv_cursor *pCur);
+UNQLITE_APIEXPORT int unqlite_kv_cursor_snapshot(unqlite *pDb,unqlite_kv_cursor **ppOut);
 UNQLITE_APIEXPORT int unqlite_kv_cursor_seek(unqlite_kv_cursor *pCursor,const void *pKey,int nKeyLen,int iPos);
 UNQLITE_APIEXPORT int unqlite_kv_cursor_first_entry(unqlite_kv_cursor *pCursor);
 UNQLITE_APIEXPORT int unqlite_kv_cursor_last_entry(unqlite_kv_cursor *pCursor);
@@ -849,12 +951,14 @@ UNQLITE_APIEXPORT int unqlite_kv_cursor_reset(unqlite_kv_cursor *pCursor);
 UNQLITE_APIEXPORT int unqlite_begin(unqlite *pDb);
 UNQLITE_APIEXPORT int unqlite_commit(unqlite *pDb);
 UNQLITE_APIEXPORT int unqlite_rollback(unqlite *pDb);
+UNQLITE_APIEXPORT int unqlite_vacuum(unqlite *pDb,int nPage,unqlite_int64 *pRemain);
 
 /* Utility interfaces */
 UNQLITE_APIEXPORT int unqlite_util_load_mmaped_file(const char *zFile,void **ppMap,unqlite_int64 *pFileSize);
 UNQLITE_APIEXPORT int unqlite_util_release_mmaped_file(void *pMap,unqlite_int64 iFileSize);
 UNQLITE_APIEXPORT int unqlite_util_random_string(unqlite *pDb,char *zBuf,unsigned int buf_size);
 UNQLITE_APIEXPORT unsigned int unqlite_util_random_num(unqlite *pDb);
+UNQLITE_APIEXPORT const unqlite_vfs * unqlite_util_io_uring_vfs(void);
 
 /* In-process extending interfaces */
 UNQLITE_APIEXPORT int unqlite_create_function(unqlite_vm *pVm,const char *zName,int (*xFunc)(unqlite_context *,int,unqlite_value **),void *pUserData);